@@ -10,23 +10,38 @@
 #include "Platform.h"
 #include "ConfigurationManager.h"
 #include "UiSettingsServiceInterface.h"
+#include "HighPerfClock.h"
+#include "CacheCompression.h"
 
 #include <QCryptographicHash>
 #include <QString>
+#include <QStringList>
 #include <QSettings>
 #include <QMessageBox>
+#include <QFile>
 
 namespace Asset
 {
     const char *DEFAULT_ASSET_CACHE_PATH = "/assetcache";
     const int DEFAULT_MEMORY_CACHE_SIZE = 32 * 1024 * 1024;
     const f64 CACHE_CHECK_INTERVAL = 1.0;
-    const int CACHE_MAX_DELETES = 10;
+    const f64 INDEX_SAVE_INTERVAL = 30.0;
+    const uint RECONCILE_ENTRIES_PER_CHECK = 256;
+    const int DEFAULT_DISK_IO_THREADS = 2;
+    const char *DEFAULT_DISK_CACHE_LAYOUT = "files";
+    const qint64 PACK_SEGMENT_SIZE = 32 * 1024 * 1024;
+    const uint MIGRATE_FILES_PER_CHECK = 64;
+
+    //! Meshes, skeletons and scripts typically compress 3-5x. Textures and Vorbis sounds are compressed already.
+    const char *DEFAULT_COMPRESSED_ASSET_TYPES = "Mesh,Skeleton,MaterialScript,ParticleScript,SoundWav,GenericAvatarXml";
 
     AssetCache::AssetCache(Foundation::Framework* framework) :
         framework_(framework),
-        memory_cache_size_(DEFAULT_MEMORY_CACHE_SIZE),
+        memory_cache_(DEFAULT_MEMORY_CACHE_SIZE),
         update_time_(0.0),
+        index_save_time_(0.0),
+        disk_hits_(0),
+        disk_hit_time_(0.0),
         disk_changes_after_last_check_(false),
         disk_cache_max_size_(0)
     {
@@ -36,7 +51,7 @@ namespace Asset
             boost::filesystem::create_directory(cache_path_);
 
         // Set size of memory cache
-        memory_cache_size_ = framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "memory_cache_size", DEFAULT_MEMORY_CACHE_SIZE);
+        memory_cache_.SetMaxSize(framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "memory_cache_size", DEFAULT_MEMORY_CACHE_SIZE));
 
         // Get path of local secondary cache
         std::string local_cache_path = framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "local_cache_path", std::string("./data/assetcache"));
@@ -44,13 +59,46 @@ namespace Asset
         // Init disk
         InitDiskCaching();
 
-        // Read both disk caches 
-        CheckDiskCache(cache_path_);
-        CheckDiskCache(local_cache_path);
+        std::string compressed_types = framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "compressed_asset_types", std::string(DEFAULT_COMPRESSED_ASSET_TYPES));
+        QStringList types = QString::fromStdString(compressed_types).split(',', QString::SkipEmptyParts);
+        foreach(QString type, types)
+            compressed_types_.insert(type.trimmed().toStdString());
+
+        int io_threads = framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "disk_io_threads", DEFAULT_DISK_IO_THREADS);
+        disk_io_.reset(new Foundation::AsyncFileIO(std::max(io_threads, 1)));
+
+        // Read both disk cache indexes
+        disk_index_.reset(new AssetDiskCacheIndex(QString::fromStdString(cache_path_)));
+        local_disk_index_.reset(new AssetDiskCacheIndex(QString::fromStdString(local_cache_path)));
+        LoadDiskIndex(*disk_index_, true);
+        LoadDiskIndex(*local_disk_index_, false);
+
+        std::string layout = framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "disk_cache_layout", std::string(DEFAULT_DISK_CACHE_LAYOUT));
+        if (layout == "pack")
+        {
+            Core::tick_t start = Core::GetCurrentClockTime();
+            pack_cache_.reset(new Foundation::PackFileCache(QString::fromStdString(cache_path_ + "/pack"), PACK_SEGMENT_SIZE));
+            bool loaded = pack_cache_->Open();
+            pack_cache_->SetMaxSize(disk_cache_max_size_);
+            double msecs = (Core::GetCurrentClockTime() - start) * 1000.0 / Core::GetCurrentClockFreq();
+
+            AssetModule::LogInfo("Asset pack cache: " + ToString(pack_cache_->GetRecords().size()) + " assets in " +
+                ToString(pack_cache_->GetSegmentCount()) + " segments, " + ToString(pack_cache_->GetTotalSize()) + " bytes, " +
+                (loaded ? "index loaded" : "segments scanned") + " in " + ToString(msecs) + " ms");
+        }
+        else if (layout != DEFAULT_DISK_CACHE_LAYOUT)
+            AssetModule::LogError("Unknown disk cache layout " + layout + ", using " + DEFAULT_DISK_CACHE_LAYOUT);
     }
 
     AssetCache::~AssetCache()
     {
+        // Let queued writes finish, so that they are recorded to the index
+        disk_io_->WaitForPending();
+        ProcessDiskResults();
+        disk_io_.reset();
+        pack_cache_.reset();
+        if (disk_index_)
+            disk_index_->Save();
     }
 
     void AssetCache::InitDiskCaching()
@@ -77,6 +125,17 @@ namespace Asset
 
     void AssetCache::ClearDiskCache()
     {
+        bool packed = pack_cache_ && pack_cache_->GetRecords().size();
+        if (packed)
+        {
+            qreal removed_bytes_f = pack_cache_->GetFileSize();
+            QString mb_string = QString::number(((removed_bytes_f/1024)/1024));
+            mb_string = mb_string.left(mb_string.indexOf(".")+3);
+            QMessageBox::information(0, "Asset Cache", QString("Asset cache cleared, removed %1 assets total of " + mb_string + " mb").arg(pack_cache_->GetRecords().size()));
+        }
+        if (pack_cache_)
+            pack_cache_->Clear();
+
         QFileInfoList file_list = cache_dir_.entryInfoList(QDir::Files);
         if (file_list.count() > 0)
         {
@@ -85,26 +144,26 @@ namespace Asset
             
             foreach(QFileInfo file_info, file_list)
             {
-                QString native_absolute_path = file_info.absoluteFilePath().replace("/", QDir::separator());
+                if (file_info.fileName().startsWith(AssetDiskCacheIndex::IndexFileName()))
+                    continue;
+
                 qint64 file_size = file_info.size();
                 if (!cache_dir_.remove(file_info.fileName()))
                     continue;
                 
                 removed_files++;
                 removed_bytes += file_size;
-
-                std::set<std::string>::iterator find_result = disk_cache_contents_.find(native_absolute_path.toStdString());
-                if (find_result != disk_cache_contents_.end())
-                    disk_cache_contents_.erase(find_result);
+                disk_index_->Remove(file_info.fileName().section('.', 0, 0).toStdString());
             }
 
             // Notify user
             qreal removed_bytes_f = removed_bytes;
             QString mb_string = QString::number(((removed_bytes_f/1024)/1024));
             mb_string = mb_string.left(mb_string.indexOf(".")+3);
-            QMessageBox::information(0, "Asset Cache", QString("Asset cache cleared, removed %1 files total of " + mb_string + " mb").arg(removed_files));
+            if (!packed || removed_files)
+                QMessageBox::information(0, "Asset Cache", QString("Asset cache cleared, removed %1 files total of " + mb_string + " mb").arg(removed_files));
         }
-        else
+        else if (!packed)
             QMessageBox::information(0, "Asset Cache", "There are currently no files in asset cache");
     }
 
@@ -113,6 +172,8 @@ namespace Asset
         if (disk_cache_max_size_ != new_disk_max_size)
         {
             disk_cache_max_size_ = new_disk_max_size;
+            if (pack_cache_)
+                pack_cache_->SetMaxSize(disk_cache_max_size_);
             CheckDiskCacheSize(false);
         }
     }
@@ -122,37 +183,32 @@ namespace Asset
         if (disk_cache_max_size_ == 0)
             return;
 
-        int current_size = 0;
-        QFileInfoList file_list = cache_dir_.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
-        foreach(QFileInfo file, file_list)
-            current_size += file.size();
-
+        qint64 current_size = disk_index_->GetTotalSize();
         if (current_size > disk_cache_max_size_)
         {
             int removed_files = 0;
             qint64 removed_bytes = 0;
 
-            int aimed_size = disk_cache_max_size_;
+            qint64 aimed_size = disk_cache_max_size_;
             if (make_extra_space)
                 aimed_size -= (2*1024*1024);
 
-            foreach(QFileInfo file_info, file_list)
+            // Least recently used files first
+            std::vector<std::string> hashes = disk_index_->GetLeastRecentlyUsed(current_size - aimed_size);
+            for(uint i = 0; i < hashes.size(); ++i)
             {
-                QString native_absolute_path = file_info.absoluteFilePath().replace("/", QDir::separator());
-                qint64 file_size = file_info.size();
-                if (!cache_dir_.remove(file_info.fileName()))
+                const AssetDiskCacheIndex::Record *record = disk_index_->Find(hashes[i]);
+                if (!record)
                     continue;
-                
-                removed_files++;
-                removed_bytes += file_size;
-                current_size -= file_size;
 
-                std::set<std::string>::iterator find_result = disk_cache_contents_.find(native_absolute_path.toStdString());
-                if (find_result != disk_cache_contents_.end())
-                    disk_cache_contents_.erase(find_result);
+                qint64 file_size = record->size_;
+                QString file_path = disk_index_->GetFilePath(hashes[i], record->type_);
+                if (!QFile::remove(file_path) && QFile::exists(file_path))
+                    continue;
 
-                if (current_size < aimed_size)
-                    break;
+                disk_index_->Remove(hashes[i]);
+                removed_files++;
+                removed_bytes += file_size;
             }
 
             AssetModule::LogInfo("Asset cache was over limit. Removed " + QString::number(removed_files).toStdString() + 
@@ -160,80 +216,69 @@ namespace Asset
         }
     }
 
-    void AssetCache::CheckDiskCache(const std::string& path)
+    void AssetCache::LoadDiskIndex(AssetDiskCacheIndex &index, bool persistent)
     {
-        try
-        {
-            boost::filesystem::directory_iterator i(path);
-            boost::filesystem::directory_iterator end_iter;
-            while (i != end_iter)
-            {
-                if (boost::filesystem::is_regular_file(i->status()))
-                    disk_cache_contents_.insert(i->path().native_directory_string());
-                ++i;
-            }
-        }
-        catch (std::exception &/*e*/)
-        {
-        }
-    }
-
-    bool CompareAssetAge(RexAsset* lhs, RexAsset* rhs)
-    {
-        // Favor oldest assets for deletion
-        return lhs->GetAge() > rhs->GetAge();
+        Core::tick_t start = Core::GetCurrentClockTime();
+        bool loaded = persistent && index.Load();
+        if (!loaded)
+            index.Rebuild();
+        double msecs = (Core::GetCurrentClockTime() - start) * 1000.0 / Core::GetCurrentClockFreq();
+
+        AssetModule::LogInfo("Asset disk cache: " + ToString(index.GetRecords().size()) + " files, " +
+            ToString(index.GetTotalSize()) + " bytes, " + (loaded ? "index loaded" : "directory listed") +
+            " in " + ToString(msecs) + " ms");
     }
 
     void AssetCache::Update(f64 frametime)
     {
+        ProcessDiskResults();
+
+        // The memory cache evicts assets as they are stored, only the disk cache needs periodic checking
         update_time_ += frametime;
         if (update_time_ < CACHE_CHECK_INTERVAL)
             return;
-        
-        AssetMap::iterator i = assets_.begin();
-        std::vector<RexAsset*> oldest_assets;
-        
-        uint total_size = 0;
-        while (i != assets_.end())
+
+        // Pick up files the persisted index did not know of, for example after a crash
+        if (!disk_index_->IsReconciled())
+            disk_index_->Reconcile(RECONCILE_ENTRIES_PER_CHECK);
+
+        if (disk_changes_after_last_check_)
         {
-            RexAsset* asset = dynamic_cast<RexAsset*>(i->second.get());
-            if (asset)
-            {
-                asset->AddAge(update_time_);
-                oldest_assets.push_back(asset);
-                total_size += asset->GetSize();
-            }
-            
-            ++i;
+            CheckDiskCacheSize();
+            disk_changes_after_last_check_ = false;
         }
-        
-        std::sort(oldest_assets.begin(), oldest_assets.end(), CompareAssetAge);
-        
-        int deletes = 0;
-        while ((total_size > memory_cache_size_) && (deletes < CACHE_MAX_DELETES) && (oldest_assets.size()))
+
+        if (pack_cache_)
         {
-            RexAsset* asset = *oldest_assets.begin();
-            AssetMap::iterator i = assets_.begin();
-            while (i != assets_.end())
+            // The pack evicts and compacts segments itself
+            pack_cache_->Update();
+
+            // Migrated files are no longer in the file index
+            std::vector<Foundation::PackFileCache::StoreResult> stores = pack_cache_->TakeCompletedStores();
+            for(uint i = 0; i < stores.size(); ++i)
             {
-                if (i->second.get() == asset)
+                if (stores[i].imported_)
+                    disk_index_->Remove(stores[i].key_);
+                else if (stores[i].success_)
                 {
-                    total_size -= asset->GetSize();
-                    AssetModule::LogDebug("Removed cached asset " + asset->GetId() + " age " + ToString<float>(asset->GetAge()));
-                    assets_.erase(i);
-                    oldest_assets.erase(oldest_assets.begin());
-                    break;
+                    CompressionStats& stats = compression_stats_[stores[i].type_];
+                    ++stats.stored_;
+                    stats.raw_bytes_ += stores[i].size_;
+                    stats.stored_bytes_ += stores[i].stored_size_;
                 }
-                ++i;
             }
-            
-            ++deletes;
+
+            if (disk_index_->GetRecords().size())
+                MigrateToPack(MIGRATE_FILES_PER_CHECK);
         }
 
-        if (disk_changes_after_last_check_)
+        index_save_time_ += update_time_;
+        if (index_save_time_ >= INDEX_SAVE_INTERVAL)
         {
-            CheckDiskCacheSize();
-            disk_changes_after_last_check_ = false;
+            disk_index_->Save();
+            if (pack_cache_)
+                pack_cache_->Save();
+            index_save_time_ = 0.0;
         }
         
         update_time_ = 0.0;
@@ -243,74 +288,223 @@ namespace Asset
     {
         if (check_memory)
         {
-            AssetMap::iterator i = assets_.begin();
-            while (i != assets_.end())
+            Foundation::AssetPtr asset = memory_cache_.GetAsset(asset_id, asset_type);
+            if (asset)
+                return asset;
+        }
+        
+        if (check_disk)
+        {
+            Core::tick_t start = Core::GetCurrentClockTime();
+            std::string asset_hash = GetHash(asset_id);
+
+            if (pack_cache_)
             {
-                Foundation::AssetPtr asset = i->second;
-                if ((asset->GetId() == asset_id) && (asset_type.empty() || (asset->GetType() == asset_type)))
+                Foundation::AssetPtr asset = ReadPackedAsset(asset_id, asset_hash, asset_type);
+                if (asset)
+                {
+                    ++disk_hits_;
+                    disk_hit_time_ += (double)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+                    return asset;
+                }
+            }
+
+            // Prefer the writable cache over the local secondary cache
+            AssetDiskCacheIndex *indexes[] = { disk_index_.get(), local_disk_index_.get() };
+            for(uint n = 0; n < 2; ++n)
+            {
+                AssetDiskCacheIndex *index = indexes[n];
+                const AssetDiskCacheIndex::Record *record = index->Find(asset_hash);
+                if (!record || (!asset_type.empty() && record->type_ != asset_type))
+                    continue;
+
+                std::string type = record->type_;
+                QFile file(index->GetFilePath(asset_hash, type));
+                if (!file.open(QIODevice::ReadOnly))
+                {
+                    // File got deleted by someone else while program was running, or something, do not re-check
+                    index->Remove(asset_hash);
+                    continue;
+                }
+
+                RexAsset* new_asset = new RexAsset(asset_id, type);
+                Foundation::AssetPtr asset(new_asset);
+
+                RexAsset::AssetDataVector& data = new_asset->GetDataInternal();
+                data.resize(file.size());
+                if (data.size() && file.read((char *)&data[0], data.size()) != (qint64)data.size())
+                {
+                    AssetModule::LogDebug("Could not read cached asset " + asset_id);
+                    continue;
+                }
+                file.close();
+
+                std::vector<u8> decompressed;
+                bool compressed = false;
+                if (!DecompressAssetData(type, data.empty() ? 0 : &data[0], data.size(), decompressed, compressed))
                 {
-                    RexAsset* asset = dynamic_cast<RexAsset*>(i->second.get());
-                    if (asset)
-                        asset->ResetAge();
-                    return i->second;
+                    AssetModule::LogDebug("Could not decompress cached asset " + asset_id);
+                    index->Remove(asset_hash);
+                    continue;
                 }
-                ++i;
+                if (compressed)
+                    data.swap(decompressed);
+                index->Touch(asset_hash);
+
+                // Store to memory cache only after the data is in, so that its size is accounted for
+                memory_cache_.StoreAsset(asset);
+
+                ++disk_hits_;
+                disk_hit_time_ += (double)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+                return asset;
             }
         }
-        
+            
+        return Foundation::AssetPtr();
+    }
+
+    bool AssetCache::RequestDiskAsset(const std::string& asset_id, const std::string& asset_type)
+    {
+        if (pending_disk_assets_.find(asset_id) != pending_disk_assets_.end())
+            return true;
+
         std::string asset_hash = GetHash(asset_id);
-        
-        if (check_disk)
+
+        if (pack_cache_)
         {
-            std::set<std::string>::iterator i = disk_cache_contents_.begin();
-            while (i != disk_cache_contents_.end())
+            // Compressed entries are read and decompressed by an I/O worker
+            const Foundation::PackFileCache::Record *record = pack_cache_->Find(asset_hash);
+            if (record && record->compressed_ && (asset_type.empty() || record->type_ == asset_type))
             {
-                if ((i->find(asset_hash) != std::string::npos) && (asset_type.empty() || i->find(asset_type) != std::string::npos))
-                    break;
-                ++i;
+                DiskRead read;
+                read.asset_id_ = asset_id;
+                read.hash_ = asset_hash;
+                read.type_ = record->type_;
+                read.index_ = 0;
+                read.start_ = Core::GetCurrentClockTime();
+                uint id = disk_io_->Read(pack_cache_->GetSegmentPath(record->segment_).toStdString(), record->offset_, record->size_, true);
+                pack_cache_->Touch(asset_hash);
+                disk_reads_[id] = read;
+                pending_disk_assets_.insert(asset_id);
+                return true;
             }
-            
-            if (i != disk_cache_contents_.end())
+
+            // Otherwise reading only maps the data, it is completed right away
+            Core::tick_t start = Core::GetCurrentClockTime();
+            Foundation::AssetPtr asset = ReadPackedAsset(asset_id, asset_hash, asset_type);
+            if (asset)
+            {
+                ++disk_hits_;
+                disk_hit_time_ += (double)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+                completed_disk_reads_.push_back(std::make_pair(asset_id, asset));
+                return true;
+            }
+        }
+
+        AssetDiskCacheIndex *indexes[] = { disk_index_.get(), local_disk_index_.get() };
+        for(uint n = 0; n < 2; ++n)
+        {
+            const AssetDiskCacheIndex::Record *record = indexes[n]->Find(asset_hash);
+            if (!record || (!asset_type.empty() && record->type_ != asset_type))
+                continue;
+
+            DiskRead read;
+            read.asset_id_ = asset_id;
+            read.hash_ = asset_hash;
+            read.type_ = record->type_;
+            read.index_ = indexes[n];
+            read.start_ = Core::GetCurrentClockTime();
+            uint id = disk_io_->Read(indexes[n]->GetFilePath(asset_hash, record->type_).toStdString(), true);
+            disk_reads_[id] = read;
+            pending_disk_assets_.insert(asset_id);
+            return true;
+        }
+
+        return false;
+    }
+
+    bool AssetCache::IsDiskAssetPending(const std::string& asset_id) const
+    {
+        return pending_disk_assets_.find(asset_id) != pending_disk_assets_.end();
+    }
+
+    std::vector<std::pair<std::string, Foundation::AssetPtr> > AssetCache::TakeCompletedDiskReads()
+    {
+        std::vector<std::pair<std::string, Foundation::AssetPtr> > reads;
+        reads.swap(completed_disk_reads_);
+        return reads;
+    }
+
+    void AssetCache::ProcessDiskResults()
+    {
+        Foundation::FileIOResultVector results = disk_io_->GetResults();
+
+        for(uint i = 0; i < results.size(); ++i)
+        {
+            Foundation::FileIOResult &result = results[i];
+            if (result.write_)
             {
-                boost::filesystem::path file_path(*i);
-                std::ifstream filestr(file_path.native_directory_string().c_str(), std::ios::in | std::ios::binary);
-                if (filestr.good())
+                std::map<uint, DiskWrite>::iterator w = disk_writes_.find(result.id_);
+                if (w == disk_writes_.end())
+                    continue;
+
+                if (w->second.deleted_)
+                    QFile::remove(QString::fromStdString(result.filename_));
+                else if (result.success_)
                 {
-                    filestr.seekg(0, std::ios::end);
-                    uint length = filestr.tellg();
-                    filestr.seekg(0, std::ios::beg);
-                    
-                    // Identify assettype from end of cached asset name
-                    StringVector assetNameType = SplitString(*i, '.');
-                    if (assetNameType.size() < 2)
-                    {
-                        AssetModule::LogDebug("Malformed assetcache filename " + *i);
-                        filestr.close();
-                        disk_cache_contents_.erase(i);
-                        return Foundation::AssetPtr();
-                    }
-                    
-                    std::string type = assetNameType[assetNameType.size() - 1];
-
-                    RexAsset* new_asset = new RexAsset(asset_id, type);
-                    assets_[asset_id] = Foundation::AssetPtr(new_asset);
-                
-                    RexAsset::AssetDataVector& data = new_asset->GetDataInternal();
-                    data.resize(length);
-                    filestr.read((char *)&data[0], length);
-                    filestr.close();
-                    return assets_[asset_id];
+                    disk_index_->Insert(w->second.hash_, w->second.type_, result.stored_size_);
+                    disk_changes_after_last_check_ = true;
+
+                    CompressionStats& stats = compression_stats_[w->second.type_];
+                    ++stats.stored_;
+                    stats.raw_bytes_ += w->second.size_;
+                    stats.stored_bytes_ += result.stored_size_;
                 }
                 else
+                    AssetModule::LogError("Error storing asset " + w->second.asset_id_ + " to cache.");
+                disk_writes_.erase(w);
+                continue;
+            }
+
+            std::map<uint, DiskRead>::iterator r = disk_reads_.find(result.id_);
+            if (r == disk_reads_.end())
+                continue;
+
+            DiskRead &read = r->second;
+            Foundation::AssetPtr asset;
+            if (result.success_)
+            {
+                // A newer version may have been stored to memory meanwhile
+                asset = memory_cache_.GetAsset(read.asset_id_);
+                if (!asset)
                 {
-                    // File got deleted by someone else while program was running, or something, do not re-check
-                    disk_cache_contents_.erase(i);
+                    RexAsset* new_asset = new RexAsset(read.asset_id_, read.type_);
+                    asset = Foundation::AssetPtr(new_asset);
+                    new_asset->GetDataInternal().swap(result.data_);
+                    memory_cache_.StoreAsset(asset);
                 }
+                if (read.index_)
+                    read.index_->Touch(read.hash_);
+                if (result.compressed_)
+                {
+                    CompressionStats& stats = compression_stats_[read.type_];
+                    ++stats.decoded_;
+                    stats.decoded_bytes_ += asset->GetSize();
+                    stats.decode_time_ += result.decode_time_;
+                }
+                ++disk_hits_;
+                disk_hit_time_ += (double)(Core::GetCurrentClockTime() - read.start_) / Core::GetCurrentClockFreq();
+            }
+            else if (read.index_)
+            {
+                // File got deleted by someone else while program was running, or something, do not re-check
+                read.index_->Remove(read.hash_);
             }
+
+            completed_disk_reads_.push_back(std::make_pair(read.asset_id_, asset));
+            pending_disk_assets_.erase(read.asset_id_);
+            disk_reads_.erase(r);
         }
-        
-            
-        return Foundation::AssetPtr();
     }
 
     void AssetCache::StoreAsset(Foundation::AssetPtr asset)
@@ -319,26 +513,29 @@ namespace Asset
         AssetModule::LogDebug("Storing complete asset " + asset_id);
 
         // Store to memory cache
-        assets_[asset_id] = asset;
+        memory_cache_.StoreAsset(asset);
 
-        // Store to disk cache
+        // Store to disk cache in the background. The asset keeps the data alive until written
         const std::string& type = asset->GetType();
-        boost::filesystem::path file_path(cache_path_ + "/" + GetHash(asset_id) + "." + type);
-        std::ofstream filestr(file_path.native_directory_string().c_str(), std::ios::out | std::ios::binary);
-        if (filestr.good())
-        {
-            const u8* data = asset->GetData();
-            uint size = asset->GetSize();
-            
-            filestr.write((const char *)&data[0], size);
-            filestr.close();
-
-            disk_cache_contents_.insert(file_path.native_directory_string());
-        }
-        else
+        std::string asset_hash = GetHash(asset_id);
+        uint size = asset->GetSize();
+        bool compress = compressed_types_.find(type) != compressed_types_.end();
+        if (pack_cache_)
         {
-            AssetModule::LogError("Error storing asset " + asset_id + " to cache.");
+            pack_cache_->Store(asset_hash, type, size ? asset->GetData() : 0, size, boost::shared_ptr<const void>(asset), compress);
+            return;
         }
+
+        boost::filesystem::path file_path(cache_path_ + "/" + asset_hash + "." + type);
+        DiskWrite write;
+        write.asset_id_ = asset_id;
+        write.hash_ = asset_hash;
+        write.type_ = type;
+        write.size_ = size;
+        write.deleted_ = false;
+        uint id = disk_io_->Write(file_path.native_directory_string(), size ? asset->GetData() : 0, size,
+            boost::shared_ptr<const void>(asset), true, compress);
+        disk_writes_[id] = write;
     }
 
     bool AssetCache::DeleteAsset(Foundation::AssetPtr asset)
@@ -347,18 +544,44 @@ namespace Asset
 
         // Delete from disk cache
         const std::string& type = asset->GetType();
-        boost::filesystem::path file_path(cache_path_ + "/" + GetHash(asset_id)  + "." + type);
+        std::string asset_hash = GetHash(asset_id);
+        boost::filesystem::path file_path(cache_path_ + "/" + asset_hash  + "." + type);
+
+        // The pack reclaims the space later
+        bool packed = false;
+        if (pack_cache_)
+        {
+            packed = pack_cache_->Find(asset_hash) || pack_cache_->IsStorePending(asset_hash);
+            pack_cache_->Remove(asset_hash);
+            if (packed)
+            {
+                AssetModule::LogDebug("Removed asset " + asset_id + " from cache");
+                memory_cache_.RemoveAsset(asset_id);
+            }
+        }
+
+        // The file of a pending write is removed once written
+        bool write_pending = false;
+        for(std::map<uint, DiskWrite>::iterator i = disk_writes_.begin(); i != disk_writes_.end(); ++i)
+        {
+            if (i->second.hash_ == asset_hash)
+            {
+                i->second.deleted_ = true;
+                write_pending = true;
+            }
+        }
+        if (write_pending)
+            memory_cache_.RemoveAsset(asset_id);
+
         if (boost::filesystem::exists(file_path))
         {
             if (boost::filesystem::remove(file_path))
             {
                 AssetModule::LogDebug("Removed asset " + asset_id + " from cache");
 
-                std::set<std::string>::iterator find_result = disk_cache_contents_.find(file_path.native_directory_string());
-                if (find_result != disk_cache_contents_.end())
-                    disk_cache_contents_.erase(find_result);
+                disk_index_->Remove(asset_hash);
 
-                assets_.erase(asset_id);
+                memory_cache_.RemoveAsset(asset_id);
                 disk_changes_after_last_check_ = true;
 
                 return true;
@@ -371,9 +594,127 @@ namespace Asset
         }
         else
         {
-            AssetModule::LogDebug("File " + file_path.string() + " does not exist, could not delete from cache.");
+            if (!write_pending && !packed)
+                AssetModule::LogDebug("File " + file_path.string() + " does not exist, could not delete from cache.");
+            return true;
+        }
+    }
+
+    Foundation::AssetPtr AssetCache::ReadPackedAsset(const std::string& asset_id, const std::string& asset_hash, const std::string& asset_type)
+    {
+        const Foundation::PackFileCache::Record *record = pack_cache_->Find(asset_hash);
+        if (!record || (!asset_type.empty() && record->type_ != asset_type))
+            return Foundation::AssetPtr();
+
+        std::string type = record->type_;
+        bool compressed = record->compressed_;
+        Foundation::PackFileView view;
+        if (!pack_cache_->Read(asset_hash, view))
+            return Foundation::AssetPtr();
+
+        RexAsset* new_asset = new RexAsset(asset_id, type);
+        Foundation::AssetPtr asset(new_asset);
+        if (compressed)
+        {
+            if (!DecompressAssetData(type, view.data_, view.size_, new_asset->GetDataInternal(), compressed))
+            {
+                AssetModule::LogDebug("Could not decompress cached asset " + asset_id);
+                pack_cache_->Remove(asset_hash);
+                return Foundation::AssetPtr();
+            }
+        }
+        else
+            new_asset->SetDataView(view.data_, view.size_, view.owner_);
+        memory_cache_.StoreAsset(asset);
+        return asset;
+    }
+
+    bool AssetCache::DecompressAssetData(const std::string& asset_type, const u8* data, uint size, std::vector<u8>& output, bool& compressed)
+    {
+        compressed = Foundation::CacheCompression::IsCompressed(data, size);
+        if (!compressed)
             return true;
+
+        Core::tick_t start = Core::GetCurrentClockTime();
+        if (!Foundation::CacheCompression::Decompress(data, size, output))
+            return false;
+
+        CompressionStats& stats = compression_stats_[asset_type];
+        ++stats.decoded_;
+        stats.decoded_bytes_ += output.size();
+        stats.decode_time_ += (double)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+        return true;
+    }
+
+    void AssetCache::MigrateToPack(uint max_files)
+    {
+        // Do not let the migration crowd out new stores
+        if (pack_cache_->GetPendingCount() >= max_files)
+            return;
+
+        std::vector<std::string> migrated;
+        const AssetDiskCacheIndex::RecordMap& records = disk_index_->GetRecords();
+        uint queued = 0;
+        for(AssetDiskCacheIndex::RecordMap::const_iterator i = records.begin(); i != records.end() && queued < max_files; ++i)
+        {
+            if (pack_cache_->IsStorePending(i->first))
+                continue;
+
+            QString file_path = disk_index_->GetFilePath(i->first, i->second.type_);
+            if (pack_cache_->Find(i->first))
+            {
+                // Already stored again in the pack
+                QFile::remove(file_path);
+                migrated.push_back(i->first);
+            }
+            else
+                pack_cache_->Import(i->first, i->second.type_, file_path.toStdString());
+            ++queued;
+        }
+
+        for(uint i = 0; i < migrated.size(); ++i)
+            disk_index_->Remove(migrated[i]);
+    }
+
+    uint AssetCache::ReadDiskAssets(uint count, qint64& bytes)
+    {
+        // Touch a byte of each page, so that mapped data is actually read
+        volatile u8 sink = 0;
+        uint read = 0;
+        bytes = 0;
+
+        if (pack_cache_)
+        {
+            std::vector<std::string> hashes;
+            const Foundation::PackFileCache::RecordMap& records = pack_cache_->GetRecords();
+            for(Foundation::PackFileCache::RecordMap::const_iterator i = records.begin(); i != records.end() && hashes.size() < count; ++i)
+                hashes.push_back(i->first);
+
+            for(uint i = 0; i < hashes.size(); ++i)
+            {
+                Foundation::PackFileView view;
+                if (!pack_cache_->Read(hashes[i], view))
+                    continue;
+                for(uint j = 0; j < view.size_; j += 4096)
+                    sink += view.data_[j];
+                bytes += view.size_;
+                ++read;
+            }
+        }
+
+        const AssetDiskCacheIndex::RecordMap& records = disk_index_->GetRecords();
+        std::vector<u8> data;
+        for(AssetDiskCacheIndex::RecordMap::const_iterator i = records.begin(); i != records.end() && read < count; ++i)
+        {
+            if (!Foundation::AsyncFileIO::ReadFile(disk_index_->GetFilePath(i->first, i->second.type_).toStdString(), data))
+                continue;
+            for(uint j = 0; j < data.size(); j += 4096)
+                sink += data[j];
+            bytes += data.size();
+            ++read;
         }
+
+        return read;
     }
 
     std::string AssetCache::GetHash(const std::string &asset_id)
@@ -5,6 +5,11 @@
 
 #include "Foundation.h"
 #include "AssetInterface.h"
+#include "AssetMemoryCache.h"
+#include "AssetDiskCacheIndex.h"
+#include "AsyncFileIO.h"
+#include "PackFileCache.h"
+#include "HighPerfClock.h"
 
 #include <QObject>
 #include <QDir>
@@ -12,12 +17,50 @@
 namespace Asset
 {
     //! Stores assets to memory and/or disk based cache. Created and used by AssetManager.
+    /*! The writable disk cache stores either a file per asset (AssetSystem/disk_cache_layout "files", the default),
+        or packs assets into a few large segment files ("pack"), see Foundation::PackFileCache. Assets read from the
+        pack refer to the memory mapped segment instead of copying the data. When the pack layout is selected, files
+        of the file per asset layout are moved into the pack a few at a time, and are used until then.
+
+        Assets of the types listed in AssetSystem/compressed_asset_types are compressed in the disk cache with
+        Foundation::CacheCompression, when that makes them clearly smaller. Compression and decompression of
+        background reads and writes is done by the I/O workers; only the synchronous GetAsset() decompresses on
+        the calling thread. GetAsset() is asked to read the disk only by AssetManager::GetAssetFromDisk(), for
+        explicit blocking lookups; everything done per frame uses RequestDiskAsset().
+     */
     class AssetCache : public QObject
     {
         Q_OBJECT
 
     public:
-        typedef std::map<std::string, Foundation::AssetPtr> AssetMap;
+        typedef AssetMemoryCache::AssetMap AssetMap;
+
+        //! Disk cache compression statistics of an asset type
+        struct CompressionStats
+        {
+            CompressionStats() : stored_(0), raw_bytes_(0), stored_bytes_(0), decoded_(0), decoded_bytes_(0), decode_time_(0.0) {}
+
+            //! Number of assets written
+            uint stored_;
+
+            //! Size of the assets written
+            qint64 raw_bytes_;
+
+            //! Size of the assets written, as stored
+            qint64 stored_bytes_;
+
+            //! Number of compressed assets read
+            uint decoded_;
+
+            //! Size of the compressed assets read, after decompression
+            qint64 decoded_bytes_;
+
+            //! Time spent decompressing, in seconds
+            double decode_time_;
+        };
+
+        //! Compression statistics by asset type
+        typedef std::map<std::string, CompressionStats> CompressionStatsMap;
 
         //! Constructor
         /*! \param framework Framework
@@ -28,7 +71,9 @@ namespace Asset
         ~AssetCache();
 
         //! Tries to get asset from cache, memory first, then disk
-        /*! \param asset_id Asset ID
+        /*! Checking the disk reads and decompresses the asset on the calling thread, so it is not done unless asked
+            for. Use RequestDiskAsset() instead anywhere the wait matters.
+            \param asset_id Asset ID
             \param check_memory Whether to check memory cache
             \param check_disk Whether to check disk cache
             \param type Optional type (empty to match any)
@@ -37,10 +82,26 @@ namespace Asset
         Foundation::AssetPtr GetAsset(
             const std::string& asset_id,
             bool check_memory = true,
-            bool check_disk = true,
+            bool check_disk = false,
             const std::string& asset_type = std::string());
 
-        //! Stores asset to cache. Posts ASSET_READY event when done.
+        //! Starts loading asset from the disk cache in the background
+        /*! The result is returned by TakeCompletedDiskReads() once the file has been read.
+            \param asset_id Asset ID
+            \param asset_type Optional type (empty to match any)
+            \return true if the asset is in the disk cache and is being loaded
+         */
+        bool RequestDiskAsset(const std::string& asset_id, const std::string& asset_type = std::string());
+
+        //! Returns true if asset is being loaded from the disk cache
+        bool IsDiskAssetPending(const std::string& asset_id) const;
+
+        //! Returns assets loaded from disk since last call, by asset id. The asset is null if loading failed.
+        /*! Loaded assets have been stored to the memory cache.
+         */
+        std::vector<std::pair<std::string, Foundation::AssetPtr> > TakeCompletedDiskReads();
+
+        //! Stores asset to memory cache, and to disk cache in the background.
         /*! \param asset Asset
          */
         void StoreAsset(Foundation::AssetPtr asset);
@@ -48,10 +109,38 @@ namespace Asset
         //! Deletes the memory asset
         bool DeleteAsset(Foundation::AssetPtr asset);
 
-        //! Returns all assets
-        const AssetMap& GetAssets() const { return assets_; }
+        //! Returns all memory cached assets
+        const AssetMap& GetAssets() const { return memory_cache_.GetAssets(); }
+
+        //! Returns the memory cache
+        const AssetMemoryCache& GetMemoryCache() const { return memory_cache_; }
+
+        //! Returns the index of the writable disk cache
+        const AssetDiskCacheIndex& GetDiskIndex() const { return *disk_index_; }
+
+        //! Returns path of the writable disk cache
+        const std::string& GetCachePath() const { return cache_path_; }
+
+        //! Returns the pack of the writable disk cache, or null if the file per asset layout is used
+        const Foundation::PackFileCache* GetPackCache() const { return pack_cache_.get(); }
+
+        //! Reads disk cached assets without storing them to memory, and touches all of their data. For benchmarking.
+        /*! \param count Maximum number of assets to read
+            \param bytes Returns total size of the assets read
+            \return Number of assets read
+         */
+        uint ReadDiskAssets(uint count, qint64& bytes);
+
+        //! Returns disk cache compression statistics by asset type
+        const CompressionStatsMap& GetCompressionStats() const { return compression_stats_; }
+
+        //! Returns number of assets loaded from the disk caches
+        uint GetDiskHits() const { return disk_hits_; }
+
+        //! Returns total time from request to completion of assets loaded from the disk caches, in seconds
+        double GetDiskHitTime() const { return disk_hit_time_; }
 
-        //! Update. Adds age to assets, removes oldest if cache size too big
+        //! Update. Collects background disk reads and writes, checks disk cache size periodically
         void Update(f64 frametime);
 
     private slots:
@@ -64,30 +153,100 @@ namespace Asset
         //! Read config and init QDir to working directory
         void ReadConfig();
 
-        //! Check contents of a disk cache path
-        /*! \param path Disk cache path
+        //! Loads a disk cache index, or lists the directory if there is no valid index
+        /*! \param index Disk cache index
+            \param persistent Whether the index is persisted, otherwise it is always built from the directory
          */
-        void CheckDiskCache(const std::string& path);
+        void LoadDiskIndex(AssetDiskCacheIndex &index, bool persistent);
+
+        //! Reads asset from the pack and stores it to memory cache, returns null if not found
+        Foundation::AssetPtr ReadPackedAsset(const std::string& asset_id, const std::string& asset_hash, const std::string& asset_type);
+
+        //! Decompresses data read synchronously from the disk cache, if compressed. Returns false if corrupt.
+        bool DecompressAssetData(const std::string& asset_type, const u8* data, uint size, std::vector<u8>& output, bool& compressed);
+
+        //! Moves files of the file per asset layout into the pack
+        /*! \param max_files Maximum number of files to queue
+         */
+        void MigrateToPack(uint max_files);
+
+        //! Background disk read
+        struct DiskRead
+        {
+            std::string asset_id_;
+            std::string hash_;
+            std::string type_;
+
+            //! Index of the file, null if read from the pack
+            AssetDiskCacheIndex *index_;
+
+            Core::tick_t start_;
+        };
+
+        //! Background disk write
+        struct DiskWrite
+        {
+            std::string asset_id_;
+            std::string hash_;
+            std::string type_;
+            uint size_;
+            bool deleted_;
+        };
+
+        //! Handles completed background reads and writes
+        void ProcessDiskResults();
 
         //! Calculates hash from given asset id
         //! Used for file name generation
         std::string GetHash(const std::string &asset_id);
 
         //! Asset memory cache
-        AssetMap assets_;
+        AssetMemoryCache memory_cache_;
 
         //! Current disk asset cache path
         std::string cache_path_;
 
-        //! Maximum memory cache size
-        uint memory_cache_size_;
-
         //! Update time accumulator
         f64 update_time_;
 
-        //! Assets known to be in disk cache
-        //! Values are hash values from asset id's
-        std::set<std::string> disk_cache_contents_;
+        //! Index save time accumulator
+        f64 index_save_time_;
+
+        //! Index of the writable disk cache
+        boost::scoped_ptr<AssetDiskCacheIndex> disk_index_;
+
+        //! Index of the local secondary (pre-warmed) disk cache
+        boost::scoped_ptr<AssetDiskCacheIndex> local_disk_index_;
+
+        //! Pack of the writable disk cache, null if the file per asset layout is used
+        boost::scoped_ptr<Foundation::PackFileCache> pack_cache_;
+
+        //! Background disk I/O
+        boost::scoped_ptr<Foundation::AsyncFileIO> disk_io_;
+
+        //! Ongoing background reads by request id
+        std::map<uint, DiskRead> disk_reads_;
+
+        //! Asset ids of ongoing background reads
+        std::set<std::string> pending_disk_assets_;
+
+        //! Ongoing background writes by request id
+        std::map<uint, DiskWrite> disk_writes_;
+
+        //! Asset types compressed in the disk cache
+        std::set<std::string> compressed_types_;
+
+        //! Compression statistics by asset type
+        CompressionStatsMap compression_stats_;
+
+        //! Completed background reads not yet taken
+        std::vector<std::pair<std::string, Foundation::AssetPtr> > completed_disk_reads_;
+
+        //! Number of assets loaded from disk
+        uint disk_hits_;
+
+        //! Time spent loading assets from disk
+        double disk_hit_time_;
 
         //! Framework
         Foundation::Framework* framework_;
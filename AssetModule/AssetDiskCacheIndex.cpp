@@ -0,0 +1,333 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "AssetDiskCacheIndex.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+namespace
+{
+    const quint32 INDEX_MAGIC = 0x49434441; // "ADCI"
+    const quint32 INDEX_VERSION = 1;
+
+    uint CurrentTime()
+    {
+        return QDateTime::currentDateTime().toTime_t();
+    }
+
+    //! For sorting records by last access
+    struct RecordAge
+    {
+        uint last_access_;
+        qint64 size_;
+        std::string hash_;
+        bool operator < (const RecordAge &rhs) const { return last_access_ < rhs.last_access_; }
+    };
+}
+
+namespace Asset
+{
+    AssetDiskCacheIndex::AssetDiskCacheIndex(const QString &path) :
+        path_(path),
+        total_size_(0),
+        dirty_(false),
+        reconciled_(false),
+        reconcile_iter_(0),
+        reconcile_pass_(0)
+    {
+    }
+
+    AssetDiskCacheIndex::~AssetDiskCacheIndex()
+    {
+        delete reconcile_iter_;
+    }
+
+    const QString &AssetDiskCacheIndex::IndexFileName()
+    {
+        static const QString name("assetcache.index");
+        return name;
+    }
+
+    bool AssetDiskCacheIndex::Load()
+    {
+        Clear();
+        dirty_ = false;
+
+        QString filename = path_ + "/" + IndexFileName();
+        if (Read(filename))
+            return true;
+
+        // A crash during Save() may have left only the temporary file
+        QString temp_filename = filename + ".tmp";
+        if (Read(temp_filename))
+        {
+            QFile::remove(filename);
+            QFile::rename(temp_filename, filename);
+            return true;
+        }
+
+        Clear();
+        dirty_ = false;
+        return false;
+    }
+
+    bool AssetDiskCacheIndex::Read(const QString &filename)
+    {
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_0);
+
+        quint32 magic = 0, version = 0, count = 0;
+        stream >> magic >> version >> count;
+        if (magic != INDEX_MAGIC || version != INDEX_VERSION)
+            return false;
+
+        records_.clear();
+        total_size_ = 0;
+        for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+        {
+            QByteArray hash, type;
+            qint64 size = 0;
+            quint32 last_access = 0;
+            stream >> hash >> type >> size >> last_access;
+
+            Record &record = records_[std::string(hash.constData(), hash.size())];
+            record.type_ = std::string(type.constData(), type.size());
+            record.size_ = size;
+            record.last_access_ = last_access;
+            record.seen_pass_ = 0;
+            total_size_ += size;
+        }
+
+        // Trailing magic guards against truncated files
+        quint32 end_magic = 0;
+        stream >> end_magic;
+        if (stream.status() != QDataStream::Ok || end_magic != INDEX_MAGIC || records_.size() != count)
+        {
+            Clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool AssetDiskCacheIndex::Save()
+    {
+        if (!dirty_)
+            return true;
+
+        QString filename = path_ + "/" + IndexFileName();
+        QString temp_filename = filename + ".tmp";
+
+        {
+            QFile file(temp_filename);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+                return false;
+
+            QDataStream stream(&file);
+            stream.setVersion(QDataStream::Qt_4_0);
+            stream << INDEX_MAGIC << INDEX_VERSION << (quint32)records_.size();
+            for(RecordMap::const_iterator i = records_.begin(); i != records_.end(); ++i)
+            {
+                stream << QByteArray(i->first.c_str(), i->first.size()) << QByteArray(i->second.type_.c_str(), i->second.type_.size())
+                    << i->second.size_ << (quint32)i->second.last_access_;
+            }
+            stream << INDEX_MAGIC;
+
+            file.flush();
+            if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError)
+            {
+                file.close();
+                QFile::remove(temp_filename);
+                return false;
+            }
+        }
+
+        // QFile::rename does not overwrite
+        QFile::remove(filename);
+        if (!QFile::rename(temp_filename, filename))
+            return false;
+
+        dirty_ = false;
+        return true;
+    }
+
+    void AssetDiskCacheIndex::Rebuild()
+    {
+        Clear();
+
+        QDirIterator iter(path_, QDir::Files);
+        while(iter.hasNext())
+        {
+            iter.next();
+            QFileInfo info = iter.fileInfo();
+            AddFile(info.fileName(), info.size(), info.lastModified().toTime_t());
+        }
+
+        dirty_ = true;
+        reconciled_ = true;
+    }
+
+    const AssetDiskCacheIndex::Record *AssetDiskCacheIndex::Find(const std::string &hash) const
+    {
+        RecordMap::const_iterator i = records_.find(hash);
+        if (i == records_.end())
+            return 0;
+        return &i->second;
+    }
+
+    void AssetDiskCacheIndex::Insert(const std::string &hash, const std::string &type, qint64 size)
+    {
+        std::pair<RecordMap::iterator, bool> result = records_.insert(std::make_pair(hash, Record()));
+        Record &record = result.first->second;
+        if (!result.second)
+            total_size_ -= record.size_;
+
+        record.type_ = type;
+        record.size_ = size;
+        record.last_access_ = CurrentTime();
+        record.seen_pass_ = reconcile_pass_;
+        total_size_ += size;
+        dirty_ = true;
+    }
+
+    void AssetDiskCacheIndex::Remove(const std::string &hash)
+    {
+        RecordMap::iterator i = records_.find(hash);
+        if (i == records_.end())
+            return;
+
+        total_size_ -= i->second.size_;
+        records_.erase(i);
+        dirty_ = true;
+    }
+
+    void AssetDiskCacheIndex::Touch(const std::string &hash)
+    {
+        RecordMap::iterator i = records_.find(hash);
+        if (i == records_.end())
+            return;
+
+        i->second.last_access_ = CurrentTime();
+        dirty_ = true;
+    }
+
+    void AssetDiskCacheIndex::Clear()
+    {
+        records_.clear();
+        total_size_ = 0;
+        dirty_ = true;
+    }
+
+    QString AssetDiskCacheIndex::GetFilePath(const std::string &hash, const std::string &type) const
+    {
+        return path_ + "/" + QString::fromStdString(hash) + "." + QString::fromStdString(type);
+    }
+
+    std::vector<std::string> AssetDiskCacheIndex::GetLeastRecentlyUsed(qint64 bytes) const
+    {
+        std::vector<RecordAge> ages;
+        ages.reserve(records_.size());
+        for(RecordMap::const_iterator i = records_.begin(); i != records_.end(); ++i)
+        {
+            RecordAge age;
+            age.last_access_ = i->second.last_access_;
+            age.size_ = i->second.size_;
+            age.hash_ = i->first;
+            ages.push_back(age);
+        }
+
+        std::sort(ages.begin(), ages.end());
+
+        std::vector<std::string> hashes;
+        qint64 total = 0;
+        for(uint i = 0; i < ages.size() && total < bytes; ++i)
+        {
+            hashes.push_back(ages[i].hash_);
+            total += ages[i].size_;
+        }
+
+        return hashes;
+    }
+
+    bool AssetDiskCacheIndex::Reconcile(uint max_entries)
+    {
+        if (!reconcile_iter_)
+        {
+            ++reconcile_pass_;
+            reconcile_iter_ = new QDirIterator(path_, QDir::Files);
+        }
+
+        for(uint n = 0; n < max_entries; ++n)
+        {
+            if (!reconcile_iter_->hasNext())
+            {
+                delete reconcile_iter_;
+                reconcile_iter_ = 0;
+
+                // Drop records of files that were not seen during the pass
+                RecordMap::iterator i = records_.begin();
+                while(i != records_.end())
+                {
+                    if (i->second.seen_pass_ != reconcile_pass_)
+                    {
+                        total_size_ -= i->second.size_;
+                        i = records_.erase(i);
+                        dirty_ = true;
+                    }
+                    else
+                        ++i;
+                }
+
+                reconciled_ = true;
+                return true;
+            }
+
+            reconcile_iter_->next();
+            QFileInfo info = reconcile_iter_->fileInfo();
+            std::string hash = info.fileName().section('.', 0, 0).toStdString();
+            RecordMap::iterator i = records_.find(hash);
+            if (i != records_.end() && i->second.size_ == info.size())
+                i->second.seen_pass_ = reconcile_pass_;
+            else
+                AddFile(info.fileName(), info.size(), info.lastModified().toTime_t());
+        }
+
+        return false;
+    }
+
+    bool AssetDiskCacheIndex::AddFile(const QString &filename, qint64 size, uint last_modified)
+    {
+        // Temporary files of interrupted writes are not assets
+        if (filename.startsWith(IndexFileName()) || filename.endsWith(".tmp"))
+            return false;
+
+        QString hash = filename.section('.', 0, 0);
+        QString type = filename.section('.', -1);
+        if (hash.isEmpty() || type.isEmpty() || hash == filename)
+            return false;
+
+        std::pair<RecordMap::iterator, bool> result = records_.insert(std::make_pair(hash.toStdString(), Record()));
+        Record &record = result.first->second;
+        if (!result.second)
+            total_size_ -= record.size_;
+
+        record.type_ = type.toStdString();
+        record.size_ = size;
+        record.last_access_ = last_modified;
+        record.seen_pass_ = reconcile_pass_;
+        total_size_ += size;
+        dirty_ = true;
+        return true;
+    }
+}
@@ -0,0 +1,132 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Asset_AssetDiskCacheIndex_h
+#define incl_Asset_AssetDiskCacheIndex_h
+
+#include "CoreTypes.h"
+
+#include <boost/unordered_map.hpp>
+#include <QString>
+
+class QDirIterator;
+
+namespace Asset
+{
+    //! Index of the files in an asset disk cache directory. Used by AssetCache.
+    /*! Cached assets are stored in files named <hash>.<type>, where hash is the MD5 of the asset id. The index maps
+        hashes to type, size and last access time, so that lookups and size accounting do not need to scan the
+        directory.
+
+        The index can be persisted to a file in the cache directory and loaded at startup instead of listing the
+        directory. Saving writes a temporary file which then replaces the old index, so a crash leaves either the
+        old or the new index intact. Because the index may be older than the directory contents, for example after
+        a crash, it is reconciled lazily: files that turn out to be missing are dropped when looked up, and
+        Reconcile() walks the directory a few entries at a time to pick up unknown files and drop stale records.
+     */
+    class AssetDiskCacheIndex
+    {
+    public:
+        //! Cached file
+        struct Record
+        {
+            //! Asset type, the file name extension
+            std::string type_;
+
+            //! File size in bytes
+            qint64 size_;
+
+            //! Last access time in seconds since epoch
+            uint last_access_;
+
+            //! Reconcile pass on which the file was last seen. Not persisted.
+            uint seen_pass_;
+        };
+
+        //! Records by hash
+        typedef boost::unordered_map<std::string, Record> RecordMap;
+
+        //! Constructor
+        /*! \param path Cache directory
+         */
+        explicit AssetDiskCacheIndex(const QString &path);
+
+        //! Destructor
+        ~AssetDiskCacheIndex();
+
+        //! Loads the persisted index. Returns false if there is none or it is corrupt.
+        bool Load();
+
+        //! Saves the index if it has changed since it was last loaded or saved. Returns true if successful.
+        bool Save();
+
+        //! Rebuilds the index by listing the cache directory
+        void Rebuild();
+
+        //! Returns record for a hash, or null if not found
+        const Record *Find(const std::string &hash) const;
+
+        //! Adds or replaces a record
+        void Insert(const std::string &hash, const std::string &type, qint64 size);
+
+        //! Removes a record. Does not remove the file.
+        void Remove(const std::string &hash);
+
+        //! Marks file as accessed now
+        void Touch(const std::string &hash);
+
+        //! Removes all records
+        void Clear();
+
+        //! Returns path of a cached file
+        QString GetFilePath(const std::string &hash, const std::string &type) const;
+
+        //! Returns hashes of the least recently accessed files first, up to a total size of at least bytes
+        std::vector<std::string> GetLeastRecentlyUsed(qint64 bytes) const;
+
+        //! Processes up to max_entries directory entries of the current reconcile pass, starting a new pass if none
+        //! is in progress. Returns true when the pass completed.
+        bool Reconcile(uint max_entries);
+
+        //! Returns true if the index is known to be consistent with the directory
+        bool IsReconciled() const { return reconciled_; }
+
+        //! Returns total size of the indexed files in bytes
+        qint64 GetTotalSize() const { return total_size_; }
+
+        //! Returns all records
+        const RecordMap &GetRecords() const { return records_; }
+
+        //! Returns name of the index file, which is stored in the cache directory
+        static const QString &IndexFileName();
+
+    private:
+        //! Adds record for a file found in the directory, returns false if the file name is not of a cached asset
+        bool AddFile(const QString &filename, qint64 size, uint last_modified);
+
+        //! Reads an index file
+        bool Read(const QString &filename);
+
+        //! Cache directory
+        QString path_;
+
+        //! Records by hash
+        RecordMap records_;
+
+        //! Total size of the indexed files
+        qint64 total_size_;
+
+        //! Whether changed since last load or save
+        bool dirty_;
+
+        //! Whether the index is known to be consistent with the directory
+        bool reconciled_;
+
+        //! Directory iterator of the current reconcile pass, or null if none in progress
+        QDirIterator *reconcile_iter_;
+
+        //! Number of the current reconcile pass
+        uint reconcile_pass_;
+    };
+}
+
+#endif
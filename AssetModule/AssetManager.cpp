@@ -4,6 +4,8 @@
 #include "AssetEvents.h"
 #include "AssetManager.h"
 #include "AssetCache.h"
+#include "AssetPrefetcher.h"
+#include "AssetScheduler.h"
 #include "RexAsset.h"
 #include "Framework.h"
 #include "EventManager.h"
@@ -12,6 +14,9 @@ using namespace RexTypes;
 
 namespace Asset
 {
+    //! Priority of prefetch requests, below the default priority of demand requests
+    const f32 PREFETCH_PRIORITY = -1.0f;
+
     AssetManager::AssetManager(Foundation::Framework* framework) : 
         framework_(framework)
     {
@@ -24,17 +29,53 @@ namespace Asset
         
         // Create asset cache
         cache_ = AssetCachePtr(new AssetCache(framework_));
+
+        scheduler_.reset(new AssetScheduler(framework_, cache_.get(), event_category_));
+        prefetcher_.reset(new AssetPrefetcher(framework_, this, cache_->GetCachePath() + "/prefetch"));
     }
     
     AssetManager::~AssetManager()
     {
+        prefetcher_.reset();
+        scheduler_.reset();
         cache_.reset();
         providers_.clear();
     }
     
     Foundation::AssetPtr AssetManager::GetAsset(const std::string& asset_id, const std::string& asset_type)
     {
-        return GetFromCache(asset_id, asset_type);
+        Foundation::AssetPtr asset = cache_->GetAsset(asset_id, true, false, asset_type);
+        if (asset)
+            return asset;
+
+        // Do not wait for the disk, but start loading from there so that a later call finds the asset in memory
+        if (!InProgress(asset_id))
+            cache_->RequestDiskAsset(asset_id, asset_type);
+        return asset;
+    }
+
+    Foundation::AssetPtr AssetManager::GetAssetFromDisk(const std::string& asset_id, const std::string& asset_type)
+    {
+        // First check memory cache
+        Foundation::AssetPtr asset = cache_->GetAsset(asset_id, true, false, asset_type);
+        if (asset)
+            return asset;
+
+        // If transfer queued or in progress in any of the providers, do not check disk cache again
+        if (InProgress(asset_id))
+            return Foundation::AssetPtr();
+            
+        // Last check disk cache. This is the only place the disk cache is read on the calling thread
+        asset = cache_->GetAsset(asset_id, false, true, asset_type);
+        return asset;
+    }
+  
+    bool AssetManager::IsAssetCached(const std::string& asset_id, const std::string& asset_type)
+    {
+        if (cache_->GetAsset(asset_id, true, false, asset_type))
+            return true;
+
+        return cache_->RequestDiskAsset(asset_id, asset_type);
     }
   
     bool AssetManager::IsValidId(const std::string& asset_id, const std::string& asset_type)
@@ -55,8 +96,10 @@ namespace Asset
     request_tag_t AssetManager::RequestAsset(const std::string& asset_id, const std::string& asset_type)
     {
         request_tag_t tag = framework_->GetEventManager()->GetNextRequestTag();
+
+        prefetcher_->RecordRequest(asset_id, asset_type);
         
-        Foundation::AssetPtr asset = GetFromCache(asset_id, asset_type);
+        Foundation::AssetPtr asset = cache_->GetAsset(asset_id, true, false, asset_type);
         if (asset)
         {
             Events::AssetReady* event_data = new Events::AssetReady(asset->GetId(), asset->GetType(), asset, tag);
@@ -64,21 +107,126 @@ namespace Asset
             
             return tag;
         }
+
+        // Load from disk cache in the background, ASSET_READY is sent from Update(). If a transfer is already
+        // queued or in progress, the disk cache has been checked already. Assets of synchronous providers, such as
+        // local files, are read from the provider right away, so that they are in the memory cache on return
+        if ((!InProgress(asset_id)) && (!IsSynchronous(asset_id, asset_type)) && (cache_->RequestDiskAsset(asset_id, asset_type)))
+        {
+            DiskRequest request;
+            request.asset_type_ = asset_type;
+            request.tag_ = tag;
+            request.priority_ = 0.0f;
+            request.discard_level_ = 0;
+            disk_requests_[asset_id].push_back(request);
+            return tag;
+        }
+        
+        if (scheduler_->Request(asset_id, asset_type, tag, 0.0f, 0))
+            return tag;
         
+        AssetModule::LogInfo("No asset provider would accept request for asset " + asset_id);
+        return 0;
+    }
+
+    bool AssetManager::SetRequestPriority(request_tag_t tag, f32 priority, int discard_level)
+    {
+        if (scheduler_->SetPriority(tag, priority, discard_level))
+            return true;
+
+        // Still waiting for the disk cache, the priority applies if it has to be transferred
+        for(DiskRequestMap::iterator i = disk_requests_.begin(); i != disk_requests_.end(); ++i)
+        {
+            std::vector<DiskRequest>& requests = i->second;
+            for(uint j = 0; j < requests.size(); ++j)
+            {
+                if (requests[j].tag_ == tag)
+                {
+                    requests[j].priority_ = priority;
+                    requests[j].discard_level_ = discard_level;
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    bool AssetManager::CancelRequest(request_tag_t tag)
+    {
+        if (scheduler_->Cancel(tag))
+            return true;
+
+        for(DiskRequestMap::iterator i = disk_requests_.begin(); i != disk_requests_.end(); ++i)
+        {
+            std::vector<DiskRequest>& requests = i->second;
+            for(uint j = 0; j < requests.size(); ++j)
+            {
+                if (requests[j].tag_ == tag)
+                {
+                    // The read itself is left to complete to the memory cache
+                    requests.erase(requests.begin() + j);
+                    if (requests.empty())
+                        disk_requests_.erase(i);
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    request_tag_t AssetManager::PrefetchAsset(const std::string& asset_id, const std::string& asset_type)
+    {
+        request_tag_t tag = framework_->GetEventManager()->GetNextRequestTag();
+        if (scheduler_->Request(asset_id, asset_type, tag, PREFETCH_PRIORITY, 0))
+            return tag;
+        return 0;
+    }
+
+    bool AssetManager::InProgress(const std::string& asset_id)
+    {
+        if (scheduler_->IsScheduled(asset_id))
+            return true;
+
         AssetProviderVector::iterator i = providers_.begin();
         while (i != providers_.end())
         {
-            // See if a provider can handle request
-            if ((*i)->RequestAsset(asset_id, asset_type, tag))
-                return tag;
-            
+            if ((*i)->InProgress(asset_id))
+                return true;
             ++i;
         }
-        
-        AssetModule::LogInfo("No asset provider would accept request for asset " + asset_id);
-        return 0;
+
+        return false;
     }
-    
+
+    bool AssetManager::IsSynchronous(const std::string& asset_id, const std::string& asset_type)
+    {
+        AssetProviderVector::iterator i = providers_.begin();
+        while (i != providers_.end())
+        {
+            // The scheduler uses the first provider that considers the id valid
+            if ((*i)->IsValidId(asset_id, asset_type))
+                return (*i)->IsSynchronous();
+            ++i;
+        }
+
+        return false;
+    }
+
+    uint AssetManager::GetTransferCount()
+    {
+        uint count = 0;
+        AssetProviderVector::iterator i = providers_.begin();
+        while (i != providers_.end())
+        {
+            count += (*i)->GetTransferInfo().size();
+            ++i;
+        }
+
+        return count;
+    }
+
     Foundation::AssetPtr AssetManager::GetIncompleteAsset(const std::string& asset_id, const std::string& asset_type, uint received)
     {
         if (!received)
@@ -113,8 +261,12 @@ namespace Asset
             ++i;
         }          
         
-        // If not ongoing, check cache
-        Foundation::AssetPtr asset = GetFromCache(asset_id);
+        // Queued but not started, nothing received yet
+        if (scheduler_->IsQueued(asset_id))
+            return false;
+
+        // If not ongoing, check memory cache. Do not wait for the disk, but start loading from there
+        Foundation::AssetPtr asset = cache_->GetAsset(asset_id, true, false);
         if (asset)
         {
             size = asset->GetSize();
@@ -122,13 +274,15 @@ namespace Asset
             received_continuous = asset->GetSize();
             return true;
         }
-        
+
+        cache_->RequestDiskAsset(asset_id);
         return false;
     }
     
     void AssetManager::StoreAsset(Foundation::AssetPtr asset)
     {
         cache_->StoreAsset(asset);
+        scheduler_->HandleStored(asset);
     }
     
     bool AssetManager::RegisterAssetProvider(Foundation::AssetProviderPtr asset_provider)
@@ -151,6 +305,7 @@ namespace Asset
         }        
         
         providers_.push_back(asset_provider);
+        scheduler_->AddProvider(asset_provider);
         AssetModule::LogInfo("Asset provider " + asset_provider->Name()  + " registered");        
         return true;
     }
@@ -169,6 +324,7 @@ namespace Asset
             if ((*i) == asset_provider)
             {
                 providers_.erase(i);
+                scheduler_->RemoveProvider(asset_provider);
                 AssetModule::LogInfo("Asset provider " + asset_provider->Name()  + " unregistered");
                 return true;
             }            
@@ -181,37 +337,49 @@ namespace Asset
         
     void AssetManager::Update(f64 frametime)
     {
-        // Update all providers
-        AssetProviderVector::iterator i = providers_.begin();
-        while (i != providers_.end())
-        {
-            (*i)->Update(frametime);
-            ++i;
-        }      
-        
         // Update cache
         cache_->Update(frametime); 
-    }
-    
-    Foundation::AssetPtr AssetManager::GetFromCache(const std::string& asset_id, const std::string& asset_type)
-    {
-        // First check memory cache
-        Foundation::AssetPtr asset = cache_->GetAsset(asset_id, true, false, asset_type);
-        if (asset)
-            return asset;
 
-        // If transfer in progress in any of the providers, do not check disk cache again
+        // Answer the requests that were waiting for the disk cache
+        std::vector<std::pair<std::string, Foundation::AssetPtr> > reads = cache_->TakeCompletedDiskReads();
+        for(uint j = 0; j < reads.size(); ++j)
+        {
+            prefetcher_->HandleDiskRead(reads[j].first, reads[j].second);
+
+            DiskRequestMap::iterator r = disk_requests_.find(reads[j].first);
+            if (r == disk_requests_.end())
+                continue;
+
+            const std::string& asset_id = r->first;
+            const std::vector<DiskRequest>& requests = r->second;
+            Foundation::AssetPtr asset = reads[j].second;
+            for(uint k = 0; k < requests.size(); ++k)
+            {
+                if (asset)
+                {
+                    Events::AssetReady* event_data = new Events::AssetReady(asset->GetId(), asset->GetType(), asset, requests[k].tag_);
+                    framework_->GetEventManager()->SendDelayedEvent(event_category_, Events::ASSET_READY, Foundation::EventDataPtr(event_data));
+                }
+                else if (!scheduler_->Request(asset_id, requests[k].asset_type_, requests[k].tag_, requests[k].priority_,
+                    requests[k].discard_level_))
+                    AssetModule::LogInfo("No asset provider would accept request for asset " + asset_id);
+            }
+
+            disk_requests_.erase(r);
+        }
+
+        // Prefetch after the demand requests have been handled, so that it can yield to them
+        prefetcher_->Update(frametime);
+
+        // Start the queued requests, then update all providers so that they send the new requests this frame
+        scheduler_->Update();
+
         AssetProviderVector::iterator i = providers_.begin();
         while (i != providers_.end())
         {
-            if ((*i)->InProgress(asset_id))
-                return Foundation::AssetPtr();
+            (*i)->Update(frametime);
             ++i;
-        } 
-            
-        // Last check disk cache
-        asset = cache_->GetAsset(asset_id, false, true, asset_type);
-        return asset;
+        }
     }
     
     Foundation::AssetCacheInfoMap AssetManager::GetAssetCacheInfo()
@@ -224,8 +392,8 @@ namespace Asset
         AssetCache::AssetMap::const_iterator i = assets.begin();
         while (i != assets.end())
         {
-            ret[i->second->GetType()].count_++;
-            ret[i->second->GetType()].size_ += i->second->GetSize();
+            ret[i->second.asset_->GetType()].count_++;
+            ret[i->second.asset_->GetType()].size_ += i->second.size_;
             ++i;
         }
         
@@ -240,7 +408,7 @@ namespace Asset
         const AssetCache::AssetMap& assets = cache_->GetAssets();
         AssetCache::AssetMap::const_iterator found_item = assets.find(asset_id);
         if (found_item != assets.end())
-            return cache_->DeleteAsset(found_item->second);
+            return cache_->DeleteAsset(found_item->second.asset_);
         return false;
     }
     
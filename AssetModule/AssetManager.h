@@ -16,6 +16,8 @@ namespace Foundation
 namespace Asset
 {
     class AssetCache;
+    class AssetPrefetcher;
+    class AssetScheduler;
 
     //! Asset manager. Implements the AssetServiceInterface.
     /*! \ingroup AssetModuleClient
@@ -37,6 +39,12 @@ namespace Asset
          */
         virtual Foundation::AssetPtr GetAsset(const std::string& asset_id, const std::string& asset_type);
 
+        //! see AssetServiceInterface
+        virtual Foundation::AssetPtr GetAssetFromDisk(const std::string& asset_id, const std::string& asset_type);
+
+        //! see AssetServiceInterface
+        virtual bool IsAssetCached(const std::string& asset_id, const std::string& asset_type);
+
         //! Gets incomplete asset
         /*! Note: a new incomplete asset object (with copy of the data) will be created for each call. Please
             do not store the shared pointer for longer than necessary.
@@ -64,6 +72,20 @@ namespace Asset
          */
         virtual request_tag_t RequestAsset(const std::string& asset_id, const std::string& asset_type);
 
+        //! Changes priority and discard level of an asset request
+        /*! \param tag Request tag returned by RequestAsset()
+            \param priority New priority, higher is downloaded first
+            \param discard_level Number of highest resolution levels of a texture not needed yet, 0 for the whole asset
+            \return true if the request is still waiting or downloading
+         */
+        virtual bool SetRequestPriority(request_tag_t tag, f32 priority, int discard_level);
+
+        //! Cancels an asset request
+        /*! \param tag Request tag returned by RequestAsset()
+            \return true if the request was still waiting or downloading
+         */
+        virtual bool CancelRequest(request_tag_t tag);
+
         //! Queries status of asset download
         /*! If asset has been already fully received, size, received & received_continuous will be the same
         
@@ -106,17 +128,38 @@ namespace Asset
             \param frametime Seconds since last frame
          */
         void Update(f64 frametime);
-        
+
+        //! Returns the asset cache
+        AssetCache* GetCache() const { return cache_.get(); }
+
+        //! Returns the region asset prefetcher
+        AssetPrefetcher* GetPrefetcher() const { return prefetcher_.get(); }
+
+        //! Returns the provider request scheduler
+        AssetScheduler* GetScheduler() const { return scheduler_.get(); }
+
+        //! Requests an asset from the providers only, at lower priority than other requests, without checking the caches
+        //! or logging the request. For prefetching.
+        /*! \return non-zero request tag if queued, 0 if no provider considers the id valid
+         */
+        request_tag_t PrefetchAsset(const std::string& asset_id, const std::string& asset_type);
+
+        //! Returns true if a transfer of the asset is queued, or in progress in any provider
+        bool InProgress(const std::string& asset_id);
+
+        //! Returns true if the provider of the asset completes requests right away, see AssetProviderInterface::IsSynchronous()
+        bool IsSynchronous(const std::string& asset_id, const std::string& asset_type);
+
+        //! Returns number of transfers in progress in the providers
+        uint GetTransferCount();
+
+        //! Returns number of assets requested and waiting for the disk cache
+        uint GetDiskRequestCount() const { return disk_requests_.size(); }
+
     private:
         //! Gets new request tag
         request_tag_t GetNextTag();
-        
-        //! Gets asset from cache
-        /*! \param asset_id Asset ID
-            \param asset_type Optional asset type (empty to match any)
-         */
-        Foundation::AssetPtr GetFromCache(const std::string& asset_id, const std::string& asset_type = std::string());
-        
+
         //! Framework we belong to
         Foundation::Framework* framework_;
         
@@ -126,6 +169,25 @@ namespace Asset
         //! Asset cache
         typedef boost::shared_ptr<AssetCache> AssetCachePtr;
         AssetCachePtr cache_;
+
+        //! Provider request scheduler
+        boost::scoped_ptr<AssetScheduler> scheduler_;
+
+        //! Region asset prefetcher
+        boost::scoped_ptr<AssetPrefetcher> prefetcher_;
+
+        //! Asset request waiting for the disk cache
+        struct DiskRequest
+        {
+            std::string asset_type_;
+            request_tag_t tag_;
+            f32 priority_;
+            int discard_level_;
+        };
+
+        //! Asset requests waiting for the disk cache, by asset id
+        typedef std::map<std::string, std::vector<DiskRequest> > DiskRequestMap;
+        DiskRequestMap disk_requests_;
         
         //! Asset providers
         typedef std::vector<Foundation::AssetProviderPtr> AssetProviderVector;
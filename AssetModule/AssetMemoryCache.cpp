@@ -0,0 +1,133 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "AssetMemoryCache.h"
+
+namespace Asset
+{
+    AssetMemoryCache::AssetMemoryCache(uint max_size) :
+        head_(0),
+        tail_(0),
+        total_size_(0),
+        max_size_(max_size),
+        evictions_(0)
+    {
+    }
+
+    Foundation::AssetPtr AssetMemoryCache::GetAsset(const std::string &asset_id, const std::string &asset_type)
+    {
+        AssetMap::iterator i = assets_.find(asset_id);
+        if (i == assets_.end())
+            return Foundation::AssetPtr();
+
+        Entry *entry = &i->second;
+        if (!asset_type.empty() && entry->asset_->GetType() != asset_type)
+            return Foundation::AssetPtr();
+
+        if (entry != head_)
+        {
+            Unlink(entry);
+            LinkFront(entry);
+        }
+
+        return entry->asset_;
+    }
+
+    Foundation::AssetPtr AssetMemoryCache::PeekAsset(const std::string &asset_id) const
+    {
+        AssetMap::const_iterator i = assets_.find(asset_id);
+        if (i == assets_.end())
+            return Foundation::AssetPtr();
+        return i->second.asset_;
+    }
+
+    void AssetMemoryCache::StoreAsset(Foundation::AssetPtr asset)
+    {
+        if (!asset)
+            return;
+
+        std::pair<AssetMap::iterator, bool> result = assets_.insert(std::make_pair(asset->GetId(), Entry()));
+        Entry *entry = &result.first->second;
+        if (result.second)
+        {
+            entry->prev_ = 0;
+            entry->next_ = 0;
+        }
+        else
+        {
+            total_size_ -= entry->size_;
+            Unlink(entry);
+        }
+
+        entry->asset_ = asset;
+        entry->size_ = asset->GetSize();
+        total_size_ += entry->size_;
+        LinkFront(entry);
+
+        Evict(entry);
+    }
+
+    bool AssetMemoryCache::RemoveAsset(const std::string &asset_id)
+    {
+        AssetMap::iterator i = assets_.find(asset_id);
+        if (i == assets_.end())
+            return false;
+
+        Unlink(&i->second);
+        total_size_ -= i->second.size_;
+        assets_.erase(i);
+        return true;
+    }
+
+    void AssetMemoryCache::Clear()
+    {
+        assets_.clear();
+        head_ = 0;
+        tail_ = 0;
+        total_size_ = 0;
+    }
+
+    void AssetMemoryCache::SetMaxSize(uint max_size)
+    {
+        max_size_ = max_size;
+        Evict();
+    }
+
+    void AssetMemoryCache::LinkFront(Entry *entry)
+    {
+        entry->prev_ = 0;
+        entry->next_ = head_;
+        if (head_)
+            head_->prev_ = entry;
+        head_ = entry;
+        if (!tail_)
+            tail_ = entry;
+    }
+
+    void AssetMemoryCache::Unlink(Entry *entry)
+    {
+        if (entry->prev_)
+            entry->prev_->next_ = entry->next_;
+        else
+            head_ = entry->next_;
+
+        if (entry->next_)
+            entry->next_->prev_ = entry->prev_;
+        else
+            tail_ = entry->prev_;
+
+        entry->prev_ = 0;
+        entry->next_ = 0;
+    }
+
+    void AssetMemoryCache::Evict(const Entry *keep)
+    {
+        while(total_size_ > max_size_ && tail_ && tail_ != keep)
+        {
+            // Copy the id, the asset may be destroyed along with the entry
+            std::string asset_id = tail_->asset_->GetId();
+            RemoveAsset(asset_id);
+            ++evictions_;
+        }
+    }
+}
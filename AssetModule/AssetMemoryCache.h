@@ -0,0 +1,110 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Asset_AssetMemoryCache_h
+#define incl_Asset_AssetMemoryCache_h
+
+#include "AssetInterface.h"
+
+#include <boost/unordered_map.hpp>
+
+namespace Asset
+{
+    //! Memory tier of the asset cache. Used by AssetCache.
+    /*! Assets are stored in a hash map keyed by asset id. The entries are also linked into an intrusive
+        least-recently-used list, and the total size of the stored assets is kept up to date on every change,
+        so lookup, touch, insertion and eviction are all constant time regardless of the number of assets.
+
+        An asset counts as used when it is stored, or found with GetAsset().
+     */
+    class AssetMemoryCache
+    {
+    public:
+        //! Cache entry
+        struct Entry
+        {
+            //! The asset
+            Foundation::AssetPtr asset_;
+
+            //! Asset size at the time it was stored
+            uint size_;
+
+            //! Previous (more recently used) entry in the LRU list
+            Entry *prev_;
+
+            //! Next (less recently used) entry in the LRU list
+            Entry *next_;
+        };
+
+        //! Entries by asset id. Element addresses stay valid on rehash, which the LRU list relies on.
+        typedef boost::unordered_map<std::string, Entry> AssetMap;
+
+        //! Constructor
+        /*! \param max_size Maximum total size of assets in bytes
+         */
+        explicit AssetMemoryCache(uint max_size);
+
+        //! Returns asset and marks it as most recently used, or null if not found
+        /*! \param asset_id Asset ID
+            \param asset_type Optional type (empty to match any)
+         */
+        Foundation::AssetPtr GetAsset(const std::string &asset_id, const std::string &asset_type = std::string());
+
+        //! Returns asset without affecting the LRU order, or null if not found
+        Foundation::AssetPtr PeekAsset(const std::string &asset_id) const;
+
+        //! Stores asset as the most recently used one, replacing an earlier asset with the same id.
+        //! Evicts least recently used assets if the cache grows over the maximum size.
+        void StoreAsset(Foundation::AssetPtr asset);
+
+        //! Removes asset. Returns true if it was in the cache.
+        bool RemoveAsset(const std::string &asset_id);
+
+        //! Removes all assets
+        void Clear();
+
+        //! Sets maximum total size in bytes and evicts assets as necessary
+        void SetMaxSize(uint max_size);
+
+        //! Returns maximum total size in bytes
+        uint GetMaxSize() const { return max_size_; }
+
+        //! Returns total size of the stored assets in bytes
+        uint GetTotalSize() const { return total_size_; }
+
+        //! Returns number of evictions since creation
+        uint GetEvictions() const { return evictions_; }
+
+        //! Returns all assets. Iteration order is arbitrary.
+        const AssetMap &GetAssets() const { return assets_; }
+
+    private:
+        //! Links entry to the front of the LRU list
+        void LinkFront(Entry *entry);
+
+        //! Unlinks entry from the LRU list
+        void Unlink(Entry *entry);
+
+        //! Evicts least recently used assets until the total size is within limits. Never evicts the entry given.
+        void Evict(const Entry *keep = 0);
+
+        //! Entries by asset id
+        AssetMap assets_;
+
+        //! Most recently used entry
+        Entry *head_;
+
+        //! Least recently used entry
+        Entry *tail_;
+
+        //! Total size of the stored assets
+        uint total_size_;
+
+        //! Maximum total size
+        uint max_size_;
+
+        //! Eviction count
+        uint evictions_;
+    };
+}
+
+#endif
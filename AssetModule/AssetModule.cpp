@@ -13,14 +13,25 @@
 #include "EventManager.h"
 #include "ServiceManager.h"
 #include "CoreException.h"
+#include "AssetCache.h"
+#include "AssetMemoryCache.h"
+#include "AssetPrefetcher.h"
+#include "AssetScheduler.h"
+#include "RexAsset.h"
+#include "HighPerfClock.h"
 
 #include "Interfaces/ProtocolModuleInterface.h"
+#include "RealXtend/RexProtocolMsgIDs.h"
+#include "NetworkMessages/NetInMessage.h"
 
 namespace Asset
 {
     std::string AssetModule::type_name_static_ = "Asset";
 
-    AssetModule::AssetModule() : ModuleInterface(type_name_static_), inboundcategory_id_(0)
+    //! Seconds after which BenchmarkHttpAssets gives up on the transfers still in progress
+    const double HTTP_BENCHMARK_TIMEOUT = 60.0;
+
+    AssetModule::AssetModule() : ModuleInterface(type_name_static_), inboundcategory_id_(0), http_benchmark_start_(0)
     {
     }
 
@@ -64,6 +75,35 @@ namespace Asset
         RegisterConsoleCommand(Console::CreateCommand(
             "RequestAsset", "Request asset from server. Usage: RequestAsset(uuid,assettype)", 
             Console::Bind(this, &AssetModule::ConsoleRequestAsset)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "BenchmarkAssetCache", "Measures asset memory cache performance. Usage: BenchmarkAssetCache(number of assets, default 10000)",
+            Console::Bind(this, &AssetModule::ConsoleBenchmarkAssetCache)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "AssetCacheStats", "Prints asset memory and disk cache statistics.",
+            Console::Bind(this, &AssetModule::ConsoleAssetCacheStats)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "AssetCompressionStats", "Prints disk cache compression ratio and decompression throughput by asset type.",
+            Console::Bind(this, &AssetModule::ConsoleAssetCompressionStats)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "BenchmarkDiskCache", "Reads disk cached assets twice, as on a cold and a warm login. Usage: BenchmarkDiskCache(number of assets, default 2000)",
+            Console::Bind(this, &AssetModule::ConsoleBenchmarkDiskCache)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "AssetPrefetch", "Prints statistics of the region asset prefetch. Usage: AssetPrefetch(cancel) to cancel it.",
+            Console::Bind(this, &AssetModule::ConsoleAssetPrefetch)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "AssetSchedulerStats", "Prints asset request queue and transfer times by asset provider.",
+            Console::Bind(this, &AssetModule::ConsoleAssetSchedulerStats)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "BenchmarkHttpAssets", "Measures HTTP asset transfer throughput, for example against tools/HttpAssetServer. "
+            "Usage: BenchmarkHttpAssets(server url, number of assets, default 100)",
+            Console::Bind(this, &AssetModule::ConsoleBenchmarkHttpAssets)));
     }
 
     void AssetModule::SubscribeToNetworkEvents(boost::weak_ptr<ProtocolUtilities::ProtocolModuleInterface> currentProtocolModule)
@@ -85,6 +125,8 @@ namespace Asset
             PROFILE(AssetModule_Update);
             if (manager_)
                 manager_->Update(frametime);
+            if (!http_benchmark_ids_.empty())
+                UpdateHttpBenchmark();
         }
         RESETPROFILER;
     }
@@ -110,6 +152,248 @@ namespace Asset
         return Console::ResultSuccess();
     }
 
+    Console::CommandResult AssetModule::ConsoleBenchmarkAssetCache(const StringVector &params)
+    {
+        uint count = 10000;
+        if (params.size() > 0)
+            count = ParseString<uint>(params[0], count);
+        if (count == 0)
+            return Console::ResultFailure("Usage: BenchmarkAssetCache(number of assets)");
+
+        const uint asset_size = 1024;
+        std::vector<Foundation::AssetPtr> assets;
+        assets.reserve(count);
+        for(uint i = 0; i < count; ++i)
+        {
+            RexAsset *asset = new RexAsset(RexUUID::CreateRandom().ToString(), "Texture");
+            asset->GetDataInternal().resize(asset_size);
+            assets.push_back(Foundation::AssetPtr(asset));
+        }
+
+        // Room for half of the assets, so that storing the rest causes evictions
+        AssetMemoryCache cache((count / 2) * asset_size);
+        double freq = (double)Core::GetCurrentClockFreq();
+
+        Core::tick_t start = Core::GetCurrentClockTime();
+        for(uint i = 0; i < count; ++i)
+            cache.StoreAsset(assets[i]);
+        double store_time = (Core::GetCurrentClockTime() - start) / freq;
+
+        uint hits = 0;
+        start = Core::GetCurrentClockTime();
+        for(uint i = 0; i < count; ++i)
+            if (cache.GetAsset(assets[i]->GetId()))
+                ++hits;
+        double lookup_time = (Core::GetCurrentClockTime() - start) / freq;
+
+        return Console::ResultSuccess(ToString(count) + " assets: store " + ToString(store_time * 1000000.0 / count) +
+            " us/asset (" + ToString(cache.GetEvictions()) + " evictions), lookup " + ToString(lookup_time * 1000000.0 / count) +
+            " us/asset (" + ToString(hits) + " hits)");
+    }
+
+    Console::CommandResult AssetModule::ConsoleBenchmarkHttpAssets(const StringVector &params)
+    {
+        if (params.empty() || params[0].find("http://") != 0)
+            return Console::ResultFailure("Usage: BenchmarkHttpAssets(server url, number of assets)");
+        if (!http_benchmark_ids_.empty())
+            return Console::ResultFailure("BenchmarkHttpAssets is already running");
+
+        uint count = 100;
+        if (params.size() > 1)
+            count = ParseString<uint>(params[1], count);
+        if (count == 0)
+            return Console::ResultFailure("Usage: BenchmarkHttpAssets(server url, number of assets)");
+
+        // The asset ids are different on each run, so that the assets are not found in the caches
+        std::string url = params[0];
+        if (url[url.size() - 1] != '/')
+            url += "/";
+        url += RexUUID::CreateRandom().ToString() + "/";
+
+        Foundation::EventManagerPtr event_manager = framework_->GetEventManager();
+        for(uint i = 0; i < count; ++i)
+        {
+            std::string id = url + ToString(i);
+            if (!http_asset_provider_->RequestAsset(id, "Texture", event_manager->GetNextRequestTag()))
+            {
+                for(uint j = 0; j < http_benchmark_ids_.size(); ++j)
+                    http_asset_provider_->CancelTransfer(http_benchmark_ids_[j]);
+                http_benchmark_ids_.clear();
+                return Console::ResultFailure("Could not request " + id);
+            }
+            http_benchmark_ids_.push_back(id);
+        }
+
+        http_benchmark_start_ = Core::GetCurrentClockTime();
+        return Console::ResultSuccess("Requested " + ToString(count) + " assets from " + url + ", the results are logged when done.");
+    }
+
+    void AssetModule::UpdateHttpBenchmark()
+    {
+        double elapsed = (Core::GetCurrentClockTime() - http_benchmark_start_) / (double)Core::GetCurrentClockFreq();
+        uint in_progress = 0;
+        for(uint i = 0; i < http_benchmark_ids_.size(); ++i)
+            if (http_asset_provider_->InProgress(http_benchmark_ids_[i]))
+                ++in_progress;
+        if (in_progress && elapsed < HTTP_BENCHMARK_TIMEOUT)
+            return;
+
+        uint received = 0;
+        double bytes = 0.0;
+        for(uint i = 0; i < http_benchmark_ids_.size(); ++i)
+        {
+            if (http_asset_provider_->InProgress(http_benchmark_ids_[i]))
+            {
+                http_asset_provider_->CancelTransfer(http_benchmark_ids_[i]);
+                continue;
+            }
+
+            Foundation::AssetPtr asset = manager_->GetAsset(http_benchmark_ids_[i], "Texture");
+            if (asset)
+            {
+                ++received;
+                bytes += asset->GetSize();
+            }
+        }
+
+        LogInfo("BenchmarkHttpAssets: " + ToString(received) + "/" + ToString(http_benchmark_ids_.size()) + " assets, " +
+            ToString(bytes) + " bytes in " + ToString(elapsed) + " s: " + ToString(received / elapsed) + " assets/s, " +
+            ToString(bytes / elapsed / (1024.0 * 1024.0)) + " MB/s" + (in_progress ? ", timed out" : ""));
+        http_benchmark_ids_.clear();
+    }
+
+    Console::CommandResult AssetModule::ConsoleAssetCacheStats(const StringVector &params)
+    {
+        AssetCache *cache = manager_ ? manager_->GetCache() : 0;
+        if (!cache)
+            return Console::ResultFailure("No asset cache");
+
+        const AssetMemoryCache &memory = cache->GetMemoryCache();
+        const AssetDiskCacheIndex &disk = cache->GetDiskIndex();
+        uint disk_hits = cache->GetDiskHits();
+        double disk_hit_latency = disk_hits ? cache->GetDiskHitTime() * 1000.0 / disk_hits : 0.0;
+
+        std::string pack_stats;
+        const Foundation::PackFileCache *pack = cache->GetPackCache();
+        if (pack)
+        {
+            pack_stats = " Pack: " + ToString(pack->GetRecords().size()) + " assets, " + ToString(pack->GetTotalSize()) + "/" +
+                ToString(pack->GetFileSize()) + " bytes live in " + ToString(pack->GetSegmentCount()) + " segments, " +
+                ToString(pack->GetCompactions()) + " compactions, " + ToString(pack->GetEvictions()) + " segments evicted, " +
+                ToString(pack->GetPendingCount()) + " writes pending.";
+        }
+
+        return Console::ResultSuccess("Memory cache: " + ToString(memory.GetAssets().size()) + " assets, " +
+            ToString(memory.GetTotalSize()) + "/" + ToString(memory.GetMaxSize()) + " bytes, " + ToString(memory.GetEvictions()) +
+            " evictions. Disk cache: " + ToString(disk.GetRecords().size()) + " files, " + ToString(disk.GetTotalSize()) +
+            " bytes, " + ToString(disk_hits) + " hits, " + ToString(disk_hit_latency) + " ms per hit." + pack_stats);
+    }
+
+    Console::CommandResult AssetModule::ConsoleAssetCompressionStats(const StringVector &params)
+    {
+        AssetCache *cache = manager_ ? manager_->GetCache() : 0;
+        if (!cache)
+            return Console::ResultFailure("No asset cache");
+
+        const AssetCache::CompressionStatsMap &stats = cache->GetCompressionStats();
+        if (stats.empty())
+            return Console::ResultSuccess("No assets written to or decompressed from the disk cache yet.");
+
+        std::string result;
+        for(AssetCache::CompressionStatsMap::const_iterator i = stats.begin(); i != stats.end(); ++i)
+        {
+            const AssetCache::CompressionStats &type = i->second;
+            double ratio = type.stored_bytes_ ? (double)type.raw_bytes_ / type.stored_bytes_ : 1.0;
+            double throughput = type.decode_time_ > 0.0 ? type.decoded_bytes_ / type.decode_time_ / (1024.0 * 1024.0) : 0.0;
+            result += i->first + ": " + ToString(type.stored_) + " written, " + ToString(type.raw_bytes_) + " -> " +
+                ToString(type.stored_bytes_) + " bytes (" + ToString(ratio) + "x), " + ToString(type.decoded_) + " decompressed, " +
+                ToString(type.decoded_bytes_) + " bytes at " + ToString(throughput) + " MB/s\n";
+        }
+
+        return Console::ResultSuccess(result);
+    }
+
+    Console::CommandResult AssetModule::ConsoleBenchmarkDiskCache(const StringVector &params)
+    {
+        AssetCache *cache = manager_ ? manager_->GetCache() : 0;
+        if (!cache)
+            return Console::ResultFailure("No asset cache");
+
+        uint count = 2000;
+        if (params.size() > 0)
+            count = ParseString<uint>(params[0], count);
+        if (count == 0)
+            return Console::ResultFailure("Usage: BenchmarkDiskCache(number of assets)");
+
+        // The first pass reads from disk unless the OS has the files cached, the second pass from the OS cache
+        std::string result = std::string(cache->GetPackCache() ? "Pack" : "File per asset") + " layout:";
+        double freq = (double)Core::GetCurrentClockFreq();
+        const char *passes[] = { " first ", " repeated " };
+        for(uint n = 0; n < 2; ++n)
+        {
+            qint64 bytes = 0;
+            Core::tick_t start = Core::GetCurrentClockTime();
+            uint read = cache->ReadDiskAssets(count, bytes);
+            double time = (Core::GetCurrentClockTime() - start) / freq;
+            if (!read)
+                return Console::ResultFailure("No assets in disk cache");
+
+            result += std::string(passes[n]) + ToString(read) + " assets, " + ToString(bytes / 1024) + " kB in " + ToString(time * 1000.0) +
+                " ms (" + ToString(time * 1000000.0 / read) + " us/asset, " + ToString(time > 0.0 ? bytes / time / (1024.0 * 1024.0) : 0.0) + " MB/s).";
+        }
+
+        return Console::ResultSuccess(result);
+    }
+
+    Console::CommandResult AssetModule::ConsoleAssetPrefetch(const StringVector &params)
+    {
+        AssetPrefetcher *prefetcher = manager_ ? manager_->GetPrefetcher() : 0;
+        if (!prefetcher)
+            return Console::ResultFailure("No asset prefetcher");
+
+        if (params.size() > 0)
+        {
+            if (params[0] != "cancel")
+                return Console::ResultFailure("Usage: AssetPrefetch(cancel)");
+            prefetcher->Cancel();
+        }
+
+        if (prefetcher->GetRegion().empty())
+            return Console::ResultSuccess("Not in a region.");
+
+        const AssetPrefetcher::Stats &stats = prefetcher->GetStats();
+        return Console::ResultSuccess("Region " + prefetcher->GetRegion() + ": " + ToString(stats.logged_) + " assets logged, " +
+            ToString(stats.memory_hits_) + " in memory, " + ToString(stats.disk_loads_) + " loaded from disk, " +
+            ToString(stats.network_loads_) + " from network (" + ToString(stats.network_bytes_) + " of " + ToString(stats.bytes_) +
+            " bytes), " + ToString(stats.failed_) + " failed, " + ToString(stats.canceled_) + " canceled, " +
+            ToString(prefetcher->GetPendingCount()) + " in progress, " + ToString(prefetcher->GetQueuedCount()) + " queued.");
+    }
+
+    Console::CommandResult AssetModule::ConsoleAssetSchedulerStats(const StringVector &params)
+    {
+        AssetScheduler *scheduler = manager_ ? manager_->GetScheduler() : 0;
+        if (!scheduler)
+            return Console::ResultFailure("No asset scheduler");
+
+        std::string result = ToString(scheduler->GetQueuedCount()) + " requests queued, " + ToString(scheduler->GetActiveCount()) +
+            " transfers in progress\n";
+
+        const AssetScheduler::StatsMap &stats = scheduler->GetStats();
+        for(AssetScheduler::StatsMap::const_iterator i = stats.begin(); i != stats.end(); ++i)
+        {
+            const AssetScheduler::Stats &provider = i->second;
+            double wait = provider.started_ ? provider.wait_time_ * 1000.0 / provider.started_ : 0.0;
+            double transfer = provider.completed_ ? provider.transfer_time_ * 1000.0 / provider.completed_ : 0.0;
+            result += i->first + ": " + ToString(provider.started_) + " started, " + ToString(provider.completed_) + " completed, " +
+                ToString(provider.failed_) + " failed, " + ToString(provider.canceled_) + " canceled, " +
+                ToString(provider.coalesced_) + " coalesced, wait " + ToString(wait) + " ms (max " +
+                ToString(provider.max_wait_time_ * 1000.0) + "), transfer " + ToString(transfer) + " ms (max " +
+                ToString(provider.max_transfer_time_ * 1000.0) + ")\n";
+        }
+
+        return Console::ResultSuccess(result);
+    }
+
     bool AssetModule::HandleEvent(
         event_category_id_t category_id,
         event_id_t event_id, 
@@ -118,6 +402,10 @@ namespace Asset
         PROFILE(AssetModule_HandleEvent);
         if ((category_id == inboundcategory_id_))
         {
+            ProtocolUtilities::NetworkEventInboundData *event_data = checked_static_cast<ProtocolUtilities::NetworkEventInboundData *>(data);
+            if (event_data->messageID == RexNetMsgRegionHandshake && manager_)
+                HandleRegionHandshake(event_data);
+
             if (udp_asset_provider_)
                 return checked_static_cast<UDPAssetProvider*>(udp_asset_provider_.get())->HandleNetworkEvent(data);
         }
@@ -134,6 +422,8 @@ namespace Asset
                 checked_static_cast<UDPAssetProvider*>(udp_asset_provider_.get())->ClearAllTransfers();
             if (http_asset_provider_)
                 checked_static_cast<QtHttpAssetProvider*>(http_asset_provider_.get())->ClearAllTransfers();
+            if (manager_)
+                manager_->GetPrefetcher()->LeaveRegion();
         }
         if (category_id == network_state_category_id_ && event_id == ProtocolUtilities::Events::EVENT_CAPS_FETCHED)
         {
@@ -146,6 +436,25 @@ namespace Asset
 
         return false;
     }
+
+    void AssetModule::HandleRegionHandshake(ProtocolUtilities::NetworkEventInboundData *data)
+    {
+        // Start prefetching as soon as the region is known, before the handshake is replied and objects are sent
+        ProtocolUtilities::NetInMessage &msg = *data->message;
+        try
+        {
+            msg.ResetReading();
+            msg.SkipToFirstVariableByName("RegionID");
+            RexUUID region_id = msg.ReadUUID();
+            if (!region_id.IsNull())
+                manager_->GetPrefetcher()->EnterRegion(region_id.ToString());
+        }
+        catch(Exception &)
+        {
+            LogDebug("RegionHandshake without region id, assets not prefetched");
+        }
+        msg.ResetReading();
+    }
 }
 
 extern "C" void POCO_LIBRARY_API SetProfiler(Foundation::Profiler *profiler);
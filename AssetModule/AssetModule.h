@@ -9,6 +9,7 @@
 #include "ConsoleCommandServiceInterface.h"
 #include "AssetProviderInterface.h"
 #include "AssetModuleApi.h"
+#include "HighPerfClock.h"
 
 namespace Foundation
 {
@@ -18,6 +19,7 @@ namespace Foundation
 namespace ProtocolUtilities
 {
     class ProtocolModuleInterface;
+    class NetworkEventInboundData;
 }
 
 namespace Asset
@@ -56,10 +58,37 @@ namespace Asset
         //! callback for console command
         Console::CommandResult ConsoleRequestAsset(const StringVector &params);
 
+        //! callback for console command. Measures memory cache store, lookup and eviction times.
+        Console::CommandResult ConsoleBenchmarkAssetCache(const StringVector &params);
+
+        //! callback for console command. Prints memory and disk cache statistics.
+        Console::CommandResult ConsoleAssetCacheStats(const StringVector &params);
+
+        //! callback for console command. Prints disk cache compression ratio and decompression throughput by asset type.
+        Console::CommandResult ConsoleAssetCompressionStats(const StringVector &params);
+
+        //! callback for console command. Measures disk cache read times, first and repeated.
+        Console::CommandResult ConsoleBenchmarkDiskCache(const StringVector &params);
+
+        //! callback for console command. Prints region prefetch statistics, or cancels the prefetch.
+        Console::CommandResult ConsoleAssetPrefetch(const StringVector &params);
+
+        //! callback for console command. Prints request queue and transfer statistics by asset provider.
+        Console::CommandResult ConsoleAssetSchedulerStats(const StringVector &params);
+
+        //! callback for console command. Starts measuring HTTP asset transfer throughput, see UpdateHttpBenchmark().
+        Console::CommandResult ConsoleBenchmarkHttpAssets(const StringVector &params);
+
         //! returns name of this module. Needed for logging.
         static const std::string &NameStatic() { return type_name_static_; }
 
     private:
+        //! Starts prefetching the assets of the region in the handshake
+        void HandleRegionHandshake(ProtocolUtilities::NetworkEventInboundData *data);
+
+        //! Logs the results of BenchmarkHttpAssets once its transfers have finished or timed out
+        void UpdateHttpBenchmark();
+
         //! Type name of the module.
         static std::string type_name_static_;
 
@@ -89,6 +118,12 @@ namespace Asset
 
         //! Pointer to current ProtocolModule
         boost::weak_ptr<ProtocolUtilities::ProtocolModuleInterface> protocolModule_;
+
+        //! Asset ids requested by BenchmarkHttpAssets, empty if not running
+        std::vector<std::string> http_benchmark_ids_;
+
+        //! Start time of BenchmarkHttpAssets
+        Core::tick_t http_benchmark_start_;
     };
 }
 
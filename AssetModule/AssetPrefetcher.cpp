@@ -0,0 +1,349 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "AssetPrefetcher.h"
+#include "AssetManager.h"
+#include "AssetCache.h"
+#include "AssetModule.h"
+
+#include "Framework.h"
+#include "ConfigurationManager.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDataStream>
+
+namespace Asset
+{
+    const quint32 LOG_MAGIC = 0x4C465052; // "RPFL"
+    const quint32 LOG_VERSION = 1;
+    const int DEFAULT_PREFETCH_MAX_ASSETS = 4000;
+    const int DEFAULT_PREFETCH_DISK_READS = 4;
+    const int DEFAULT_PREFETCH_TRANSFERS = 2;
+    const int DEFAULT_PREFETCH_BANDWIDTH = 128;
+
+    //! Assets not requested for this many visits in a row are dropped from the log
+    const uint MAX_MISSES = 3;
+
+    //! Maximum number of queued assets checked per update
+    const uint MAX_CHECKS_PER_UPDATE = 64;
+
+    AssetPrefetcher::AssetPrefetcher(Foundation::Framework* framework, AssetManager* manager, const std::string& path) :
+        framework_(framework),
+        manager_(manager),
+        path_(QString::fromStdString(path)),
+        bandwidth_budget_(0.0),
+        active_(false)
+    {
+        Foundation::ConfigurationManager& config = framework_->GetDefaultConfig();
+        enabled_ = config.DeclareSetting("AssetSystem", "prefetch_enabled", true);
+        max_assets_ = std::max(config.DeclareSetting("AssetSystem", "prefetch_max_assets", DEFAULT_PREFETCH_MAX_ASSETS), 0);
+        max_disk_reads_ = std::max(config.DeclareSetting("AssetSystem", "prefetch_disk_reads", DEFAULT_PREFETCH_DISK_READS), 1);
+        max_transfers_ = std::max(config.DeclareSetting("AssetSystem", "prefetch_transfers", DEFAULT_PREFETCH_TRANSFERS), 0);
+        bandwidth_ = std::max(config.DeclareSetting("AssetSystem", "prefetch_bandwidth", DEFAULT_PREFETCH_BANDWIDTH), 0) * 1024.0;
+
+        if (enabled_)
+            QDir().mkpath(path_);
+    }
+
+    AssetPrefetcher::~AssetPrefetcher()
+    {
+        if (!region_id_.empty())
+            SaveLog();
+    }
+
+    void AssetPrefetcher::EnterRegion(const std::string& region_id)
+    {
+        if (region_id == region_id_)
+            return;
+
+        LeaveRegion();
+        if (!enabled_ || region_id.empty())
+            return;
+
+        region_id_ = region_id;
+        stats_ = Stats();
+        ReadLog(region_id_, previous_log_);
+        queue_.assign(previous_log_.begin(), previous_log_.end());
+        stats_.logged_ = queue_.size();
+        active_ = !queue_.empty();
+
+        // Start right away, so that the first reads are in progress before the handshake is replied
+        bandwidth_budget_ = bandwidth_;
+        if (active_)
+            AssetModule::LogInfo("Prefetching " + ToString(queue_.size()) + " assets of region " + region_id_);
+    }
+
+    void AssetPrefetcher::LeaveRegion()
+    {
+        if (region_id_.empty())
+            return;
+
+        if (!SaveLog())
+            AssetModule::LogWarning("Could not save asset prefetch log of region " + region_id_);
+        Cancel();
+
+        region_id_.clear();
+        previous_log_.clear();
+        log_.clear();
+        logged_ids_.clear();
+    }
+
+    void AssetPrefetcher::RecordRequest(const std::string& asset_id, const std::string& asset_type)
+    {
+        if (region_id_.empty() || logged_ids_.size() >= max_assets_)
+            return;
+
+        if (!logged_ids_.insert(asset_id).second)
+            return;
+
+        Entry entry;
+        entry.asset_id_ = asset_id;
+        entry.asset_type_ = asset_type;
+        log_.push_back(entry);
+    }
+
+    void AssetPrefetcher::Cancel()
+    {
+        if (!queue_.empty())
+            AssetModule::LogDebug("Asset prefetch canceled, " + ToString(queue_.size()) + " assets not prefetched");
+
+        stats_.canceled_ += queue_.size();
+        queue_.clear();
+        active_ = false;
+
+        // Demand requests of the same assets keep their transfers going
+        for(std::map<std::string, request_tag_t>::const_iterator i = network_pending_.begin(); i != network_pending_.end(); ++i)
+            manager_->CancelRequest(i->second);
+        stats_.canceled_ += network_pending_.size();
+        network_pending_.clear();
+    }
+
+    void AssetPrefetcher::HandleDiskRead(const std::string& asset_id, Foundation::AssetPtr asset)
+    {
+        std::map<std::string, std::string>::iterator i = disk_pending_.find(asset_id);
+        if (i == disk_pending_.end())
+            return;
+
+        if (asset)
+            CountLoaded(asset, false);
+        else if (active_)
+        {
+            // The cached file was lost or corrupt, try the providers next
+            Entry entry;
+            entry.asset_id_ = asset_id;
+            entry.asset_type_ = i->second;
+            entry.disk_tried_ = true;
+            queue_.push_front(entry);
+        }
+        else
+            ++stats_.failed_;
+
+        disk_pending_.erase(i);
+    }
+
+    void AssetPrefetcher::Update(f64 frametime)
+    {
+        AssetCache* cache = manager_->GetCache();
+
+        bandwidth_budget_ = std::min(bandwidth_budget_ + bandwidth_ * frametime, bandwidth_);
+
+        // Transfers no longer in progress have completed, or failed if the asset is not in memory
+        std::map<std::string, request_tag_t>::iterator i = network_pending_.begin();
+        while(i != network_pending_.end())
+        {
+            if (manager_->InProgress(i->first))
+            {
+                ++i;
+                continue;
+            }
+
+            Foundation::AssetPtr asset = cache->GetAsset(i->first, true, false);
+            if (asset)
+            {
+                CountLoaded(asset, true);
+                bandwidth_budget_ -= asset->GetSize();
+            }
+            else
+                ++stats_.failed_;
+            network_pending_.erase(i++);
+        }
+
+        if (queue_.empty())
+            return;
+
+        // Leave the other half of the memory cache to the demand requests
+        if (stats_.bytes_ >= (qint64)cache->GetMemoryCache().GetMaxSize() / 2)
+        {
+            AssetModule::LogDebug("Asset prefetch reached memory cache limit");
+            Cancel();
+            return;
+        }
+
+        // Yield to demand requests waiting for the disk or the providers
+        bool disk_idle = manager_->GetDiskRequestCount() == 0;
+        int network_idle = -1;
+
+        uint checked = 0;
+        while(!queue_.empty() && checked < MAX_CHECKS_PER_UPDATE)
+        {
+            const Entry& entry = queue_.front();
+            ++checked;
+
+            // Skip assets that are in memory already, or being loaded for a demand request
+            if (cache->GetAsset(entry.asset_id_, true, false))
+            {
+                ++stats_.memory_hits_;
+                queue_.pop_front();
+                continue;
+            }
+            if (cache->IsDiskAssetPending(entry.asset_id_) || manager_->InProgress(entry.asset_id_))
+            {
+                queue_.pop_front();
+                continue;
+            }
+
+            if (!entry.disk_tried_)
+            {
+                if (!disk_idle || disk_pending_.size() >= max_disk_reads_)
+                    break;
+                if (cache->RequestDiskAsset(entry.asset_id_, entry.asset_type_))
+                {
+                    disk_pending_[entry.asset_id_] = entry.asset_type_;
+                    queue_.pop_front();
+                    continue;
+                }
+            }
+
+            // Not in the disk cache, transfer at most a few at a time within the bandwidth limit
+            if (network_pending_.size() >= max_transfers_ || bandwidth_budget_ <= 0.0)
+                break;
+            if (network_idle < 0)
+                network_idle = manager_->GetTransferCount() <= network_pending_.size() ? 1 : 0;
+            if (!network_idle)
+                break;
+
+            request_tag_t tag = manager_->PrefetchAsset(entry.asset_id_, entry.asset_type_);
+            if (tag)
+                network_pending_[entry.asset_id_] = tag;
+            else
+                ++stats_.failed_;
+            queue_.pop_front();
+        }
+
+        if (queue_.empty() && active_)
+        {
+            active_ = false;
+            AssetModule::LogDebug("Asset prefetch of region " + region_id_ + " queued: " + ToString(stats_.memory_hits_) +
+                " in memory, " + ToString(disk_pending_.size() + stats_.disk_loads_) + " from disk, " +
+                ToString(network_pending_.size() + stats_.network_loads_) + " from network");
+        }
+    }
+
+    void AssetPrefetcher::CountLoaded(Foundation::AssetPtr asset, bool network)
+    {
+        if (network)
+        {
+            ++stats_.network_loads_;
+            stats_.network_bytes_ += asset->GetSize();
+        }
+        else
+            ++stats_.disk_loads_;
+        stats_.bytes_ += asset->GetSize();
+    }
+
+    QString AssetPrefetcher::GetLogPath(const std::string& region_id) const
+    {
+        return path_ + "/" + QString::fromStdString(region_id) + ".log";
+    }
+
+    bool AssetPrefetcher::ReadLog(const std::string& region_id, std::vector<Entry>& entries)
+    {
+        entries.clear();
+
+        QFile file(GetLogPath(region_id));
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_0);
+
+        quint32 magic = 0, version = 0, count = 0;
+        stream >> magic >> version >> count;
+        if (magic != LOG_MAGIC || version != LOG_VERSION)
+            return false;
+
+        entries.reserve(std::min((uint)count, max_assets_));
+        for(quint32 i = 0; i < count && entries.size() < max_assets_ && stream.status() == QDataStream::Ok; ++i)
+        {
+            QByteArray id, type;
+            quint32 misses = 0;
+            stream >> id >> type >> misses;
+
+            Entry entry;
+            entry.asset_id_ = std::string(id.constData(), id.size());
+            entry.asset_type_ = std::string(type.constData(), type.size());
+            entry.misses_ = misses;
+            entries.push_back(entry);
+        }
+
+        if (stream.status() != QDataStream::Ok)
+        {
+            entries.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool AssetPrefetcher::SaveLog()
+    {
+        if (region_id_.empty())
+            return false;
+
+        // This visit in request order, then what earlier visits requested and this one did not
+        std::vector<Entry> entries(log_);
+        for(uint i = 0; i < previous_log_.size() && entries.size() < max_assets_; ++i)
+        {
+            const Entry& previous = previous_log_[i];
+            if (logged_ids_.find(previous.asset_id_) != logged_ids_.end() || previous.misses_ + 1 >= MAX_MISSES)
+                continue;
+            entries.push_back(previous);
+            ++entries.back().misses_;
+        }
+
+        QString filename = GetLogPath(region_id_);
+        if (entries.empty())
+        {
+            QFile::remove(filename);
+            return true;
+        }
+
+        QString temp_filename = filename + ".tmp";
+        {
+            QFile file(temp_filename);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+                return false;
+
+            QDataStream stream(&file);
+            stream.setVersion(QDataStream::Qt_4_0);
+            stream << LOG_MAGIC << LOG_VERSION << (quint32)entries.size();
+            for(uint i = 0; i < entries.size(); ++i)
+            {
+                stream << QByteArray(entries[i].asset_id_.c_str(), entries[i].asset_id_.size())
+                    << QByteArray(entries[i].asset_type_.c_str(), entries[i].asset_type_.size()) << (quint32)entries[i].misses_;
+            }
+
+            file.flush();
+            if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError)
+            {
+                file.close();
+                QFile::remove(temp_filename);
+                return false;
+            }
+        }
+
+        // QFile::rename does not overwrite
+        QFile::remove(filename);
+        return QFile::rename(temp_filename, filename);
+    }
+}
@@ -0,0 +1,196 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Asset_AssetPrefetcher_h
+#define incl_Asset_AssetPrefetcher_h
+
+#include "AssetInterface.h"
+
+#include <QString>
+
+#include <deque>
+#include <set>
+
+namespace Foundation
+{
+    class Framework;
+}
+
+namespace Asset
+{
+    class AssetManager;
+
+    //! Prefetches the assets a region used on the previous visits. Created and used by AssetManager.
+    /*! The asset requests made while in a region are logged in the order they were first made, and the log is
+        saved per region id to the prefetch directory of the asset cache when the region is left. When the region
+        is entered again, which is known from the region handshake before any objects are received, the logged
+        assets are loaded to the memory cache: from the disk cache if there, otherwise from the asset providers.
+
+        Prefetching yields to demand requests: disk reads are only started while no requests wait for the disk
+        cache, and transfers only while the providers have no other transfers, at a priority below demand requests.
+        At most a few reads and transfers are in progress at a time, transfers are limited to
+        AssetSystem/prefetch_bandwidth kilobytes per second, and prefetching stops when half of the memory cache
+        has been filled. Prefetching is canceled when the region is left or with Cancel(); transfers are canceled if
+        the provider supports it, reads already started are completed.
+
+        Assets not requested for a few visits in a row are dropped from the log.
+     */
+    class AssetPrefetcher
+    {
+    public:
+        //! Prefetch statistics, since the region was entered
+        struct Stats
+        {
+            Stats() : logged_(0), memory_hits_(0), disk_loads_(0), network_loads_(0), failed_(0), canceled_(0), bytes_(0), network_bytes_(0) {}
+
+            //! Number of assets in the log
+            uint logged_;
+
+            //! Number of assets that were in memory already
+            uint memory_hits_;
+
+            //! Number of assets loaded from the disk cache
+            uint disk_loads_;
+
+            //! Number of assets loaded from the asset providers
+            uint network_loads_;
+
+            //! Number of assets that could not be loaded
+            uint failed_;
+
+            //! Number of assets not prefetched because of cancel or the memory limit
+            uint canceled_;
+
+            //! Size of the assets loaded
+            qint64 bytes_;
+
+            //! Size of the assets loaded from the asset providers
+            qint64 network_bytes_;
+        };
+
+        //! Constructor
+        /*! \param framework Framework
+            \param manager Asset manager
+            \param path Directory of the region logs, created if needed
+         */
+        AssetPrefetcher(Foundation::Framework* framework, AssetManager* manager, const std::string& path);
+
+        //! Destructor. Saves the log of the current region.
+        ~AssetPrefetcher();
+
+        //! Enters a region. Saves the log of the previous region, and starts prefetching the assets logged for this one.
+        /*! \param region_id Region id
+         */
+        void EnterRegion(const std::string& region_id);
+
+        //! Leaves the current region. Saves its log and cancels prefetching.
+        void LeaveRegion();
+
+        //! Logs a request to the current region
+        void RecordRequest(const std::string& asset_id, const std::string& asset_type);
+
+        //! Cancels prefetching and the prefetch transfers. Reads already started are completed.
+        void Cancel();
+
+        //! Handles a completed disk cache read. The asset is null if reading failed.
+        void HandleDiskRead(const std::string& asset_id, Foundation::AssetPtr asset);
+
+        //! Checks started reads and transfers, and starts new ones within the limits
+        void Update(f64 frametime);
+
+        //! Returns current region id, empty if not in a region
+        const std::string& GetRegion() const { return region_id_; }
+
+        //! Returns number of assets waiting to be prefetched
+        uint GetQueuedCount() const { return queue_.size(); }
+
+        //! Returns number of reads and transfers in progress
+        uint GetPendingCount() const { return disk_pending_.size() + network_pending_.size(); }
+
+        //! Returns statistics since the region was entered
+        const Stats& GetStats() const { return stats_; }
+
+    private:
+        //! Logged asset
+        struct Entry
+        {
+            Entry() : misses_(0), disk_tried_(false) {}
+
+            std::string asset_id_;
+            std::string asset_type_;
+
+            //! Number of visits in a row the asset was not requested
+            uint misses_;
+
+            //! Whether reading from the disk cache failed already
+            bool disk_tried_;
+        };
+
+        //! Reads the log of a region
+        bool ReadLog(const std::string& region_id, std::vector<Entry>& entries);
+
+        //! Saves the log of the current region
+        bool SaveLog();
+
+        //! Returns path of the log of a region
+        QString GetLogPath(const std::string& region_id) const;
+
+        //! Counts a loaded asset to the statistics
+        void CountLoaded(Foundation::AssetPtr asset, bool network);
+
+        //! Framework
+        Foundation::Framework* framework_;
+
+        //! Asset manager
+        AssetManager* manager_;
+
+        //! Directory of the region logs
+        QString path_;
+
+        //! Whether prefetching and logging are enabled
+        bool enabled_;
+
+        //! Maximum number of assets in a log
+        uint max_assets_;
+
+        //! Maximum number of disk reads in progress
+        uint max_disk_reads_;
+
+        //! Maximum number of transfers in progress
+        uint max_transfers_;
+
+        //! Transfer bandwidth limit in bytes per second
+        f64 bandwidth_;
+
+        //! Bytes that may be transferred now, negative when over the limit
+        f64 bandwidth_budget_;
+
+        //! Current region, empty if none
+        std::string region_id_;
+
+        //! Log of the previous visits of the current region
+        std::vector<Entry> previous_log_;
+
+        //! Assets requested during this visit, in order
+        std::vector<Entry> log_;
+
+        //! Asset ids in the log of this visit
+        std::set<std::string> logged_ids_;
+
+        //! Assets waiting to be prefetched
+        std::deque<Entry> queue_;
+
+        //! Whether the assets of the current region are being prefetched
+        bool active_;
+
+        //! Assets being read from the disk cache, by asset id
+        std::map<std::string, std::string> disk_pending_;
+
+        //! Request tags of the assets being transferred, by asset id
+        std::map<std::string, request_tag_t> network_pending_;
+
+        //! Statistics
+        Stats stats_;
+    };
+}
+
+#endif
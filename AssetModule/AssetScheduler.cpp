@@ -0,0 +1,439 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "AssetScheduler.h"
+#include "AssetCache.h"
+#include "AssetModule.h"
+#include "AssetEvents.h"
+
+#include "Framework.h"
+#include "EventManager.h"
+#include "ConfigurationManager.h"
+
+namespace Asset
+{
+    const int DEFAULT_MAX_TRANSFERS_PER_PROVIDER = 32;
+    const int DEFAULT_MAX_TRANSFERS = 48;
+
+    AssetScheduler::AssetScheduler(Foundation::Framework* framework, AssetCache* cache, event_category_id_t event_category) :
+        framework_(framework),
+        cache_(cache),
+        event_category_(event_category),
+        counted_(0),
+        next_sequence_(0)
+    {
+        max_transfers_per_provider_ = std::max(framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "max_transfers_per_provider",
+            DEFAULT_MAX_TRANSFERS_PER_PROVIDER), 1);
+        max_transfers_ = std::max(framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "max_transfers", DEFAULT_MAX_TRANSFERS), 1);
+    }
+
+    AssetScheduler::~AssetScheduler()
+    {
+    }
+
+    void AssetScheduler::AddProvider(Foundation::AssetProviderPtr provider)
+    {
+        ProviderState state;
+        state.provider_ = provider;
+        state.active_ = 0;
+        providers_.push_back(state);
+    }
+
+    void AssetScheduler::RemoveProvider(Foundation::AssetProviderPtr provider)
+    {
+        ProviderList::iterator p = providers_.begin();
+        while(p != providers_.end() && p->provider_ != provider)
+            ++p;
+        if (p == providers_.end())
+            return;
+
+        ProviderList::iterator next = p;
+        ++next;
+
+        RequestMap::iterator i = requests_.begin();
+        while(i != requests_.end())
+        {
+            RequestMap::iterator current = i++;
+            ScheduledRequest& request = current->second;
+            if (request.provider_ != p)
+                continue;
+
+            if (request.active_)
+            {
+                Finish(current, false);
+                continue;
+            }
+
+            p->queue_.erase(request.queue_key_);
+            if (!QueueToProvider(current->first, request, next))
+            {
+                Events::AssetCanceled* event_data = new Events::AssetCanceled(current->first.first, current->first.second);
+                framework_->GetEventManager()->SendDelayedEvent(event_category_, Events::ASSET_CANCELED, Foundation::EventDataPtr(event_data));
+                Erase(current);
+            }
+        }
+
+        providers_.erase(p);
+    }
+
+    bool AssetScheduler::Request(const std::string& asset_id, const std::string& asset_type, request_tag_t tag, f32 priority,
+        int discard_level)
+    {
+        TagPriority tag_priority;
+        tag_priority.priority_ = priority;
+        tag_priority.discard_level_ = discard_level;
+
+        RequestKey key(asset_id, asset_type);
+        RequestMap::iterator i = requests_.find(key);
+        if (i != requests_.end())
+        {
+            ScheduledRequest& request = i->second;
+            request.tags_[tag] = tag_priority;
+            tags_[tag] = key;
+            ++stats_[request.provider_->provider_->Name()].coalesced_;
+
+            if (request.active_)
+            {
+                // Let the provider send the ready event to this tag too
+                request.canceled_ = false;
+                Foundation::AssetProviderPtr provider = request.provider_->provider_;
+                provider->RequestAsset(asset_id, asset_type, tag);
+                provider->SetTransferPriority(asset_id, GetPriority(request), GetDiscardLevel(request));
+                UpdateCounted(request);
+            }
+            else
+                Reprioritize(key, request);
+            return true;
+        }
+
+        ScheduledRequest request;
+        request.tags_[tag] = tag_priority;
+        request.queue_key_.priority_ = priority;
+        request.queue_key_.sequence_ = next_sequence_++;
+        request.active_ = false;
+        request.counted_ = false;
+        request.canceled_ = false;
+        request.queued_time_ = Core::GetCurrentClockTime();
+        request.start_time_ = 0;
+        if (!QueueToProvider(key, request, providers_.begin()))
+            return false;
+
+        requests_[key] = request;
+        tags_[tag] = key;
+
+        // Providers that answer right away are not waited for, callers expect the asset in the cache on return
+        if (request.provider_->provider_->IsSynchronous())
+            return Start(requests_.find(key));
+        return true;
+    }
+
+    bool AssetScheduler::SetPriority(request_tag_t tag, f32 priority, int discard_level)
+    {
+        std::map<request_tag_t, RequestKey>::iterator t = tags_.find(tag);
+        if (t == tags_.end())
+            return false;
+
+        ScheduledRequest& request = requests_[t->second];
+        TagPriority& tag_priority = request.tags_[tag];
+        if (tag_priority.priority_ == priority && tag_priority.discard_level_ == discard_level)
+            return true;
+
+        tag_priority.priority_ = priority;
+        tag_priority.discard_level_ = discard_level;
+        if (request.active_)
+        {
+            request.provider_->provider_->SetTransferPriority(t->second.first, GetPriority(request), GetDiscardLevel(request));
+            UpdateCounted(request);
+        }
+        else
+            Reprioritize(t->second, request);
+        return true;
+    }
+
+    bool AssetScheduler::Cancel(request_tag_t tag)
+    {
+        std::map<request_tag_t, RequestKey>::iterator t = tags_.find(tag);
+        if (t == tags_.end())
+            return false;
+
+        RequestKey key = t->second;
+        tags_.erase(t);
+        RequestMap::iterator i = requests_.find(key);
+        ScheduledRequest& request = i->second;
+        request.tags_.erase(tag);
+        if (!request.tags_.empty())
+        {
+            if (request.active_)
+            {
+                request.provider_->provider_->SetTransferPriority(key.first, GetPriority(request), GetDiscardLevel(request));
+                UpdateCounted(request);
+            }
+            else
+                Reprioritize(key, request);
+            return true;
+        }
+
+        // Nobody is interested anymore
+        Stats& stats = stats_[request.provider_->provider_->Name()];
+        if (!request.active_)
+        {
+            ++stats.canceled_;
+            Erase(i);
+        }
+        else if (request.provider_->provider_->CancelTransfer(key.first))
+        {
+            ++stats.canceled_;
+            request.active_ = false;
+            UpdateCounted(request);
+            active_.erase(key);
+            Erase(i);
+        }
+        else
+            request.canceled_ = true;
+        return true;
+    }
+
+    bool AssetScheduler::IsScheduled(const std::string& asset_id) const
+    {
+        RequestMap::const_iterator i = requests_.lower_bound(RequestKey(asset_id, std::string()));
+        return i != requests_.end() && i->first.first == asset_id;
+    }
+
+    bool AssetScheduler::IsQueued(const std::string& asset_id) const
+    {
+        RequestMap::const_iterator i = requests_.lower_bound(RequestKey(asset_id, std::string()));
+        for(; i != requests_.end() && i->first.first == asset_id; ++i)
+            if (!i->second.active_)
+                return true;
+        return false;
+    }
+
+    void AssetScheduler::HandleStored(Foundation::AssetPtr asset)
+    {
+        RequestMap::iterator i = requests_.find(RequestKey(asset->GetId(), asset->GetType()));
+        if (i != requests_.end() && i->second.active_)
+            Finish(i, true);
+    }
+
+    void AssetScheduler::Update()
+    {
+        // Transfers no longer in progress have completed if the asset is in memory, failed otherwise
+        std::set<RequestKey>::iterator a = active_.begin();
+        while(a != active_.end())
+        {
+            RequestKey key = *a;
+            ++a;
+
+            RequestMap::iterator i = requests_.find(key);
+            if (!i->second.provider_->provider_->InProgress(key.first))
+                Finish(i, cache_->GetAsset(key.first, true, false).get() != 0);
+        }
+
+        // Start the highest priority request of the providers that have room
+        while(counted_ < max_transfers_)
+        {
+            ProviderList::iterator best = providers_.end();
+            for(ProviderList::iterator p = providers_.begin(); p != providers_.end(); ++p)
+            {
+                if (p->queue_.empty() || p->active_ >= max_transfers_per_provider_)
+                    continue;
+                if (best == providers_.end() || p->queue_.begin()->first < best->queue_.begin()->first)
+                    best = p;
+            }
+            if (best == providers_.end())
+                break;
+
+            RequestKey key = best->queue_.begin()->second;
+            best->queue_.erase(best->queue_.begin());
+            Start(requests_.find(key));
+        }
+    }
+
+    f32 AssetScheduler::GetPriority(const ScheduledRequest& request)
+    {
+        TagPriorityMap::const_iterator t = request.tags_.begin();
+        f32 priority = t->second.priority_;
+        for(++t; t != request.tags_.end(); ++t)
+            priority = std::max(priority, t->second.priority_);
+        return priority;
+    }
+
+    int AssetScheduler::GetDiscardLevel(const ScheduledRequest& request)
+    {
+        TagPriorityMap::const_iterator t = request.tags_.begin();
+        int discard_level = t->second.discard_level_;
+        for(++t; t != request.tags_.end(); ++t)
+            discard_level = std::min(discard_level, t->second.discard_level_);
+        return discard_level;
+    }
+
+    void AssetScheduler::UpdateCounted(ScheduledRequest& request)
+    {
+        bool counted = request.active_;
+        if (counted == request.counted_)
+            return;
+
+        request.counted_ = counted;
+        if (counted)
+        {
+            ++request.provider_->active_;
+            ++counted_;
+        }
+        else
+        {
+            --request.provider_->active_;
+            --counted_;
+        }
+    }
+
+    void AssetScheduler::Reprioritize(const RequestKey& key, ScheduledRequest& request)
+    {
+        f32 priority = GetPriority(request);
+        if (priority == request.queue_key_.priority_)
+            return;
+
+        request.provider_->queue_.erase(request.queue_key_);
+        request.queue_key_.priority_ = priority;
+        request.provider_->queue_[request.queue_key_] = key;
+    }
+
+    bool AssetScheduler::QueueToProvider(const RequestKey& key, ScheduledRequest& request, ProviderList::iterator from)
+    {
+        for(ProviderList::iterator p = from; p != providers_.end(); ++p)
+        {
+            if (p->provider_->IsValidId(key.first, key.second))
+            {
+                request.provider_ = p;
+                p->queue_[request.queue_key_] = key;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool AssetScheduler::Start(RequestMap::iterator i)
+    {
+        RequestKey key = i->first;
+        ScheduledRequest& request = i->second;
+        ProviderList::iterator provider = request.provider_;
+        Stats& stats = stats_[provider->provider_->Name()];
+        double wait = GetElapsed(request.queued_time_);
+
+        // The asset may have arrived with a request of another type, or been stored by someone else
+        Foundation::AssetPtr asset = cache_->GetAsset(key.first, true, false, key.second);
+        if (asset)
+        {
+            TagPriorityMap::const_iterator t = request.tags_.begin();
+            for(; t != request.tags_.end(); ++t)
+            {
+                Events::AssetReady* event_data = new Events::AssetReady(asset->GetId(), asset->GetType(), asset, t->first);
+                framework_->GetEventManager()->SendDelayedEvent(event_category_, Events::ASSET_READY, Foundation::EventDataPtr(event_data));
+            }
+            stats.coalesced_ += request.tags_.size();
+            Erase(i);
+            return true;
+        }
+
+        RequestTagVector tags;
+        for(TagPriorityMap::const_iterator t = request.tags_.begin(); t != request.tags_.end(); ++t)
+            tags.push_back(t->first);
+        f32 priority = GetPriority(request);
+        int discard_level = GetDiscardLevel(request);
+
+        request.active_ = true;
+        request.start_time_ = Core::GetCurrentClockTime();
+        active_.insert(key);
+        UpdateCounted(request);
+
+        // Providers that complete right away store the asset, and so finish the request, within RequestAsset().
+        // The provider then sends the ready event only to the tags passed to it so far; answer the rest from the cache
+        bool accepted = false;
+        bool finished = false;
+        for(uint n = 0; n < tags.size(); ++n)
+        {
+            if (provider->provider_->RequestAsset(key.first, key.second, tags[n]))
+                accepted = true;
+            else if (!accepted)
+                break;
+            if (requests_.find(key) == requests_.end())
+            {
+                finished = true;
+                asset = cache_->GetAsset(key.first, true, false, key.second);
+                for(++n; asset && n < tags.size(); ++n)
+                {
+                    Events::AssetReady* event_data = new Events::AssetReady(asset->GetId(), asset->GetType(), asset, tags[n]);
+                    framework_->GetEventManager()->SendDelayedEvent(event_category_, Events::ASSET_READY, Foundation::EventDataPtr(event_data));
+                }
+                break;
+            }
+        }
+
+        if (accepted)
+        {
+            if (!finished)
+                provider->provider_->SetTransferPriority(key.first, priority, discard_level);
+            ++stats.started_;
+            stats.wait_time_ += wait;
+            stats.max_wait_time_ = std::max(stats.max_wait_time_, wait);
+            return true;
+        }
+
+        i = requests_.find(key);
+        if (i == requests_.end())
+            return true;
+
+        // Rejected, fall back to the next provider
+        i->second.active_ = false;
+        UpdateCounted(i->second);
+        active_.erase(key);
+        ++provider;
+        if (QueueToProvider(key, i->second, provider))
+            return true;
+
+        AssetModule::LogInfo("No asset provider would accept request for asset " + key.first);
+        ++stats.failed_;
+        Events::AssetCanceled* event_data = new Events::AssetCanceled(key.first, key.second);
+        framework_->GetEventManager()->SendDelayedEvent(event_category_, Events::ASSET_CANCELED, Foundation::EventDataPtr(event_data));
+        Erase(i);
+        return false;
+    }
+
+    void AssetScheduler::Finish(RequestMap::iterator i, bool success)
+    {
+        ScheduledRequest& request = i->second;
+        Stats& stats = stats_[request.provider_->provider_->Name()];
+        if (request.canceled_)
+            ++stats.canceled_;
+        else if (success)
+        {
+            double time = GetElapsed(request.start_time_);
+            ++stats.completed_;
+            stats.transfer_time_ += time;
+            stats.max_transfer_time_ = std::max(stats.max_transfer_time_, time);
+        }
+        else
+            ++stats.failed_;
+
+        request.active_ = false;
+        UpdateCounted(request);
+        active_.erase(i->first);
+        Erase(i);
+    }
+
+    void AssetScheduler::Erase(RequestMap::iterator i)
+    {
+        ScheduledRequest& request = i->second;
+        if (!request.active_)
+            request.provider_->queue_.erase(request.queue_key_);
+
+        for(TagPriorityMap::const_iterator t = request.tags_.begin(); t != request.tags_.end(); ++t)
+            tags_.erase(t->first);
+        requests_.erase(i);
+    }
+
+    double AssetScheduler::GetElapsed(Core::tick_t since)
+    {
+        return (double)(Core::GetCurrentClockTime() - since) / Core::GetCurrentClockFreq();
+    }
+}
@@ -0,0 +1,276 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Asset_AssetScheduler_h
+#define incl_Asset_AssetScheduler_h
+
+#include "AssetInterface.h"
+#include "AssetProviderInterface.h"
+#include "HighPerfClock.h"
+
+#include <list>
+#include <set>
+
+namespace Foundation
+{
+    class Framework;
+}
+
+namespace Asset
+{
+    class AssetCache;
+
+    //! Schedules asset requests to the asset providers. Created and used by AssetManager.
+    /*! Requests that were not found in the caches are queued by asset id and type, so a request of an asset that is
+        queued or being transferred already only adds its tag. Each request is queued to the first provider that
+        considers the id valid, and falls back to the next one if that provider rejects it.
+
+        Queued requests are started highest priority first, and in request order within a priority. The priority of
+        a request is the highest priority of its tags, and its discard level the lowest discard level of its tags.
+        Both can be changed with SetPriority(); once the request has started, the change is passed to the provider.
+        At most AssetSystem/max_transfers_per_provider transfers per provider, and AssetSystem/max_transfers in
+        total, are in progress at a time. Transfers of a reduced discard level count towards the limits too, even
+        though the server stops sending once the requested level has been sent, so that they cannot flood the
+        providers. Requests whose asset has meanwhile arrived in the memory cache are answered from there when their
+        turn comes.
+
+        When all tags of a request are canceled, the request is removed from the queue, or its transfer is canceled
+        if the provider supports that. A transfer completes when the provider stores the asset, and fails when the
+        provider no longer has it in progress without having stored it.
+
+        Time spent queued and time spent transferring are collected per provider.
+     */
+    class AssetScheduler
+    {
+    public:
+        //! Statistics of a provider
+        struct Stats
+        {
+            Stats() : started_(0), completed_(0), failed_(0), canceled_(0), coalesced_(0), wait_time_(0.0), max_wait_time_(0.0),
+                transfer_time_(0.0), max_transfer_time_(0.0) {}
+
+            //! Number of transfers started
+            uint started_;
+
+            //! Number of transfers completed
+            uint completed_;
+
+            //! Number of transfers failed
+            uint failed_;
+
+            //! Number of requests canceled
+            uint canceled_;
+
+            //! Number of requests that joined a queued or ongoing request of the same asset, or were answered from memory
+            uint coalesced_;
+
+            //! Total time requests were queued before started, in seconds
+            double wait_time_;
+
+            //! Longest time a request was queued, in seconds
+            double max_wait_time_;
+
+            //! Total time of completed transfers, in seconds
+            double transfer_time_;
+
+            //! Longest time of a completed transfer, in seconds
+            double max_transfer_time_;
+        };
+
+        //! Statistics by provider name
+        typedef std::map<std::string, Stats> StatsMap;
+
+        //! Constructor
+        /*! \param framework Framework
+            \param cache Asset cache, checked before starting a transfer
+            \param event_category Asset event category
+         */
+        AssetScheduler(Foundation::Framework* framework, AssetCache* cache, event_category_id_t event_category);
+
+        //! Destructor
+        ~AssetScheduler();
+
+        //! Adds a provider. Providers are tried in the order added.
+        void AddProvider(Foundation::AssetProviderPtr provider);
+
+        //! Removes a provider. Its queued requests fall back to the next provider, its transfers are forgotten.
+        void RemoveProvider(Foundation::AssetProviderPtr provider);
+
+        //! Queues an asset request
+        /*! \param asset_id Asset ID
+            \param asset_type Asset type
+            \param tag Request tag
+            \param priority Priority, higher is started first
+            \param discard_level Texture resolution levels not needed, 0 for the whole asset
+            \return true if queued, false if no provider considers the id valid
+         */
+        bool Request(const std::string& asset_id, const std::string& asset_type, request_tag_t tag, f32 priority, int discard_level);
+
+        //! Changes priority and discard level of a request. Returns false if the tag is not known.
+        bool SetPriority(request_tag_t tag, f32 priority, int discard_level);
+
+        //! Cancels a request. Returns false if the tag is not known.
+        bool Cancel(request_tag_t tag);
+
+        //! Returns true if a request of an asset is queued or in progress
+        bool IsScheduled(const std::string& asset_id) const;
+
+        //! Returns true if a request of an asset is queued and not yet started
+        bool IsQueued(const std::string& asset_id) const;
+
+        //! Handles an asset stored to the cache, completing its transfer
+        void HandleStored(Foundation::AssetPtr asset);
+
+        //! Checks transfers in progress, and starts queued requests
+        void Update();
+
+        //! Returns number of requests queued
+        uint GetQueuedCount() const { return requests_.size() - active_.size(); }
+
+        //! Returns number of transfers in progress
+        uint GetActiveCount() const { return active_.size(); }
+
+        //! Returns statistics by provider name
+        const StatsMap& GetStats() const { return stats_; }
+
+    private:
+        //! Asset id and type
+        typedef std::pair<std::string, std::string> RequestKey;
+
+        //! Order in the queue: priority, highest first, then request order
+        struct QueueKey
+        {
+            f32 priority_;
+            uint sequence_;
+
+            bool operator <(const QueueKey& rhs) const
+            {
+                if (priority_ != rhs.priority_)
+                    return priority_ > rhs.priority_;
+                return sequence_ < rhs.sequence_;
+            }
+        };
+
+        //! Queued requests in order
+        typedef std::map<QueueKey, RequestKey> Queue;
+
+        //! Registered provider
+        struct ProviderState
+        {
+            Foundation::AssetProviderPtr provider_;
+
+            //! Queued requests
+            Queue queue_;
+
+            //! Number of transfers in progress that count towards the limits
+            uint active_;
+        };
+
+        typedef std::list<ProviderState> ProviderList;
+
+        //! Priority and discard level of a tag
+        struct TagPriority
+        {
+            f32 priority_;
+            int discard_level_;
+        };
+
+        typedef std::map<request_tag_t, TagPriority> TagPriorityMap;
+
+        //! Request of an asset, coalescing all requests of the same id and type
+        struct ScheduledRequest
+        {
+            //! Priorities by tag
+            TagPriorityMap tags_;
+
+            //! Position in the queue of the provider
+            QueueKey queue_key_;
+
+            //! Provider the request is queued to or transferred by
+            ProviderList::iterator provider_;
+
+            //! Whether the transfer is in progress
+            bool active_;
+
+            //! Whether the transfer counts towards the transfer limits
+            bool counted_;
+
+            //! Whether all tags were canceled while in progress, and the provider could not cancel the transfer
+            bool canceled_;
+
+            //! Time queued
+            Core::tick_t queued_time_;
+
+            //! Time started
+            Core::tick_t start_time_;
+        };
+
+        typedef std::map<RequestKey, ScheduledRequest> RequestMap;
+
+        //! Returns highest priority of the tags of a request
+        static f32 GetPriority(const ScheduledRequest& request);
+
+        //! Returns lowest discard level of the tags of a request
+        static int GetDiscardLevel(const ScheduledRequest& request);
+
+        //! Counts a request towards the transfer limits, or stops counting it, according to its state
+        void UpdateCounted(ScheduledRequest& request);
+
+        //! Moves a queued request to its place in the queue after its priority may have changed
+        void Reprioritize(const RequestKey& key, ScheduledRequest& request);
+
+        //! Queues a request to the first provider from the given one that considers the id valid. Returns false if none.
+        bool QueueToProvider(const RequestKey& key, ScheduledRequest& request, ProviderList::iterator from);
+
+        //! Starts a queued request. Returns false if no provider accepted it, in which case it is removed.
+        bool Start(RequestMap::iterator i);
+
+        //! Removes a request in progress
+        /*! \param success Whether the asset was received
+         */
+        void Finish(RequestMap::iterator i, bool success);
+
+        //! Removes a request and its tags
+        void Erase(RequestMap::iterator i);
+
+        //! Returns seconds since a time
+        static double GetElapsed(Core::tick_t since);
+
+        //! Framework
+        Foundation::Framework* framework_;
+
+        //! Asset cache
+        AssetCache* cache_;
+
+        //! Asset event category
+        event_category_id_t event_category_;
+
+        //! Maximum number of transfers in progress per provider
+        uint max_transfers_per_provider_;
+
+        //! Maximum number of transfers in progress in total
+        uint max_transfers_;
+
+        //! Number of transfers counted towards the limits
+        uint counted_;
+
+        //! Providers in order of registration
+        ProviderList providers_;
+
+        //! Requests by asset id and type
+        RequestMap requests_;
+
+        //! Requests in progress
+        std::set<RequestKey> active_;
+
+        //! Request of each tag
+        std::map<request_tag_t, RequestKey> tags_;
+
+        //! Sequence number of the next request
+        uint next_sequence_;
+
+        //! Statistics by provider name
+        StatsMap stats_;
+    };
+}
+
+#endif
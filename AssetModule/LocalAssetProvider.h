@@ -43,6 +43,9 @@ namespace Asset
          */
         virtual bool RequestAsset(const std::string& asset_id, const std::string& asset_type, request_tag_t tag);
         
+        //! Returns true, as files are read within RequestAsset()
+        virtual bool IsSynchronous() { return true; }
+        
         //! Returns whether a certain asset is already being "downloaded". Returns always false.
         virtual bool InProgress(const std::string& asset_id);
         
@@ -18,27 +18,42 @@
 #include <QDebug>
 #include <QStringList>
 
-#define MAX_HTTP_CONNECTIONS 10000 // Basically means no limit to parallel connections
-
 namespace Asset
 {
+    //! Default maximum number of requests in progress per host. The network access manager opens at most this many
+    //! connections per host, and queues further requests where their priority does not apply
+    const int DEFAULT_HTTP_CONNECTIONS_PER_HOST = 6;
+
+    //! Smallest byte range requested, so that ranged textures are not fetched in tiny pieces
+    const uint MIN_RANGE_SIZE = 4096;
+
+    //! Texture dimensions assumed before the JPEG2000 header has been received
+    const uint DEFAULT_TEXTURE_SIZE = 512;
+    const uint DEFAULT_TEXTURE_COMPONENTS = 4;
+
+    //! Estimated JPEG2000 codestream bytes per pixel and component, as the texture decoder estimates it
+    const float J2K_BYTES_PER_SAMPLE = 0.15f;
+
     QtHttpAssetProvider::QtHttpAssetProvider(Foundation::Framework *framework) :
         QObject(),
         framework_(framework),
         event_manager_(framework->GetEventManager().get()),
         name_("QtHttpAssetProvider"),
         network_manager_(new QNetworkAccessManager()),
-        filling_stack_(false),
+        next_sequence_(0),
         get_texture_cap_(QUrl())
     {
         if (event_manager_)
             asset_event_category_ = event_manager_->QueryEventCategory("Asset");
+        max_connections_per_host_ = std::max(framework_->GetDefaultConfig().DeclareSetting("AssetSystem", "http_connections_per_host",
+            DEFAULT_HTTP_CONNECTIONS_PER_HOST), 1);
         connect(network_manager_, SIGNAL(finished(QNetworkReply*)), SLOT(TranferCompleted(QNetworkReply*)));
         AssetModule::LogInfo("HttpAssetProvider initialized");
     }
 
     QtHttpAssetProvider::~QtHttpAssetProvider()
     {
+        ClearAllTransfers();
         SAFE_DELETE(network_manager_);
     }
 
@@ -95,10 +110,11 @@ namespace Asset
             QtHttpAssetTransfer *transfer = 0;
             if (IsAcceptableAssetType(asset_type) && RexUUID::IsValid(asset_id) && get_texture_cap_.isValid())
             {
-                // Http texture/meshes via cap url
+                // Http texture/meshes via cap url. Textures are fetched in ranges as their discard level allows
                 QString texture_url_string = get_texture_cap_.toString() + "?texture_id=" + asset_id_qstring;
                 QUrl texture_url(texture_url_string);
                 transfer = new QtHttpAssetTransfer(texture_url, asset_id_qstring, asset_type_int, tag);
+                transfer->SetRanged(asset_type_int == RexTypes::RexAT_Texture);
             }
             else
             {
@@ -110,45 +126,81 @@ namespace Asset
             if (!transfer)
                 return false;
 
+            // Started on the next update, once the priority is known
             transfer->setOriginatingObject(transfer);
-            if (assetid_to_transfer_map_.count() <= MAX_HTTP_CONNECTIONS)
-            {
-                assetid_to_transfer_map_[asset_id_qstring] = transfer;
-                network_manager_->get(*transfer);
-                AssetModule::LogDebug("New HTTP asset request: " + asset_id + " type: " + asset_type);
-            }
-            else
-                pending_request_queue_.append(transfer);
+            transfer->SetSequence(next_sequence_++);
+            assetid_to_transfer_map_[asset_id_qstring] = transfer;
+            QueueTransfer(transfer);
+            AssetModule::LogDebug("New HTTP asset request: " + asset_id + " type: " + asset_type);
         }
         return true;
     }
 
     bool QtHttpAssetProvider::InProgress(const std::string& asset_id)
+    {
+        return assetid_to_transfer_map_.contains(QString::fromStdString(asset_id));
+    }
+
+    bool QtHttpAssetProvider::CancelTransfer(const std::string& asset_id)
     {
         QString qt_asset_id = QString::fromStdString(asset_id);
-        if (assetid_to_transfer_map_.contains(qt_asset_id) || CheckRequestQueue(qt_asset_id))
-            return true;
-        else
+        if (!assetid_to_transfer_map_.contains(qt_asset_id))
             return false;
+
+        // The aborted reply is no longer known when it finishes, so no events are sent for it
+        QtHttpAssetTransfer *transfer = assetid_to_transfer_map_[qt_asset_id];
+        QNetworkReply *reply = transfer->GetReply();
+        ReleaseReply(transfer);
+        if (reply)
+            reply->abort();
+
+        RemoveFinishedTransfers(qt_asset_id, QUrl());
+        return true;
+    }
+
+    void QtHttpAssetProvider::SetTransferPriority(const std::string& asset_id, f32 priority, int discard_level)
+    {
+        QString qt_asset_id = QString::fromStdString(asset_id);
+        if (!assetid_to_transfer_map_.contains(qt_asset_id))
+            return;
+
+        QtHttpAssetTransfer *transfer = assetid_to_transfer_map_[qt_asset_id];
+        if (transfer->GetPriority() == priority && transfer->GetDiscardLevel() == discard_level)
+            return;
+
+        bool queued = pending_request_queue_.removeOne(transfer);
+        transfer->SetPriority(priority, discard_level);
+
+        // A transfer that has received what it needed continues when the discard level is lowered
+        if (queued || (!transfer->GetReply() && NeedsMoreData(transfer)))
+            QueueTransfer(transfer);
     }
 
     bool QtHttpAssetProvider::QueryAssetStatus(const std::string& asset_id, uint& size, uint& received, uint& received_continuous)
     {
-        if (InProgress(asset_id))
-        {
-            // We dont know, QNetworkAccessManager handles these
-            size = 0;
-            received = 0;
-            received_continuous = 0;
-            return true;
-        }
-        else
+        QString qt_asset_id = QString::fromStdString(asset_id);
+        if (!assetid_to_transfer_map_.contains(qt_asset_id))
             return false;
+
+        // Data is received in order, so all of it is continuous
+        QtHttpAssetTransfer *transfer = assetid_to_transfer_map_[qt_asset_id];
+        size = transfer->GetSize();
+        received = transfer->GetReceived();
+        received_continuous = received;
+        return true;
     }
 
     Foundation::AssetPtr QtHttpAssetProvider::GetIncompleteAsset(const std::string& asset_id, const std::string& asset_type, uint received)       
     {
-        return Foundation::AssetPtr();
+        QString qt_asset_id = QString::fromStdString(asset_id);
+        if (!assetid_to_transfer_map_.contains(qt_asset_id))
+            return Foundation::AssetPtr();
+
+        QtHttpAssetTransfer *transfer = assetid_to_transfer_map_[qt_asset_id];
+        if (!transfer->GetReceived() || transfer->GetReceived() < received)
+            return Foundation::AssetPtr();
+
+        return CreateAsset(transfer);
     }
 
     Foundation::AssetTransferInfoVector QtHttpAssetProvider::GetTransferInfo()
@@ -156,16 +208,14 @@ namespace Asset
         Foundation::AssetTransferInfoVector info_vector;
         foreach (QtHttpAssetTransfer *transfer, assetid_to_transfer_map_.values())
         {
-            HttpAssetTransferInfo iter_info = transfer->GetTranferInfo();
-            // What we know
+            HttpAssetTransferInfo &iter_info = transfer->GetTranferInfo();
             Foundation::AssetTransferInfo info;
             info.id_ = iter_info.id.toStdString();
             info.type_ = RexTypes::GetAssetTypeString(iter_info.type);
             info.provider_ = Name();
-            // The following we dont know, QNetworkAccessManager handles these
-            info.size_ = 0;
-            info.received_ = 0;
-            info.received_continuous_ = 0;
+            info.size_ = transfer->GetSize();
+            info.received_ = transfer->GetReceived();
+            info.received_continuous_ = transfer->GetReceived();
             info_vector.push_back(info);
         }
         return info_vector;
@@ -183,10 +233,21 @@ namespace Asset
     void QtHttpAssetProvider::TranferCompleted(QNetworkReply *reply)
     {
         fake_metadata_fetch_ = false;
-        QtHttpAssetTransfer *transfer = dynamic_cast<QtHttpAssetTransfer*>(reply->request().originatingObject());
+        QtHttpAssetTransfer *transfer = reply_to_transfer_map_.value(reply, 0);
+        if (!transfer)
+        {
+            // Canceled
+            reply->deleteLater();
+            return;
+        }
+
+        bool reply_ok = (reply->error() == QNetworkReply::NoError) && ReadReplyData(transfer);
+        ReleaseReply(transfer);
+        if (reply_ok)
+            transfer->EndReply();
 
         /**** THIS IS A DATA REQUEST REPLY AND IT FAILED ****/
-        if (reply->error() != QNetworkReply::NoError && transfer)
+        if (!reply_ok)
         {
             // Send asset canceled events
             HttpAssetTransferInfo error_transfer_data = transfer->GetTranferInfo();
@@ -203,78 +264,78 @@ namespace Asset
             return;
         }
 
-        /**** THIS IS A /data REQUEST REPLY ****/
-        if (transfer)
+        /**** THIS IS A RANGE REQUEST REPLY, AND THE REST OF THE ASSET IS NOT NEEDED YET ****/
+        if (!transfer->IsComplete())
         {
-            // Create asset pointer
-            HttpAssetTransferInfo tranfer_info = transfer->GetTranferInfo();
-            std::string id = tranfer_info.id.toStdString();
-            std::string type = RexTypes::GetTypeNameFromAssetType(tranfer_info.type);
-            Foundation::AssetPtr asset_ptr = Foundation::AssetPtr(new RexAsset(id, type));
-
-            // Fill asset data with reply data
-            RexAsset::AssetDataVector& data_vector = checked_static_cast<RexAsset*>(asset_ptr.get())->GetDataInternal();
-            QByteArray data_array = reply->readAll();
-            for (int index = 0; index < data_array.count(); ++index)
-                data_vector.push_back(data_array.at(index));
-
-            // Get metadata if available
-            QString url_path = tranfer_info.url.path();
-            if (url_path.endsWith("/data") || url_path.endsWith("/data/"))
-            {
-                // Generate metada url
-                int clip_count;
-                if (url_path.endsWith("/data"))
-                    clip_count = 5;
-                else if (url_path.endsWith("/data/"))
-                    clip_count = 6;
-                else
-                {
-                    reply->deleteLater();
-                    return;
-                }
+            // Continue right away if the discard level was lowered meanwhile, otherwise wait until it is
+            if (NeedsMoreData(transfer))
+                QueueTransfer(transfer);
+            StartTransferFromQueue();
+            reply->deleteLater();
+            return;
+        }
 
-                QUrl metadata_url = tranfer_info.url;
-                url_path = url_path.left(url_path.count()-clip_count);
-                url_path = url_path + "/metadata";
-                metadata_url.setPath(url_path);
-                tranfer_info.url = metadata_url;
-
-                QNetworkRequest *metada_request = new QNetworkRequest(metadata_url);
-
-                // Store tranfer data and asset data pointer internally
-                QPair<HttpAssetTransferInfo, Foundation::AssetPtr> data_pair;
-                data_pair.first = tranfer_info;
-                data_pair.second = asset_ptr;
-                metadata_to_assetptr_[metada_request->url()] = data_pair;
-                
-                // Send metadata network request
-                //network_manager_->get(*metada_request);
-                
-                // HACK to avoid metadata fetch for now, we dont use it to anything yet
-                fake_metadata_url_ = metada_request->url();
-                fake_metadata_fetch_ = true;
-            }
-            // Asset data feched, lets store
+        /**** THIS IS A /data REQUEST REPLY ****/
+        // Create asset pointer, sharing the received data
+        HttpAssetTransferInfo tranfer_info = transfer->GetTranferInfo();
+        Foundation::AssetPtr asset_ptr = CreateAsset(transfer);
+
+        // Get metadata if available
+        QString url_path = tranfer_info.url.path();
+        if (url_path.endsWith("/data") || url_path.endsWith("/data/"))
+        {
+            // Generate metada url
+            int clip_count;
+            if (url_path.endsWith("/data"))
+                clip_count = 5;
+            else if (url_path.endsWith("/data/"))
+                clip_count = 6;
             else
             {
-                AssetModule::LogDebug("HTTP asset " + tranfer_info.id.toStdString() + " completed");
+                reply->deleteLater();
+                return;
+            }
 
-                // Store asset, but don't store textures, they have their own cache action after decoding
-                boost::shared_ptr<Foundation::AssetServiceInterface> asset_service = framework_->GetServiceManager()->GetService<Foundation::AssetServiceInterface>(Foundation::Service::ST_Asset).lock();
-                if (asset_service) 
-                    asset_service->StoreAsset(asset_ptr);
+            QUrl metadata_url = tranfer_info.url;
+            url_path = url_path.left(url_path.count()-clip_count);
+            url_path = url_path + "/metadata";
+            metadata_url.setPath(url_path);
+            tranfer_info.url = metadata_url;
+
+            QNetworkRequest *metada_request = new QNetworkRequest(metadata_url);
+
+            // Store tranfer data and asset data pointer internally
+            QPair<HttpAssetTransferInfo, Foundation::AssetPtr> data_pair;
+            data_pair.first = tranfer_info;
+            data_pair.second = asset_ptr;
+            metadata_to_assetptr_[metada_request->url()] = data_pair;
+            
+            // Send metadata network request
+            //network_manager_->get(*metada_request);
+            
+            // HACK to avoid metadata fetch for now, we dont use it to anything yet
+            fake_metadata_url_ = metada_request->url();
+            fake_metadata_fetch_ = true;
+        }
+        // Asset data feched, lets store
+        else
+        {
+            AssetModule::LogDebug("HTTP asset " + tranfer_info.id.toStdString() + " completed");
 
-                // Send asset ready events
-                foreach (request_tag_t tag, tranfer_info.tags)
-                {
-                    Events::AssetReady event_data(asset_ptr.get()->GetId(), asset_ptr.get()->GetType(), asset_ptr, tag);
-                    event_manager_->SendEvent(asset_event_category_, Events::ASSET_READY, &event_data);
-                }
+            // Store asset, but don't store textures, they have their own cache action after decoding
+            boost::shared_ptr<Foundation::AssetServiceInterface> asset_service = framework_->GetServiceManager()->GetService<Foundation::AssetServiceInterface>(Foundation::Service::ST_Asset).lock();
+            if (asset_service) 
+                asset_service->StoreAsset(asset_ptr);
 
-                RemoveFinishedTransfers(tranfer_info.id, QUrl());
-                StartTransferFromQueue();
+            // Send asset ready events
+            foreach (request_tag_t tag, tranfer_info.tags)
+            {
+                Events::AssetReady event_data(asset_ptr.get()->GetId(), asset_ptr.get()->GetType(), asset_ptr, tag);
+                event_manager_->SendEvent(asset_event_category_, Events::ASSET_READY, &event_data);
             }
+
+            RemoveFinishedTransfers(tranfer_info.id, QUrl());
+            StartTransferFromQueue();
         }
 
         // Complete /data and /metadata sequence, fake is here as long as we dont have xml parser for metadata
@@ -329,10 +390,23 @@ namespace Asset
         reply->deleteLater();
     }
 
+    void QtHttpAssetProvider::ReplyDataReceived()
+    {
+        QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+        QtHttpAssetTransfer *transfer = reply_to_transfer_map_.value(reply, 0);
+        if (!transfer)
+            return;
+
+        // The reply finishes with an error once aborted
+        if (!ReadReplyData(transfer))
+            reply->abort();
+    }
+
     void QtHttpAssetProvider::RemoveFinishedTransfers(QString asset_transfer_key, QUrl metadata_transfer_key)
     {
         QtHttpAssetTransfer *remove_transfer = assetid_to_transfer_map_[asset_transfer_key];
         assetid_to_transfer_map_.remove(asset_transfer_key);
+        pending_request_queue_.removeOne(remove_transfer);
         if (metadata_transfer_key.isValid())
             metadata_to_assetptr_.remove(metadata_transfer_key);
         SAFE_DELETE(remove_transfer);
@@ -341,48 +415,140 @@ namespace Asset
     void QtHttpAssetProvider::ClearAllTransfers()
     {
         foreach (QtHttpAssetTransfer *transfer, assetid_to_transfer_map_.values())
+        {
+            QNetworkReply *reply = transfer->GetReply();
+            ReleaseReply(transfer);
+            if (reply)
+                reply->abort();
             SAFE_DELETE(transfer);
+        }
         assetid_to_transfer_map_.clear();
-
-        foreach (QtHttpAssetTransfer *transfer, pending_request_queue_)
-            SAFE_DELETE(transfer);
         pending_request_queue_.clear();
+        metadata_to_assetptr_.clear();
     }
 
     void QtHttpAssetProvider::StartTransferFromQueue()
     {
-        if (pending_request_queue_.count() == 0)
-            return;
+        // Start the highest priority transfers whose host has a free connection
+        int index = 0;
+        while (index < pending_request_queue_.count())
+        {
+            QtHttpAssetTransfer *transfer = pending_request_queue_[index];
+            if (host_connections_.value(transfer->GetTranferInfo().url.host(), 0) >= max_connections_per_host_)
+            {
+                ++index;
+                continue;
+            }
 
-        // If the whole map is empty then go and start new MAX_HTTP_CONNECTIONS amount of http gets
-        if (assetid_to_transfer_map_.count() == 0)
-            filling_stack_ = true;
+            pending_request_queue_.removeAt(index);
+            StartTransfer(transfer);
+        }
+    }
 
-        if (!filling_stack_)
-            return;
+    void QtHttpAssetProvider::QueueTransfer(QtHttpAssetTransfer *transfer)
+    {
+        int index = 0;
+        while (index < pending_request_queue_.count())
+        {
+            QtHttpAssetTransfer *queued = pending_request_queue_[index];
+            if (queued->GetPriority() < transfer->GetPriority() ||
+                (queued->GetPriority() == transfer->GetPriority() && queued->GetSequence() > transfer->GetSequence()))
+                break;
+            ++index;
+        }
+        pending_request_queue_.insert(index, transfer);
+    }
 
-        if (assetid_to_transfer_map_.count() <= MAX_HTTP_CONNECTIONS && pending_request_queue_.count() > 0)
+    void QtHttpAssetProvider::StartTransfer(QtHttpAssetTransfer *transfer)
+    {
+        if (transfer->IsRanged())
         {
-            if (assetid_to_transfer_map_.count() == MAX_HTTP_CONNECTIONS || pending_request_queue_.count() == 0)
-                filling_stack_ = false; 
-            else
-            {
-                QtHttpAssetTransfer *new_transfer = pending_request_queue_.takeAt(0);
-                assetid_to_transfer_map_[new_transfer->GetTranferInfo().id] = new_transfer;
-                network_manager_->get(*new_transfer);
+            uint start = transfer->GetReceived();
+            uint end = GetNeededSize(transfer);
+            if (end)
+                end = std::max(end, start + MIN_RANGE_SIZE);
+            if ((end) && (transfer->GetSize()) && (end >= transfer->GetSize()))
+                end = 0;
+            transfer->SetRange(start, end);
+        }
 
-                AssetModule::LogDebug("New HTTP asset request from queue: " + new_transfer->GetTranferInfo().id.toStdString() + " type: " + RexTypes::GetAssetTypeString(new_transfer->GetTranferInfo().type));
-                StartTransferFromQueue(); // Recursivly fill the transfer map
-            }
+        QNetworkReply *reply = network_manager_->get(*transfer);
+        connect(reply, SIGNAL(readyRead()), SLOT(ReplyDataReceived()));
+        transfer->SetReply(reply);
+        reply_to_transfer_map_[reply] = transfer;
+        ++host_connections_[transfer->GetTranferInfo().url.host()];
+
+        AssetModule::LogDebug("HTTP asset request started: " + transfer->GetTranferInfo().id.toStdString() + " from byte " +
+            ToString<uint>(transfer->GetReceived()));
+    }
+
+    bool QtHttpAssetProvider::ReadReplyData(QtHttpAssetTransfer *transfer)
+    {
+        if (!transfer->IsReplyBegun() && !transfer->BeginReply())
+        {
+            AssetModule::LogWarning("HTTP asset " + transfer->GetTranferInfo().id.toStdString() + " reply does not match requested range");
+            return false;
         }
+
+        transfer->ReadData();
+        return true;
     }
 
-    bool QtHttpAssetProvider::CheckRequestQueue(QString assed_id)
+    void QtHttpAssetProvider::ReleaseReply(QtHttpAssetTransfer *transfer)
     {
-        foreach (QtHttpAssetTransfer *transfer, pending_request_queue_)
-            if (transfer->GetTranferInfo().id == assed_id)
-                return true;
-        return false;
+        QNetworkReply *reply = transfer->GetReply();
+        if (!reply)
+            return;
+
+        reply_to_transfer_map_.remove(reply);
+        QString host = transfer->GetTranferInfo().url.host();
+        if (--host_connections_[host] <= 0)
+            host_connections_.remove(host);
+        transfer->SetReply(0);
+    }
+
+    uint QtHttpAssetProvider::GetNeededSize(QtHttpAssetTransfer *transfer) const
+    {
+        int discard_level = transfer->GetDiscardLevel();
+        if (!transfer->IsRanged() || discard_level <= 0)
+            return 0;
+
+        // Each discard level halves the dimensions. Assume a typical texture until the header has been received
+        uint width = DEFAULT_TEXTURE_SIZE;
+        uint height = DEFAULT_TEXTURE_SIZE;
+        uint components = DEFAULT_TEXTURE_COMPONENTS;
+        transfer->GetImageSize(width, height, components);
+
+        uint needed = (uint)((width >> discard_level) * (height >> discard_level) * components * J2K_BYTES_PER_SAMPLE);
+        needed = std::max(needed, MIN_RANGE_SIZE);
+        if ((transfer->GetSize()) && (needed >= transfer->GetSize()))
+            return 0;
+        return needed;
+    }
+
+    bool QtHttpAssetProvider::NeedsMoreData(QtHttpAssetTransfer *transfer) const
+    {
+        if (transfer->IsComplete())
+            return false;
+
+        uint needed = GetNeededSize(transfer);
+        return !needed || transfer->GetReceived() < needed;
+    }
+
+    Foundation::AssetPtr QtHttpAssetProvider::CreateAsset(QtHttpAssetTransfer *transfer) const
+    {
+        HttpAssetTransferInfo &info = transfer->GetTranferInfo();
+        RexAsset *new_asset = new RexAsset(info.id.toStdString(), RexTypes::GetTypeNameFromAssetType(info.type));
+        Foundation::AssetPtr asset_ptr(new_asset);
+
+        // The asset shares the data received so far from the transfer buffer
+        if (transfer->GetReceived())
+        {
+            QtHttpAssetTransfer::DataBufferPtr buffer = transfer->GetBuffer();
+            new_asset->SetDataView(&(*buffer)[0], transfer->GetReceived(), buffer);
+        }
+
+        return asset_ptr;
     }
 
     bool QtHttpAssetProvider::IsAcceptableAssetType(const std::string& asset_type)
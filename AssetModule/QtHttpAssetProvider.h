@@ -15,6 +15,16 @@
 
 namespace Asset
 {
+    //! Http asset provider
+    /*! Requests are queued and started highest priority first. At most AssetSystem/http_connections_per_host
+        requests per host are in progress at a time, so that the queue and not the network access manager decides
+        the order, and the connections of a host are kept alive and reused for the following requests.
+
+        Textures fetched with the GetTexture capability are downloaded in byte ranges: while a texture is needed
+        only at a reduced discard level, just enough of the JPEG2000 codestream for that level is requested, and the
+        rest follows when the discard level is lowered. The data received so far is available for progressive
+        decoding as an incomplete asset.
+     */
     class QtHttpAssetProvider : public QObject, public Foundation::AssetProviderInterface
     {
 
@@ -35,6 +45,8 @@ namespace Asset
         
         bool RequestAsset(const std::string& asset_id, const std::string& asset_type, request_tag_t tag);
         bool InProgress(const std::string& asset_id);
+        bool CancelTransfer(const std::string& asset_id);
+        void SetTransferPriority(const std::string& asset_id, f32 priority, int discard_level);
         bool QueryAssetStatus(const std::string& asset_id, uint& size, uint& received, uint& received_continuous);
 
         Foundation::AssetPtr GetIncompleteAsset(const std::string& asset_id, const std::string& asset_type, uint received);
@@ -43,13 +55,34 @@ namespace Asset
     private slots:
         QUrl CreateUrl(QString assed_id);
         void TranferCompleted(QNetworkReply *reply);
+        void ReplyDataReceived();
         void RemoveFinishedTransfers(QString asset_transfer_key, QUrl metadata_transfer_key);
         void StartTransferFromQueue();
 
-        bool CheckRequestQueue(QString assed_id);
         bool IsAcceptableAssetType(const std::string& asset_type);
 
     private:
+        //! Queues a transfer to wait for a connection, in order of priority
+        void QueueTransfer(QtHttpAssetTransfer *transfer);
+
+        //! Sends the request of the next range or the whole asset
+        void StartTransfer(QtHttpAssetTransfer *transfer);
+
+        //! Reads the data a reply has received so far. Returns false if the reply does not continue the transfer.
+        bool ReadReplyData(QtHttpAssetTransfer *transfer);
+
+        //! Forgets the reply in progress of a transfer, freeing its connection
+        void ReleaseReply(QtHttpAssetTransfer *transfer);
+
+        //! Returns the amount of data needed for the discard level of a transfer, 0 if the whole asset is needed
+        uint GetNeededSize(QtHttpAssetTransfer *transfer) const;
+
+        //! Returns whether a transfer needs more data than it has received
+        bool NeedsMoreData(QtHttpAssetTransfer *transfer) const;
+
+        //! Creates an asset sharing the data a transfer has received
+        Foundation::AssetPtr CreateAsset(QtHttpAssetTransfer *transfer) const;
+
         Foundation::Framework *framework_;
         Foundation::EventManager *event_manager_;
         const std::string name_;
@@ -58,11 +91,25 @@ namespace Asset
         event_category_id_t asset_event_category_;
         f64 asset_timeout_;
 
+        //! All transfers, queued, in progress or waiting for a lower discard level
         QMap<QString, QtHttpAssetTransfer *> assetid_to_transfer_map_;
         QMap<QUrl, QPair<HttpAssetTransferInfo, Foundation::AssetPtr> > metadata_to_assetptr_;
+
+        //! Transfers waiting for a connection, in order of priority
         QList<QtHttpAssetTransfer *> pending_request_queue_;
 
-        bool filling_stack_;
+        //! Transfers by reply in progress
+        QMap<QNetworkReply *, QtHttpAssetTransfer *> reply_to_transfer_map_;
+
+        //! Number of replies in progress by host
+        QMap<QString, int> host_connections_;
+
+        //! Maximum number of replies in progress per host
+        int max_connections_per_host_;
+
+        //! Sequence number of the next transfer
+        uint next_sequence_;
+
         bool fake_metadata_fetch_;
         QUrl fake_metadata_url_;
 
@@ -71,4 +118,4 @@ namespace Asset
     };
 }
 
-#endif
+#endif
\ No newline at end of file
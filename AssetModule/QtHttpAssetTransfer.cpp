@@ -3,6 +3,8 @@
 #include "StableHeaders.h"
 #include "QtHttpAssetTransfer.h"
 
+#include <QNetworkReply>
+
 namespace Asset
 {
     // ==========================================================
@@ -38,8 +40,137 @@ namespace Asset
     QtHttpAssetTransfer::QtHttpAssetTransfer(QUrl asset_url, QString asset_id, asset_type_t asset_type, request_tag_t tag) :
         QObject(0),
         QNetworkRequest(asset_url),
-        transfer_info_(asset_url, asset_id, asset_type)
+        transfer_info_(asset_url, asset_id, asset_type),
+        priority_(0.0f),
+        discard_level_(0),
+        sequence_(0),
+        ranged_(false),
+        reply_(0),
+        reply_begun_(false),
+        whole_reply_(false),
+        received_(0),
+        size_(0),
+        complete_(false)
     {
         transfer_info_.AddTag(tag);
+
+        // Ask the server to keep the connection open for the following requests
+        setRawHeader("Connection", "Keep-Alive");
+    }
+
+    void QtHttpAssetTransfer::SetRange(uint start, uint end)
+    {
+        if (!start && !end)
+        {
+            setRawHeader("Range", QByteArray());
+            return;
+        }
+
+        QByteArray range = "bytes=" + QByteArray::number(start) + "-";
+        if (end)
+            range += QByteArray::number(end - 1);
+        setRawHeader("Range", range);
+    }
+
+    bool QtHttpAssetTransfer::BeginReply()
+    {
+        if (!reply_)
+            return false;
+        reply_begun_ = true;
+
+        int status = reply_->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (status == 206)
+        {
+            // Content-Range: bytes first-last/total
+            QString content_range = QString(reply_->rawHeader("Content-Range"));
+            int space = content_range.indexOf(' ');
+            int dash = content_range.indexOf('-');
+            int slash = content_range.indexOf('/');
+            if (space < 0 || dash < space || slash < dash)
+                return false;
+            if (content_range.mid(space + 1, dash - space - 1).toUInt() != received_)
+                return false;
+
+            bool known = false;
+            uint size = content_range.mid(slash + 1).toUInt(&known);
+            if (known)
+                size_ = size;
+        }
+        else
+        {
+            // The server ignored the range, and sends the whole asset. Data shared from the old buffer stays valid,
+            // as the sharers hold it
+            whole_reply_ = true;
+            buffer_.reset();
+            received_ = 0;
+            size_ = reply_->header(QNetworkRequest::ContentLengthHeader).toUInt();
+        }
+
+        if (size_)
+            Reserve(size_);
+        return true;
+    }
+
+    void QtHttpAssetTransfer::ReadData()
+    {
+        if (!reply_)
+            return;
+
+        qint64 available = reply_->bytesAvailable();
+        if (available <= 0)
+            return;
+
+        Reserve(received_ + (uint)available);
+        qint64 read = reply_->read((char *)&(*buffer_)[received_], available);
+        if (read > 0)
+            received_ += (uint)read;
+    }
+
+    void QtHttpAssetTransfer::EndReply()
+    {
+        if (whole_reply_)
+            size_ = received_;
+        complete_ = whole_reply_ || ((size_) && (received_ >= size_));
+        SetReply(0);
+    }
+
+    void QtHttpAssetTransfer::Reserve(uint size)
+    {
+        if ((buffer_) && (buffer_->size() >= size))
+            return;
+
+        // Until the asset size is known, grow geometrically. Data shared from the old buffer stays valid, as the
+        // sharers hold it
+        if ((!size_) && (buffer_))
+            size = std::max(size, (uint)buffer_->size() * 2);
+
+        DataBufferPtr buffer(new DataBuffer(std::max(size, size_)));
+        if (received_)
+            memcpy(&(*buffer)[0], &(*buffer_)[0], received_);
+        buffer_ = buffer;
+    }
+
+    bool QtHttpAssetTransfer::GetImageSize(uint &width, uint &height, uint &components) const
+    {
+        // JPEG2000 codestream starts with the SOC marker, followed by the SIZ marker segment
+        const uint SIZ_SIZE = 42;
+        if (received_ < SIZ_SIZE)
+            return false;
+
+        const u8 *data = &(*buffer_)[0];
+        if (data[0] != 0xff || data[1] != 0x4f || data[2] != 0xff || data[3] != 0x51)
+            return false;
+
+        uint x_size = (data[8] << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
+        uint y_size = (data[12] << 24) | (data[13] << 16) | (data[14] << 8) | data[15];
+        uint x_offset = (data[16] << 24) | (data[17] << 16) | (data[18] << 8) | data[19];
+        uint y_offset = (data[20] << 24) | (data[21] << 16) | (data[22] << 8) | data[23];
+        if (x_size <= x_offset || y_size <= y_offset)
+            return false;
+
+        width = x_size - x_offset;
+        height = y_size - y_offset;
+        components = (data[40] << 8) | data[41];
+        return true;
     }
 }
\ No newline at end of file
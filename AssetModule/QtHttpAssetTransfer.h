@@ -9,6 +9,9 @@
 #include <QNetworkRequest>
 #include <QUrl>
 #include <QString>
+#include <QByteArray>
+
+class QNetworkReply;
 
 namespace Asset
 {
@@ -25,19 +28,110 @@ namespace Asset
         QList<request_tag_t> tags;
     };
 
+    //! Http asset transfer. Receives the asset data either in one reply, or in several byte ranges.
+    /*! Data is read from the replies directly into a single buffer, allocated to the asset size once it is known.
+        The data received can be shared from the buffer without copying, see GetBuffer(); the bytes shared are never
+        written again.
+     */
     class QtHttpAssetTransfer : public QObject, public QNetworkRequest
     {
 
     Q_OBJECT
 
     public:
+        //! Asset data buffer
+        typedef std::vector<u8> DataBuffer;
+        typedef boost::shared_ptr<DataBuffer> DataBufferPtr;
+
         QtHttpAssetTransfer(QUrl asset_url, QString asset_id, asset_type_t asset_type, request_tag_t tag);
-        HttpAssetTransferInfo GetTranferInfo() { return transfer_info_; }
+        HttpAssetTransferInfo& GetTranferInfo() { return transfer_info_; }
+
+        //! Sets priority and texture discard level
+        void SetPriority(f32 priority, int discard_level) { priority_ = priority; discard_level_ = discard_level; }
+
+        //! Sets order of the request among requests of the same priority
+        void SetSequence(uint sequence) { sequence_ = sequence; }
+
+        //! Sets whether the asset may be downloaded in byte ranges
+        void SetRanged(bool ranged) { ranged_ = ranged; }
+
+        //! Sets the byte range the next reply should contain
+        /*! \param start First byte
+            \param end End of range, exclusive. 0 for up to the end of the asset
+         */
+        void SetRange(uint start, uint end);
+
+        //! Sets the reply in progress, 0 if none
+        void SetReply(QNetworkReply *reply) { reply_ = reply; reply_begun_ = false; whole_reply_ = false; }
+
+        //! Handles headers of the reply in progress
+        /*! \return false if the reply does not continue the data received so far
+         */
+        bool BeginReply();
+
+        //! Reads the data available from the reply in progress
+        void ReadData();
+
+        //! Handles end of the reply in progress
+        void EndReply();
+
+        f32 GetPriority() const { return priority_; }
+        int GetDiscardLevel() const { return discard_level_; }
+        uint GetSequence() const { return sequence_; }
+        bool IsRanged() const { return ranged_; }
+        QNetworkReply *GetReply() const { return reply_; }
+        bool IsReplyBegun() const { return reply_begun_; }
+
+        //! Returns the buffer holding the data received so far, continuous from the start. May be larger than the data
+        DataBufferPtr GetBuffer() const { return buffer_; }
+
+        //! Returns number of bytes received
+        uint GetReceived() const { return received_; }
+
+        //! Returns total size, 0 if not known yet
+        uint GetSize() const { return size_; }
+
+        //! Returns whether the whole asset has been received
+        bool IsComplete() const { return complete_; }
+
+        //! Reads image dimensions from the JPEG2000 header, if received
+        /*! \return true if the header was received and the variables filled
+         */
+        bool GetImageSize(uint &width, uint &height, uint &components) const;
 
     private:
         HttpAssetTransferInfo transfer_info_;
 
+        f32 priority_;
+        int discard_level_;
+        uint sequence_;
+        bool ranged_;
+
+        //! Reply in progress, 0 if none
+        QNetworkReply *reply_;
+
+        //! Whether the headers of the reply in progress have been handled
+        bool reply_begun_;
+
+        //! Whether the reply in progress contains the whole asset instead of the requested range
+        bool whole_reply_;
+
+        //! Makes room for the given amount of data in the buffer
+        void Reserve(uint size);
+
+        //! Buffer of the data received so far
+        DataBufferPtr buffer_;
+
+        //! Number of bytes received
+        uint received_;
+
+        //! Total size, 0 if not known yet
+        uint size_;
+
+        //! Whether the whole asset has been received
+        bool complete_;
+
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -8,7 +8,30 @@ namespace Asset
     RexAsset::RexAsset(const std::string& asset_id, const std::string& asset_type) :
         asset_id_(asset_id),
         asset_type_(asset_type),
+        view_data_(0),
+        view_size_(0),
         age_(0.0)
     {
     }
+
+    RexAsset::AssetDataVector& RexAsset::GetDataInternal()
+    {
+        ResetAge();
+        if (view_data_)
+        {
+            data_.assign(view_data_, view_data_ + view_size_);
+            view_data_ = 0;
+            view_size_ = 0;
+            view_owner_.reset();
+        }
+        return data_;
+    }
+
+    void RexAsset::SetDataView(const u8* data, uint size, boost::shared_ptr<const void> owner)
+    {
+        AssetDataVector().swap(data_);
+        view_data_ = data;
+        view_size_ = size;
+        view_owner_ = owner;
+    }
 }
@@ -32,13 +32,22 @@ namespace Asset
         virtual const std::string& GetType() const { return asset_type_; }
 
         //! returns asset data size
-        virtual uint GetSize() const { return data_.size(); }
+        virtual uint GetSize() const { return view_data_ ? view_size_ : data_.size(); }
 
         //! returns asset data
-        virtual const u8* GetData() const { ResetAge(); return &data_[0]; }
+        virtual const u8* GetData() const { ResetAge(); return view_data_ ? view_data_ : &data_[0]; }
 
         //! returns asset data vector, non-const. For internal use
-        AssetDataVector& GetDataInternal() { ResetAge(); return data_; }
+        /*! If the asset refers to external data, the data is copied to the vector first.
+         */
+        AssetDataVector& GetDataInternal();
+
+        //! sets asset to refer to external data instead of its own, without copying. For internal use
+        /*! \param data Data
+            \param size Data size
+            \param owner Object keeping the data valid, held as long as the asset refers to the data
+         */
+        void SetDataView(const u8* data, uint size, boost::shared_ptr<const void> owner);
 
         //! returns asset metadata
         virtual Foundation::AssetMetadataInterface* GetMetadata() const { ResetAge(); return (Foundation::AssetMetadataInterface*)&metadata_;}
@@ -62,6 +71,15 @@ namespace Asset
         //! asset data
         AssetDataVector data_;
 
+        //! external asset data, null if the asset has its own data
+        const u8* view_data_;
+
+        //! external asset data size
+        uint view_size_;
+
+        //! keeps the external data valid
+        boost::shared_ptr<const void> view_owner_;
+
         //! asset metadata
         RexAssetMetadata metadata_;
 
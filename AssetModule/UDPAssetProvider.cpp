@@ -25,6 +25,18 @@ namespace Asset
 {
     const float UDPAssetProvider::DEFAULT_ASSET_TIMEOUT = 120.0;
 
+    //! Lowest texture download priority sent to the server, as 0 cancels the download
+    const f32 MIN_TEXTURE_PRIORITY = 1.0f;
+
+    //! Highest discard level of a texture
+    const int MAX_DISCARD_LEVEL = 5;
+
+    //! Size of the texture data in the ImageData message
+    const uint FIRST_IMAGE_PACKET_SIZE = 600;
+
+    //! Size of the texture data in the ImagePacket messages, except the last
+    const uint IMAGE_PACKET_SIZE = 1000;
+
     UDPAssetProvider::UDPAssetProvider(Foundation::Framework* framework) :
         framework_(framework)
     {
@@ -69,6 +81,8 @@ namespace Asset
         new_request.asset_id_ = asset_id;
         new_request.asset_type_ = asset_type_int;
         new_request.tags_.push_back(tag);
+        new_request.priority_ = 0.0f;
+        new_request.discard_level_ = 0;
         pending_requests_.push_back(new_request);
 
         return true;
@@ -77,22 +91,114 @@ namespace Asset
     bool UDPAssetProvider::InProgress(const std::string& asset_id)
     {
         UDPAssetTransfer* transfer = GetTransfer(asset_id);
-        return (transfer != 0);
+        if (transfer)
+            return true;
+
+        // Requests not sent yet, or waiting for the connection to return
+        for(uint i = 0; i < pending_requests_.size(); ++i)
+        {
+            if (pending_requests_[i].asset_id_ == asset_id)
+                return true;
+        }
+
+        return false;
+    }
+
+    bool UDPAssetProvider::CancelTransfer(const std::string& asset_id)
+    {
+        bool canceled = false;
+        AssetRequestVector::iterator r = pending_requests_.begin();
+        while(r != pending_requests_.end())
+        {
+            if (r->asset_id_ == asset_id)
+            {
+                r = pending_requests_.erase(r);
+                canceled = true;
+            }
+            else
+                ++r;
+        }
+
+        boost::shared_ptr<ProtocolUtilities::ProtocolModuleInterface> net = protocolModule_.lock();
+        bool connected = net && net->IsConnected();
+        RexUUID asset_uuid(asset_id);
+
+        UDPAssetTransferMap::iterator i = texture_transfers_.find(asset_uuid);
+        if (i != texture_transfers_.end())
+        {
+            if (connected)
+                SendRequestImage(net, asset_uuid, -1, 0.0f, 0);
+
+            texture_transfers_.erase(i);
+            return true;
+        }
+
+        UDPAssetTransferMap::iterator j = asset_transfers_.begin();
+        while (j != asset_transfers_.end())
+        {
+            if (j->second.GetAssetId() == asset_id)
+            {
+                if (connected)
+                {
+                    ProtocolUtilities::NetOutMessage *m = net->StartMessageBuilding(RexNetMsgTransferAbort);
+                    assert(m);
+                    m->AddUUID(j->first); // Transfer ID
+                    m->AddS32(RexAC_Asset); // Asset channel type
+                    m->MarkReliable();
+                    net->FinishMessageBuilding(m);
+                }
+
+                asset_transfers_.erase(j);
+                return true;
+            }
+            ++j;
+        }
+
+        return canceled;
+    }
+
+    void UDPAssetProvider::SetTransferPriority(const std::string& asset_id, f32 priority, int discard_level)
+    {
+        priority = std::max(priority, MIN_TEXTURE_PRIORITY);
+        discard_level = std::min(std::max(discard_level, 0), MAX_DISCARD_LEVEL);
+
+        for(uint i = 0; i < pending_requests_.size(); ++i)
+        {
+            if (pending_requests_[i].asset_id_ == asset_id)
+            {
+                pending_requests_[i].priority_ = priority;
+                pending_requests_[i].discard_level_ = discard_level;
+            }
+        }
+
+        // Only textures can be reprioritized once requested
+        RexUUID asset_uuid(asset_id);
+        UDPAssetTransferMap::iterator i = texture_transfers_.find(asset_uuid);
+        if (i == texture_transfers_.end())
+            return;
+
+        UDPAssetTransfer& transfer = i->second;
+        if (transfer.GetPriority() == priority && transfer.GetDiscardLevel() == discard_level)
+            return;
+        transfer.SetPriority(priority, discard_level);
+
+        boost::shared_ptr<ProtocolUtilities::ProtocolModuleInterface> net = protocolModule_.lock();
+        if (net && net->IsConnected() && !transfer.Ready())
+            SendRequestImage(net, asset_uuid, discard_level, priority, transfer.GetReceivedContinuousPackets());
     }
 
     Foundation::AssetPtr UDPAssetProvider::GetIncompleteAsset(const std::string& asset_id, const std::string& asset_type, uint received)
     {
         UDPAssetTransfer* transfer = GetTransfer(asset_id);
 
-        if ((transfer) && (transfer->GetReceivedContinuous() >= received))
+        if ((transfer) && (transfer->GetReceivedContinuous()) && (transfer->GetReceivedContinuous() >= received))
         {
-            // Make new temporary asset for the incomplete data
+            // Make new temporary asset for the incomplete data. It shares the continuous data of the transfer buffer
             RexAsset* new_asset = new RexAsset(transfer->GetAssetId(), GetTypeNameFromAssetType(transfer->GetAssetType()));
             Foundation::AssetPtr asset_ptr(new_asset);
-            
-            RexAsset::AssetDataVector& data = new_asset->GetDataInternal();
-            data.resize(transfer->GetReceivedContinuous());
-            transfer->AssembleData(&data[0]);
+
+            UDPAssetTransfer::DataBufferPtr buffer = transfer->GetBuffer();
+            new_asset->SetDataView(&(*buffer)[0], transfer->GetReceivedContinuous(), buffer);
 
             return asset_ptr;
         }
@@ -155,6 +261,8 @@ namespace Asset
             new_request.asset_id_ = i->second.GetAssetId();
             new_request.asset_type_ = i->second.GetAssetType();
             new_request.tags_ = i->second.GetTags();
+            new_request.priority_ = i->second.GetPriority();
+            new_request.discard_level_ = i->second.GetDiscardLevel();
             pending_requests_.push_back(new_request);
             ++i;
         }
@@ -166,6 +274,8 @@ namespace Asset
             new_request.asset_id_ = j->second.GetAssetId();
             new_request.asset_type_ = j->second.GetAssetType();
             new_request.tags_ = j->second.GetTags();
+            new_request.priority_ = 0.0f;
+            new_request.discard_level_ = 0;
             pending_requests_.push_back(new_request);
             ++j;
         }
@@ -191,21 +301,7 @@ namespace Asset
                     AssetModule::LogInfo("Texture transfer " + transfer.GetAssetId() + " timed out.");
 
                     // Send cancel message
-                    const ProtocolUtilities::ClientParameters& client = net->GetClientParameters();
-                    ProtocolUtilities::NetOutMessage *m = net->StartMessageBuilding(RexNetMsgRequestImage);
-                    assert(m);
-                    
-                    m->AddUUID(client.agentID);
-                    m->AddUUID(client.sessionID);
-
-                    m->SetVariableBlockCount(1);
-                    m->AddUUID(asset_uuid); // Image UUID
-                    m->AddS8(-1); // Discard level, -1 = cancel
-                    m->AddF32(0.0); // Download priority, 0 = cancel
-                    m->AddU32(0); // Starting packet
-                    m->AddU8(RexIT_Normal); // Image type
-                    m->MarkReliable();
-                    net->FinishMessageBuilding(m);
+                    SendRequestImage(net, asset_uuid, -1, 0.0f, 0);
 
                     // Send transfer canceled event
                     SendAssetCanceled(transfer);
@@ -266,7 +362,7 @@ namespace Asset
         {
             RexUUID asset_uuid(i->asset_id_);
             if (i->asset_type_ == RexAT_Texture)
-                RequestTexture(net, asset_uuid, i->tags_);
+                RequestTexture(net, asset_uuid, i->tags_, i->priority_, i->discard_level_);
             else
                 RequestOtherAsset(net, asset_uuid, i->asset_type_, i->tags_);
 
@@ -275,7 +371,7 @@ namespace Asset
     }
 
     void UDPAssetProvider::RequestTexture(boost::shared_ptr<ProtocolUtilities::ProtocolModuleInterface> net, 
-        const RexUUID& asset_id, const RequestTagVector& tags)
+        const RexUUID& asset_id, const RequestTagVector& tags, f32 priority, int discard_level)
     {
         // If request already exists, just append the new tag(s)
         std::string asset_id_str = asset_id.ToString();
@@ -286,16 +382,25 @@ namespace Asset
             return;
         }
 
-        const ProtocolUtilities::ClientParameters& client = net->GetClientParameters();
+        priority = std::max(priority, MIN_TEXTURE_PRIORITY);
 
         UDPAssetTransfer new_transfer;
         new_transfer.SetAssetId(asset_id.ToString());
         new_transfer.SetAssetType(RexAT_Texture);
+        new_transfer.SetPacketLayout(FIRST_IMAGE_PACKET_SIZE, IMAGE_PACKET_SIZE);
+        new_transfer.SetPriority(priority, discard_level);
         new_transfer.InsertTags(tags);
         texture_transfers_[asset_id] = new_transfer;
 
-        AssetModule::LogDebug("Requesting texture " + asset_id.ToString());
+        AssetModule::LogDebug("Requesting texture " + asset_id.ToString() + " discard level " + ToString(discard_level));
 
+        SendRequestImage(net, asset_id, discard_level, priority, 0);
+    }
+
+    void UDPAssetProvider::SendRequestImage(boost::shared_ptr<ProtocolUtilities::ProtocolModuleInterface> net,
+        const RexUUID& asset_id, int discard_level, f32 priority, uint packet)
+    {
+        const ProtocolUtilities::ClientParameters& client = net->GetClientParameters();
         ProtocolUtilities::NetOutMessage *m = net->StartMessageBuilding(RexNetMsgRequestImage);
         assert(m);
 
@@ -304,9 +409,9 @@ namespace Asset
 
         m->SetVariableBlockCount(1);
         m->AddUUID(asset_id); // Image UUID
-        m->AddS8(0); // Discard level
-        m->AddF32(100.0); // Download priority
-        m->AddU32(0); // Starting packet
+        m->AddS8(discard_level); // Discard level, -1 = cancel
+        m->AddF32(priority); // Download priority, 0 = cancel
+        m->AddU32(packet); // Starting packet
         m->AddU8(RexIT_Normal); // Image type
         m->MarkReliable();
         net->FinishMessageBuilding(m);
@@ -618,10 +723,10 @@ namespace Asset
         {
             const std::string& asset_id = transfer.GetAssetId();
 
+            // The asset takes over the transfer buffer, which holds exactly the asset data
             Foundation::AssetPtr new_asset = Foundation::AssetPtr(new RexAsset(asset_id, GetTypeNameFromAssetType(transfer.GetAssetType())));
-            RexAsset::AssetDataVector& data = checked_static_cast<RexAsset*>(new_asset.get())->GetDataInternal();
-            data.resize(transfer.GetReceived());
-            transfer.AssembleData(&data[0]);
+            UDPAssetTransfer::DataBufferPtr buffer = transfer.GetBuffer();
+            checked_static_cast<RexAsset*>(new_asset.get())->SetDataView(&(*buffer)[0], transfer.GetReceived(), buffer);
 
             asset_service->StoreAsset(new_asset);
 
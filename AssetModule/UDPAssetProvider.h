@@ -39,9 +39,22 @@ namespace Asset
          */
         virtual bool RequestAsset(const std::string& asset_id, const std::string& asset_type, request_tag_t tag);
 
-        //! Returns whether a certain asset is already being downloaded
+        //! Returns whether a certain asset is already being downloaded, or waiting to be requested
         virtual bool InProgress(const std::string& asset_id);
 
+        //! Cancels download of an asset. Sends a cancel message to the server if the transfer was started.
+        /*! \param asset_id Asset UUID
+            \return true if the download was canceled
+         */
+        virtual bool CancelTransfer(const std::string& asset_id);
+
+        //! Changes priority and discard level of a texture download. Sends an update to the server if the download was started.
+        /*! \param asset_id Asset UUID
+            \param priority Priority, higher is downloaded first
+            \param discard_level Resolution levels not needed, each halving the size. 0 downloads the whole texture.
+         */
+        virtual void SetTransferPriority(const std::string& asset_id, f32 priority, int discard_level);
+
         //! Queries status of asset download
         /*! \param asset_id Asset UUID
             \param size Variable to receive asset size (if known, 0 if unknown)
@@ -89,6 +102,10 @@ namespace Asset
             int asset_type_;
             //! Associated request tags
             RequestTagVector tags_;
+            //! Download priority
+            f32 priority_;
+            //! Discard level
+            int discard_level_;
         };
 
         //! Sends pending UDP asset requests
@@ -156,9 +173,21 @@ namespace Asset
         /*! \param net Connected network interface
             \param asset_id Asset UUID
             \param tags Asset request tag(s)
+            \param priority Download priority
+            \param discard_level Discard level
          */
         void RequestTexture(boost::shared_ptr<ProtocolUtilities::ProtocolModuleInterface> net,
-            const RexUUID& asset_id, const RequestTagVector& tags);
+            const RexUUID& asset_id, const RequestTagVector& tags, f32 priority, int discard_level);
+
+        //! Sends a RequestImage message, which starts, updates or cancels a texture download
+        /*! \param net Connected network interface
+            \param asset_id Asset UUID
+            \param discard_level Discard level, -1 to cancel
+            \param priority Download priority, 0 to cancel
+            \param packet Packet to start sending from
+         */
+        void SendRequestImage(boost::shared_ptr<ProtocolUtilities::ProtocolModuleInterface> net,
+            const RexUUID& asset_id, int discard_level, f32 priority, uint packet);
 
         //! Requests an other asset from network
         /*! \param net Connected network interface
@@ -4,85 +4,113 @@
 
 namespace Asset
 {
+    //! Size of asset transfer packets
+    const uint DEFAULT_PACKET_SIZE = 1000;
+
     UDPAssetTransfer::UDPAssetTransfer() :
         size_(0),
         received_(0),
-        time_(0.0)
+        first_packet_size_(DEFAULT_PACKET_SIZE),
+        packet_size_(DEFAULT_PACKET_SIZE),
+        continuous_packets_(0),
+        short_packet_end_(0),
+        time_(0.0),
+        priority_(0.0f),
+        discard_level_(0)
     {
     }
-    
+
     UDPAssetTransfer::~UDPAssetTransfer()
     {
     }
-    
+
     bool UDPAssetTransfer::Ready() const
     {
-        if (!size_) 
+        if (!size_)
             return false; // No header received, size not known yet
-        
+
         return received_ >= size_;
     }
-    
+
+    void UDPAssetTransfer::SetSize(uint size)
+    {
+        size_ = size;
+        Reserve(size);
+    }
+
     uint UDPAssetTransfer::GetReceivedContinuous() const
     {
-        uint size = 0;
-        
-        DataPacketMap::const_iterator i = data_packets_.begin();
-        
-        uint expected_index = 0;
-      
-        while (i != data_packets_.end())
-        {
-            if (i->first != expected_index)
-                break;
-            
-            size += i->second.size();
-            
-            ++expected_index;
-            ++i;
-        }
-        
+        uint size = GetPacketOffset(continuous_packets_);
+
+        // The last packet may be shorter than the others
+        if ((short_packet_end_) && (short_packet_end_ < size))
+            size = short_packet_end_;
+        if ((size_) && (size > size_))
+            size = size_;
+
         return size;
     }
-    
+
     void UDPAssetTransfer::ReceiveData(uint packet_index, const u8* data, uint size)
     {
         time_ = 0.0;
-        
+
         if (!size)
         {
             AssetModule::LogDebug("Trying to store zero bytes of data");
             return;
         }
-        
-        if (!data_packets_[packet_index].size())
+
+        if ((packet_index < received_packets_.size()) && (received_packets_[packet_index]))
         {
-            data_packets_[packet_index].resize(size);
-            memcpy(&data_packets_[packet_index][0], data, size);
-            received_ += size;
+            AssetModule::LogDebug("Already received asset data packet index " + ToString<uint>(packet_index));
+            return;
         }
-        else
+
+        // Only the last packet may be short, and nothing may extend past the asset
+        uint offset = GetPacketOffset(packet_index);
+        uint full_size = GetPacketSize(packet_index);
+        bool last = (size_) && (offset + size == size_);
+        if ((size > full_size) || ((size_) && (offset + size > size_)) || ((size < full_size) && (size_) && (!last)))
         {
-            AssetModule::LogDebug("Already received asset data packet index " + ToString<uint>(packet_index));
+            AssetModule::LogWarning("Asset " + asset_id_ + " data packet index " + ToString<uint>(packet_index) + " of unexpected size " +
+                ToString<uint>(size));
+            return;
         }
+
+        Reserve(offset + size);
+        memcpy(&(*buffer_)[offset], data, size);
+        received_ += size;
+        if (size < full_size)
+            short_packet_end_ = offset + size;
+
+        if (packet_index >= received_packets_.size())
+            received_packets_.resize(packet_index + 1, false);
+        received_packets_[packet_index] = true;
+        while ((continuous_packets_ < received_packets_.size()) && (received_packets_[continuous_packets_]))
+            ++continuous_packets_;
     }
-    
+
     void UDPAssetTransfer::AssembleData(u8* buffer) const
     {
-        DataPacketMap::const_iterator i = data_packets_.begin();
-        
-        uint expected_index = 0;
-      
-        while (i != data_packets_.end())
-        {
-            if (i->first != expected_index)
-                break;
-            
-            memcpy(buffer, &i->second[0], i->second.size());
-            buffer += i->second.size();
-            
-            ++expected_index;
-            ++i;
-        }
+        uint size = GetReceivedContinuous();
+        if (size)
+            memcpy(buffer, &(*buffer_)[0], size);
+    }
+
+    void UDPAssetTransfer::Reserve(uint size)
+    {
+        if ((buffer_) && (buffer_->size() >= size))
+            return;
+
+        // Until the asset size is known, grow geometrically. Data shared from the old buffer stays valid, as the
+        // sharers hold it
+        if ((!size_) && (buffer_))
+            size = std::max(size, (uint)buffer_->size() * 2);
+
+        DataBufferPtr buffer(new DataBuffer(std::max(size, size_)));
+        if (buffer_)
+            memcpy(&(*buffer)[0], &(*buffer_)[0], buffer_->size());
+        buffer_ = buffer;
     }
-}
\ No newline at end of file
+}
@@ -7,9 +7,18 @@
 namespace Asset
 {
     //! Stores data related to an UDP asset transfer that is in progress. Not necessary to clients of the AssetModule.
+    /*! Packets are received directly to their place in a single buffer, allocated to the asset size once it is
+        known. Packet positions follow from the packet layout: all packets except the last are of fixed size, and
+        packets of other sizes are rejected. The continuous data received from the start can be shared from the
+        buffer without copying, see GetBuffer(); the bytes shared are never written again.
+     */
     class UDPAssetTransfer
     {
     public:
+        //! Asset data buffer
+        typedef std::vector<u8> DataBuffer;
+        typedef boost::shared_ptr<DataBuffer> DataBufferPtr;
+
         //! Constructor
         UDPAssetTransfer();
         //! Destructor
@@ -40,11 +49,17 @@ namespace Asset
          */
         void SetAssetType(uint asset_type) { asset_type_ = asset_type; }
         
-        //! Sets asset size
+        //! Sets asset size, and allocates the buffer for it
         /*! Called when asset transfer header received
             \param size Asset size in bytes
          */
-        void SetSize(uint size) { size_ = size; }
+        void SetSize(uint size);
+
+        //! Sets packet sizes. Must be called before receiving data
+        /*! \param first_packet_size Size of the first packet
+            \param packet_size Size of the other packets, except the last which may be shorter
+         */
+        void SetPacketLayout(uint first_packet_size, uint packet_size) { first_packet_size_ = first_packet_size; packet_size_ = packet_size; }
         
         //! Adds elapsed time
         /*! \param delta_time Amount of time to add
@@ -53,6 +68,9 @@ namespace Asset
         
         //! Resets elapsed time
         void ResetTime() { time_ = 0.0; }
+
+        //! Sets download priority and discard level requested from the server
+        void SetPriority(f32 priority, int discard_level) { priority_ = priority; discard_level_ = discard_level; }
         
         //! Inserts a request tag
         void InsertTag(request_tag_t tag) { tags_.push_back(tag); }
@@ -80,6 +98,21 @@ namespace Asset
         
         //! Returns total size of continuous data from the asset beginning received so far
         uint GetReceivedContinuous() const;
+
+        //! Returns number of continuous data packets from the asset beginning received so far
+        uint GetReceivedContinuousPackets() const { return continuous_packets_; }
+
+        //! Returns the data buffer, null if nothing received. The continuous data from the start is valid to read.
+        /*! The buffer may be replaced by a larger one when the asset size becomes known. Holding the returned pointer
+            keeps the data valid also then.
+         */
+        DataBufferPtr GetBuffer() const { return buffer_; }
+
+        //! Returns download priority requested from the server
+        f32 GetPriority() const { return priority_; }
+
+        //! Returns discard level requested from the server
+        int GetDiscardLevel() const { return discard_level_; }
         
         //! Returns elapsed time since last packet
         f64 GetTime() const { return time_; }
@@ -88,7 +121,14 @@ namespace Asset
         bool Ready() const;
         
     private:
-        typedef std::map<uint, std::vector<u8> > DataPacketMap;
+        //! Returns position of a packet in the asset data
+        uint GetPacketOffset(uint packet_index) const { return packet_index ? first_packet_size_ + (packet_index - 1) * packet_size_ : 0; }
+
+        //! Returns full size of a packet
+        uint GetPacketSize(uint packet_index) const { return packet_index ? packet_size_ : first_packet_size_; }
+
+        //! Makes the buffer at least the given size
+        void Reserve(uint size);
         
         //! Asset ID
         std::string asset_id_;
@@ -101,12 +141,33 @@ namespace Asset
         
         //! Received bytes
         uint received_;
-        
-        //! Map of data packets
-        DataPacketMap data_packets_;
+
+        //! Size of the first packet
+        uint first_packet_size_;
+
+        //! Size of the other packets
+        uint packet_size_;
+
+        //! Asset data, shared with incomplete assets made of the continuous data
+        DataBufferPtr buffer_;
+
+        //! Received packets by index
+        std::vector<bool> received_packets_;
+
+        //! Number of continuous packets received from the start
+        uint continuous_packets_;
+
+        //! End of the last packet if it was shorter than a full packet, 0 if not received
+        uint short_packet_end_;
         
         //! Elapsed time since last packet
         f64 time_;
+
+        //! Download priority
+        f32 priority_;
+
+        //! Discard level, 0 = whole asset
+        int discard_level_;
         
         //! List of request tags associated with this transfer
         RequestTagVector tags_;
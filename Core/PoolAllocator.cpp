@@ -0,0 +1,249 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "CoreStableHeaders.h"
+#include "PoolAllocator.h"
+
+#include <algorithm>
+#include <new>
+
+namespace
+{
+    //! Alignment of blocks. Enough for doubles, pointers and SSE vector types.
+    const std::size_t BlockAlignment = 16;
+
+    //! Registry of the pools of this binary, until the framework sets its own. Allocated on first use and never
+    //! freed, so that pools destroyed during static destruction can still unregister themselves.
+    struct LocalRegistry
+    {
+        LocalRegistry() : current(&registry) {}
+
+        Core::FixedSizePoolRegistry registry;
+        //! Registry in use
+        Core::FixedSizePoolRegistry *current;
+        //! Guards changing the registry in use
+        Mutex mutex;
+    };
+
+    LocalRegistry &GetLocalRegistry()
+    {
+        static LocalRegistry *registry = new LocalRegistry();
+        return *registry;
+    }
+}
+
+namespace Core
+{
+    void FixedSizePoolRegistry::Add(FixedSizePool *pool)
+    {
+        MutexLock lock(mutex_);
+        pools_.push_back(pool);
+    }
+
+    void FixedSizePoolRegistry::Remove(FixedSizePool *pool)
+    {
+        MutexLock lock(mutex_);
+        pools_.erase(std::remove(pools_.begin(), pools_.end(), pool), pools_.end());
+    }
+
+    std::vector<FixedSizePool*> FixedSizePoolRegistry::GetPools() const
+    {
+        MutexLock lock(mutex_);
+        return pools_;
+    }
+
+    std::size_t FixedSizePoolRegistry::ReleaseUnused()
+    {
+        MutexLock lock(mutex_);
+        std::size_t freed = 0;
+        for(std::size_t i = 0; i < pools_.size(); ++i)
+            freed += pools_[i]->ReleaseUnused();
+        return freed;
+    }
+
+    FixedSizePool::FixedSizePool(const std::string &name, std::size_t block_size, std::size_t blocks_per_chunk) :
+        name_(name),
+        block_size_((std::max(block_size, sizeof(void*)) + BlockAlignment - 1) & ~(BlockAlignment - 1)),
+        blocks_per_chunk_(std::max(blocks_per_chunk, (std::size_t)1)),
+        free_list_(0)
+    {
+        stats_.allocations = 0;
+        stats_.frees = 0;
+        stats_.live = 0;
+        stats_.peak_live = 0;
+        stats_.chunk_allocations = 0;
+        stats_.chunks = 0;
+
+        LocalRegistry &local = GetLocalRegistry();
+        MutexLock lock(local.mutex);
+        local.current->Add(this);
+    }
+
+    FixedSizePool::~FixedSizePool()
+    {
+        {
+            LocalRegistry &local = GetLocalRegistry();
+            MutexLock lock(local.mutex);
+            local.current->Remove(this);
+        }
+
+        // If objects are still alive (static destruction order), their memory must stay valid
+        MutexLock lock(mutex_);
+        if (stats_.live == 0)
+            FreeChunks();
+    }
+
+    void *FixedSizePool::Allocate()
+    {
+        MutexLock lock(mutex_);
+        if (!free_list_)
+            AllocateChunk();
+
+        void *block = free_list_;
+        free_list_ = *reinterpret_cast<void**>(block);
+
+        ++stats_.allocations;
+        ++stats_.live;
+        if (stats_.live > stats_.peak_live)
+            stats_.peak_live = stats_.live;
+        return block;
+    }
+
+    void FixedSizePool::Free(void *ptr)
+    {
+        if (!ptr)
+            return;
+
+        MutexLock lock(mutex_);
+        *reinterpret_cast<void**>(ptr) = free_list_;
+        free_list_ = ptr;
+
+        ++stats_.frees;
+        --stats_.live;
+
+        // When the last block is freed, for example when a scene is torn down, return the memory in bulk.
+        // One chunk is kept so that creating and deleting single objects does not allocate a chunk every time.
+        if (stats_.live == 0 && chunks_.size() > 1)
+            FreeUnusedChunks(1);
+    }
+
+    std::size_t FixedSizePool::ReleaseUnused()
+    {
+        MutexLock lock(mutex_);
+        if (stats_.live == 0)
+        {
+            std::size_t freed = chunks_.size();
+            FreeChunks();
+            return freed;
+        }
+
+        return FreeUnusedChunks(0);
+    }
+
+    FixedSizePool::Stats FixedSizePool::GetStats() const
+    {
+        MutexLock lock(mutex_);
+        return stats_;
+    }
+
+    FixedSizePoolRegistry &FixedSizePool::GetRegistry()
+    {
+        LocalRegistry &local = GetLocalRegistry();
+        MutexLock lock(local.mutex);
+        return *local.current;
+    }
+
+    void FixedSizePool::SetRegistry(FixedSizePoolRegistry *registry)
+    {
+        LocalRegistry &local = GetLocalRegistry();
+        MutexLock lock(local.mutex);
+        if (!registry || registry == local.current)
+            return;
+
+        std::vector<FixedSizePool*> pools = local.current->GetPools();
+        for(std::size_t i = 0; i < pools.size(); ++i)
+        {
+            local.current->Remove(pools[i]);
+            registry->Add(pools[i]);
+        }
+        local.current = registry;
+    }
+
+    void FixedSizePool::AllocateChunk()
+    {
+        char *chunk = static_cast<char*>(::operator new(block_size_ * blocks_per_chunk_));
+        chunks_.push_back(chunk);
+        ++stats_.chunk_allocations;
+        ++stats_.chunks;
+
+        // Link the blocks of the new chunk into the free list, in address order
+        for(std::size_t i = blocks_per_chunk_; i > 0; --i)
+        {
+            void *block = chunk + (i - 1) * block_size_;
+            *reinterpret_cast<void**>(block) = free_list_;
+            free_list_ = block;
+        }
+    }
+
+    std::size_t FixedSizePool::FreeUnusedChunks(std::size_t keep)
+    {
+        // Count the free blocks of each chunk by walking the free list
+        std::vector<char*> chunks(chunks_);
+        std::sort(chunks.begin(), chunks.end());
+        std::vector<std::size_t> free_blocks(chunks.size(), 0);
+        for(void *block = free_list_; block; block = *reinterpret_cast<void**>(block))
+        {
+            std::vector<char*>::iterator c = std::upper_bound(chunks.begin(), chunks.end(), static_cast<char*>(block));
+            ++free_blocks[c - chunks.begin() - 1];
+        }
+
+        std::vector<bool> unused(chunks.size(), false);
+        std::size_t kept = 0;
+        std::size_t freed = 0;
+        for(std::size_t i = 0; i < chunks.size(); ++i)
+        {
+            if (free_blocks[i] != blocks_per_chunk_)
+                continue;
+            if (kept < keep)
+            {
+                ++kept;
+                continue;
+            }
+            unused[i] = true;
+            ++freed;
+        }
+        if (!freed)
+            return 0;
+
+        // Unlink the blocks of the unused chunks, keeping the order of the rest, then free the chunks
+        void **link = &free_list_;
+        while (*link)
+        {
+            char *block = static_cast<char*>(*link);
+            std::vector<char*>::iterator c = std::upper_bound(chunks.begin(), chunks.end(), block);
+            if (unused[c - chunks.begin() - 1])
+                *link = *reinterpret_cast<void**>(block);
+            else
+                link = reinterpret_cast<void**>(block);
+        }
+
+        chunks_.clear();
+        for(std::size_t i = 0; i < chunks.size(); ++i)
+        {
+            if (unused[i])
+                ::operator delete(chunks[i]);
+            else
+                chunks_.push_back(chunks[i]);
+        }
+        stats_.chunks = chunks_.size();
+        return freed;
+    }
+
+    void FixedSizePool::FreeChunks()
+    {
+        for(std::size_t i = 0; i < chunks_.size(); ++i)
+            ::operator delete(chunks_[i]);
+        chunks_.clear();
+        free_list_ = 0;
+        stats_.chunks = 0;
+    }
+}
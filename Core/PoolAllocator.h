@@ -0,0 +1,198 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Core_PoolAllocator_h
+#define incl_Core_PoolAllocator_h
+
+#include "CoreThread.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Core
+{
+    class FixedSizePool;
+
+    //! List of existing pools, for statistics and releasing memory. Thread-safe.
+    /*! Core is a static library, and so are libraries such as SceneManager that contain pool allocated classes, so
+        each binary (module) that allocates such objects has a pool of its own for the class. Every binary starts
+        with a registry of its own; the framework makes all of them use its registry, see FixedSizePool::SetRegistry(),
+        so that the pools of all modules are found in one place.
+     */
+    class FixedSizePoolRegistry
+    {
+    public:
+        //! Adds a pool
+        void Add(FixedSizePool *pool);
+
+        //! Removes a pool
+        void Remove(FixedSizePool *pool);
+
+        //! Returns the pools
+        std::vector<FixedSizePool*> GetPools() const;
+
+        //! Frees the chunks of all pools that have no blocks in use. Returns number of chunks freed.
+        std::size_t ReleaseUnused();
+
+    private:
+        //! Pools
+        std::vector<FixedSizePool*> pools_;
+
+        //! Guards the pools
+        mutable Mutex mutex_;
+    };
+
+    //! Allocator for fixed-size memory blocks, used for objects that are created in large numbers.
+    /*! Blocks are carved out of large chunks and recycled through a free list, so allocating and freeing a block
+        costs a few pointer operations instead of a heap allocation, and the objects end up close to each other in
+        memory. When the last block is freed, all chunks but one are returned to the system in bulk. ReleaseUnused()
+        frees every chunk with no blocks in use, also while other chunks still have, for example after a scene has
+        been torn down.
+
+        Normally used through the DECLARE_POOL_ALLOCATED / DEFINE_POOL_ALLOCATED macros, which give a class its own
+        pool. Pools register themselves to a FixedSizePoolRegistry for statistics, see GetRegistry().
+
+        Thread-safe.
+    */
+    class FixedSizePool
+    {
+    public:
+        //! Allocation statistics
+        struct Stats
+        {
+            //! Total blocks allocated from the pool
+            std::size_t allocations;
+            //! Total blocks freed back to the pool
+            std::size_t frees;
+            //! Blocks currently in use
+            std::size_t live;
+            //! Peak number of blocks in use
+            std::size_t peak_live;
+            //! Total chunks (heap allocations) made by the pool
+            std::size_t chunk_allocations;
+            //! Chunks currently held by the pool
+            std::size_t chunks;
+        };
+
+        //! Constructor.
+        /*! \param name Name for statistics, for example the class name
+            \param block_size Size of one block in bytes
+            \param blocks_per_chunk Number of blocks to allocate at once
+         */
+        FixedSizePool(const std::string &name, std::size_t block_size, std::size_t blocks_per_chunk = 256);
+
+        //! Destructor. Frees all chunks if no blocks are in use anymore, otherwise leaves them be.
+        ~FixedSizePool();
+
+        //! Allocates a block. Throws std::bad_alloc if out of memory.
+        void *Allocate();
+
+        //! Frees a block previously allocated from this pool.
+        void Free(void *ptr);
+
+        //! Frees all chunks that have no blocks in use, also the one kept in reserve. Returns number of chunks freed.
+        std::size_t ReleaseUnused();
+
+        //! Returns block size
+        std::size_t GetBlockSize() const { return block_size_; }
+
+        //! Returns pool name
+        const std::string &GetName() const { return name_; }
+
+        //! Returns allocation statistics
+        Stats GetStats() const;
+
+        //! Returns the registry the pools of this binary register to
+        static FixedSizePoolRegistry &GetRegistry();
+
+        //! Makes the pools of this binary register to another registry, and moves the existing ones there
+        /*! Called by the framework for each module it loads. The registry has to outlive the pools.
+         */
+        static void SetRegistry(FixedSizePoolRegistry *registry);
+
+    private:
+        FixedSizePool(const FixedSizePool &);
+        FixedSizePool &operator =(const FixedSizePool &);
+
+        //! Allocates a new chunk and adds its blocks to the free list
+        void AllocateChunk();
+
+        //! Frees all chunks
+        void FreeChunks();
+
+        //! Frees chunks whose blocks are all in the free list, and rebuilds the free list from the rest
+        /*! \param keep Number of free chunks to keep
+            \return Number of chunks freed
+         */
+        std::size_t FreeUnusedChunks(std::size_t keep);
+
+        //! Pool name
+        const std::string name_;
+
+        //! Block size, rounded up for alignment
+        const std::size_t block_size_;
+
+        //! Blocks per chunk
+        const std::size_t blocks_per_chunk_;
+
+        //! Head of the free list. The next pointer of a free block is stored in the block itself.
+        void *free_list_;
+
+        //! Allocated chunks
+        std::vector<char*> chunks_;
+
+        //! Statistics
+        Stats stats_;
+
+        //! Guards all of the above
+        mutable Mutex mutex_;
+    };
+}
+
+#if defined(_MSC_VER) && defined(_DEBUG) && defined(MEMORY_LEAK_CHECK)
+//! With MemoryLeakCheck.h, new is redefined as the debug placement form, which the class-specific operator new would hide.
+#define DECLARE_POOL_ALLOCATED_DEBUG_NEW(classname) \
+    static void *operator new(std::size_t size, const char *, int) { return operator new(size); } \
+    static void operator delete(void *ptr, const char *, int) { operator delete(ptr, sizeof(classname)); }
+#else
+#define DECLARE_POOL_ALLOCATED_DEBUG_NEW(classname)
+#endif
+
+//! Gives a class its own Core::FixedSizePool. Put in the class declaration, and DEFINE_POOL_ALLOCATED in the .cpp.
+/*! Objects of subclasses that are larger than the class are allocated normally from the heap.
+    The class must have a virtual destructor if objects are deleted through a base class pointer.
+    \note Placement new of the class must be written as ::new.
+ */
+#define DECLARE_POOL_ALLOCATED(classname) \
+public: \
+    static void *operator new(std::size_t size); \
+    static void operator delete(void *ptr, std::size_t size); \
+    static Core::FixedSizePool &GetAllocationPool(); \
+    DECLARE_POOL_ALLOCATED_DEBUG_NEW(classname) \
+private:
+
+//! Defines the pool functions declared by DECLARE_POOL_ALLOCATED. Put in the .cpp file of the class, outside namespaces
+//! and before including MemoryLeakCheck.h, which would otherwise rewrite the operator new definitions.
+#define DEFINE_POOL_ALLOCATED(classname) \
+    Core::FixedSizePool &classname::GetAllocationPool() \
+    { \
+        static Core::FixedSizePool pool(#classname, sizeof(classname)); \
+        return pool; \
+    } \
+    void *classname::operator new(std::size_t size) \
+    { \
+        if (size != sizeof(classname)) \
+            return ::operator new(size); \
+        return GetAllocationPool().Allocate(); \
+    } \
+    void classname::operator delete(void *ptr, std::size_t size) \
+    { \
+        if (!ptr) \
+            return; \
+        if (size != sizeof(classname)) \
+            ::operator delete(ptr); \
+        else \
+            GetAllocationPool().Free(ptr); \
+    }
+
+#endif
@@ -20,6 +20,8 @@
 #include "WorldStream.h"
 #include "SceneEvents.h"
 #include "SceneManager.h"
+#include "SceneBinaryFormat.h"
+#include "HighPerfClock.h"
 #include "NetworkEvents.h"
 #include "RealXtend/RexProtocolMsgIDs.h"
 #include "NetworkMessages/NetInMessage.h"
@@ -27,11 +29,13 @@
 #include "Renderer.h"
 #include "ResourceHandler.h"
 #include "OgreTextureResource.h"
+#include "PoolAllocator.h"
 #include "UiServiceInterface.h"
 #include "UiProxyWidget.h"
 #include "EC_OpenSimPresence.h"
 
 #include <utility>
+#include <map>
 
 
 #include <QCryptographicHash>
@@ -106,6 +110,26 @@ void DebugStatsModule::PostInitialize()
         "Loads scene (serializable entities) from an XML file. Usage: \"loadscene(filename)\"",
         Console::Bind(this, &DebugStatsModule::LoadScene)));
         
+    RegisterConsoleCommand(Console::CreateCommand("savescenebinary",
+        "Saves scene (serializable entities) into a binary scene file. Usage: \"savescenebinary(filename)\"",
+        Console::Bind(this, &DebugStatsModule::SaveSceneBinary)));
+    
+    RegisterConsoleCommand(Console::CreateCommand("loadscenebinary",
+        "Loads scene (serializable entities) from a binary scene file. Usage: \"loadscenebinary(filename)\"",
+        Console::Bind(this, &DebugStatsModule::LoadSceneBinary)));
+    
+    RegisterConsoleCommand(Console::CreateCommand("loadsceneasync",
+        "Loads scene (serializable entities) from an XML or binary scene file over several frames. Usage: \"loadsceneasync(filename)\"",
+        Console::Bind(this, &DebugStatsModule::LoadSceneAsync)));
+    
+    RegisterConsoleCommand(Console::CreateCommand("convertscene",
+        "Converts a scene file between XML and binary forms. Usage: \"convertscene(tobinary|toxml, source, destination)\"",
+        Console::Bind(this, &DebugStatsModule::ConvertScene)));
+
+    RegisterConsoleCommand(Console::CreateCommand("poolstats",
+        "Prints allocation statistics of the entity and component memory pools.",
+        Console::Bind(this, &DebugStatsModule::PoolStats)));
+        
     RegisterConsoleCommand(Console::CreateCommand("exec",
         "Invokes action execution in entity",
         Console::Bind(this, &DebugStatsModule::Exec)));
@@ -421,9 +445,11 @@ Console::CommandResult DebugStatsModule::SaveScene(const StringVector &params)
         return Console::ResultFailure("No active scene found.");
     if (params.size() < 1)
         return Console::ResultFailure("No filename given.");
+    Core::tick_t start = Core::GetCurrentClockTime();
     bool success = scene->SaveScene(params[0]);
+    double msecs = (double)(Core::GetCurrentClockTime() - start) * 1000.0 / Core::GetCurrentClockFreq();
     if (success)
-        return Console::ResultSuccess();
+        return Console::ResultSuccess("Saved " + ToString(scene->GetEntityMap().size()) + " entities in " + ToString(msecs) + " ms.");
     else
         return Console::ResultFailure("Failed to save the scene.");
 }
@@ -435,13 +461,118 @@ Console::CommandResult DebugStatsModule::LoadScene(const StringVector &params)
         return Console::ResultFailure("No active scene found.");
     if (params.size() < 1)
         return Console::ResultFailure("No filename given.");
+    Core::tick_t start = Core::GetCurrentClockTime();
     bool success = scene->LoadScene(params[0], AttributeChange::LocalOnly);
+    double msecs = (double)(Core::GetCurrentClockTime() - start) * 1000.0 / Core::GetCurrentClockFreq();
     if (success)
-        return Console::ResultSuccess();
+        return Console::ResultSuccess("Loaded " + ToString(scene->GetEntityMap().size()) + " entities in " + ToString(msecs) + " ms.");
+    else
+        return Console::ResultFailure("Failed to load the scene.");
+}
+
+Console::CommandResult DebugStatsModule::SaveSceneBinary(const StringVector &params)
+{
+    Scene::ScenePtr scene = GetFramework()->GetDefaultWorldScene();
+    if (!scene)
+        return Console::ResultFailure("No active scene found.");
+    if (params.size() < 1)
+        return Console::ResultFailure("No filename given.");
+    Core::tick_t start = Core::GetCurrentClockTime();
+    bool success = scene->SaveSceneBinary(params[0]);
+    double msecs = (double)(Core::GetCurrentClockTime() - start) * 1000.0 / Core::GetCurrentClockFreq();
+    if (success)
+        return Console::ResultSuccess("Saved " + ToString(scene->GetEntityMap().size()) + " entities in " + ToString(msecs) + " ms.");
+    else
+        return Console::ResultFailure("Failed to save the scene.");
+}
+
+Console::CommandResult DebugStatsModule::LoadSceneBinary(const StringVector &params)
+{
+    Scene::ScenePtr scene = GetFramework()->GetDefaultWorldScene();
+    if (!scene)
+        return Console::ResultFailure("No active scene found.");
+    if (params.size() < 1)
+        return Console::ResultFailure("No filename given.");
+    Core::tick_t start = Core::GetCurrentClockTime();
+    bool success = scene->LoadSceneBinary(params[0], AttributeChange::LocalOnly);
+    double msecs = (double)(Core::GetCurrentClockTime() - start) * 1000.0 / Core::GetCurrentClockFreq();
+    if (success)
+        return Console::ResultSuccess("Loaded " + ToString(scene->GetEntityMap().size()) + " entities in " + ToString(msecs) + " ms.");
     else
         return Console::ResultFailure("Failed to load the scene.");
 }
 
+Console::CommandResult DebugStatsModule::LoadSceneAsync(const StringVector &params)
+{
+    Scene::ScenePtr scene = GetFramework()->GetDefaultWorldScene();
+    if (!scene)
+        return Console::ResultFailure("No active scene found.");
+    if (params.size() < 1)
+        return Console::ResultFailure("No filename given.");
+    if (scene->LoadSceneAsync(params[0], AttributeChange::LocalOnly))
+        return Console::ResultSuccess("Scene load started.");
+    else
+        return Console::ResultFailure("Failed to start loading the scene.");
+}
+
+Console::CommandResult DebugStatsModule::ConvertScene(const StringVector &params)
+{
+    if (params.size() < 3)
+        return Console::ResultFailure("Usage: convertscene(tobinary|toxml, source, destination)");
+    bool success = false;
+    if (params[0] == "tobinary")
+        success = Scene::ConvertXmlSceneToBinary(params[1].c_str(), params[2].c_str());
+    else if (params[0] == "toxml")
+        success = Scene::ConvertBinarySceneToXml(params[1].c_str(), params[2].c_str());
+    else
+        return Console::ResultFailure("Unknown conversion " + params[0] + ", use tobinary or toxml.");
+    if (success)
+        return Console::ResultSuccess();
+    else
+        return Console::ResultFailure("Failed to convert the scene.");
+}
+
+Console::CommandResult DebugStatsModule::PoolStats(const StringVector &params)
+{
+    // Classes in static libraries have a pool in each module that uses them, so sum up the pools by name.
+    std::vector<Core::FixedSizePool*> pools = GetFramework()->GetAllocationPools()->GetPools();
+    std::map<std::string, std::pair<Core::FixedSizePool::Stats, uint> > totals;
+    std::map<std::string, std::size_t> block_sizes;
+    for(uint i = 0; i < pools.size(); ++i)
+    {
+        Core::FixedSizePool::Stats stats = pools[i]->GetStats();
+        std::pair<Core::FixedSizePool::Stats, uint> &total = totals[pools[i]->GetName()];
+        if (!total.second)
+        {
+            total.first = stats;
+            block_sizes[pools[i]->GetName()] = pools[i]->GetBlockSize();
+        }
+        else
+        {
+            total.first.allocations += stats.allocations;
+            total.first.frees += stats.frees;
+            total.first.live += stats.live;
+            total.first.peak_live += stats.peak_live;
+            total.first.chunk_allocations += stats.chunk_allocations;
+            total.first.chunks += stats.chunks;
+        }
+        ++total.second;
+    }
+
+    std::string result;
+    std::map<std::string, std::pair<Core::FixedSizePool::Stats, uint> >::const_iterator i = totals.begin();
+    for(; i != totals.end(); ++i)
+    {
+        const Core::FixedSizePool::Stats &stats = i->second.first;
+        result += i->first + " (" + ToString(block_sizes[i->first]) + " bytes, " + ToString(i->second.second) + " pools): " +
+            ToString(stats.live) + " live, " + ToString(stats.peak_live) + " peak, " +
+            ToString(stats.allocations) + " allocations, " + ToString(stats.frees) + " frees, " +
+            ToString(stats.chunks) + " chunks (" + ToString(stats.chunk_allocations) + " chunk allocations)\n";
+    }
+
+    return Console::ResultSuccess(result);
+}
+
 Console::CommandResult DebugStatsModule::DumpTextures(const StringVector &params)
 {
     boost::shared_ptr<OgreRenderer::Renderer> renderer = GetFramework()->GetServiceManager()->GetService
@@ -96,6 +96,21 @@ namespace DebugStats
         /// Loads scene from an XML file. Expect crashes and/or emptiness.
         Console::CommandResult LoadScene(const StringVector &params);
 
+        /// Saves scene to a binary scene file and reports the time taken.
+        Console::CommandResult SaveSceneBinary(const StringVector &params);
+
+        /// Loads scene from a binary scene file and reports the time taken.
+        Console::CommandResult LoadSceneBinary(const StringVector &params);
+
+        /// Starts loading scene asynchronously from an XML or binary scene file.
+        Console::CommandResult LoadSceneAsync(const StringVector &params);
+
+        /// Converts a scene file between the XML and binary forms.
+        Console::CommandResult ConvertScene(const StringVector &params);
+
+        /// Prints allocation statistics of the entity and component memory pools.
+        Console::CommandResult PoolStats(const StringVector &params);
+
         /// Invokes action in entity.
         Console::CommandResult Exec(const StringVector &params);
 
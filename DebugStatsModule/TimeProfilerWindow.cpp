@@ -15,6 +15,9 @@
 #include "WorldStream.h"
 #include "SceneManager.h"
 #include "RenderServiceInterface.h"
+#include "Renderer.h"
+#include "ResourceHandler.h"
+#include "SharedMeshCache.h"
 #include "EC_OpenSimPrim.h"
 #include "EC_OgreMesh.h"
 #include "EC_OgreCustomObject.h"
@@ -1658,6 +1661,19 @@ void TimeProfilerWindow::RefreshSceneComplexityProfilingData()
     text << "# of avg. triangles per batch: " << triangles / (batches ? batches : 1) << std::endl;
     text << "Avg. FPS: " << avgfps << std::endl;
     text << std::endl;
+
+    boost::shared_ptr<OgreRenderer::Renderer> ogre_renderer =
+        framework_->GetServiceManager()->GetService<OgreRenderer::Renderer>(Foundation::Service::ST_Renderer).lock();
+    if (ogre_renderer && ogre_renderer->GetResourceHandler())
+    {
+        OgreRenderer::ResourceHandlerPtr resource_handler = ogre_renderer->GetResourceHandler();
+        text << "Texture uploads" << std::endl;
+        text << "# of textures uploaded last frame: " << resource_handler->GetNumTextureUploads() << std::endl;
+        text << "Kilobytes uploaded last frame: " << resource_handler->GetTextureUploadBytes() / 1024 << std::endl;
+        text << "Upload time last frame: " << floor(resource_handler->GetTextureUploadTime() * 100000.0) / 100.0 << " ms" << std::endl;
+        text << "# of textures waiting for upload: " << resource_handler->GetNumQueuedTextureUploads() << std::endl;
+        text << std::endl;
+    }
     
     uint entities = 0;
     uint prims = 0;
@@ -1827,6 +1843,17 @@ void TimeProfilerWindow::RefreshSceneComplexityProfilingData()
     text << "# of avg. triangles in the scene per mesh: " << mesh_instance_triangles / (mesh_instances ? mesh_instances : 1) << std::endl;
     text << std::endl;
     
+    if (ogre_renderer)
+    {
+        OgreRenderer::SharedMeshCache* shared_meshes = ogre_renderer->GetSharedMeshCache();
+        text << "Shared prim meshes" << std::endl;
+        text << "# of shared meshes: " << shared_meshes->GetNumMeshes() << std::endl;
+        text << "# of prims using shared meshes: " << shared_meshes->GetNumUsers() << std::endl;
+        text << "Shared mesh data size: " << shared_meshes->GetMeshMemory() / 1024 << " KBytes (" <<
+            shared_meshes->GetUnsharedMemory() / 1024 << " KBytes unshared)" << std::endl;
+        text << std::endl;
+    }
+    
     // Go through all textures and see which of them are in the scene
     Ogre::ResourceManager::ResourceMapIterator tex_iter = ((Ogre::ResourceManager*)Ogre::TextureManager::getSingletonPtr())->getResourceIterator();
     while (tex_iter.hasMoreElements())
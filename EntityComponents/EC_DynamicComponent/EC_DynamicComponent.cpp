@@ -65,6 +65,36 @@ void EC_DynamicComponent::DeserializeFrom(QDomElement& element, AttributeChange:
         child = child.nextSiblingElement("attribute");
     }
 
+    DeserializeAttributes(deserializedAttributes);
+}
+
+void EC_DynamicComponent::SerializeToAttributes(Foundation::SerializedAttributeVector& attributes) const
+{
+    AttributeVector::const_iterator iter = attributes_.begin();
+    while(iter != attributes_.end())
+    {
+        Foundation::SerializedAttribute attr;
+        attr.name = (*iter)->GetNameString();
+        attr.value = (*iter)->ToString();
+        attr.type = (*iter)->TypenameToString();
+        attributes.push_back(attr);
+        iter++;
+    }
+}
+
+void EC_DynamicComponent::DeserializeFromAttributes(const QString& name, const Foundation::SerializedAttributeVector& attributes, AttributeChange::Type change)
+{
+    SetName(name);
+
+    std::vector<DeserializeData> deserializedAttributes;
+    for(uint i = 0; i < attributes.size(); ++i)
+        deserializedAttributes.push_back(DeserializeData(attributes[i].name, attributes[i].type, attributes[i].value));
+
+    DeserializeAttributes(deserializedAttributes);
+}
+
+void EC_DynamicComponent::DeserializeAttributes(std::vector<DeserializeData> &deserializedAttributes)
+{
     // Sort both lists in alphabetical order.
     AttributeVector oldAttributes = attributes_;
     std::stable_sort(oldAttributes.begin(), oldAttributes.end(), &CmpAttributeByName);
@@ -62,6 +62,10 @@ public:
 
     void DeserializeFrom(QDomElement& element, AttributeChange::Type change);
 
+    void SerializeToAttributes(Foundation::SerializedAttributeVector& attributes) const;
+
+    void DeserializeFromAttributes(const QString& name, const Foundation::SerializedAttributeVector& attributes, AttributeChange::Type change);
+
     /// Constructs a new attribute of type Attribute<T>.
     template<typename T>
     void AddAttribute(const QString &name)
@@ -117,6 +121,9 @@ public slots:
 
 private:
     explicit EC_DynamicComponent(Foundation::ModuleInterface *module);
+
+    //! Adds, removes and updates attributes so that they match the deserialized list. Shared by the XML and attribute list deserialization.
+    void DeserializeAttributes(std::vector<DeserializeData> &deserializedAttributes);
 };
 
 #endif
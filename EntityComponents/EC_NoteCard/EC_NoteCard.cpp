@@ -86,6 +86,35 @@ void EC_NoteCard::DeserializeFrom(QDomElement& element, AttributeChange::Type ch
     text_ = ReadAttribute(element, "text");
 }
 
+void EC_NoteCard::SerializeToAttributes(Foundation::SerializedAttributeVector& attributes) const
+{
+    // No xml escaping limitations here, so store title & text as they are
+    Foundation::SerializedAttribute title;
+    title.name = "title";
+    title.value = title_;
+    attributes.push_back(title);
+    
+    Foundation::SerializedAttribute text;
+    text.name = "text";
+    text.value = text_;
+    attributes.push_back(text);
+}
+
+void EC_NoteCard::DeserializeFromAttributes(const QString& name, const Foundation::SerializedAttributeVector& attributes, AttributeChange::Type change)
+{
+    SetName(name);
+    
+    title_.clear();
+    text_.clear();
+    for (uint i = 0; i < attributes.size(); ++i)
+    {
+        if (attributes[i].name == "title")
+            title_ = attributes[i].value;
+        else if (attributes[i].name == "text")
+            text_ = attributes[i].value;
+    }
+}
+
 void EC_NoteCard::SetTitle(const std::string& title)
 {
     title_ = title;
@@ -24,6 +24,8 @@ public:
     virtual bool IsSerializable() const { return true; }
     virtual void SerializeTo(QDomDocument& doc, QDomElement& base_element) const;
     virtual void DeserializeFrom(QDomElement& element, AttributeChange::Type change);
+    virtual void SerializeToAttributes(Foundation::SerializedAttributeVector& attributes) const;
+    virtual void DeserializeFromAttributes(const QString& name, const Foundation::SerializedAttributeVector& attributes, AttributeChange::Type change);
     
     void Show();
     void Hide();
@@ -15,6 +15,8 @@
 
 DEFINE_POCO_LOGGING_FUNCTIONS("EC_OpenSimPrim");
 
+DEFINE_POOL_ALLOCATED(EC_OpenSimPrim)
+
 EC_OpenSimPrim::EC_OpenSimPrim(Foundation::ModuleInterface* module) :
     Foundation::ComponentInterface(module->GetFramework()),
     editor_(0),
@@ -12,6 +12,7 @@
 #include "RexUUID.h"
 #include "Color.h"
 #include "Declare_EC.h"
+#include "PoolAllocator.h"
 
 #include <QVariant>
 #include <QStringList>
@@ -44,6 +45,7 @@ typedef std::map<uint8_t, float> UVParamMap;
 class EC_OpenSimPrim : public Foundation::ComponentInterface
 {
     DECLARE_EC(EC_OpenSimPrim);
+    DECLARE_POOL_ALLOCATED(EC_OpenSimPrim)
 
     Q_OBJECT
     Q_PROPERTY(QString FullId READ getFullId DESIGNABLE false)
@@ -17,6 +17,7 @@
 #include "ServiceManager.h"
 #include "OgreMaterialUtils.h"
 #include "TextureInterface.h"
+#include "BlockCompression.h"
 #include "TextureServiceInterface.h"
 #include "InputEvents.h"
 #include "InputServiceInterface.h"
@@ -2090,6 +2091,17 @@ namespace Environment
         uint img_height       = tex.GetHeight(); 
         uint img_components   = tex.GetComponents();
         u8 *data              = tex.GetData();
+
+        // Compressed textures are converted through RGBA
+        std::vector<u8> decompressed;
+        if (Foundation::BlockCompression::IsCompressed(tex.GetFormat()))
+        {
+            decompressed.resize(img_width * img_height * 4);
+            Foundation::BlockCompression::DecompressLevel(data, img_width, img_height, (Foundation::BlockCompression::Format)tex.GetFormat(), &decompressed[0]);
+            data = &decompressed[0];
+            img_components = 4;
+        }
+
         uint img_width_step   = img_width * img_components;
         QImage image;
 
@@ -0,0 +1,394 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "AsyncFileIO.h"
+#include "CacheCompression.h"
+#include "MappedFile.h"
+#include "HighPerfClock.h"
+
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+
+namespace
+{
+    //! Orders batch indices by file name and offset
+    template <typename T> struct CompareFileNames
+    {
+        const std::vector<T> &batch_;
+        CompareFileNames(const std::vector<T> &batch) : batch_(batch) {}
+        bool operator ()(uint lhs, uint rhs) const
+        {
+            if (batch_[lhs].filename_ != batch_[rhs].filename_)
+                return batch_[lhs].filename_ < batch_[rhs].filename_;
+            return batch_[lhs].offset_ < batch_[rhs].offset_;
+        }
+    };
+}
+
+namespace Foundation
+{
+    AsyncFileIO::AsyncFileIO(uint num_threads, uint batch_size) :
+        pending_(0),
+        next_id_(1),
+        batch_size_(std::max(batch_size, 1u)),
+        keep_running_(true)
+    {
+        for(uint i = 0; i < std::max(num_threads, 1u); ++i)
+            threads_.create_thread(boost::bind(&AsyncFileIO::Work, this));
+    }
+
+    AsyncFileIO::~AsyncFileIO()
+    {
+        {
+            MutexLock lock(mutex_);
+            keep_running_ = false;
+            requests_.clear();
+        }
+        request_condition_.notify_all();
+        threads_.join_all();
+    }
+
+    uint AsyncFileIO::Read(const std::string &filename, bool decompress)
+    {
+        Request request;
+        request.filename_ = filename;
+        request.write_ = false;
+        request.map_ = false;
+        request.touch_ = false;
+        request.overwrite_ = false;
+        request.range_ = false;
+        request.compression_ = decompress;
+        request.offset_ = 0;
+        request.size_ = 0;
+        request.external_data_ = 0;
+        request.external_size_ = 0;
+        return Queue(request);
+    }
+
+    uint AsyncFileIO::Read(const std::string &filename, qint64 offset, uint size, bool decompress)
+    {
+        Request request;
+        request.filename_ = filename;
+        request.write_ = false;
+        request.map_ = false;
+        request.touch_ = false;
+        request.overwrite_ = false;
+        request.range_ = true;
+        request.compression_ = decompress;
+        request.offset_ = offset;
+        request.size_ = size;
+        request.external_data_ = 0;
+        request.external_size_ = 0;
+        return Queue(request);
+    }
+
+    uint AsyncFileIO::Map(const std::string &filename, bool touch)
+    {
+        Request request;
+        request.filename_ = filename;
+        request.write_ = false;
+        request.map_ = true;
+        request.touch_ = touch;
+        request.overwrite_ = false;
+        request.range_ = false;
+        request.compression_ = false;
+        request.offset_ = 0;
+        request.size_ = 0;
+        request.external_data_ = 0;
+        request.external_size_ = 0;
+        return Queue(request);
+    }
+
+    uint AsyncFileIO::Write(const std::string &filename, std::vector<u8> &data, bool overwrite, bool compress)
+    {
+        Request request;
+        request.filename_ = filename;
+        request.write_ = true;
+        request.map_ = false;
+        request.touch_ = false;
+        request.overwrite_ = overwrite;
+        request.range_ = false;
+        request.compression_ = compress;
+        request.offset_ = 0;
+        request.size_ = 0;
+        request.data_.swap(data);
+        request.external_data_ = 0;
+        request.external_size_ = 0;
+        return Queue(request);
+    }
+
+    uint AsyncFileIO::Write(const std::string &filename, const u8 *data, uint size, boost::shared_ptr<const void> owner, bool overwrite,
+        bool compress)
+    {
+        Request request;
+        request.filename_ = filename;
+        request.write_ = true;
+        request.map_ = false;
+        request.touch_ = false;
+        request.overwrite_ = overwrite;
+        request.range_ = false;
+        request.compression_ = compress;
+        request.offset_ = 0;
+        request.size_ = 0;
+        request.external_data_ = data;
+        request.external_size_ = size;
+        request.owner_ = owner;
+        return Queue(request);
+    }
+
+    void AsyncFileIO::Request::Swap(Request &rhs)
+    {
+        std::swap(id_, rhs.id_);
+        filename_.swap(rhs.filename_);
+        std::swap(write_, rhs.write_);
+        std::swap(map_, rhs.map_);
+        std::swap(touch_, rhs.touch_);
+        std::swap(overwrite_, rhs.overwrite_);
+        std::swap(range_, rhs.range_);
+        std::swap(compression_, rhs.compression_);
+        std::swap(offset_, rhs.offset_);
+        std::swap(size_, rhs.size_);
+        data_.swap(rhs.data_);
+        std::swap(external_data_, rhs.external_data_);
+        std::swap(external_size_, rhs.external_size_);
+        owner_.swap(rhs.owner_);
+    }
+
+    uint AsyncFileIO::Queue(Request &request)
+    {
+        uint id;
+        {
+            MutexLock lock(mutex_);
+            id = next_id_++;
+            if (!next_id_)
+                next_id_ = 1;
+            request.id_ = id;
+            requests_.push_back(Request());
+            requests_.back().Swap(request);
+            ++pending_;
+        }
+
+        request_condition_.notify_one();
+        return id;
+    }
+
+    FileIOResultVector AsyncFileIO::GetResults()
+    {
+        FileIOResultVector results;
+        MutexLock lock(mutex_);
+        results.swap(results_);
+        return results;
+    }
+
+    uint AsyncFileIO::GetPendingCount() const
+    {
+        MutexLock lock(mutex_);
+        return pending_;
+    }
+
+    void AsyncFileIO::Work()
+    {
+        std::vector<Request> batch;
+        std::vector<uint> order;
+        std::vector<u8> compressed;
+
+        for(;;)
+        {
+            {
+                ScopedLock lock(mutex_);
+                while(requests_.empty() && keep_running_)
+                    request_condition_.wait(lock);
+                if (!keep_running_)
+                    return;
+
+                uint count = std::min((uint)requests_.size(), batch_size_);
+                batch.resize(count);
+                for(uint i = 0; i < count; ++i)
+                {
+                    batch[i].Swap(requests_.front());
+                    requests_.pop_front();
+                }
+            }
+
+            // Process the batch in file name and offset order
+            order.resize(batch.size());
+            for(uint i = 0; i < order.size(); ++i)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), CompareFileNames<Request>(batch));
+
+            FileIOResultVector results(batch.size());
+            for(uint n = 0; n < order.size(); ++n)
+            {
+                Request &request = batch[order[n]];
+                FileIOResult &result = results[n];
+                result.id_ = request.id_;
+                result.filename_ = request.filename_;
+                result.write_ = request.write_;
+                result.compressed_ = false;
+                result.stored_size_ = 0;
+                result.decode_time_ = 0.0;
+                if (request.write_)
+                {
+                    const u8 *data = request.external_data_;
+                    uint size = request.external_size_;
+                    if (!data)
+                    {
+                        data = request.data_.empty() ? 0 : &request.data_[0];
+                        size = request.data_.size();
+                    }
+
+                    if (request.compression_ && CacheCompression::Compress(data, size, compressed))
+                    {
+                        data = &compressed[0];
+                        size = compressed.size();
+                        result.compressed_ = true;
+                    }
+                    result.stored_size_ = size;
+
+                    if (!request.overwrite_ && boost::filesystem::exists(request.filename_))
+                        result.success_ = false;
+                    else
+                        result.success_ = WriteFile(request.filename_, data, size);
+                }
+                else if (request.map_)
+                {
+                    result.mapping_.reset(new MappedFile(QString::fromStdString(request.filename_)));
+                    result.success_ = result.mapping_->GetData() != 0;
+                    if (result.success_)
+                    {
+                        result.stored_size_ = (uint)result.mapping_->GetSize();
+
+                        // Read a byte of each page, so that the data is paged in here rather than on the user's thread
+                        if (request.touch_)
+                        {
+                            const u8 *data = result.mapping_->GetData();
+                            volatile u8 sum = 0;
+                            for(qint64 offset = 0; offset < result.mapping_->GetSize(); offset += 4096)
+                                sum += data[offset];
+                        }
+                    }
+                    else
+                        result.mapping_.reset();
+                }
+                else
+                {
+                    if (request.range_)
+                        result.success_ = ReadFile(request.filename_, request.offset_, request.size_, result.data_);
+                    else
+                        result.success_ = ReadFile(request.filename_, result.data_);
+                    result.stored_size_ = result.data_.size();
+
+                    if (result.success_ && request.compression_ && !result.data_.empty() &&
+                        CacheCompression::IsCompressed(&result.data_[0], result.data_.size()))
+                    {
+                        Core::tick_t start = Core::GetCurrentClockTime();
+                        result.success_ = CacheCompression::Decompress(&result.data_[0], result.data_.size(), compressed);
+                        result.data_.swap(compressed);
+                        result.compressed_ = true;
+                        result.decode_time_ = (double)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+                    }
+                }
+                std::vector<u8>().swap(compressed);
+
+                // Release written data, and the owner, right away
+                std::vector<u8>().swap(request.data_);
+                request.owner_.reset();
+            }
+
+            {
+                MutexLock lock(mutex_);
+                for(uint i = 0; i < results.size(); ++i)
+                {
+                    results_.push_back(FileIOResult());
+                    FileIOResult &result = results_.back();
+                    result.id_ = results[i].id_;
+                    result.filename_.swap(results[i].filename_);
+                    result.write_ = results[i].write_;
+                    result.success_ = results[i].success_;
+                    result.compressed_ = results[i].compressed_;
+                    result.stored_size_ = results[i].stored_size_;
+                    result.decode_time_ = results[i].decode_time_;
+                    result.data_.swap(results[i].data_);
+                    result.mapping_.swap(results[i].mapping_);
+                }
+                pending_ -= results.size();
+            }
+            done_condition_.notify_all();
+        }
+    }
+
+    void AsyncFileIO::WaitForPending()
+    {
+        ScopedLock lock(mutex_);
+        while(pending_ && keep_running_)
+            done_condition_.wait(lock);
+    }
+
+    bool AsyncFileIO::ReadFile(const std::string &filename, std::vector<u8> &data)
+    {
+        std::ifstream filestr(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!filestr.good())
+            return false;
+
+        filestr.seekg(0, std::ios::end);
+        std::streamoff length = filestr.tellg();
+        filestr.seekg(0, std::ios::beg);
+        if (length < 0)
+            return false;
+
+        data.resize((size_t)length);
+        if (length)
+            filestr.read((char *)&data[0], length);
+        return filestr.good();
+    }
+
+    bool AsyncFileIO::ReadFile(const std::string &filename, qint64 offset, uint size, std::vector<u8> &data)
+    {
+        std::ifstream filestr(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!filestr.good())
+            return false;
+
+        filestr.seekg(offset, std::ios::beg);
+        data.resize(size);
+        if (size)
+            filestr.read((char *)&data[0], size);
+        return filestr.good();
+    }
+
+    bool AsyncFileIO::WriteFile(const std::string &filename, const u8 *data, uint size)
+    {
+        // Each thread uses its own temporary file, in case several write the same file
+        std::ostringstream temp_stream;
+        temp_stream << filename << "." << boost::this_thread::get_id() << ".tmp";
+        std::string temp_filename = temp_stream.str();
+
+        {
+            std::ofstream filestr(temp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!filestr.good())
+                return false;
+
+            if (size)
+                filestr.write((const char *)data, size);
+            filestr.close();
+            if (filestr.fail())
+            {
+                std::remove(temp_filename.c_str());
+                return false;
+            }
+        }
+
+        // Renaming over an existing file fails on some platforms, in which case the old file is removed first
+        if (std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(filename.c_str());
+            if (std::rename(temp_filename.c_str(), filename.c_str()) != 0)
+            {
+                std::remove(temp_filename.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,194 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Foundation_AsyncFileIO_h
+#define incl_Foundation_AsyncFileIO_h
+
+#include "CoreTypes.h"
+#include "CoreThread.h"
+
+#include <deque>
+
+namespace Foundation
+{
+    class MappedFile;
+
+    //! Result of an asynchronous file operation
+    struct FileIOResult
+    {
+        //! Request id, as returned by AsyncFileIO::Read(), AsyncFileIO::Map() or AsyncFileIO::Write()
+        uint id_;
+
+        //! File name
+        std::string filename_;
+
+        //! Whether the request was a write
+        bool write_;
+
+        //! Whether the operation succeeded. A write that was skipped because the file existed counts as failed.
+        bool success_;
+
+        //! Whether the data was compressed in the file
+        bool compressed_;
+
+        //! Size of the data in the file
+        uint stored_size_;
+
+        //! Time spent decompressing, in seconds
+        double decode_time_;
+
+        //! Data read. Empty for writes and maps.
+        std::vector<u8> data_;
+
+        //! Mapped file, for requests made with Map(). Null if the file could not be mapped.
+        boost::shared_ptr<MappedFile> mapping_;
+    };
+
+    typedef std::vector<FileIOResult> FileIOResultVector;
+
+    //! Reads and writes whole files on a pool of worker threads, so that disk caches do not stall the main thread.
+    /*! Requests are queued with Read() and Write(), and the results are collected on the owner's thread with
+        GetResults(), typically once per frame. Workers take up to batch_size queued requests at a time and process
+        them in file name and offset order, so that files in the same directory, or parts of the same file, are read back
+        to back. Compression and decompression of cache entries is done by the workers too. Map() opens and maps a file on
+        a worker, for data that is used in place.
+
+        The static ReadFile() and WriteFile() functions perform the same operations synchronously, for callers that
+        need the data right away.
+     */
+    class AsyncFileIO
+    {
+    public:
+        //! Constructor. Starts the worker threads.
+        /*! \param num_threads Number of worker threads
+            \param batch_size Maximum number of requests a worker takes from the queue at once
+         */
+        AsyncFileIO(uint num_threads = 2, uint batch_size = 8);
+
+        //! Destructor. Discards requests not yet started and waits for the workers to finish.
+        ~AsyncFileIO();
+
+        //! Queues a file read. Returns request id.
+        /*! \param filename File name
+            \param decompress Whether to decompress the data if it was compressed with CacheCompression
+         */
+        uint Read(const std::string &filename, bool decompress = false);
+
+        //! Queues a read of part of a file. Returns request id.
+        /*! \param filename File name
+            \param offset Offset to read from
+            \param size Number of bytes to read. The read fails if the file is shorter.
+            \param decompress Whether to decompress the data if it was compressed with CacheCompression
+         */
+        uint Read(const std::string &filename, qint64 offset, uint size, bool decompress = false);
+
+        //! Queues opening and memory mapping a file, so that neither stalls the caller. Returns request id.
+        /*! \param filename File name
+            \param touch Whether to also read a byte of each page, so that the data is paged in before it is used
+         */
+        uint Map(const std::string &filename, bool touch = false);
+
+        //! Queues a file write. The data is swapped out of the vector given. Returns request id.
+        /*! \param filename File name
+            \param data Data to write. Left empty.
+            \param overwrite Whether to overwrite an existing file. If false and the file exists, the write fails.
+            \param compress Whether to compress the data with CacheCompression, if it shrinks enough
+         */
+        uint Write(const std::string &filename, std::vector<u8> &data, bool overwrite = true, bool compress = false);
+
+        //! Queues a file write without copying the data. Returns request id.
+        /*! \param filename File name
+            \param data Data to write
+            \param size Data size
+            \param owner Object owning the data, kept alive until the data has been written
+            \param overwrite Whether to overwrite an existing file
+            \param compress Whether to compress the data with CacheCompression, if it shrinks enough
+         */
+        uint Write(const std::string &filename, const u8 *data, uint size, boost::shared_ptr<const void> owner, bool overwrite = true,
+            bool compress = false);
+
+        //! Returns results completed since the last call
+        FileIOResultVector GetResults();
+
+        //! Returns number of queued and ongoing requests
+        uint GetPendingCount() const;
+
+        //! Blocks until all queued and ongoing requests have completed. Their results are left for GetResults().
+        void WaitForPending();
+
+        //! Reads a file synchronously. Returns true if successful.
+        static bool ReadFile(const std::string &filename, std::vector<u8> &data);
+
+        //! Reads part of a file synchronously. Returns true if successful.
+        static bool ReadFile(const std::string &filename, qint64 offset, uint size, std::vector<u8> &data);
+
+        //! Writes a file synchronously. Returns true if successful.
+        /*! The data is written to a temporary file first, which then replaces the file, so that a failed or interrupted
+            write does not leave a truncated file behind.
+         */
+        static bool WriteFile(const std::string &filename, const u8 *data, uint size);
+
+    private:
+        AsyncFileIO(const AsyncFileIO &);
+        AsyncFileIO &operator =(const AsyncFileIO &);
+
+        //! Queued request
+        struct Request
+        {
+            uint id_;
+            std::string filename_;
+            bool write_;
+            bool map_;
+            bool touch_;
+            bool overwrite_;
+            bool range_;
+            bool compression_;
+            qint64 offset_;
+            uint size_;
+            std::vector<u8> data_;
+            const u8 *external_data_;
+            uint external_size_;
+            boost::shared_ptr<const void> owner_;
+
+            //! Swaps contents without copying the data
+            void Swap(Request &rhs);
+        };
+
+        //! Queues a request and wakes up a worker
+        uint Queue(Request &request);
+
+        //! Worker thread function
+        void Work();
+
+        //! Worker threads
+        boost::thread_group threads_;
+
+        //! Queued requests
+        std::deque<Request> requests_;
+
+        //! Completed results
+        FileIOResultVector results_;
+
+        //! Number of queued and ongoing requests
+        uint pending_;
+
+        //! Next request id
+        uint next_id_;
+
+        //! Maximum requests per batch
+        uint batch_size_;
+
+        //! Whether the workers should keep running
+        bool keep_running_;
+
+        //! Guards the requests, results and counters
+        mutable Mutex mutex_;
+
+        //! Signaled when requests are queued or the workers should stop
+        Condition request_condition_;
+
+        //! Signaled when a batch of requests has completed
+        Condition done_condition_;
+    };
+}
+
+#endif
@@ -0,0 +1,345 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "BlockCompression.h"
+#include "PixelConversion.h"
+
+#include <boost/cstdint.hpp>
+
+namespace
+{
+    //! Expands pixels of 1 to 4 bytes into RGBA
+    void ExpandToRgba(const u8 *input, uint num_pixels, uint components, u8 *output)
+    {
+        for(uint i = 0; i < num_pixels; ++i)
+        {
+            const u8 *in = input + i * components;
+            u8 *out = output + i * 4;
+            switch (components)
+            {
+            case 1:
+                out[0] = out[1] = out[2] = in[0];
+                out[3] = 255;
+                break;
+
+            case 2:
+                out[0] = out[1] = out[2] = in[0];
+                out[3] = in[1];
+                break;
+
+            case 3:
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                out[3] = 255;
+                break;
+
+            default:
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                out[3] = in[3];
+                break;
+            }
+        }
+    }
+
+    //! Halves RGBA pixels to the next mip level. A dimension of 1 stays 1.
+    void HalveRgba(const u8 *input, uint width, uint height, u8 *output)
+    {
+        if (width >= 2 && height >= 2)
+        {
+            Foundation::PixelConversion::DownsampleHalf(input, width, height, 4, output);
+            return;
+        }
+
+        // One row or column left: average pairs along it
+        uint count = std::max(width, height) / 2;
+        for(uint i = 0; i < count; ++i)
+            for(uint c = 0; c < 4; ++c)
+                output[i * 4 + c] = (u8)((input[i * 8 + c] + input[i * 8 + 4 + c] + 1) >> 1);
+    }
+
+    u16 ToRgb565(const u8 *color)
+    {
+        return (u16)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+    }
+
+    void FromRgb565(u16 value, u8 *color)
+    {
+        u8 r = (value >> 11) & 0x1f;
+        u8 g = (value >> 5) & 0x3f;
+        u8 b = value & 0x1f;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    //! Encodes the colors of a 4x4 block of RGBA pixels into 8 bytes
+    void EncodeColorBlock(const u8 block[16][4], u8 *output)
+    {
+        u8 min_color[3] = { 255, 255, 255 };
+        u8 max_color[3] = { 0, 0, 0 };
+        for(uint i = 0; i < 16; ++i)
+        {
+            for(uint c = 0; c < 3; ++c)
+            {
+                min_color[c] = std::min(min_color[c], block[i][c]);
+                max_color[c] = std::max(max_color[c], block[i][c]);
+            }
+        }
+
+        // Inset the bounding box, so that the endpoints are not pulled to outlying colors
+        for(uint c = 0; c < 3; ++c)
+        {
+            u8 inset = (max_color[c] - min_color[c]) >> 4;
+            min_color[c] += inset;
+            max_color[c] -= inset;
+        }
+
+        // The maximum is never below the minimum, so color0 >= color1, which selects the four color mode
+        u16 color0 = ToRgb565(max_color);
+        u16 color1 = ToRgb565(min_color);
+        u32 indices = 0;
+        if (color0 != color1)
+        {
+            int palette[4][3];
+            u8 endpoint[3];
+            FromRgb565(color0, endpoint);
+            for(uint c = 0; c < 3; ++c)
+                palette[0][c] = endpoint[c];
+            FromRgb565(color1, endpoint);
+            for(uint c = 0; c < 3; ++c)
+            {
+                palette[1][c] = endpoint[c];
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for(uint i = 0; i < 16; ++i)
+            {
+                uint best = 0;
+                int best_distance = 0x7fffffff;
+                for(uint p = 0; p < 4; ++p)
+                {
+                    int distance = 0;
+                    for(uint c = 0; c < 3; ++c)
+                    {
+                        int d = block[i][c] - palette[p][c];
+                        distance += d * d;
+                    }
+                    if (distance < best_distance)
+                    {
+                        best_distance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (i * 2);
+            }
+        }
+
+        output[0] = color0 & 0xff;
+        output[1] = color0 >> 8;
+        output[2] = color1 & 0xff;
+        output[3] = color1 >> 8;
+        for(uint i = 0; i < 4; ++i)
+            output[4 + i] = (indices >> (i * 8)) & 0xff;
+    }
+
+    //! Encodes the alpha of a 4x4 block of RGBA pixels into 8 bytes
+    void EncodeAlphaBlock(const u8 block[16][4], u8 *output)
+    {
+        u8 min_alpha = 255;
+        u8 max_alpha = 0;
+        for(uint i = 0; i < 16; ++i)
+        {
+            min_alpha = std::min(min_alpha, block[i][3]);
+            max_alpha = std::max(max_alpha, block[i][3]);
+        }
+
+        // With alpha0 > alpha1, the indices select alpha0, alpha1 and six steps between them, from alpha0 towards alpha1
+        boost::uint64_t indices = 0;
+        uint range = max_alpha - min_alpha;
+        if (range)
+        {
+            for(uint i = 0; i < 16; ++i)
+            {
+                uint step = ((block[i][3] - min_alpha) * 7 + range / 2) / range;
+                boost::uint64_t index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+                indices |= index << (i * 3);
+            }
+        }
+
+        output[0] = max_alpha;
+        output[1] = min_alpha;
+        for(uint i = 0; i < 6; ++i)
+            output[2 + i] = (u8)((indices >> (i * 8)) & 0xff);
+    }
+
+    //! Encodes one level of RGBA pixels
+    void EncodeLevel(const u8 *input, uint width, uint height, Foundation::BlockCompression::Format format, u8 *output)
+    {
+        uint block_size = format == Foundation::BlockCompression::DXT1 ? 8 : 16;
+        for(uint by = 0; by < height; by += 4)
+        {
+            for(uint bx = 0; bx < width; bx += 4)
+            {
+                // Levels smaller than a block repeat their last row and column
+                u8 block[16][4];
+                for(uint y = 0; y < 4; ++y)
+                {
+                    const u8 *row = input + std::min(by + y, height - 1) * width * 4;
+                    for(uint x = 0; x < 4; ++x)
+                        memcpy(block[y * 4 + x], row + std::min(bx + x, width - 1) * 4, 4);
+                }
+
+                if (format == Foundation::BlockCompression::DXT5)
+                {
+                    EncodeAlphaBlock(block, output);
+                    EncodeColorBlock(block, output + 8);
+                }
+                else
+                    EncodeColorBlock(block, output);
+                output += block_size;
+            }
+        }
+    }
+}
+
+namespace Foundation
+{
+    uint BlockCompression::GetMipLevels(uint width, uint height)
+    {
+        uint levels = 1;
+        while (width > 1 || height > 1)
+        {
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+            ++levels;
+        }
+        return levels;
+    }
+
+    uint BlockCompression::GetLevelSize(uint width, uint height, Format format)
+    {
+        return ((width + 3) / 4) * ((height + 3) / 4) * (format == DXT1 ? 8 : 16);
+    }
+
+    uint BlockCompression::GetChainSize(uint width, uint height, Format format)
+    {
+        uint size = GetLevelSize(width, height, format);
+        while (width > 1 || height > 1)
+        {
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+            size += GetLevelSize(width, height, format);
+        }
+        return size;
+    }
+
+    bool BlockCompression::HasTranslucency(const u8 *input, uint num_pixels, uint components)
+    {
+        if (components != 2 && components != 4)
+            return false;
+
+        for(uint i = components - 1; i < num_pixels * components; i += components)
+            if (input[i] != 255)
+                return true;
+        return false;
+    }
+
+    bool BlockCompression::CompressChain(const u8 *input, uint width, uint height, uint components, Format format, u8 *output)
+    {
+        if (components < 1 || components > 4 || !width || !height || width % 4 || height % 4)
+            return false;
+
+        std::vector<u8> level(width * height * 4);
+        ExpandToRgba(input, width * height, components, &level[0]);
+
+        std::vector<u8> next;
+        for(;;)
+        {
+            EncodeLevel(&level[0], width, height, format, output);
+            output += GetLevelSize(width, height, format);
+            if (width == 1 && height == 1)
+                break;
+
+            uint next_width = std::max(width / 2, 1u);
+            uint next_height = std::max(height / 2, 1u);
+            next.resize(next_width * next_height * 4);
+            HalveRgba(&level[0], width, height, &next[0]);
+            level.swap(next);
+            width = next_width;
+            height = next_height;
+        }
+
+        return true;
+    }
+
+    void BlockCompression::DecompressLevel(const u8 *input, uint width, uint height, Format format, u8 *output)
+    {
+        for(uint by = 0; by < height; by += 4)
+        {
+            for(uint bx = 0; bx < width; bx += 4)
+            {
+                u8 alpha[8];
+                boost::uint64_t alpha_indices = 0;
+                if (format == DXT5)
+                {
+                    alpha[0] = input[0];
+                    alpha[1] = input[1];
+                    for(uint i = 2; i < 8; ++i)
+                    {
+                        if (alpha[0] > alpha[1])
+                            alpha[i] = (u8)(((8 - i) * alpha[0] + (i - 1) * alpha[1]) / 7);
+                        else if (i < 6)
+                            alpha[i] = (u8)(((6 - i) * alpha[0] + (i - 1) * alpha[1]) / 5);
+                        else
+                            alpha[i] = i == 6 ? 0 : 255;
+                    }
+                    for(uint i = 0; i < 6; ++i)
+                        alpha_indices |= (boost::uint64_t)input[2 + i] << (i * 8);
+                    input += 8;
+                }
+
+                u16 color0 = input[0] | (input[1] << 8);
+                u16 color1 = input[2] | (input[3] << 8);
+                u32 indices = input[4] | (input[5] << 8) | (input[6] << 16) | ((u32)input[7] << 24);
+                input += 8;
+
+                u8 palette[4][4];
+                FromRgb565(color0, palette[0]);
+                FromRgb565(color1, palette[1]);
+                palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+                for(uint c = 0; c < 3; ++c)
+                {
+                    if (color0 > color1 || format == DXT5)
+                    {
+                        palette[2][c] = (u8)((2 * palette[0][c] + palette[1][c]) / 3);
+                        palette[3][c] = (u8)((palette[0][c] + 2 * palette[1][c]) / 3);
+                    }
+                    else
+                    {
+                        palette[2][c] = (u8)((palette[0][c] + palette[1][c]) / 2);
+                        palette[3][c] = 0;
+                    }
+                }
+                if (color0 <= color1 && format == DXT1)
+                    palette[3][3] = 0;
+
+                for(uint i = 0; i < 16; ++i)
+                {
+                    uint x = bx + i % 4;
+                    uint y = by + i / 4;
+                    if (x >= width || y >= height)
+                        continue;
+
+                    u8 *out = output + (y * width + x) * 4;
+                    memcpy(out, palette[(indices >> (i * 2)) & 3], 4);
+                    if (format == DXT5)
+                        out[3] = alpha[(alpha_indices >> (i * 3)) & 7];
+                }
+            }
+        }
+    }
+}
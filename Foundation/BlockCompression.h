@@ -0,0 +1,68 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Foundation_BlockCompression_h
+#define incl_Foundation_BlockCompression_h
+
+#include "CoreTypes.h"
+
+namespace Foundation
+{
+    //! Fast encoding of 8-bit pixels into the DXT1 (BC1) and DXT5 (BC3) block compressed formats, with mip chains.
+    /*! Endpoints of each 4x4 block are taken from the bounding box of its colors, slightly inset, which is much faster
+        than a search for the best endpoints, at some cost in quality.
+
+        A compressed chain holds every mip level down to 1x1, largest first. Levels smaller than a block are stored
+        in a whole block.
+     */
+    class BlockCompression
+    {
+    public:
+        //! Compressed formats, same values as Ogre::PF_DXT1 and Ogre::PF_DXT5
+        enum Format
+        {
+            DXT1 = 17,
+            DXT5 = 21
+        };
+
+        //! Returns whether a pixel format value is one of the compressed formats
+        static bool IsCompressed(int format) { return format == DXT1 || format == DXT5; }
+
+        //! Returns number of mip levels in a full chain from a size down to 1x1
+        static uint GetMipLevels(uint width, uint height);
+
+        //! Returns size of one compressed level in bytes
+        static uint GetLevelSize(uint width, uint height, Format format);
+
+        //! Returns size of a full compressed mip chain in bytes
+        static uint GetChainSize(uint width, uint height, Format format);
+
+        //! Returns whether pixels have alpha other than fully opaque, and so need DXT5 instead of DXT1
+        /*! \param input Pixels in luminance, luminance-alpha, RGB or RGBA byte order
+            \param num_pixels Number of pixels
+            \param components Bytes per pixel, 1 to 4
+         */
+        static bool HasTranslucency(const u8 *input, uint num_pixels, uint components);
+
+        //! Compresses an image and generates its mip chain
+        /*! \param input Pixels in luminance, luminance-alpha, RGB or RGBA byte order
+            \param width Width, a multiple of 4
+            \param height Height, a multiple of 4
+            \param components Bytes per pixel, 1 to 4
+            \param format Format to compress to. Alpha is left out of DXT1
+            \param output Output, GetChainSize() bytes
+            \return false if the size or pixel size is not supported
+         */
+        static bool CompressChain(const u8 *input, uint width, uint height, uint components, Format format, u8 *output);
+
+        //! Decompresses the first level of compressed data to RGBA, for users that need the pixels
+        /*! \param input Compressed data
+            \param width Width
+            \param height Height
+            \param format Format of the data
+            \param output Output, width * height * 4 bytes
+         */
+        static void DecompressLevel(const u8 *input, uint width, uint height, Format format, u8 *output);
+    };
+}
+
+#endif
@@ -0,0 +1,82 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "CacheCompression.h"
+
+#include <QByteArray>
+
+namespace
+{
+    const u32 COMPRESSION_MAGIC = 0x5A434352; // "RCCZ"
+    const uint HEADER_SIZE = 12;
+
+    //! Data smaller than this is not compressed
+    const uint MIN_COMPRESS_SIZE = 256;
+}
+
+namespace Foundation
+{
+    uint CacheCompression::GetHeaderSize()
+    {
+        return HEADER_SIZE;
+    }
+
+    bool CacheCompression::Compress(const u8 *data, uint size, std::vector<u8> &output, int level)
+    {
+        output.clear();
+        if (!data || size < MIN_COMPRESS_SIZE)
+            return false;
+
+        QByteArray compressed = qCompress(data, size, level);
+
+        // Not worth decompressing for less than an eighth saved
+        if (compressed.isEmpty() || HEADER_SIZE + compressed.size() > size - size / 8)
+            return false;
+
+        output.resize(HEADER_SIZE + compressed.size());
+        u32 magic = COMPRESSION_MAGIC;
+        u8 codec = CODEC_DEFLATE;
+        u8 reserved[3] = { 0, 0, 0 };
+        memcpy(&output[0], &magic, 4);
+        memcpy(&output[4], &codec, 1);
+        memcpy(&output[5], reserved, 3);
+        memcpy(&output[8], &size, 4);
+        memcpy(&output[HEADER_SIZE], compressed.constData(), compressed.size());
+        return true;
+    }
+
+    CacheCompression::Codec CacheCompression::GetCodec(const u8 *data, uint size)
+    {
+        if (!data || size < HEADER_SIZE)
+            return CODEC_NONE;
+
+        u32 magic;
+        memcpy(&magic, data, 4);
+        if (magic != COMPRESSION_MAGIC || data[4] != CODEC_DEFLATE)
+            return CODEC_NONE;
+        return (Codec)data[4];
+    }
+
+    bool CacheCompression::IsCompressed(const u8 *data, uint size)
+    {
+        return GetCodec(data, size) != CODEC_NONE;
+    }
+
+    bool CacheCompression::Decompress(const u8 *data, uint size, std::vector<u8> &output)
+    {
+        if (GetCodec(data, size) != CODEC_DEFLATE)
+            return false;
+
+        u32 uncompressed_size;
+        memcpy(&uncompressed_size, data + 8, 4);
+
+        QByteArray uncompressed = qUncompress(data + HEADER_SIZE, size - HEADER_SIZE);
+        if ((u32)uncompressed.size() != uncompressed_size)
+            return false;
+
+        output.resize(uncompressed_size);
+        if (uncompressed_size)
+            memcpy(&output[0], uncompressed.constData(), uncompressed_size);
+        return true;
+    }
+}
@@ -0,0 +1,55 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Foundation_CacheCompression_h
+#define incl_Foundation_CacheCompression_h
+
+#include "CoreTypes.h"
+
+namespace Foundation
+{
+    //! Compression of disk cache entries.
+    /*! Compressed data starts with a 12 byte header: a magic number, the codec, and the uncompressed size. Entries
+        are only stored compressed when that makes them clearly smaller, so readers check IsCompressed() and use the
+        data as is otherwise.
+     */
+    class CacheCompression
+    {
+    public:
+        //! Codecs. The value is stored in the header, so existing values must not change.
+        enum Codec
+        {
+            //! Not compressed
+            CODEC_NONE = 0,
+            //! Deflate, as implemented by qCompress()
+            CODEC_DEFLATE = 1
+        };
+
+        //! Compresses data
+        /*! \param data Data
+            \param size Data size
+            \param output Compressed data, with header
+            \param level Compression level, 1 (fastest) to 9 (smallest)
+            \return true if the data was compressed, false if it is too small or would not shrink enough to be worth it
+         */
+        static bool Compress(const u8 *data, uint size, std::vector<u8> &output, int level = 1);
+
+        //! Returns true if data starts with a compression header
+        static bool IsCompressed(const u8 *data, uint size);
+
+        //! Returns codec of compressed data, or CODEC_NONE if not compressed
+        static Codec GetCodec(const u8 *data, uint size);
+
+        //! Decompresses data
+        /*! \param data Compressed data, with header
+            \param size Data size
+            \param output Uncompressed data
+            \return true if successful, false if the data is not compressed or is corrupt
+         */
+        static bool Decompress(const u8 *data, uint size, std::vector<u8> &output);
+
+        //! Returns size of the compression header
+        static uint GetHeaderSize();
+    };
+}
+
+#endif
@@ -21,6 +21,7 @@
 #include "ConsoleCommandServiceInterface.h"
 #include "FrameworkQtApplication.h"
 #include "CoreException.h"
+#include "PoolAllocator.h"
 #include "InputServiceInterface.h"
 
 #include <Poco/Logger.h>
@@ -68,7 +69,8 @@ namespace Foundation
         argv_(argv),
         initialized_(false),
         log_formatter_(0),
-        splitterchannel(0)
+        splitterchannel(0),
+        allocation_pools_(&Core::FixedSizePool::GetRegistry())
     {
         ParseProgramOptions();
         if (cm_options_.count("help")) 
@@ -300,6 +302,13 @@ namespace Foundation
                 event_manager_->ProcessDelayedEvents(frametime);
             }
 
+            // publish the scene changes of this frame as one batch per scene
+            {
+                PROFILE(FW_PublishSceneChanges);
+                for(SceneMap::iterator iter = scenes_.begin(); iter != scenes_.end(); ++iter)
+                    iter->second->PublishChanges();
+            }
+
             // if we have a renderer service, render now
             boost::weak_ptr<Foundation::RenderServiceInterface> renderer = 
                         service_manager_->GetService<RenderServiceInterface>(Service::ST_Renderer);
@@ -394,6 +403,9 @@ namespace Foundation
             default_scene_.reset();
         if (scene != scenes_.end())
             scenes_.erase(scene);
+
+        // The entities and components of the scene are likely gone now, return the memory of their pools
+        allocation_pools_->ReleaseUnused();
     }
 
     Scene::ScenePtr Framework::GetScene(const std::string &name) const
@@ -21,6 +21,11 @@ class QWidget;
 class QObject;
 class InputServiceInterface;
 
+namespace Core
+{
+    class FixedSizePoolRegistry;
+}
+
 namespace Poco
 {
     class SplitterChannel;
@@ -185,6 +190,9 @@ namespace Foundation
         //! Profiler &GetProfiler() { return *ProfilerSection::GetProfiler(); }
         Profiler &GetProfiler();
 #endif
+        //! Returns the registry of the allocation pools of all modules, see Core::FixedSizePool
+        Core::FixedSizePoolRegistry *GetAllocationPools() const { return allocation_pools_; }
+
         //! Add a new log listener for poco log
         void AddLogChannel(Poco::Channel *channel);
 
@@ -320,6 +328,9 @@ namespace Foundation
         //! profiler
         Profiler profiler_;
 #endif
+        //! Registry of the allocation pools of all modules. The one of the main binary, which is never freed.
+        Core::FixedSizePoolRegistry *allocation_pools_;
+
         //! program options
         boost::program_options::variables_map cm_options_;
 
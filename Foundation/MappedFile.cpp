@@ -0,0 +1,32 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "MappedFile.h"
+
+namespace Foundation
+{
+    MappedFile::MappedFile(const QString &filename) :
+        file_(filename),
+        data_(0),
+        size_(0),
+        remove_(false)
+    {
+        if (file_.open(QIODevice::ReadOnly))
+        {
+            qint64 size = file_.size();
+            if (size)
+                data_ = file_.map(0, size);
+            if (data_)
+                size_ = size;
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+            file_.unmap(data_);
+        file_.close();
+        if (remove_)
+            QFile::remove(file_.fileName());
+    }
+}
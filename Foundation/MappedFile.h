@@ -0,0 +1,45 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Foundation_MappedFile_h
+#define incl_Foundation_MappedFile_h
+
+#include "CoreTypes.h"
+
+#include <QFile>
+
+namespace Foundation
+{
+    //! Read-only memory mapping of a whole file, unmapped when destroyed.
+    /*! Typically held through a shared pointer by everyone using the mapped data, so that the file stays mapped as
+        long as any of them needs it.
+     */
+    class MappedFile
+    {
+    public:
+        //! Constructor. Opens and maps the file.
+        explicit MappedFile(const QString &filename);
+
+        //! Destructor. Unmaps the file, and removes it if requested.
+        ~MappedFile();
+
+        //! Returns mapped data, null if the file could not be mapped
+        const u8 *GetData() const { return data_; }
+
+        //! Returns size of the mapped data
+        qint64 GetSize() const { return size_; }
+
+        //! Removes the file once it is no longer mapped
+        void RemoveOnClose() { remove_ = true; }
+
+    private:
+        MappedFile(const MappedFile &);
+        MappedFile &operator =(const MappedFile &);
+
+        QFile file_;
+        uchar *data_;
+        qint64 size_;
+        bool remove_;
+    };
+}
+
+#endif
@@ -84,6 +84,7 @@ namespace Foundation
             Poco::Logger::get(module->Name()).setLevel(log_level);
 #endif
             module->SetFramework(framework_);
+            module->SetAllocationPoolRegistry(framework_->GetAllocationPools());
             module->LoadInternal();
         }
         else
@@ -536,6 +537,7 @@ namespace Foundation
 #endif
 
             module->SetFramework(framework_);
+            module->SetAllocationPoolRegistry(framework_->GetAllocationPools());
             module->LoadInternal();
 
             Module::Entry entry = { modulePtr, *it, library };
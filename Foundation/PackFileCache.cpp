@@ -0,0 +1,863 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "PackFileCache.h"
+#include "AsyncFileIO.h"
+#include "CacheCompression.h"
+#include "MappedFile.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <boost/bind.hpp>
+
+namespace
+{
+    const quint32 INDEX_MAGIC = 0x49434650; // "PFCI"
+    const quint32 INDEX_VERSION = 2;
+
+    //! Entry header in a segment file: magic, data size, key length and type length, followed by key and type
+    const u32 ENTRY_MAGIC = 0x45434650; // "PFCE"
+    const uint ENTRY_HEADER_SIZE = 12;
+
+    uint CurrentTime()
+    {
+        return QDateTime::currentDateTime().toTime_t();
+    }
+
+    //! Appends an entry to a segment file. Returns offset of the data, or -1 if failed.
+    qint64 AppendEntry(QFile &file, const std::string &key, const std::string &type, const u8 *data, uint size)
+    {
+        if (key.size() > 0xffff || type.size() > 0xffff)
+            return -1;
+
+        std::vector<u8> header(ENTRY_HEADER_SIZE + key.size() + type.size());
+        u32 magic = ENTRY_MAGIC;
+        u16 key_length = key.size();
+        u16 type_length = type.size();
+        memcpy(&header[0], &magic, 4);
+        memcpy(&header[4], &size, 4);
+        memcpy(&header[8], &key_length, 2);
+        memcpy(&header[10], &type_length, 2);
+        if (key_length)
+            memcpy(&header[ENTRY_HEADER_SIZE], key.c_str(), key_length);
+        if (type_length)
+            memcpy(&header[ENTRY_HEADER_SIZE + key_length], type.c_str(), type_length);
+
+        qint64 offset = file.size() + header.size();
+        if (file.write((const char *)&header[0], header.size()) != (qint64)header.size())
+            return -1;
+        if (size && file.write((const char *)data, size) != (qint64)size)
+            return -1;
+        if (!file.flush())
+            return -1;
+        return offset;
+    }
+}
+
+namespace Foundation
+{
+    PackFileCache::PackFileCache(const QString &path, qint64 segment_size) :
+        path_(path),
+        segment_size_(segment_size),
+        max_size_(0),
+        total_size_(0),
+        active_segment_(0),
+        dirty_(false),
+        compactions_(0),
+        evictions_(0),
+        pending_(0),
+        next_job_id_(1),
+        writer_segment_(1),
+        writer_append_(false),
+        keep_running_(true)
+    {
+        compaction_.segment_ = 0;
+    }
+
+    PackFileCache::~PackFileCache()
+    {
+        if (thread_)
+        {
+            {
+                MutexLock lock(mutex_);
+                keep_running_ = false;
+
+                // Stores can not be redone, compaction can
+                std::deque<Job>::iterator i = jobs_.begin();
+                while(i != jobs_.end())
+                {
+                    if (i->kind_ == Job::CopyEntry)
+                    {
+                        i = jobs_.erase(i);
+                        --pending_;
+                    }
+                    else
+                        ++i;
+                }
+            }
+            job_condition_.notify_all();
+            thread_->join();
+
+            for(uint i = 0; i < results_.size(); ++i)
+                HandleResult(results_[i]);
+            results_.clear();
+        }
+
+        Save();
+    }
+
+    const QString &PackFileCache::IndexFileName()
+    {
+        static const QString name("pack.index");
+        return name;
+    }
+
+    QString PackFileCache::GetSegmentPath(uint segment) const
+    {
+        return path_ + "/" + QString("segment_%1.pack").arg(segment, 8, 10, QChar('0'));
+    }
+
+    bool PackFileCache::Open()
+    {
+        QDir dir(path_);
+        if (!dir.exists())
+            dir.mkpath(".");
+
+        // List segments
+        QFileInfoList files = dir.entryInfoList(QStringList("segment_*.pack"), QDir::Files);
+        foreach(QFileInfo info, files)
+        {
+            bool ok = false;
+            uint segment = info.fileName().section('_', 1).section('.', 0, 0).toUInt(&ok);
+            if (ok && segment)
+                segments_[segment].file_size_ = info.size();
+        }
+
+        QString filename = path_ + "/" + IndexFileName();
+        QString temp_filename = filename + ".tmp";
+        bool loaded = ReadIndex(filename);
+        if (!loaded && ReadIndex(temp_filename))
+        {
+            // A crash during Save() may have left only the temporary file
+            QFile::remove(filename);
+            QFile::rename(temp_filename, filename);
+            loaded = true;
+        }
+        if (!loaded)
+            Rebuild();
+
+        // Continue the last segment if nothing follows its last indexed entry, so that short sessions do not each
+        // leave a small segment behind. Otherwise the end of the segment may be a partially written entry.
+        writer_segment_ = segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+        writer_append_ = false;
+        if (loaded && !segments_.empty() && segments_.rbegin()->second.file_size_ < segment_size_)
+        {
+            uint last = segments_.rbegin()->first;
+            qint64 end = 0;
+            for(RecordMap::const_iterator i = records_.begin(); i != records_.end(); ++i)
+                if (i->second.segment_ == last)
+                    end = std::max(end, i->second.offset_ + (qint64)i->second.size_);
+            if (end && end == segments_.rbegin()->second.file_size_)
+            {
+                writer_segment_ = last;
+                writer_append_ = true;
+                active_segment_ = last;
+            }
+        }
+
+        if (!thread_)
+            thread_.reset(new Thread(boost::bind(&PackFileCache::Work, this)));
+
+        return loaded;
+    }
+
+    bool PackFileCache::ReadIndex(const QString &filename)
+    {
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_0);
+
+        // Version 1 did not compress entries
+        quint32 magic = 0, version = 0, count = 0;
+        stream >> magic >> version >> count;
+        if (magic != INDEX_MAGIC || version < 1 || version > INDEX_VERSION)
+            return false;
+
+        RecordMap records;
+        for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+        {
+            QByteArray key, type;
+            quint32 segment = 0, size = 0, last_access = 0;
+            qint64 offset = 0;
+            bool compressed = false;
+            stream >> key >> type >> segment >> offset >> size >> last_access;
+            if (version >= 2)
+                stream >> compressed;
+
+            Record &record = records[std::string(key.constData(), key.size())];
+            record.type_ = std::string(type.constData(), type.size());
+            record.segment_ = segment;
+            record.offset_ = offset;
+            record.size_ = size;
+            record.last_access_ = last_access;
+            record.compressed_ = compressed;
+        }
+
+        // Trailing magic guards against truncated files
+        quint32 end_magic = 0;
+        stream >> end_magic;
+        if (stream.status() != QDataStream::Ok || end_magic != INDEX_MAGIC || records.size() != count)
+            return false;
+
+        records_.clear();
+        total_size_ = 0;
+        for(std::map<uint, Segment>::iterator i = segments_.begin(); i != segments_.end(); ++i)
+            i->second.live_size_ = 0;
+
+        // Drop records of segments that have been removed or truncated
+        dirty_ = false;
+        for(RecordMap::const_iterator i = records.begin(); i != records.end(); ++i)
+        {
+            std::map<uint, Segment>::const_iterator s = segments_.find(i->second.segment_);
+            if (s != segments_.end() && i->second.offset_ + (qint64)i->second.size_ <= s->second.file_size_)
+                InsertRecord(i->first, i->second);
+            else
+                dirty_ = true;
+        }
+
+        return true;
+    }
+
+    void PackFileCache::Rebuild()
+    {
+        records_.clear();
+        total_size_ = 0;
+
+        // Later entries replace earlier ones of the same key
+        std::vector<u8> header(ENTRY_HEADER_SIZE);
+        for(std::map<uint, Segment>::iterator s = segments_.begin(); s != segments_.end(); ++s)
+        {
+            s->second.live_size_ = 0;
+
+            QString filename = GetSegmentPath(s->first);
+            QFile file(filename);
+            if (!file.open(QIODevice::ReadOnly))
+                continue;
+
+            uint last_access = QFileInfo(filename).lastModified().toTime_t();
+            qint64 file_size = file.size();
+            qint64 pos = 0;
+            while(pos + ENTRY_HEADER_SIZE <= file_size)
+            {
+                if (!file.seek(pos) || file.read((char *)&header[0], ENTRY_HEADER_SIZE) != (qint64)ENTRY_HEADER_SIZE)
+                    break;
+
+                u32 magic, size;
+                u16 key_length, type_length;
+                memcpy(&magic, &header[0], 4);
+                memcpy(&size, &header[4], 4);
+                memcpy(&key_length, &header[8], 2);
+                memcpy(&type_length, &header[10], 2);
+
+                // Stop at a partially written entry
+                qint64 offset = pos + ENTRY_HEADER_SIZE + key_length + type_length;
+                if (magic != ENTRY_MAGIC || offset + size > file_size)
+                    break;
+
+                QByteArray key = file.read(key_length);
+                QByteArray type = file.read(type_length);
+                if (key.size() != key_length || type.size() != type_length)
+                    break;
+                QByteArray start = file.read(std::min(size, CacheCompression::GetHeaderSize()));
+
+                Record record;
+                record.type_ = std::string(type.constData(), type.size());
+                record.segment_ = s->first;
+                record.offset_ = offset;
+                record.size_ = size;
+                record.last_access_ = last_access;
+                record.compressed_ = CacheCompression::IsCompressed((const u8 *)start.constData(), start.size());
+                InsertRecord(std::string(key.constData(), key.size()), record);
+
+                pos = offset + size;
+            }
+        }
+
+        dirty_ = true;
+    }
+
+    bool PackFileCache::Save()
+    {
+        if (!dirty_)
+            return true;
+
+        QString filename = path_ + "/" + IndexFileName();
+        QString temp_filename = filename + ".tmp";
+
+        {
+            QFile file(temp_filename);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+                return false;
+
+            QDataStream stream(&file);
+            stream.setVersion(QDataStream::Qt_4_0);
+            stream << INDEX_MAGIC << INDEX_VERSION << (quint32)records_.size();
+            for(RecordMap::const_iterator i = records_.begin(); i != records_.end(); ++i)
+            {
+                stream << QByteArray(i->first.c_str(), i->first.size()) << QByteArray(i->second.type_.c_str(), i->second.type_.size())
+                    << (quint32)i->second.segment_ << i->second.offset_ << (quint32)i->second.size_ << (quint32)i->second.last_access_
+                    << i->second.compressed_;
+            }
+            stream << INDEX_MAGIC;
+
+            file.flush();
+            if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError)
+            {
+                file.close();
+                QFile::remove(temp_filename);
+                return false;
+            }
+        }
+
+        // QFile::rename does not overwrite
+        QFile::remove(filename);
+        if (!QFile::rename(temp_filename, filename))
+            return false;
+
+        dirty_ = false;
+        return true;
+    }
+
+    const PackFileCache::Record *PackFileCache::Find(const std::string &key) const
+    {
+        RecordMap::const_iterator i = records_.find(key);
+        if (i == records_.end())
+            return 0;
+        return &i->second;
+    }
+
+    bool PackFileCache::Read(const std::string &key, PackFileView &view)
+    {
+        RecordMap::iterator i = records_.find(key);
+        if (i == records_.end())
+            return false;
+
+        Record &record = i->second;
+        std::map<uint, Segment>::iterator s = segments_.find(record.segment_);
+        if (s == segments_.end())
+        {
+            EraseRecord(i);
+            return false;
+        }
+
+        // The current segment grows, map it again if the entry was appended after it was mapped
+        Segment &segment = s->second;
+        qint64 end = record.offset_ + record.size_;
+        if (!segment.mapping_ || segment.mapping_->GetSize() < end)
+        {
+            boost::shared_ptr<MappedFile> mapping(new MappedFile(GetSegmentPath(record.segment_)));
+            if (mapping->GetSize() < end)
+            {
+                EraseRecord(i);
+                return false;
+            }
+            segment.mapping_ = mapping;
+        }
+
+        view.data_ = segment.mapping_->GetData() + record.offset_;
+        view.size_ = record.size_;
+        view.owner_ = segment.mapping_;
+
+        record.last_access_ = CurrentTime();
+        dirty_ = true;
+        return true;
+    }
+
+    void PackFileCache::Touch(const std::string &key)
+    {
+        RecordMap::iterator i = records_.find(key);
+        if (i == records_.end())
+            return;
+
+        i->second.last_access_ = CurrentTime();
+        dirty_ = true;
+    }
+
+    void PackFileCache::Store(const std::string &key, const std::string &type, const u8 *data, uint size, boost::shared_ptr<const void> owner,
+        bool compress)
+    {
+        Job job;
+        job.kind_ = Job::StoreEntry;
+        job.key_ = key;
+        job.type_ = type;
+        job.data_ = data;
+        job.size_ = size;
+        job.owner_ = owner;
+        job.compress_ = compress;
+        job.source_offset_ = 0;
+        Queue(job);
+        pending_stores_[key] = job.id_;
+    }
+
+    void PackFileCache::Import(const std::string &key, const std::string &type, const std::string &filename)
+    {
+        Job job;
+        job.kind_ = Job::ImportFile;
+        job.key_ = key;
+        job.type_ = type;
+        job.data_ = 0;
+        job.size_ = 0;
+        job.compress_ = false;
+        job.source_ = filename;
+        job.source_offset_ = 0;
+        Queue(job);
+        pending_stores_[key] = job.id_;
+    }
+
+    bool PackFileCache::IsStorePending(const std::string &key) const
+    {
+        return pending_stores_.find(key) != pending_stores_.end();
+    }
+
+    void PackFileCache::Remove(const std::string &key)
+    {
+        pending_stores_.erase(key);
+
+        RecordMap::iterator i = records_.find(key);
+        if (i != records_.end())
+            EraseRecord(i);
+    }
+
+    void PackFileCache::Clear()
+    {
+        {
+            MutexLock lock(mutex_);
+            pending_ -= jobs_.size();
+            jobs_.clear();
+        }
+
+        pending_stores_.clear();
+        compaction_.segment_ = 0;
+        compaction_.jobs_.clear();
+
+        records_.clear();
+        total_size_ = 0;
+        dirty_ = true;
+
+        std::vector<uint> segments;
+        for(std::map<uint, Segment>::iterator i = segments_.begin(); i != segments_.end(); ++i)
+            if (i->first != active_segment_)
+                segments.push_back(i->first);
+        for(uint i = 0; i < segments.size(); ++i)
+            DropSegment(segments[i]);
+
+        // The writer has the current segment open, it is removed once closed
+        if (active_segment_)
+        {
+            Job job;
+            job.kind_ = Job::RotateSegment;
+            job.data_ = 0;
+            job.size_ = 0;
+            job.compress_ = false;
+            job.source_offset_ = 0;
+            Queue(job);
+        }
+    }
+
+    void PackFileCache::Update()
+    {
+        std::vector<Result> results;
+        {
+            MutexLock lock(mutex_);
+            results.swap(results_);
+        }
+
+        for(uint i = 0; i < results.size(); ++i)
+            HandleResult(results[i]);
+
+        Evict();
+        StartCompaction();
+    }
+
+    std::vector<PackFileCache::StoreResult> PackFileCache::TakeCompletedStores()
+    {
+        std::vector<StoreResult> stores;
+        stores.swap(completed_stores_);
+        return stores;
+    }
+
+    qint64 PackFileCache::GetFileSize() const
+    {
+        qint64 size = 0;
+        for(std::map<uint, Segment>::const_iterator i = segments_.begin(); i != segments_.end(); ++i)
+            size += i->second.file_size_;
+        return size;
+    }
+
+    uint PackFileCache::GetPendingCount() const
+    {
+        MutexLock lock(mutex_);
+        return pending_;
+    }
+
+    void PackFileCache::Queue(Job &job)
+    {
+        {
+            MutexLock lock(mutex_);
+            job.id_ = next_job_id_++;
+            if (!next_job_id_)
+                next_job_id_ = 1;
+            jobs_.push_back(job);
+            ++pending_;
+        }
+
+        job_condition_.notify_one();
+    }
+
+    void PackFileCache::HandleResult(const Result &result)
+    {
+        if (result.kind_ == Job::RotateSegment)
+        {
+            if (result.segment_)
+            {
+                if (active_segment_ == result.segment_)
+                    active_segment_ = 0;
+                DropSegment(result.segment_);
+            }
+            return;
+        }
+
+        // Track the size of the segment being written
+        if (result.success_)
+        {
+            segments_[result.segment_].file_size_ = result.segment_size_;
+            active_segment_ = result.segment_;
+        }
+
+        if (result.kind_ == Job::CopyEntry)
+        {
+            if (!compaction_.segment_ || !compaction_.jobs_.erase(result.id_))
+                return;
+
+            // Move the record unless it was replaced or removed meanwhile
+            RecordMap::iterator i = records_.find(result.key_);
+            if (result.success_ && i != records_.end() && i->second.segment_ == compaction_.segment_)
+            {
+                Record record = i->second;
+                record.segment_ = result.segment_;
+                record.offset_ = result.offset_;
+                record.compressed_ = result.compressed_;
+                InsertRecord(result.key_, record);
+            }
+
+            if (compaction_.jobs_.empty())
+            {
+                DropSegment(compaction_.segment_);
+                compaction_.segment_ = 0;
+                ++compactions_;
+            }
+            return;
+        }
+
+        // A store is only current if it has not been replaced, removed or cleared meanwhile
+        StoreResult store;
+        store.key_ = result.key_;
+        store.imported_ = result.kind_ == Job::ImportFile;
+        store.success_ = false;
+        store.type_ = result.type_;
+        store.size_ = result.raw_size_;
+        store.stored_size_ = result.size_;
+
+        std::map<std::string, uint>::iterator p = pending_stores_.find(result.key_);
+        if (p != pending_stores_.end() && p->second == result.id_)
+        {
+            pending_stores_.erase(p);
+            if (result.success_)
+            {
+                Record record;
+                record.type_ = result.type_;
+                record.segment_ = result.segment_;
+                record.offset_ = result.offset_;
+                record.size_ = result.size_;
+                record.last_access_ = CurrentTime();
+                record.compressed_ = result.compressed_;
+                InsertRecord(result.key_, record);
+                store.success_ = true;
+            }
+        }
+
+        completed_stores_.push_back(store);
+    }
+
+    void PackFileCache::StartCompaction()
+    {
+        if (compaction_.segment_)
+            return;
+
+        // Compact the segment with the smallest share of live entries, if under half
+        uint candidate = 0;
+        double candidate_ratio = 0.5;
+        for(std::map<uint, Segment>::const_iterator i = segments_.begin(); i != segments_.end(); ++i)
+        {
+            if (i->first == active_segment_ || !i->second.file_size_)
+                continue;
+            double ratio = (double)i->second.live_size_ / i->second.file_size_;
+            if (ratio < candidate_ratio)
+            {
+                candidate = i->first;
+                candidate_ratio = ratio;
+            }
+        }
+        if (!candidate)
+            return;
+
+        compaction_.segment_ = candidate;
+        compaction_.jobs_.clear();
+
+        std::string source = GetSegmentPath(candidate).toStdString();
+        for(RecordMap::const_iterator i = records_.begin(); i != records_.end(); ++i)
+        {
+            if (i->second.segment_ != candidate)
+                continue;
+
+            Job job;
+            job.kind_ = Job::CopyEntry;
+            job.key_ = i->first;
+            job.type_ = i->second.type_;
+            job.data_ = 0;
+            job.size_ = i->second.size_;
+            job.compress_ = false;
+            job.source_ = source;
+            job.source_offset_ = i->second.offset_;
+            Queue(job);
+            compaction_.jobs_.insert(job.id_);
+        }
+
+        // Nothing live to copy
+        if (compaction_.jobs_.empty())
+        {
+            DropSegment(candidate);
+            compaction_.segment_ = 0;
+            ++compactions_;
+        }
+    }
+
+    void PackFileCache::Evict()
+    {
+        if (!max_size_)
+            return;
+
+        qint64 file_size = GetFileSize();
+        if (file_size <= max_size_)
+            return;
+
+        // Newest access of each segment, the current segment is not evicted
+        std::map<uint, uint> newest_access;
+        for(std::map<uint, Segment>::const_iterator i = segments_.begin(); i != segments_.end(); ++i)
+            if (i->first != active_segment_)
+                newest_access[i->first] = 0;
+        for(RecordMap::const_iterator i = records_.begin(); i != records_.end(); ++i)
+        {
+            std::map<uint, uint>::iterator n = newest_access.find(i->second.segment_);
+            if (n != newest_access.end())
+                n->second = std::max(n->second, i->second.last_access_);
+        }
+
+        while(file_size > max_size_ && !newest_access.empty())
+        {
+            std::map<uint, uint>::iterator oldest = newest_access.begin();
+            for(std::map<uint, uint>::iterator i = newest_access.begin(); i != newest_access.end(); ++i)
+                if (i->second < oldest->second)
+                    oldest = i;
+
+            file_size -= segments_[oldest->first].file_size_;
+            DropSegment(oldest->first);
+            newest_access.erase(oldest);
+            ++evictions_;
+        }
+    }
+
+    void PackFileCache::DropSegment(uint segment)
+    {
+        std::map<uint, Segment>::iterator s = segments_.find(segment);
+        if (s == segments_.end())
+            return;
+
+        if (s->second.live_size_)
+        {
+            RecordMap::iterator i = records_.begin();
+            while(i != records_.end())
+            {
+                if (i->second.segment_ == segment)
+                    i = EraseRecord(i);
+                else
+                    ++i;
+            }
+        }
+
+        if (s->second.mapping_)
+            s->second.mapping_->RemoveOnClose();
+        else
+            QFile::remove(GetSegmentPath(segment));
+        segments_.erase(s);
+
+        if (compaction_.segment_ == segment)
+        {
+            compaction_.segment_ = 0;
+            compaction_.jobs_.clear();
+        }
+    }
+
+    void PackFileCache::InsertRecord(const std::string &key, const Record &record)
+    {
+        std::pair<RecordMap::iterator, bool> result = records_.insert(std::make_pair(key, record));
+        if (!result.second)
+        {
+            Record &old = result.first->second;
+            std::map<uint, Segment>::iterator s = segments_.find(old.segment_);
+            if (s != segments_.end())
+                s->second.live_size_ -= old.size_;
+            total_size_ -= old.size_;
+            old = record;
+        }
+
+        segments_[record.segment_].live_size_ += record.size_;
+        total_size_ += record.size_;
+        dirty_ = true;
+    }
+
+    PackFileCache::RecordMap::iterator PackFileCache::EraseRecord(RecordMap::iterator i)
+    {
+        std::map<uint, Segment>::iterator s = segments_.find(i->second.segment_);
+        if (s != segments_.end())
+            s->second.live_size_ -= i->second.size_;
+        total_size_ -= i->second.size_;
+        dirty_ = true;
+        return records_.erase(i);
+    }
+
+    void PackFileCache::Work()
+    {
+        QFile output;
+        uint output_segment = 0;
+        std::vector<u8> buffer;
+        std::vector<u8> compressed;
+
+        for(;;)
+        {
+            Job job;
+            {
+                ScopedLock lock(mutex_);
+                while(jobs_.empty() && keep_running_)
+                    job_condition_.wait(lock);
+                if (jobs_.empty())
+                    return;
+                job = jobs_.front();
+                jobs_.pop_front();
+            }
+
+            Result result;
+            result.kind_ = job.kind_;
+            result.id_ = job.id_;
+            result.key_ = job.key_;
+            result.type_ = job.type_;
+            result.success_ = false;
+            result.segment_ = 0;
+            result.offset_ = 0;
+            result.size_ = 0;
+            result.raw_size_ = 0;
+            result.compressed_ = false;
+            result.segment_size_ = 0;
+
+            if (job.kind_ == Job::RotateSegment)
+            {
+                // The last segment may be waiting to be continued without having been opened
+                result.segment_ = output_segment;
+                if (!output_segment && writer_append_)
+                    result.segment_ = writer_segment_++;
+                result.success_ = true;
+                output.close();
+                output_segment = 0;
+                writer_append_ = false;
+            }
+            else
+            {
+                const u8 *data = job.data_;
+                uint size = job.size_;
+                bool ok = true;
+                if (job.kind_ == Job::ImportFile)
+                    ok = AsyncFileIO::ReadFile(job.source_, buffer);
+                else if (job.kind_ == Job::CopyEntry)
+                    ok = AsyncFileIO::ReadFile(job.source_, job.source_offset_, job.size_, buffer);
+                if (job.kind_ != Job::StoreEntry)
+                {
+                    data = buffer.empty() ? 0 : &buffer[0];
+                    size = buffer.size();
+                }
+
+                result.raw_size_ = size;
+                if (ok && job.compress_ && CacheCompression::Compress(data, size, compressed))
+                {
+                    data = &compressed[0];
+                    size = compressed.size();
+                }
+                result.compressed_ = CacheCompression::IsCompressed(data, size);
+
+                // Start a new segment when the current one would grow over the segment size
+                qint64 entry_size = ENTRY_HEADER_SIZE + job.key_.size() + job.type_.size() + size;
+                if (ok && output_segment && output.size() > 0 && output.size() + entry_size > segment_size_)
+                {
+                    output.close();
+                    output_segment = 0;
+                }
+                if (ok && !output_segment)
+                {
+                    output.setFileName(GetSegmentPath(writer_segment_));
+                    if (output.open(QIODevice::WriteOnly | (writer_append_ ? QIODevice::Append : QIODevice::Truncate)))
+                        output_segment = writer_segment_;
+                    ++writer_segment_;
+                    writer_append_ = false;
+                    ok = output_segment != 0;
+                }
+
+                if (ok)
+                {
+                    qint64 offset = AppendEntry(output, job.key_, job.type_, data, size);
+                    if (offset >= 0)
+                    {
+                        result.success_ = true;
+                        result.segment_ = output_segment;
+                        result.offset_ = offset;
+                        result.size_ = size;
+                        result.segment_size_ = output.size();
+                    }
+                    else
+                    {
+                        // Do not append after a partially written entry
+                        output.close();
+                        output_segment = 0;
+                    }
+                }
+
+                if (result.success_ && job.kind_ == Job::ImportFile)
+                    QFile::remove(QString::fromStdString(job.source_));
+
+                // Release the data right away
+                std::vector<u8>().swap(buffer);
+                std::vector<u8>().swap(compressed);
+                job.owner_.reset();
+            }
+
+            MutexLock lock(mutex_);
+            results_.push_back(result);
+            --pending_;
+        }
+    }
+}
@@ -0,0 +1,361 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Foundation_PackFileCache_h
+#define incl_Foundation_PackFileCache_h
+
+#include "CoreTypes.h"
+#include "CoreThread.h"
+
+#include <boost/unordered_map.hpp>
+#include <QString>
+
+#include <deque>
+#include <map>
+#include <set>
+
+namespace Foundation
+{
+    class MappedFile;
+
+    //! Read-only view of data in a pack file cache. The owner keeps the data mapped.
+    struct PackFileView
+    {
+        //! Data
+        const u8 *data_;
+
+        //! Data size in bytes
+        uint size_;
+
+        //! Keeps the data valid while held
+        boost::shared_ptr<const void> owner_;
+    };
+
+    //! Disk cache that stores entries in a few large append-only segment files instead of a file per entry.
+    /*! Entries are identified by a key, typically a hash, and have a type string. Each entry is appended to the
+        current segment file as a small header followed by the data. Segments are named segment_<number>.pack and
+        are started when the current one would grow over the segment size.
+
+        An index maps keys to segment, offset, size and last access time. It is loaded from pack.index at Open(),
+        or rebuilt by scanning the segment headers if missing or corrupt, and saved with Save(). Entries written
+        after the index was last saved are not known after a crash; their space is reclaimed by compaction.
+
+        Read() maps the segment to memory and returns a view of the entry, so no data is copied. The mapping stays
+        valid as long as any view of it is held, even if the segment is removed meanwhile.
+
+        All writes are done by a single background thread in queue order: Store() and Import() append entries, and
+        compaction copies the live entries of segments that are mostly overwritten or removed to the current
+        segment, after which the old segment is removed. Completed stores are reflected in the index by Update(),
+        which also enforces the size limit by removing whole segments, least recently accessed first.
+
+        All functions except the destructor are meant to be called from the same thread, typically the main thread.
+     */
+    class PackFileCache
+    {
+    public:
+        //! Cached entry
+        struct Record
+        {
+            //! Type
+            std::string type_;
+
+            //! Segment number
+            uint segment_;
+
+            //! Offset of the data in the segment file
+            qint64 offset_;
+
+            //! Data size in bytes, as stored
+            uint size_;
+
+            //! Last access time in seconds since epoch
+            uint last_access_;
+
+            //! Whether the data is compressed with CacheCompression
+            bool compressed_;
+        };
+
+        //! Records by key
+        typedef boost::unordered_map<std::string, Record> RecordMap;
+
+        //! Completed Store() or Import()
+        struct StoreResult
+        {
+            //! Key
+            std::string key_;
+
+            //! Whether the entry was imported from a file
+            bool imported_;
+
+            //! Whether the entry is now in the cache
+            bool success_;
+
+            //! Type
+            std::string type_;
+
+            //! Data size before compression
+            uint size_;
+
+            //! Data size as stored
+            uint stored_size_;
+        };
+
+        //! Constructor. Call Open() before use.
+        /*! \param path Cache directory, created if needed
+            \param segment_size Size at which a new segment file is started
+         */
+        explicit PackFileCache(const QString &path, qint64 segment_size = 64 * 1024 * 1024);
+
+        //! Destructor. Completes queued stores and imports, and saves the index.
+        ~PackFileCache();
+
+        //! Loads the index, or rebuilds it from the segment files. Starts the writer thread.
+        /*! \return true if the persisted index was loaded
+         */
+        bool Open();
+
+        //! Saves the index if it has changed. Returns true if successful.
+        bool Save();
+
+        //! Returns record for a key, or null if not found. Entries being stored are not found until completed.
+        const Record *Find(const std::string &key) const;
+
+        //! Returns a view of the data of an entry and marks it accessed. Returns false if not found or the segment
+        //! could not be mapped, in which case the entry is removed.
+        /*! The data is as stored: if the record is compressed, it must be decompressed with CacheCompression.
+         */
+        bool Read(const std::string &key, PackFileView &view);
+
+        //! Marks an entry accessed, for when it is read from the segment file without Read()
+        void Touch(const std::string &key);
+
+        //! Queues an entry to be stored, replacing any previous entry of the key
+        /*! \param key Key
+            \param type Type
+            \param data Data
+            \param size Data size
+            \param owner Object owning the data, kept alive until written
+            \param compress Whether to compress the data with CacheCompression on the writer thread, if it shrinks enough
+         */
+        void Store(const std::string &key, const std::string &type, const u8 *data, uint size, boost::shared_ptr<const void> owner,
+            bool compress = false);
+
+        //! Queues a file to be moved into the cache. The file is removed once its contents are stored.
+        /*! \param key Key
+            \param type Type
+            \param filename File to import
+         */
+        void Import(const std::string &key, const std::string &type, const std::string &filename);
+
+        //! Returns true if a store or import of the key is queued
+        bool IsStorePending(const std::string &key) const;
+
+        //! Removes an entry, and cancels its pending store. The space is reclaimed by compaction.
+        void Remove(const std::string &key);
+
+        //! Removes all entries and segment files
+        void Clear();
+
+        //! Collects completed writes, and compacts and evicts segments as needed
+        void Update();
+
+        //! Returns stores and imports completed since last call
+        std::vector<StoreResult> TakeCompletedStores();
+
+        //! Sets maximum total size of the segment files in bytes, 0 for unlimited
+        void SetMaxSize(qint64 max_size) { max_size_ = max_size; }
+
+        //! Returns all records
+        const RecordMap &GetRecords() const { return records_; }
+
+        //! Returns total size of the entries in bytes
+        qint64 GetTotalSize() const { return total_size_; }
+
+        //! Returns total size of the segment files in bytes
+        qint64 GetFileSize() const;
+
+        //! Returns number of segment files
+        uint GetSegmentCount() const { return segments_.size(); }
+
+        //! Returns number of segments compacted
+        uint GetCompactions() const { return compactions_; }
+
+        //! Returns number of segments evicted because of the size limit
+        uint GetEvictions() const { return evictions_; }
+
+        //! Returns number of queued and ongoing writes
+        uint GetPendingCount() const;
+
+        //! Returns path of a segment file
+        QString GetSegmentPath(uint segment) const;
+
+        //! Returns name of the index file, which is stored in the cache directory
+        static const QString &IndexFileName();
+
+    private:
+        PackFileCache(const PackFileCache &);
+        PackFileCache &operator =(const PackFileCache &);
+
+        //! Segment file
+        struct Segment
+        {
+            Segment() : file_size_(0), live_size_(0) {}
+
+            //! File size
+            qint64 file_size_;
+
+            //! Total size of the live entries
+            qint64 live_size_;
+
+            //! Current mapping, or null if not mapped
+            boost::shared_ptr<MappedFile> mapping_;
+        };
+
+        //! Writer job
+        struct Job
+        {
+            enum Kind { StoreEntry, ImportFile, CopyEntry, RotateSegment };
+
+            Kind kind_;
+            uint id_;
+            std::string key_;
+            std::string type_;
+            const u8 *data_;
+            uint size_;
+            boost::shared_ptr<const void> owner_;
+            bool compress_;
+
+            //! File to import, or segment file to copy from
+            std::string source_;
+
+            //! Offset to copy from
+            qint64 source_offset_;
+        };
+
+        //! Writer result
+        struct Result
+        {
+            Job::Kind kind_;
+            uint id_;
+            std::string key_;
+            std::string type_;
+            bool success_;
+            uint segment_;
+            qint64 offset_;
+            uint size_;
+            uint raw_size_;
+            bool compressed_;
+            qint64 segment_size_;
+        };
+
+        //! Ongoing compaction
+        struct Compaction
+        {
+            //! Segment being compacted
+            uint segment_;
+
+            //! Copy jobs not yet completed
+            std::set<uint> jobs_;
+        };
+
+        //! Queues a writer job
+        void Queue(Job &job);
+
+        //! Handles a completed writer job
+        void HandleResult(const Result &result);
+
+        //! Starts compacting a segment if one has enough dead space
+        void StartCompaction();
+
+        //! Removes segments until under the size limit
+        void Evict();
+
+        //! Removes a segment and its records. The file is removed when no longer mapped.
+        void DropSegment(uint segment);
+
+        //! Adds or replaces a record
+        void InsertRecord(const std::string &key, const Record &record);
+
+        //! Removes a record, returns iterator to the next one
+        RecordMap::iterator EraseRecord(RecordMap::iterator i);
+
+        //! Reads the index file
+        bool ReadIndex(const QString &filename);
+
+        //! Rebuilds the index by scanning the segment files
+        void Rebuild();
+
+        //! Writer thread function
+        void Work();
+
+        //! Cache directory
+        QString path_;
+
+        //! Size at which a new segment is started
+        qint64 segment_size_;
+
+        //! Maximum total size of the segment files, 0 for unlimited
+        qint64 max_size_;
+
+        //! Records by key
+        RecordMap records_;
+
+        //! Total size of the entries
+        qint64 total_size_;
+
+        //! Segments by number
+        std::map<uint, Segment> segments_;
+
+        //! Segment the writer appends to, 0 if none
+        uint active_segment_;
+
+        //! Latest queued store job by key
+        std::map<std::string, uint> pending_stores_;
+
+        //! Completed stores not yet taken
+        std::vector<StoreResult> completed_stores_;
+
+        //! Ongoing compaction, segment 0 if none
+        Compaction compaction_;
+
+        //! Whether the records have changed since last load or save
+        bool dirty_;
+
+        //! Number of segments compacted
+        uint compactions_;
+
+        //! Number of segments evicted
+        uint evictions_;
+
+        //! Writer thread, null until opened
+        boost::scoped_ptr<Thread> thread_;
+
+        //! Queued jobs
+        std::deque<Job> jobs_;
+
+        //! Completed results
+        std::vector<Result> results_;
+
+        //! Number of queued and ongoing jobs
+        uint pending_;
+
+        //! Next job id
+        uint next_job_id_;
+
+        //! Segment the writer starts next, or continues if it is the last one and can be appended to
+        uint writer_segment_;
+
+        //! Whether the writer may continue the last segment rather than start a new one
+        bool writer_append_;
+
+        //! Whether the writer should keep running
+        bool keep_running_;
+
+        //! Guards the jobs, results and counters shared with the writer
+        mutable Mutex mutex_;
+
+        //! Signaled when jobs are queued or the writer should stop
+        Condition job_condition_;
+    };
+}
+
+#endif
@@ -0,0 +1,225 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "PixelConversion.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXELCONVERSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    //! How the samples of a plane are scaled to 8 bits
+    struct SampleScale
+    {
+        //! Added to make signed samples unsigned
+        s32 offset_;
+
+        //! Right shift, for samples of more than 8 bits
+        int right_;
+
+        //! Left shift, for samples of less than 8 bits
+        int left_;
+    };
+
+    SampleScale GetSampleScale(const Foundation::PixelConversion::Plane &plane)
+    {
+        int precision = plane.precision_ ? std::min((int)plane.precision_, 31) : 8;
+
+        SampleScale scale;
+        scale.offset_ = plane.signed_ ? (1 << (precision - 1)) : 0;
+        scale.right_ = std::max(precision - 8, 0);
+        scale.left_ = std::max(8 - precision, 0);
+        return scale;
+    }
+
+    inline u8 ConvertSample(s32 sample, const SampleScale &scale)
+    {
+        // Shift left as unsigned, to match the wrapping of the SIMD shift
+        s32 value = (s32)((u32)((sample + scale.offset_) >> scale.right_) << scale.left_);
+        if (value < 0)
+            return 0;
+        if (value > 255)
+            return 255;
+        return (u8)value;
+    }
+
+#ifdef PIXELCONVERSION_SSE2
+    //! Converts 16 samples to 8 bits
+    inline __m128i ConvertSamples(const s32 *samples, const SampleScale &scale)
+    {
+        __m128i offset = _mm_set1_epi32(scale.offset_);
+        __m128i right = _mm_cvtsi32_si128(scale.right_);
+        __m128i left = _mm_cvtsi32_si128(scale.left_);
+
+        __m128i values[4];
+        for(uint i = 0; i < 4; ++i)
+        {
+            values[i] = _mm_loadu_si128((const __m128i*)(samples + i * 4));
+            values[i] = _mm_sll_epi32(_mm_sra_epi32(_mm_add_epi32(values[i], offset), right), left);
+        }
+
+        // Pack with saturation, which clamps to 0-255
+        return _mm_packus_epi16(_mm_packs_epi32(values[0], values[1]), _mm_packs_epi32(values[2], values[3]));
+    }
+
+    //! Sums horizontally adjacent pixels of 8 16-bit channel values: 4 pixels of 2 channels give 2 pixels, etc.
+    /*! \param lo First 8 channel values
+        \param hi Next 8 channel values
+        \return 8 channel values of the sums
+     */
+    inline __m128i SumPixelPairs(__m128i lo, __m128i hi, uint bytes_per_pixel)
+    {
+        switch (bytes_per_pixel)
+        {
+        case 1:
+            {
+                __m128i mask = _mm_set1_epi32(0xffff);
+                lo = _mm_add_epi32(_mm_and_si128(lo, mask), _mm_srli_epi32(lo, 16));
+                hi = _mm_add_epi32(_mm_and_si128(hi, mask), _mm_srli_epi32(hi, 16));
+                return _mm_packs_epi32(lo, hi);
+            }
+
+        case 2:
+            {
+                __m128i mask = _mm_set_epi32(0, -1, 0, -1);
+                lo = _mm_add_epi32(_mm_and_si128(lo, mask), _mm_srli_epi64(lo, 32));
+                hi = _mm_add_epi32(_mm_and_si128(hi, mask), _mm_srli_epi64(hi, 32));
+                lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+                hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+                return _mm_unpacklo_epi64(lo, hi);
+            }
+
+        default:
+            return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        }
+    }
+#endif
+}
+
+namespace Foundation
+{
+    bool PixelConversion::Interleave(const Plane *planes, uint num_planes, uint num_pixels, u8 *output)
+    {
+        if (num_planes < 1 || num_planes > 4)
+            return false;
+
+        SampleScale scales[4];
+        for(uint c = 0; c < num_planes; ++c)
+            scales[c] = GetSampleScale(planes[c]);
+
+        uint i = 0;
+
+#ifdef PIXELCONVERSION_SSE2
+        for(; i + 16 <= num_pixels; i += 16)
+        {
+            __m128i bytes[4];
+            for(uint c = 0; c < num_planes; ++c)
+                bytes[c] = ConvertSamples(planes[c].data_ + i, scales[c]);
+
+            __m128i *out = (__m128i*)(output + i * num_planes);
+            switch (num_planes)
+            {
+            case 1:
+                _mm_storeu_si128(out, bytes[0]);
+                break;
+
+            case 2:
+                _mm_storeu_si128(out, _mm_unpacklo_epi8(bytes[0], bytes[1]));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(bytes[0], bytes[1]));
+                break;
+
+            case 3:
+                {
+                    // No byte shuffles in SSE2, so three channels are interleaved a byte at a time
+                    u8 converted[3][16];
+                    for(uint c = 0; c < 3; ++c)
+                        _mm_storeu_si128((__m128i*)converted[c], bytes[c]);
+                    u8 *out_bytes = output + i * 3;
+                    for(uint p = 0; p < 16; ++p)
+                    {
+                        out_bytes[p * 3] = converted[0][p];
+                        out_bytes[p * 3 + 1] = converted[1][p];
+                        out_bytes[p * 3 + 2] = converted[2][p];
+                    }
+                }
+                break;
+
+            case 4:
+                {
+                    __m128i lo01 = _mm_unpacklo_epi8(bytes[0], bytes[1]);
+                    __m128i hi01 = _mm_unpackhi_epi8(bytes[0], bytes[1]);
+                    __m128i lo23 = _mm_unpacklo_epi8(bytes[2], bytes[3]);
+                    __m128i hi23 = _mm_unpackhi_epi8(bytes[2], bytes[3]);
+                    _mm_storeu_si128(out, _mm_unpacklo_epi16(lo01, lo23));
+                    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+                    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+                    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+                }
+                break;
+            }
+        }
+#endif
+
+        for(; i < num_pixels; ++i)
+        {
+            u8 *out = output + i * num_planes;
+            for(uint c = 0; c < num_planes; ++c)
+                out[c] = ConvertSample(planes[c].data_[i], scales[c]);
+        }
+
+        return true;
+    }
+
+    bool PixelConversion::DownsampleHalf(const u8 *input, uint width, uint height, uint bytes_per_pixel, u8 *output)
+    {
+        if (bytes_per_pixel < 1 || bytes_per_pixel > 4 || width < 2 || height < 2)
+            return false;
+
+        uint out_width = width / 2;
+        uint out_height = height / 2;
+        uint stride = width * bytes_per_pixel;
+
+        for(uint y = 0; y < out_height; ++y)
+        {
+            const u8 *row0 = input + y * 2 * stride;
+            const u8 *row1 = row0 + stride;
+            u8 *out = output + y * out_width * bytes_per_pixel;
+            uint x = 0;
+
+#ifdef PIXELCONVERSION_SSE2
+            // 32 input bytes per row make 16 output bytes. Three byte pixels do not divide evenly, and use the loop below.
+            if (bytes_per_pixel != 3)
+            {
+                uint step = 16 / bytes_per_pixel;
+                __m128i zero = _mm_setzero_si128();
+                __m128i rounding = _mm_set1_epi16(2);
+                for(; x + step <= out_width; x += step)
+                {
+                    __m128i sums[2];
+                    for(uint half = 0; half < 2; ++half)
+                    {
+                        __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 2 * bytes_per_pixel + half * 16));
+                        __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 2 * bytes_per_pixel + half * 16));
+                        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                        sums[half] = _mm_srli_epi16(_mm_add_epi16(SumPixelPairs(lo, hi, bytes_per_pixel), rounding), 2);
+                    }
+                    _mm_storeu_si128((__m128i*)(out + x * bytes_per_pixel), _mm_packus_epi16(sums[0], sums[1]));
+                }
+            }
+#endif
+
+            for(; x < out_width; ++x)
+            {
+                const u8 *a = row0 + x * 2 * bytes_per_pixel;
+                const u8 *b = row1 + x * 2 * bytes_per_pixel;
+                for(uint c = 0; c < bytes_per_pixel; ++c)
+                    out[x * bytes_per_pixel + c] = (u8)((a[c] + a[c + bytes_per_pixel] + b[c] + b[c + bytes_per_pixel] + 2) >> 2);
+            }
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,57 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_Foundation_PixelConversion_h
+#define incl_Foundation_PixelConversion_h
+
+#include "CoreTypes.h"
+
+namespace Foundation
+{
+    //! Conversions of decoded images into the 8-bit pixel layouts textures are created from.
+    /*! The kernels use SSE2 where the compiler targets it, and plain loops otherwise and for the ends of rows.
+        Both give the same results.
+     */
+    class PixelConversion
+    {
+    public:
+        //! A plane of samples, as decoders such as OpenJpeg produce them
+        struct Plane
+        {
+            //! Samples, one per pixel, row after row
+            const s32 *data_;
+
+            //! Bits per sample
+            uint precision_;
+
+            //! Whether samples are signed
+            bool signed_;
+        };
+
+        //! Interleaves planes into 8-bit pixels, one byte per plane in plane order
+        /*! Samples are offset to unsigned, scaled to 8 bits by shifting, and clamped to 0-255. With 1 to 4 planes
+            in luminance, luminance-alpha, RGB and RGBA order, the output is in the Ogre PF_BYTE_L, PF_BYTE_LA,
+            PF_BYTE_RGB and PF_BYTE_RGBA layouts.
+
+            \param planes Planes, all of the same size
+            \param num_planes Number of planes, 1 to 4
+            \param num_pixels Number of pixels
+            \param output Output, num_pixels * num_planes bytes
+            \return false if the number of planes is not supported
+         */
+        static bool Interleave(const Plane *planes, uint num_planes, uint num_pixels, u8 *output);
+
+        //! Halves an image in both dimensions, averaging each 2x2 block of pixels
+        /*! An odd last row or column is left out.
+
+            \param input Input pixels, 8 bits per channel
+            \param width Input width, at least 2
+            \param height Input height, at least 2
+            \param bytes_per_pixel Bytes per pixel, 1 to 4
+            \param output Output, (width / 2) * (height / 2) * bytes_per_pixel bytes
+            \return false if the size or pixel size is not supported
+         */
+        static bool DownsampleHalf(const u8 *input, uint width, uint height, uint bytes_per_pixel, u8 *output);
+    };
+}
+
+#endif
@@ -67,11 +67,34 @@ namespace Foundation
          */
         virtual bool RequestAsset(const std::string& asset_id, const std::string& asset_type, request_tag_t tag) = 0;
 
+        //! Returns whether RequestAsset() completes the download before returning, storing the asset right away
+        /*! The asset service starts requests to such providers immediately instead of scheduling them, so that
+            the asset is in the cache as soon as it has been requested. Local file providers are like this.
+         */
+        virtual bool IsSynchronous() { return false; }
+
         //! Returns whether a certain asset is already being downloaded
         /*! \param asset_id Asset ID
          */           
         virtual bool InProgress(const std::string& asset_id) = 0;
 
+        //! Cancels download of an asset, when no one is interested in it anymore
+        /*! No events are sent for a canceled download. Providers that can not cancel a download let it complete.
+
+            \param asset_id Asset ID
+            \return true if the download was canceled
+         */
+        virtual bool CancelTransfer(const std::string& asset_id) { return false; }
+
+        //! Changes priority and discard level of a download, if supported
+        /*! Called also right after RequestAsset(), before the provider has had a chance to send the request.
+
+            \param asset_id Asset ID
+            \param priority Priority, higher is downloaded first. 0 is the default.
+            \param discard_level Texture resolution levels not needed, each halving the size. 0 downloads the whole asset.
+         */
+        virtual void SetTransferPriority(const std::string& asset_id, f32 priority, int discard_level) {}
+
         //! Queries status of asset download
         /*! If asset provider receives data only in ordered manner (http requests etc.) received & received_continuous 
             should be the same.
@@ -41,15 +41,41 @@ namespace Foundation
         AssetServiceInterface() {}
         virtual ~AssetServiceInterface() {}
 
-        //! Gets asset
-        /*! If asset not in cache, will return empty pointer 
-            Does not queue an asset download request.
+        //! Gets asset from the memory cache
+        /*! If asset not in memory cache, will return empty pointer, even if it is in the disk cache.
+            Does not queue an asset download request. An asset found in the disk cache is loaded into the memory
+            cache in the background, so it is not waited for; use RequestAsset() to be notified when it is ready,
+            or GetAssetFromDisk() to wait for it. IsAssetCached() tells whether waiting is worthwhile.
+
+            Note: this used to read the disk cache on the calling thread, as GetAssetFromDisk() does. Code that
+            relies on a disk cache hit being returned has to use one of the alternatives above.
 
             \param asset_id Asset ID, UUID for legacy UDP assets
             \param asset_type Asset type
             \return Pointer to asset           
          */
         virtual AssetPtr GetAsset(const std::string& asset_id, const std::string& asset_type) = 0;
+
+        //! Gets asset, reading the disk cache on the calling thread if needed
+        /*! If asset not in memory or disk cache, will return empty pointer.
+            Does not queue an asset download request. Blocks for the disk read and possible decompression, so
+            only for one-off uses, not for anything done every frame.
+
+            \param asset_id Asset ID, UUID for legacy UDP assets
+            \param asset_type Asset type
+            \return Pointer to asset
+         */
+        virtual AssetPtr GetAssetFromDisk(const std::string& asset_id, const std::string& asset_type) { return GetAsset(asset_id, asset_type); }
+
+        //! Returns whether an asset is in the memory or disk cache, without waiting for the disk
+        /*! An asset in the disk cache starts loading in the background, so that a following RequestAsset()
+            gets it from the cache without a download.
+
+            \param asset_id Asset ID, UUID for legacy UDP assets
+            \param asset_type Asset type
+            eturn true if the asset is cached
+         */
+        virtual bool IsAssetCached(const std::string& asset_id, const std::string& asset_type) { return GetAsset(asset_id, asset_type).get() != 0; }
         
         //! Gets incomplete asset
         /*! If not enough bytes received, will return empty pointer
@@ -72,6 +98,27 @@ namespace Foundation
          */
         virtual request_tag_t RequestAsset(const std::string& asset_id, const std::string& asset_type) = 0;
 
+        //! Changes priority and discard level of an asset request
+        /*! Requests of higher priority are downloaded first. Requests have priority 0 by default. A download shared by
+            several requests has the highest of their priorities and the lowest of their discard levels. Priority
+            affects the order of downloads not yet started, and of started ones if the asset provider supports it.
+
+            \param tag Request tag returned by RequestAsset()
+            \param priority New priority
+            \param discard_level Number of highest resolution levels of a texture not needed yet, 0 for the whole asset
+            \return true if the request is still queued or downloading
+         */
+        virtual bool SetRequestPriority(request_tag_t tag, f32 priority, int discard_level) { return false; }
+
+        //! Cancels an asset request
+        /*! When all requests of an asset are canceled, its download is canceled. Events may still be sent for the tag
+            if the download is shared with other requests.
+
+            \param tag Request tag returned by RequestAsset()
+            \return true if the request was still queued or downloading
+         */
+        virtual bool CancelRequest(request_tag_t tag) { return false; }
+
         //! Checks asset id for validity
         /*! \return true if asset id is valid
          */
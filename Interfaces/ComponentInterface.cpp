@@ -217,4 +217,41 @@ void ComponentInterface::DeserializeFrom(QDomElement& element, AttributeChange::
     }
 }
 
+void ComponentInterface::SerializeToAttributes(SerializedAttributeVector& attributes) const
+{
+    if (!IsSerializable())
+        return;
+
+    for (uint i = 0; i < attributes_.size(); ++i)
+    {
+        SerializedAttribute attr;
+        attr.name = attributes_[i]->GetNameString();
+        attr.value = attributes_[i]->ToString();
+        attributes.push_back(attr);
+    }
+}
+
+void ComponentInterface::DeserializeFromAttributes(const QString& name, const SerializedAttributeVector& attributes, AttributeChange::Type change)
+{
+    if (!IsSerializable())
+        return;
+
+    SetName(name);
+
+    // Same semantics as DeserializeFrom: attributes missing from the list are set from an empty string
+    for (uint i = 0; i < attributes_.size(); ++i)
+    {
+        std::string attr_str;
+        for (uint j = 0; j < attributes.size(); ++j)
+        {
+            if (attributes[j].name == attributes_[i]->GetNameString())
+            {
+                attr_str = attributes[j].value;
+                break;
+            }
+        }
+        attributes_[i]->FromString(attr_str, change);
+    }
+}
+
 }
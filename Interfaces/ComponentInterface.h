@@ -23,6 +23,19 @@ class QDomElement;
 
 namespace Foundation
 {
+    //! One serialized attribute of a component: the same name/value/type triple the XML form stores in an <attribute> element.
+    /*! Used by formats that do not go through a DOM, such as the binary scene format. Type is empty for components whose
+        attribute set is fixed at construction time.
+     */
+    struct SerializedAttribute
+    {
+        std::string name;
+        std::string value;
+        std::string type;
+    };
+
+    typedef std::vector<SerializedAttribute> SerializedAttributeVector;
+
     //! Base class for all components. Inherit from this class when creating new components.
     /*! Use the ComponentInterface typedef to refer to the abstract component type.
     */
@@ -121,6 +134,19 @@ namespace Foundation
         //! Deserialize from XML
         virtual void DeserializeFrom(QDomElement& element, AttributeChange::Type change);
 
+        //! Serialize into a flat attribute list, without a DOM. Override together with SerializeTo if you override that.
+        /*! \param attributes Attribute list to append to
+         */
+        virtual void SerializeToAttributes(SerializedAttributeVector& attributes) const;
+
+        //! Deserialize from a flat attribute list, without a DOM. Override together with DeserializeFrom if you override that.
+        /*! The component type is assumed to be already checked by the caller.
+            \param name Component name
+            \param attributes Attribute list
+            \param change Change type
+         */
+        virtual void DeserializeFromAttributes(const QString& name, const SerializedAttributeVector& attributes, AttributeChange::Type change);
+
         /** Handles an event. Override in your own module if you want to receive events. Do not call.
             @param category_id Category id of the event
             @param event_id Id of the event
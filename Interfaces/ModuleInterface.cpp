@@ -13,6 +13,7 @@
 #include "EventManager.h"
 #include "ModuleManager.h"
 #include "ConsoleCommandServiceInterface.h"
+#include "PoolAllocator.h"
 
 #include <Poco/Logger.h>
 
@@ -22,7 +23,7 @@ namespace Foundation
 static const int DEFAULT_EVENT_PRIORITY = 100;
 
 ModuleInterface::ModuleInterface(const std::string &name) :
-    name_(name), state_(Module::MS_Unloaded), framework_(0)
+    name_(name), state_(Module::MS_Unloaded), framework_(0), set_pool_registry_(&Core::FixedSizePool::SetRegistry)
 {
     try
     {
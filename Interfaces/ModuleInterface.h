@@ -31,6 +31,11 @@ namespace Console
     struct Command;
 }
 
+namespace Core
+{
+    class FixedSizePoolRegistry;
+}
+
 namespace Foundation
 {
     class Framework;
@@ -146,6 +151,9 @@ namespace Foundation
         /// Only for internal use.
         void SetFramework(Framework *framework) { framework_ = framework; assert (framework_); }
 
+        /// Makes the allocation pools of the module's binary register to the framework's registry. For internal use.
+        void SetAllocationPoolRegistry(Core::FixedSizePoolRegistry *registry) { set_pool_registry_(registry); }
+
         /// Called when module is loaded. For internal use.
         void LoadInternal() { assert(state_ == Module::MS_Unloaded); Load(); state_ = Module::MS_Loaded; }
 
@@ -179,6 +187,9 @@ namespace Foundation
 
         /// Current state of the module
         Module::State state_;
+
+        /// Core::FixedSizePool::SetRegistry of the module's binary, taken in the constructor which runs in that binary
+        void (*set_pool_registry_)(Core::FixedSizePoolRegistry *registry);
     };
 }
 
@@ -45,6 +45,9 @@ namespace Foundation
 
         //! Get ogre image pixel format
         virtual int GetFormat() = 0;
+
+        //! Returns number of mip levels in the data, largest first
+        virtual uint GetMipLevels() { return 1; }
     };
 }
 
@@ -4,6 +4,7 @@
 #define incl_Interfaces_TextureServiceInterface_h
 
 #include "ServiceInterface.h"
+#include "AssetInterface.h"
 
 namespace Foundation
 {    
@@ -29,9 +30,24 @@ namespace Foundation
          */
         virtual request_tag_t RequestTexture(const std::string& asset_id) = 0;
 
+        //! Requests an image asset (PNG, JPEG etc.) to be decoded into a raw texture
+        /*! The image is decoded off the main thread, and the result is cached like received textures. A RESOURCE_READY
+            event is sent when done, or RESOURCE_CANCELED if the image could not be decoded.
+            \param source Image asset
+            \return request tag, 0 if not supported, in which case the caller should decode the image itself
+         */
+        virtual request_tag_t DecodeImage(AssetPtr source) { return 0; }
+
         //! Removes a texture from the disk cache with the texture id
         //! @param texture_is as std::string
         virtual void DeleteFromCache(const std::string &texture_id) = 0;
+
+        //! Tells how large the textures are on screen, so that downloads and decodes can be prioritized
+        /*! Visible textures are downloaded and decoded first, and only up to the resolution they are shown at.
+            Called periodically by the renderer.
+            \param screen_sizes Largest on-screen size in pixels by texture ID. Textures not included are not visible.
+         */
+        virtual void SetTextureScreenSizes(const std::map<std::string, uint>& screen_sizes) {}
     };
 }
 
@@ -439,7 +439,7 @@ void InventoryModule::OpenItemPropertiesWindow(const QString &inventory_id)
         Foundation::AssetServiceInterface *asset_service = framework_->GetService<Foundation::AssetServiceInterface>();
         if (asset_service)
         {
-            Foundation::AssetPtr assetPtr = asset_service->GetAsset(asset->GetAssetReference().toStdString(), GetTypeNameFromAssetType(asset->GetAssetType()));
+            Foundation::AssetPtr assetPtr = asset_service->GetAssetFromDisk(asset->GetAssetReference().toStdString(), GetTypeNameFromAssetType(asset->GetAssetType()));
             if (assetPtr && assetPtr->GetSize() > 0)
                 wnd->SetFileSize(assetPtr->GetSize());
         }
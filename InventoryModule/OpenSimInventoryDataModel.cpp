@@ -247,7 +247,7 @@ bool OpenSimInventoryDataModel::OpenItem(AbstractInventoryItem *item)
     request_tag_t tag = 0;
 
     // Check out if the asset already exists in the cache.
-    Foundation::AssetPtr assetPtr = asset_service->GetAsset(asset_id, GetTypeNameFromAssetType(asset_type));
+    Foundation::AssetPtr assetPtr = asset_service->GetAssetFromDisk(asset_id, GetTypeNameFromAssetType(asset_type));
     if(assetPtr.get() && assetPtr->GetSize() > 0)
     {
         // Send InventoryItemDownloadedEventData event.
@@ -10,6 +10,7 @@
 #include "Inventory/InventoryEvents.h"
 #include "AssetEvents.h"
 #include "TextureInterface.h"
+#include "BlockCompression.h"
 #include "ResourceInterface.h"
 #include "TextureServiceInterface.h"
 
@@ -125,7 +126,20 @@ namespace Naali
             Foundation::TextureInterface *tex = dynamic_cast<Foundation::TextureInterface *>(res->resource_.get());
             if(tex)
             {
-                QImage img = ConvertToQImage(tex->GetData(), tex->GetWidth(), tex->GetHeight(), tex->GetComponents());
+                // Compressed textures are converted through RGBA
+                const u8 *data = tex->GetData();
+                uint components = tex->GetComponents();
+                std::vector<u8> decompressed;
+                if (Foundation::BlockCompression::IsCompressed(tex->GetFormat()))
+                {
+                    decompressed.resize(tex->GetWidth() * tex->GetHeight() * 4);
+                    Foundation::BlockCompression::DecompressLevel(data, tex->GetWidth(), tex->GetHeight(),
+                        (Foundation::BlockCompression::Format)tex->GetFormat(), &decompressed[0]);
+                    data = &decompressed[0];
+                    components = 4;
+                }
+
+                QImage img = ConvertToQImage(data, tex->GetWidth(), tex->GetHeight(), components);
                 // Only show chessboard patern if image has an alfa channel.
                 if(tex->GetComponents() == 4 || tex->GetComponents() == 2) 
                 {
@@ -5,9 +5,12 @@
 #include "Renderer.h"
 #include "EC_OgrePlaceable.h"
 #include "EC_OgreCustomObject.h"
+#include "SharedMeshCache.h"
 
 #include <Ogre.h>
 
+DEFINE_POOL_ALLOCATED(OgreRenderer::EC_OgreCustomObject)
+
 namespace OgreRenderer
 {
     EC_OgreCustomObject::EC_OgreCustomObject(Foundation::ModuleInterface* module) :
@@ -42,7 +45,7 @@ namespace OgreRenderer
         AttachEntity();
     }
     
-    bool EC_OgreCustomObject::CommitChanges(Ogre::ManualObject* object)
+    bool EC_OgreCustomObject::CommitChanges(Ogre::ManualObject* object, const std::string& shared_key)
     {
         if (!object)
             return false;
@@ -55,31 +58,12 @@ namespace OgreRenderer
         
         if (!object->getNumSections())
             return true;
-            
+        
+        std::string mesh_name = renderer->GetUniqueObjectName();
         try
         {
-            std::string mesh_name = renderer->GetUniqueObjectName();
             object->convertToMesh(mesh_name);
             object->clear();
-        
-            Ogre::SceneManager* scene_mgr = renderer->GetSceneManager();
-
-            entity_ = scene_mgr->createEntity(renderer->GetUniqueObjectName(), mesh_name);
-            if (entity_)
-            {
-                AttachEntity();
-                entity_->setRenderingDistance(draw_distance_);
-                entity_->setCastShadows(cast_shadows_);
-                entity_->setUserAny(Ogre::Any(GetParentEntity()));
-                // Set UserAny also on subentities
-                for (uint i = 0; i < entity_->getNumSubEntities(); ++i)
-                    entity_->getSubEntity(i)->setUserAny(entity_->getUserAny());
-            }
-            else
-            {
-                OgreRenderingModule::LogError("Could not create entity from manualobject mesh");
-                return false;
-            }
         }   
         catch (Ogre::Exception& e)
         {
@@ -87,6 +71,61 @@ namespace OgreRenderer
             return false;
         }
         
+        if (!shared_key.empty())
+            renderer->GetSharedMeshCache()->Add(shared_key, mesh_name);
+        
+        return CreateEntity(mesh_name);
+    }
+    
+    bool EC_OgreCustomObject::CommitSharedMesh(const std::string& shared_key)
+    {
+        if (shared_key.empty())
+            return false;
+        
+        if (renderer_.expired())
+            return false;
+        RendererPtr renderer = renderer_.lock();
+        
+        // Take the reference before destroying the old entity, as it may use the same mesh
+        std::string mesh_name = renderer->GetSharedMeshCache()->Acquire(shared_key);
+        if (mesh_name.empty())
+            return false;
+        
+        DestroyEntity();
+        
+        return CreateEntity(mesh_name);
+    }
+    
+    bool EC_OgreCustomObject::CreateEntity(const std::string& mesh_name)
+    {
+        RendererPtr renderer = renderer_.lock();
+        Ogre::SceneManager* scene_mgr = renderer->GetSceneManager();
+        
+        try
+        {
+            entity_ = scene_mgr->createEntity(renderer->GetUniqueObjectName(), mesh_name);
+        }
+        catch (Ogre::Exception& e)
+        {
+            OgreRenderingModule::LogError("Could not create entity from manualobject mesh: " + std::string(e.what()));
+            entity_ = 0;
+        }
+        
+        if (!entity_)
+        {
+            OgreRenderingModule::LogError("Could not create entity from manualobject mesh");
+            ReleaseMesh(mesh_name);
+            return false;
+        }
+        
+        AttachEntity();
+        entity_->setRenderingDistance(draw_distance_);
+        entity_->setCastShadows(cast_shadows_);
+        entity_->setUserAny(Ogre::Any(GetParentEntity()));
+        // Set UserAny also on subentities
+        for (uint i = 0; i < entity_->getNumSubEntities(); ++i)
+            entity_->getSubEntity(i)->setUserAny(entity_->getUserAny());
+        
         return true;
     }
     
@@ -185,12 +224,24 @@ namespace OgreRenderer
             std::string mesh_name = entity_->getMesh()->getName();
             scene_mgr->destroyEntity(entity_);
             entity_ = 0;
-            try
-            {
-                Ogre::MeshManager::getSingleton().remove(mesh_name);
-            }
-            catch (...) {}
+            ReleaseMesh(mesh_name);
+        }
+    }
+    
+    void EC_OgreCustomObject::ReleaseMesh(const std::string& mesh_name)
+    {
+        if (renderer_.expired())
+            return;
+        RendererPtr renderer = renderer_.lock();
+        
+        if (renderer->GetSharedMeshCache()->Release(mesh_name))
+            return;
+        
+        try
+        {
+            Ogre::MeshManager::getSingleton().remove(mesh_name);
         }
+        catch (...) {}
     }
 
 	void EC_OgreCustomObject::GetBoundingBox(Vector3df& min, Vector3df& max) const
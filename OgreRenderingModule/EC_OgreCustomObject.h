@@ -6,6 +6,7 @@
 #include "ComponentInterface.h"
 #include "OgreModuleApi.h"
 #include "Declare_EC.h"
+#include "PoolAllocator.h"
 
 #include "Vector3D.h"
 
@@ -34,6 +35,7 @@ namespace OgreRenderer
         Q_OBJECT
 
         DECLARE_EC(EC_OgreCustomObject);
+        DECLARE_POOL_ALLOCATED(EC_OgreCustomObject)
     public:
         virtual ~EC_OgreCustomObject();
 
@@ -56,9 +58,20 @@ namespace OgreRenderer
 
         //! Commit changes from a manual object
         /*! converts ManualObject to mesh, makes an entity out of it & clears the manualobject.
+            \param object manual object
+            \param shared_key if not empty, the mesh is shared with other objects committing the same key, see CommitSharedMesh().
+                   The key must describe everything the geometry was generated from.
             \return true if successful
          */
-        bool CommitChanges(Ogre::ManualObject* object);
+        bool CommitChanges(Ogre::ManualObject* object, const std::string& shared_key = std::string());
+
+        //! Commit a mesh already committed by another object with the same key
+        /*! makes an entity out of the shared mesh, without converting a manual object.
+            \param shared_key key the mesh was committed with
+            \return true if successful, false if no mesh has been committed with the key, in which case the geometry
+                    should be generated and committed with CommitChanges()
+         */
+        bool CommitSharedMesh(const std::string& shared_key);
 
         //! Sets material on already committed geometry, similar to EC_OgreMesh
         /*! \param index submesh index
@@ -99,6 +112,12 @@ namespace OgreRenderer
         //! removes old entity and mesh
         void DestroyEntity();
         
+        //! creates entity from a mesh, releases the mesh if fails
+        bool CreateEntity(const std::string& mesh_name);
+        
+        //! removes mesh, or releases it if shared
+        void ReleaseMesh(const std::string& mesh_name);
+        
         //! placeable component 
         Foundation::ComponentPtr placeable_;
         
@@ -10,6 +10,8 @@
 #include <Ogre.h>
 #include <OgreTagPoint.h>
 
+DEFINE_POOL_ALLOCATED(OgreRenderer::EC_OgreMesh)
+
 namespace OgreRenderer
 {
     EC_OgreMesh::EC_OgreMesh(Foundation::ModuleInterface* module) :
@@ -8,6 +8,7 @@
 #include "Vector3D.h"
 #include "Quaternion.h"
 #include "Declare_EC.h"
+#include "PoolAllocator.h"
 
 namespace Ogre
 {
@@ -34,6 +35,7 @@ namespace OgreRenderer
         Q_OBJECT
         
         DECLARE_EC(EC_OgreMesh);
+        DECLARE_POOL_ALLOCATED(EC_OgreMesh)
     public:
         virtual ~EC_OgreMesh();
     public slots:    
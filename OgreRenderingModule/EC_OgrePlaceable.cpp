@@ -7,6 +7,8 @@
 #include <Ogre.h>
 #include <QDebug>
 
+DEFINE_POOL_ALLOCATED(OgreRenderer::EC_OgrePlaceable)
+
 namespace OgreRenderer
 {
     EC_OgrePlaceable::EC_OgrePlaceable(Foundation::ModuleInterface* module) :
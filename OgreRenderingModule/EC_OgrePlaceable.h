@@ -8,6 +8,7 @@
 #include "Vector3D.h"
 #include "Quaternion.h"
 #include "Declare_EC.h"
+#include "PoolAllocator.h"
 #include <QtGui/qquaternion.h>
 #include <QtGui/qvector3d.h>
 
@@ -29,6 +30,7 @@ namespace OgreRenderer
     class OGRE_MODULE_API EC_OgrePlaceable : public Foundation::ComponentInterface
     {
         DECLARE_EC(EC_OgrePlaceable);
+        DECLARE_POOL_ALLOCATED(EC_OgrePlaceable)
 
         Q_OBJECT
         Q_PROPERTY(QVector3D Position READ GetQPosition WRITE SetQPosition)
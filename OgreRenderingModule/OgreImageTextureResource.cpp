@@ -3,6 +3,7 @@
 #include "StableHeaders.h"
 #include "OgreImageTextureResource.h"
 #include "OgreRenderingModule.h"
+#include "BlockCompression.h"
 
 #include <Ogre.h>
 
@@ -61,6 +62,71 @@ namespace OgreRenderer
         return true;
     }
 
+    bool OgreImageTextureResource::SetDataFromTexture(Foundation::TexturePtr source)
+    {
+        if (!source)
+        {
+            OgreRenderingModule::LogError("Null source texture data pointer");
+            return false;
+        }
+        if ((!source->GetWidth()) || (!source->GetHeight()) || (source->GetFormat() == -1))
+        {
+            OgreRenderingModule::LogError("Texture with zero dimension(s) or no pixel format");
+            return false;
+        }
+
+        try
+        {
+            RemoveTexture();
+
+            Ogre::PixelFormat format = (Ogre::PixelFormat)source->GetFormat();
+            uint width = source->GetWidth();
+            uint height = source->GetHeight();
+            uint mip_levels = std::max(source->GetMipLevels(), 1u);
+            u8* data = source->GetData();
+
+            // Without hardware support, decompress the largest level and let Ogre generate the mipmaps
+            std::vector<u8> decompressed;
+            if (Foundation::BlockCompression::IsCompressed(format) && !Ogre::Root::getSingleton().getRenderSystem()->
+                getCapabilities()->hasCapability(Ogre::RSC_TEXTURE_COMPRESSION_DXT))
+            {
+                decompressed.resize(width * height * 4);
+                Foundation::BlockCompression::DecompressLevel(data, width, height, (Foundation::BlockCompression::Format)format,
+                    &decompressed[0]);
+                data = &decompressed[0];
+                format = Ogre::PF_BYTE_RGBA;
+                mip_levels = 1;
+            }
+
+            // In low quality mode, leave out the largest level of a mip chain, or halve the image
+            bool reduced = false;
+            if ((texturequality_ == Texture_Low) && (mip_levels > 1))
+            {
+                data += Ogre::PixelUtil::getMemorySize(width, height, 1, format);
+                width = std::max(width / 2, 1u);
+                height = std::max(height / 2, 1u);
+                --mip_levels;
+                reduced = true;
+            }
+
+            // The image refers to the data as it is, without a copy
+            Ogre::Image image;
+            image.loadDynamicImage(data, width, height, 1, format, false, 1, mip_levels - 1);
+            if ((texturequality_ == Texture_Low) && (!reduced) && (width >= 2) && (height >= 2))
+                image.resize(width / 2, height / 2);
+            ogre_texture_ = Ogre::TextureManager::getSingleton().loadImage(id_, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, image);
+        }
+        catch (Ogre::Exception &e)
+        {
+            OgreRenderingModule::LogError("Failed to create image texture " + id_ + ": " + std::string(e.what()));
+            RemoveTexture();
+            return false;
+        }
+
+        OgreRenderingModule::LogDebug("Ogre image texture " + id_ + " created from decoded image");
+        return true;
+    }
+
     bool OgreImageTextureResource::HasAlpha() const
     {
         if (ogre_texture_.get())
@@ -56,6 +56,12 @@ namespace OgreRenderer
             \return true if successful
          */
         bool SetData(Foundation::AssetPtr source);
+
+        //! sets contents from an image already decoded into a raw texture, so that only the upload is left
+        /*! \param source source raw texture data, with its pixel format set
+            \return true if successful
+         */
+        bool SetDataFromTexture(Foundation::TexturePtr source);
         
         //! returns resource type in text form (static)
         static const std::string& GetTypeStatic();
@@ -3,22 +3,43 @@
 #include "StableHeaders.h"
 #include "OgreTextureResource.h"
 #include "OgreRenderingModule.h"
+#include "PixelConversion.h"
+#include "BlockCompression.h"
 
 #include <Ogre.h>
 
 namespace OgreRenderer
 {
+    //! Returns whether pixels of a format consist of 1 to 4 channels of a byte each, which can be averaged bytewise
+    static bool HasByteChannels(Ogre::PixelFormat format)
+    {
+        if (Ogre::PixelUtil::isCompressed(format) || Ogre::PixelUtil::isFloatingPoint(format))
+            return false;
+        size_t bytes = Ogre::PixelUtil::getNumElemBytes(format);
+        if (bytes < 1 || bytes > 4)
+            return false;
+
+        int bits[4];
+        Ogre::PixelUtil::getBitDepths(format, bits);
+        for (int i = 0; i < 4; ++i)
+            if (bits[i] != 0 && bits[i] != 8)
+                return false;
+        return true;
+    }
+
     OgreTextureResource::OgreTextureResource(const std::string& id, TextureQuality texturequality) : 
         ResourceInterface(id),
         texturequality_(texturequality),
-        level_(-1)
+        level_(-1),
+        downgraded_(false)
     {
     }
 
     OgreTextureResource::OgreTextureResource(const std::string& id, TextureQuality texturequality, Foundation::TexturePtr source) : 
         ResourceInterface(id),
         texturequality_(texturequality),
-        level_(-1)
+        level_(-1),
+        downgraded_(false)
     {
         SetData(source);
     }
@@ -57,8 +78,22 @@ namespace OgreRenderer
             Ogre::DataStreamPtr stream(new Ogre::MemoryDataStream((void*)source->GetData(), source->GetSize(), false));
             Ogre::Image image;
             image.load(stream);
+
+            std::vector<u8> downsampled;
             if (texturequality_ == Texture_Low)
-                image.resize(image.getWidth() / 2, image.getHeight() / 2);
+            {
+                uint width = image.getWidth();
+                uint height = image.getHeight();
+                uint bytes = Ogre::PixelUtil::getNumElemBytes(image.getFormat());
+                if (HasByteChannels(image.getFormat()) && image.getDepth() == 1 && image.getNumFaces() == 1 && width >= 2 && height >= 2)
+                {
+                    downsampled.resize((width / 2) * (height / 2) * bytes);
+                    Foundation::PixelConversion::DownsampleHalf(image.getData(), width, height, bytes, &downsampled[0]);
+                    image.loadDynamicImage(&downsampled[0], width / 2, height / 2, image.getFormat());
+                }
+                else
+                    image.resize(width / 2, height / 2);
+            }
             ogre_texture_ = Ogre::TextureManager::getSingleton().loadImage(id_, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, image);
             
         }
@@ -71,6 +106,7 @@ namespace OgreRenderer
 
         OgreRenderingModule::LogDebug("Ogre texture " + id_ + " created");
         level_ = 0;
+        downgraded_ = false;
         return true;
     }
     
@@ -120,50 +156,66 @@ namespace OgreRenderer
 
         try
         {
-            if (ogre_texture_.isNull())
-            {   
-                ogre_texture_ = Ogre::TextureManager::getSingleton().createManual(
-                    id_, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, Ogre::TEX_TYPE_2D,
-                    source->GetWidth(), source->GetHeight(), Ogre::MIP_DEFAULT, pixel_format, Ogre::TU_DEFAULT); 
+            uint width = source->GetWidth();
+            uint height = source->GetHeight();
+            uint mip_levels = std::max(source->GetMipLevels(), 1u);
+            const u8* data = source->GetData();
 
-                if (ogre_texture_.isNull())
-                {
-                    OgreRenderingModule::LogError("Failed to create texture " + id_);
-                    return false; 
-                }   
-            }
-            else
+            // Without hardware support, decompress the largest level and let Ogre generate the mipmaps
+            std::vector<u8> decompressed;
+            if (Foundation::BlockCompression::IsCompressed(pixel_format) && !Ogre::Root::getSingleton().getRenderSystem()->
+                getCapabilities()->hasCapability(Ogre::RSC_TEXTURE_COMPRESSION_DXT))
             {
-                // See if size/format changed, have to delete/recreate internal resources
-                if ((source->GetWidth() != ogre_texture_->getWidth()) ||
-                    (source->GetHeight() != ogre_texture_->getHeight()) ||
-                    (pixel_format != ogre_texture_->getFormat()))
-                {
-                    ogre_texture_->freeInternalResources();
-                    ogre_texture_->setWidth(source->GetWidth());
-                    ogre_texture_->setHeight(source->GetHeight());
-                    ogre_texture_->setFormat(pixel_format);
-                    ogre_texture_->createInternalResources();
-                }
+                decompressed.resize(width * height * 4);
+                Foundation::BlockCompression::DecompressLevel(data, width, height, (Foundation::BlockCompression::Format)pixel_format,
+                    &decompressed[0]);
+                data = &decompressed[0];
+                pixel_format = Ogre::PF_BYTE_RGBA;
+                mip_levels = 1;
             }
 
-            // For the highest level texture, reduce size in low quality mode
-            if ((!source->GetLevel()) && (texturequality_ == Texture_Low))
+            // The data must hold the mip chain it claims to
+            size_t chain_size = 0;
+            for(uint mip = 0; mip < mip_levels; ++mip)
+                chain_size += Ogre::PixelUtil::getMemorySize(std::max(width >> mip, 1u), std::max(height >> mip, 1u), 1, pixel_format);
+            if ((mip_levels > 1) && (chain_size > source->GetDataSize()))
             {
-                Ogre::Image tempImage;
-                Ogre::DataStreamPtr stream(new Ogre::MemoryDataStream((void*)source->GetData(), source->GetDataSize(), false));
-                tempImage.loadRawData(stream, source->GetWidth(), source->GetHeight(), 1, pixel_format);
-                tempImage.resize(source->GetWidth() / 2, source->GetHeight() / 2);
-                if (!ogre_texture_->getBuffer().isNull())
-                    ogre_texture_->getBuffer()->blitFromMemory(tempImage.getPixelBox());
+                OgreRenderingModule::LogError("Texture " + id_ + " has less data than its mip levels need");
+                return false;
             }
-            else
+
+            // For the highest level texture, reduce size in low quality mode. The texture is created at the reduced
+            // size, so that the pixels are uploaded as they are. With a mip chain, the largest level is left out
+            std::vector<u8> downsampled;
+            Ogre::Image temp_image;
+            if ((!source->GetLevel()) && (texturequality_ == Texture_Low) && (width >= 2) && (height >= 2))
             {
-                Ogre::Box dimensions(0,0, source->GetWidth(), source->GetHeight());
-                Ogre::PixelBox pixel_box(dimensions, pixel_format, (void*)source->GetData());
-                if (!ogre_texture_->getBuffer().isNull())
-                    ogre_texture_->getBuffer()->blitFromMemory(pixel_box);
+                if (mip_levels > 1)
+                {
+                    data += Ogre::PixelUtil::getMemorySize(width, height, 1, pixel_format);
+                    --mip_levels;
+                }
+                else if (HasByteChannels(pixel_format))
+                {
+                    uint bytes = Ogre::PixelUtil::getNumElemBytes(pixel_format);
+                    downsampled.resize((width / 2) * (height / 2) * bytes);
+                    Foundation::PixelConversion::DownsampleHalf(data, width, height, bytes, &downsampled[0]);
+                    data = &downsampled[0];
+                }
+                else
+                {
+                    Ogre::DataStreamPtr stream(new Ogre::MemoryDataStream((void*)source->GetData(), source->GetDataSize(), false));
+                    temp_image.loadRawData(stream, width, height, 1, pixel_format);
+                    temp_image.resize(width / 2, height / 2);
+                    data = temp_image.getData();
+                }
+                width /= 2;
+                height /= 2;
             }
+
+            if (!PrepareTexture(width, height, pixel_format, mip_levels))
+                return false;
+            UploadLevels(data, width, height, pixel_format, mip_levels);
         }
         catch (Ogre::Exception &e)
         {
@@ -173,9 +225,154 @@ namespace OgreRenderer
 
         OgreRenderingModule::LogDebug("Ogre texture " + id_ + " updated");
         level_ = source->GetLevel();
+        downgraded_ = false;
+        return true;
+    }
+
+    bool OgreTextureResource::PrepareTexture(uint width, uint height, Ogre::PixelFormat format, uint mip_levels)
+    {
+        // A mip chain is uploaded as it is, otherwise Ogre generates the mipmaps
+        int num_mipmaps = mip_levels > 1 ? (int)mip_levels - 1 : Ogre::MIP_DEFAULT;
+        int usage = mip_levels > 1 ? Ogre::TU_STATIC_WRITE_ONLY : Ogre::TU_DEFAULT;
+
+        if (ogre_texture_.isNull())
+        {   
+            ogre_texture_ = Ogre::TextureManager::getSingleton().createManual(
+                id_, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, Ogre::TEX_TYPE_2D,
+                width, height, num_mipmaps, format, usage); 
+
+            if (ogre_texture_.isNull())
+            {
+                OgreRenderingModule::LogError("Failed to create texture " + id_);
+                return false; 
+            }   
+        }
+        else
+        {
+            // See if size/format/mipmaps changed, have to delete/recreate internal resources
+            if ((width != ogre_texture_->getWidth()) ||
+                (height != ogre_texture_->getHeight()) ||
+                (format != ogre_texture_->getFormat()) ||
+                (usage != ogre_texture_->getUsage()) ||
+                ((mip_levels > 1) && (mip_levels - 1 != ogre_texture_->getNumMipmaps())))
+            {
+                ogre_texture_->freeInternalResources();
+                ogre_texture_->setWidth(width);
+                ogre_texture_->setHeight(height);
+                ogre_texture_->setFormat(format);
+                ogre_texture_->setUsage(usage);
+                ogre_texture_->setNumMipmaps(mip_levels > 1 ? mip_levels - 1 : Ogre::TextureManager::getSingleton().getDefaultNumMipmaps());
+                ogre_texture_->createInternalResources();
+            }
+        }
+
         return true;
     }
 
+    void OgreTextureResource::UploadLevels(const u8* data, uint width, uint height, Ogre::PixelFormat format, uint mip_levels)
+    {
+        for(uint mip = 0; mip < mip_levels; ++mip)
+        {
+            Ogre::HardwarePixelBufferSharedPtr buffer = ogre_texture_->getBuffer(0, mip);
+            if (buffer.isNull())
+                break;
+
+            uint mip_width = std::max(width >> mip, 1u);
+            uint mip_height = std::max(height >> mip, 1u);
+            Ogre::Box dimensions(0, 0, mip_width, mip_height);
+            Ogre::PixelBox pixel_box(dimensions, format, (void*)data);
+            buffer->blitFromMemory(pixel_box);
+            data += Ogre::PixelUtil::getMemorySize(mip_width, mip_height, 1, format);
+        }
+    }
+
+    bool OgreTextureResource::Downgrade(uint max_size)
+    {
+        if (ogre_texture_.isNull() || !ogre_texture_->isLoaded())
+            return false;
+
+        uint width = ogre_texture_->getWidth();
+        uint height = ogre_texture_->getHeight();
+        uint num_mipmaps = ogre_texture_->getNumMipmaps();
+        uint first = 0;
+        while ((std::max(width >> first, height >> first) > std::max(max_size, 1u)) && (first < num_mipmaps))
+            ++first;
+        if (!first)
+            return false;
+
+        // Read back the levels kept. Generated mipmaps are generated again, an uploaded chain is uploaded again
+        Ogre::PixelFormat format = ogre_texture_->getFormat();
+        bool generated = (ogre_texture_->getUsage() & Ogre::TU_AUTOMIPMAP) != 0;
+        uint mip_levels = generated ? 1 : num_mipmaps + 1 - first;
+        uint new_width = std::max(width >> first, 1u);
+        uint new_height = std::max(height >> first, 1u);
+
+        std::vector<u8> data;
+        try
+        {
+            for(uint mip = 0; mip < mip_levels; ++mip)
+            {
+                uint mip_width = std::max(new_width >> mip, 1u);
+                uint mip_height = std::max(new_height >> mip, 1u);
+                size_t offset = data.size();
+                data.resize(offset + Ogre::PixelUtil::getMemorySize(mip_width, mip_height, 1, format));
+                Ogre::PixelBox pixel_box(mip_width, mip_height, 1, format, &data[offset]);
+                ogre_texture_->getBuffer(0, first + mip)->blitToMemory(pixel_box);
+            }
+        }
+        catch (Ogre::Exception &)
+        {
+            // Some render systems do not expose generated mipmaps. Read the whole texture and shrink it instead
+            if (!generated || Ogre::PixelUtil::isCompressed(format))
+                return false;
+            try
+            {
+                std::vector<u8> whole(Ogre::PixelUtil::getMemorySize(width, height, 1, format));
+                ogre_texture_->getBuffer()->blitToMemory(Ogre::PixelBox(width, height, 1, format, &whole[0]));
+                Ogre::Image image;
+                image.loadDynamicImage(&whole[0], width, height, format);
+                image.resize(new_width, new_height);
+                data.assign(image.getData(), image.getData() + image.getSize());
+            }
+            catch (Ogre::Exception &e)
+            {
+                OgreRenderingModule::LogError("Failed to read back texture " + id_ + ": " + std::string(e.what()));
+                return false;
+            }
+        }
+
+        try
+        {
+            if (!PrepareTexture(new_width, new_height, format, mip_levels))
+                return false;
+            UploadLevels(&data[0], new_width, new_height, format, mip_levels);
+        }
+        catch (Ogre::Exception &e)
+        {
+            OgreRenderingModule::LogError("Failed to downgrade texture " + id_ + ": " + std::string(e.what()));
+            return false;
+        }
+
+        // A lower level makes the texture be requested again in full
+        level_ += first;
+        downgraded_ = true;
+        OgreRenderingModule::LogDebug("Ogre texture " + id_ + " downgraded to " + ToString(new_width) + "x" + ToString(new_height));
+        return true;
+    }
+
+    uint OgreTextureResource::GetMemorySize() const
+    {
+        if (ogre_texture_.isNull())
+            return 0;
+
+        uint size = 0;
+        uint width = ogre_texture_->getWidth();
+        uint height = ogre_texture_->getHeight();
+        for(uint mip = 0; mip <= ogre_texture_->getNumMipmaps(); ++mip)
+            size += Ogre::PixelUtil::getMemorySize(std::max(width >> mip, 1u), std::max(height >> mip, 1u), 1, ogre_texture_->getFormat());
+        return size;
+    }
+
     bool OgreTextureResource::HasAlpha() const
     {
         if (ogre_texture_.get())
@@ -53,6 +53,20 @@ namespace OgreRenderer
         
         //! returns whether has alpha channel
         bool HasAlpha() const;
+
+        //! returns whether the texture has been downgraded since its data was last set
+        bool IsDowngraded() const { return downgraded_; }
+
+        //! returns GPU memory used by the texture and its mipmaps in bytes
+        uint GetMemorySize() const;
+
+        //! reduces the texture to its first mip level no larger than a size, freeing GPU memory
+        /*! The texture stays usable by materials. The quality level is lowered, so that a request of the texture
+            loads it again in full.
+            \param max_size Largest width or height to keep
+            \return true if the texture was reduced
+         */
+        bool Downgrade(uint max_size);
         
         //! sets contents from an image file
         /*! \param source source image asset
@@ -72,6 +86,14 @@ namespace OgreRenderer
     private:
         //! Remove texture
         void RemoveTexture();
+
+        //! Creates the Ogre texture, or recreates its internal resources if the size, format or mipmaps change
+        /*! \param mip_levels Number of mip levels to be uploaded. If 1, Ogre generates the mipmaps
+         */
+        bool PrepareTexture(uint width, uint height, Ogre::PixelFormat format, uint mip_levels);
+
+        //! Uploads mip levels, stored one after another largest first
+        void UploadLevels(const u8* data, uint width, uint height, Ogre::PixelFormat format, uint mip_levels);
         
         //! Ogre texture
         Ogre::TexturePtr ogre_texture_;
@@ -81,6 +103,9 @@ namespace OgreRenderer
         
         //! Texture quality
         TextureQuality texturequality_;
+
+        //! Whether the texture has been downgraded since its data was last set
+        bool downgraded_;
     };
 }
 #endif
@@ -17,6 +17,9 @@
 #include "StereoController.h"
 #include "OgreShadowCameraSetupFocusedPSSM.h"
 #include "CompositionHandler.h"
+#include "TextureVisibilityTracker.h"
+#include "TextureResidencyManager.h"
+#include "SharedMeshCache.h"
 
 #include "SceneManager.h"
 #include "SceneEvents.h"
@@ -69,7 +72,11 @@ namespace OgreRenderer
             {
                 entity = Ogre::any_cast<Scene::Entity*>(any);
                 if (entity)
+                {
                     renderer_->visible_entities_.insert(entity->GetId());
+                    if (renderer_->texture_tracker_->IsSampling())
+                        renderer_->texture_tracker_->AddRenderable(rend);
+                }
             }
             catch (Ogre::InvalidParametersException &/*e*/)
             {
@@ -124,6 +131,9 @@ namespace OgreRenderer
         object_id_(0),
         group_id_(0),
         resource_handler_(ResourceHandlerPtr(new ResourceHandler(this, framework))),
+        texture_tracker_(TextureVisibilityTrackerPtr(new TextureVisibilityTracker(framework))),
+        texture_residency_(TextureResidencyManagerPtr(new TextureResidencyManager(framework, this))),
+        shared_meshes_(SharedMeshCachePtr(new SharedMeshCache())),
         config_filename_(config),
         plugins_filename_(plugins),
         ray_query_(0),
@@ -199,6 +209,7 @@ namespace OgreRenderer
         foreach(GaussianListener* listener, gaussianListeners_)
             SAFE_DELETE(listener);
 
+        texture_residency_.reset();
         resource_handler_.reset();
         root_.reset();
         SAFE_DELETE(c_handler_);
@@ -536,6 +547,10 @@ namespace OgreRenderer
     void Renderer::Update(f64 frametime)
     {
         Ogre::WindowEventUtilities::messagePump();
+        texture_tracker_->Update(frametime);
+        texture_residency_->Update(frametime);
+        if (initialized_)
+            resource_handler_->ProcessTextureUploads(texture_tracker_->GetScreenSizes());
     }
     
     void Renderer::SetCurrentCamera(Ogre::Camera* camera)
@@ -590,9 +605,16 @@ namespace OgreRenderer
                 resized_dirty_--;
         }
         
-        // The RenderableListener will fill in visible entities for this frame
+        // The RenderableListener will fill in visible entities for this frame, and texture sizes if sampled
         visible_entities_.clear();
+        texture_tracker_->BeginFrame(camera_, viewport_ ? viewport_->getActualHeight() : 0);
+        bool sampled = texture_tracker_->IsSampling();
         q_ogre_world_view_->RenderOneFrame();
+        texture_tracker_->EndFrame();
+
+        // Keep texture memory within budget, by what the sampled frame showed
+        if (sampled)
+            texture_residency_->AddSample(texture_tracker_->GetScreenSizes());
         q_ogre_ui_view_->setDirty(false);
     }
 
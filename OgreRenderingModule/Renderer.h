@@ -52,11 +52,17 @@ namespace OgreRenderer
     class StereoController;
     class CompositionHandler;
     class GaussianListener;
+    class TextureVisibilityTracker;
+    class TextureResidencyManager;
+    class SharedMeshCache;
 
     typedef boost::shared_ptr<Ogre::Root> OgreRootPtr;
     typedef boost::shared_ptr<LogListener> OgreLogListenerPtr;
     typedef boost::shared_ptr<ResourceHandler> ResourceHandlerPtr;
     typedef boost::shared_ptr<RenderableListener> RenderableListenerPtr;
+    typedef boost::shared_ptr<TextureVisibilityTracker> TextureVisibilityTrackerPtr;
+    typedef boost::shared_ptr<TextureResidencyManager> TextureResidencyManagerPtr;
+    typedef boost::shared_ptr<SharedMeshCache> SharedMeshCachePtr;
 
     //! Ogre renderer
     /*! Created by OgreRenderingModule. Implements the RenderServiceInterface.
@@ -200,6 +206,9 @@ namespace OgreRenderer
         //! Returns resource handler
         ResourceHandlerPtr GetResourceHandler() const { return resource_handler_; }
 
+        //! Returns meshes shared by custom objects of identical geometry
+        SharedMeshCache* GetSharedMeshCache() const { return shared_meshes_.get(); }
+
         //! Removes log listener
         void RemoveLogListener();
 
@@ -327,6 +336,15 @@ namespace OgreRenderer
         //! Resource handler
         ResourceHandlerPtr resource_handler_;
 
+        //! On-screen texture size tracker, fed by the renderable listener
+        TextureVisibilityTrackerPtr texture_tracker_;
+
+        //! Texture memory budget keeper, fed by the texture size tracker
+        TextureResidencyManagerPtr texture_residency_;
+
+        //! Meshes shared by custom objects
+        SharedMeshCachePtr shared_meshes_;
+
         //! Renderer event category
         event_category_id_t renderercategory_id_;
 
@@ -12,17 +12,21 @@
 #include "ResourceInterface.h"
 #include "ResourceHandler.h"
 #include "OgreMaterialUtils.h"
+#include "TextureUploadQueue.h"
 #include "RexTypes.h"
 #include "TextureServiceInterface.h"
 #include "AssetServiceInterface.h"
 #include "Framework.h"
 #include "EventManager.h"
 #include "ServiceManager.h"
+#include "Profiler.h"
+#include "HighPerfClock.h"
 
 
 namespace OgreRenderer
 {
     ResourceHandler::ResourceHandler(Renderer* renderer, Foundation::Framework* framework) :
+        texture_uploads_(TextureUploadQueuePtr(new TextureUploadQueue(framework))),
         renderer_(renderer),
         framework_(framework)
     {
@@ -109,6 +113,10 @@ namespace OgreRenderer
     
     void ResourceHandler::RemoveResource(const std::string& id, const std::string& type)
     {
+        // A texture still waiting for upload would otherwise be created again
+        if (type == OgreTextureResource::GetTypeStatic())
+            texture_uploads_->Remove(id);
+
         Foundation::ResourceMap::iterator i = resources_.find(id);
         if (i == resources_.end())
             return;
@@ -165,7 +173,12 @@ namespace OgreRenderer
                     UpdateParticles(event_data->asset_, event_data->tag_);
 
                 if (event_data->asset_type_ == RexTypes::ASSETTYPENAME_IMAGE)
-                    UpdateImageTexture(event_data->asset_, event_data->tag_);
+                {
+                    if (texture_image_tags_.erase(event_data->tag_))
+                        UpdateTextureFromImage(event_data->asset_, event_data->tag_);
+                    else
+                        UpdateImageTexture(event_data->asset_, event_data->tag_);
+                }
             }
             break;
             
@@ -215,13 +228,37 @@ namespace OgreRenderer
                 // Check for texture arriving from the texture decoder
                 if (event_data->resource_->GetType() == "Texture")
                 {
+                    // A decoded image of an image texture is uploaded right away. One of a texture goes to the upload queue
+                    std::map<request_tag_t, ImageDecode>::iterator i = image_decodes_.find(event_data->tag_);
+                    if (i != image_decodes_.end())
+                    {
+                        bool image_texture = i->second.image_texture_;
+                        image_decodes_.erase(i);
+                        if (image_texture)
+                        {
+                            UploadImageTexture(boost::shared_dynamic_cast<Foundation::TextureInterface>(event_data->resource_));
+                            return false;
+                        }
+                    }
+
                     // Check that the request tag matches our request, so we do not (possibly) update unnecessarily many times
                     // because of others' requests
                     if (expected_request_tags_.find(event_data->tag_) != expected_request_tags_.end())
-                        UpdateTexture(event_data->resource_, event_data->tag_);
+                        QueueTexture(event_data->resource_, event_data->tag_);
                 }
             }
         }
+        else if (event_id == Resource::Events::RESOURCE_CANCELED)
+        {
+            Resource::Events::ResourceCanceled *event_data = checked_static_cast<Resource::Events::ResourceCanceled*>(data);
+            std::map<request_tag_t, ImageDecode>::iterator i = image_decodes_.find(event_data->tag_);
+            if (i != image_decodes_.end())
+            {
+                ImageDecode decode = i->second;
+                image_decodes_.erase(i);
+                HandleImageDecodeFailure(decode, event_data->tag_);
+            }
+        }
 
         return false;
     }
@@ -258,18 +295,23 @@ namespace OgreRenderer
             Foundation::AssetPtr imageasset = asset_service->GetAsset(id, RexTypes::ASSETTYPENAME_IMAGE);
             if (imageasset)
             {
-                // If not found, prepare new
-                Foundation::ResourcePtr tex = GetResourceInternal(imageasset->GetId(), OgreTextureResource::GetTypeStatic());
-                if (!tex)
+                // Decode off the main thread if possible. The decoded texture is then uploaded like a decoded J2K texture
+                if (request_tags_.find(id) != request_tags_.end())
                 {
-                    tex = Foundation::ResourcePtr(new OgreTextureResource(imageasset->GetId(), renderer_->GetTextureQuality()));
+                    request_tags_[id].push_back(tag);
+                    return tag;
                 }
-                OgreTextureResource* tex_res = dynamic_cast<OgreTextureResource*>(tex.get());
-                if ((tex_res) && (tex_res->SetDataFromImage(imageasset)))
+                request_tag_t decode_tag = RequestImageDecode(imageasset, false);
+                if (decode_tag)
+                {
+                    expected_request_tags_.insert(decode_tag);
+                    request_tags_[id].push_back(tag);
+                    return tag;
+                }
+
+                Foundation::ResourcePtr tex = LoadTextureFromImage(imageasset);
+                if (tex)
                 {
-                    // Create legacy material(s) based on the texture
-                    UpdateLegacyMaterials(tex->GetId());
-                    resources_[tex->GetId()] = tex;
                     Resource::Events::ResourceReady* event_data = new Resource::Events::ResourceReady(tex->GetId(), tex, tag);
                     framework_->GetEventManager()->SendDelayedEvent(resource_event_category_, Resource::Events::RESOURCE_READY, Foundation::EventDataPtr(event_data));
                     return tag;
@@ -277,6 +319,23 @@ namespace OgreRenderer
                 else
                     OgreRenderingModule::LogInfo("Failed to set imagetexturedata");
             }
+            // An image in the disk cache is loaded in the background; wait for it rather than go through the J2K pipe
+            else if (asset_service->IsAssetCached(id, RexTypes::ASSETTYPENAME_IMAGE))
+            {
+                if (request_tags_.find(id) != request_tags_.end())
+                {
+                    request_tags_[id].push_back(tag);
+                    return tag;
+                }
+                request_tag_t source_tag = asset_service->RequestAsset(id, RexTypes::ASSETTYPENAME_IMAGE);
+                if (source_tag)
+                {
+                    expected_request_tags_.insert(source_tag);
+                    texture_image_tags_.insert(source_tag);
+                    request_tags_[id].push_back(tag);
+                    return tag;
+                }
+            }
         }
         
         // Otherwise, request from texture decoder
@@ -304,6 +363,49 @@ namespace OgreRenderer
         return 0;
     }
 
+    void ResourceHandler::QueueTexture(Foundation::ResourcePtr source, request_tag_t tag)
+    {
+        Foundation::TexturePtr source_tex = boost::shared_dynamic_cast<Foundation::TextureInterface>(source);
+        if (source_tex)
+            texture_uploads_->Add(source_tex, tag);
+    }
+
+    void ResourceHandler::ProcessTextureUploads(const std::map<std::string, uint>& screen_sizes)
+    {
+        PROFILE(ResourceHandler_ProcessTextureUploads);
+
+        texture_uploads_->BeginFrame();
+        Foundation::TexturePtr source;
+        request_tag_t tag;
+        while (texture_uploads_->Next(screen_sizes, source, tag))
+        {
+            Core::tick_t start = Core::GetCurrentClockTime();
+            UpdateTexture(source, tag);
+            f64 time = (f64)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+            texture_uploads_->AddUploaded(source->GetDataSize(), time);
+        }
+    }
+
+    f64 ResourceHandler::GetTextureUploadTime() const
+    {
+        return texture_uploads_->GetFrameTime();
+    }
+
+    uint ResourceHandler::GetTextureUploadBytes() const
+    {
+        return texture_uploads_->GetFrameBytes();
+    }
+
+    uint ResourceHandler::GetNumTextureUploads() const
+    {
+        return texture_uploads_->GetFrameUploads();
+    }
+
+    uint ResourceHandler::GetNumQueuedTextureUploads() const
+    {
+        return texture_uploads_->GetNumQueued();
+    }
+
     bool ResourceHandler::UpdateTexture(Foundation::ResourcePtr source, request_tag_t tag)
     {
         Foundation::TexturePtr source_tex = boost::shared_dynamic_cast<Foundation::TextureInterface>(source);
@@ -419,6 +521,45 @@ namespace OgreRenderer
     {    
         expected_request_tags_.erase(tag);
             
+        // If already have valid data, success (send RESOURCE_READY_EVENT)
+        Foundation::ResourcePtr tex = GetResourceInternal(source->GetId(), OgreImageTextureResource::GetTypeStatic());
+        if ((tex) && (tex->IsValid()))
+        {
+            resources_[source->GetId()] = tex;
+            ProcessResourceReferences(tex);
+            return true;
+        }
+
+        // Decode off the main thread if possible, the texture is created once decoded
+        if (RequestImageDecode(source, true))
+            return true;
+
+        return LoadImageTexture(source);
+    }
+
+    bool ResourceHandler::UpdateTextureFromImage(Foundation::AssetPtr source, request_tag_t tag)
+    {
+        expected_request_tags_.erase(tag);
+
+        // Decode off the main thread if possible. The decoded texture is then uploaded like a decoded J2K texture,
+        // which answers the texture requests
+        request_tag_t decode_tag = RequestImageDecode(source, false);
+        if (decode_tag)
+        {
+            expected_request_tags_.insert(decode_tag);
+            return true;
+        }
+
+        // Otherwise load on the main thread, as when decoding fails
+        ImageDecode decode;
+        decode.source_ = source;
+        decode.image_texture_ = false;
+        HandleImageDecodeFailure(decode, tag);
+        return true;
+    }
+
+    bool ResourceHandler::LoadImageTexture(Foundation::AssetPtr source)
+    {
         // If not found, prepare new
         Foundation::ResourcePtr tex = GetResourceInternal(source->GetId(), OgreImageTextureResource::GetTypeStatic());
         if (!tex)
@@ -426,19 +567,99 @@ namespace OgreRenderer
             tex = Foundation::ResourcePtr(new OgreImageTextureResource(source->GetId(), renderer_->GetTextureQuality()));
         }
 
-        bool success = false;
-        OgreImageTextureResource* tex_res = checked_static_cast<OgreImageTextureResource*>(tex.get());
+        if (!checked_static_cast<OgreImageTextureResource*>(tex.get())->SetData(source))
+            return false;
 
-        // If data successfully set, or already have valid data, success (send RESOURCE_READY_EVENT)
-        if ((tex_res->IsValid()) || (tex_res->SetData(source)))
+        resources_[source->GetId()] = tex;
+        ProcessResourceReferences(tex);
+        return true;
+    }
+
+    bool ResourceHandler::UploadImageTexture(Foundation::TexturePtr source)
+    {
+        if (!source)
+            return false;
+
+        // If not found, prepare new
+        Foundation::ResourcePtr tex = GetResourceInternal(source->GetId(), OgreImageTextureResource::GetTypeStatic());
+        if (!tex)
         {
-            resources_[source->GetId()] = tex;
-            ProcessResourceReferences(tex);
-            
-            success = true;
+            tex = Foundation::ResourcePtr(new OgreImageTextureResource(source->GetId(), renderer_->GetTextureQuality()));
         }
-        
-        return success;
+
+        if (!checked_static_cast<OgreImageTextureResource*>(tex.get())->SetDataFromTexture(source))
+            return false;
+
+        resources_[source->GetId()] = tex;
+        ProcessResourceReferences(tex);
+        return true;
+    }
+
+    Foundation::ResourcePtr ResourceHandler::LoadTextureFromImage(Foundation::AssetPtr source)
+    {
+        // If not found, prepare new
+        Foundation::ResourcePtr tex = GetResourceInternal(source->GetId(), OgreTextureResource::GetTypeStatic());
+        if (!tex)
+        {
+            tex = Foundation::ResourcePtr(new OgreTextureResource(source->GetId(), renderer_->GetTextureQuality()));
+        }
+        OgreTextureResource* tex_res = dynamic_cast<OgreTextureResource*>(tex.get());
+        if ((!tex_res) || (!tex_res->SetDataFromImage(source)))
+        {
+            OgreRenderingModule::LogInfo("Failed to set imagetexturedata");
+            return Foundation::ResourcePtr();
+        }
+
+        // Create legacy material(s) based on the texture
+        UpdateLegacyMaterials(tex->GetId());
+        resources_[tex->GetId()] = tex;
+        return tex;
+    }
+
+    request_tag_t ResourceHandler::RequestImageDecode(Foundation::AssetPtr source, bool image_texture)
+    {
+        boost::shared_ptr<Foundation::TextureServiceInterface> texture_service = framework_->GetServiceManager()->
+            GetService<Foundation::TextureServiceInterface>(Foundation::Service::ST_Texture).lock();
+        if (!texture_service)
+            return 0;
+
+        request_tag_t tag = texture_service->DecodeImage(source);
+        if (tag)
+        {
+            ImageDecode& decode = image_decodes_[tag];
+            decode.source_ = source;
+            decode.image_texture_ = image_texture;
+        }
+        return tag;
+    }
+
+    void ResourceHandler::HandleImageDecodeFailure(const ImageDecode& decode, request_tag_t tag)
+    {
+        // Formats the texture service can not decode, such as DDS, are loaded by Ogre on the main thread
+        if (decode.image_texture_)
+        {
+            LoadImageTexture(decode.source_);
+            return;
+        }
+
+        expected_request_tags_.erase(tag);
+        const std::string& id = decode.source_->GetId();
+        Foundation::ResourcePtr tex = LoadTextureFromImage(decode.source_);
+        const RequestTagVector& tags = request_tags_[id];
+        for (uint i = 0; i < tags.size(); ++i)
+        {
+            if (tex)
+            {
+                Resource::Events::ResourceReady event_data(id, tex, tags[i]);
+                framework_->GetEventManager()->SendEvent(resource_event_category_, Resource::Events::RESOURCE_READY, &event_data);
+            }
+            else
+            {
+                Resource::Events::ResourceCanceled event_data(id, tags[i]);
+                framework_->GetEventManager()->SendEvent(resource_event_category_, Resource::Events::RESOURCE_CANCELED, &event_data);
+            }
+        }
+        request_tags_.erase(id);
     }
 
     bool ResourceHandler::UpdateMaterial(Foundation::AssetPtr source, request_tag_t tag)
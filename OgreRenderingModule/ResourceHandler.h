@@ -5,10 +5,14 @@
 
 #include "ResourceInterface.h"
 #include "AssetInterface.h"
+#include "TextureInterface.h"
 #include "OgreModuleApi.h"
 
 namespace OgreRenderer
 {
+    class TextureUploadQueue;
+    typedef boost::shared_ptr<TextureUploadQueue> TextureUploadQueuePtr;
+
     //! Manages Ogre resources & requests for their data from the asset system. Used internally by Renderer.
     class OGRE_MODULE_API ResourceHandler
     {
@@ -39,6 +43,23 @@ namespace OgreRenderer
 
         //! Handles a resource event. Called by OgreRenderingModule
         bool HandleResourceEvent(event_id_t event_id, Foundation::EventDataInterface* data);
+
+        //! Uploads decoded textures within the budget of a frame. Called by Renderer
+        /*! \param screen_sizes Largest on-screen sizes in pixels by texture name, for priority
+         */
+        void ProcessTextureUploads(const std::map<std::string, uint>& screen_sizes);
+
+        //! Returns seconds spent uploading textures in the last frame
+        f64 GetTextureUploadTime() const;
+
+        //! Returns bytes of textures uploaded in the last frame
+        uint GetTextureUploadBytes() const;
+
+        //! Returns number of textures uploaded in the last frame
+        uint GetNumTextureUploads() const;
+
+        //! Returns number of decoded textures waiting to be uploaded
+        uint GetNumQueuedTextureUploads() const;
         
         //! Internal method to parse braces from an Ogre script. Returns true if line contained open/close brace
         static bool ProcessBraces(const std::string& line, int& brace_level);
@@ -48,7 +69,8 @@ namespace OgreRenderer
         Foundation::ResourcePtr GetResourceInternal(const std::string& id, const std::string& type); 
         
         //! Requests a texture to be downloaded & decoded
-        /*! A resource event (with the returned request tag) is sent as each quality level is decoded.
+        /*! A resource event (with the returned request tag) is sent as each quality level is uploaded. A level
+            superseded by a better one before its turn to upload is skipped.
             \param id Resource ID, same as asset ID
             \return Request tag, 0 if asset ID invalid or asset system fatally non-existent
          */
@@ -61,6 +83,12 @@ namespace OgreRenderer
          */
         request_tag_t RequestOtherResource(const std::string& id, const std::string& type);
 
+        //! Queues a source raw texture resource to be uploaded by ProcessTextureUploads
+        /*! \param source Raw texture
+            \param tag Request tag from raw texture resource event
+         */
+        void QueueTexture(Foundation::ResourcePtr source, request_tag_t tag);
+
         //! Creates or updates a texture, based on a source raw texture resource
         /*! \param source Raw texture 
             \param tag Request tag from raw texture resource event
@@ -97,12 +125,52 @@ namespace OgreRenderer
         bool UpdateParticles(Foundation::AssetPtr source, request_tag_t tag);
 
         //! Creates or updates image based texture, based on source asset data
-        /*! \param source The image asset data.
+        /*! The image is decoded by the texture service if possible, and the texture created once decoded.
+            \param source The image asset data.
             \param tag Request tag from raw asset resource event
-            \return true if successful
+            \return true if successful or decoding
          */
         bool UpdateImageTexture(Foundation::AssetPtr source, request_tag_t tag);
 
+        //! Creates a texture from an image asset that was loaded from the disk cache for a texture request
+        /*! \param source The image asset data.
+            \param tag Request tag of the image asset
+            
+eturn true if successful or decoding
+         */
+        bool UpdateTextureFromImage(Foundation::AssetPtr source, request_tag_t tag);
+
+        //! An image asset being decoded by the texture service
+        struct ImageDecode
+        {
+            //! Image asset, loaded by Ogre if the texture service can not decode it
+            Foundation::AssetPtr source_;
+
+            //! Whether for an image texture, rather than a texture
+            bool image_texture_;
+        };
+
+        //! Requests an image asset to be decoded by the texture service
+        /*! \param source Image asset
+            \param image_texture Whether for an image texture, rather than a texture
+            \return Request tag, 0 if the texture service can not decode images
+         */
+        request_tag_t RequestImageDecode(Foundation::AssetPtr source, bool image_texture);
+
+        //! Loads an image texture from an image asset with Ogre, on the main thread
+        bool LoadImageTexture(Foundation::AssetPtr source);
+
+        //! Creates or updates an image texture from an image decoded by the texture service
+        bool UploadImageTexture(Foundation::TexturePtr source);
+
+        //! Loads a texture from an image asset with Ogre, on the main thread
+        /*! \return The texture, null if failed
+         */
+        Foundation::ResourcePtr LoadTextureFromImage(Foundation::AssetPtr source);
+
+        //! Loads an image the texture service could not decode with Ogre instead, and replies to its requests
+        void HandleImageDecodeFailure(const ImageDecode& decode, request_tag_t tag);
+
         //! Processes resource references of a resource once it has been loaded.
         /*! Adds references to outstanding list and makes requests as necessary.
             If no outstanding references, sends RESOURCE_READY event
@@ -137,6 +205,15 @@ namespace OgreRenderer
         //! Map of outstanding reference requests per resource
         std::map<std::string, Foundation::ResourceReferenceVector> outstanding_references_;
         
+        //! Decoded textures waiting to be uploaded
+        TextureUploadQueuePtr texture_uploads_;
+
+        //! Image assets being decoded by the texture service, by request tag
+        std::map<request_tag_t, ImageDecode> image_decodes_;
+
+        //! Request tags of image assets requested for texture requests, see RequestTexture()
+        std::set<request_tag_t> texture_image_tags_;
+
         //! Framework we belong to
         Foundation::Framework* framework_;
         
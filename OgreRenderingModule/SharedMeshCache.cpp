@@ -0,0 +1,117 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "SharedMeshCache.h"
+
+#include <Ogre.h>
+
+namespace
+{
+    //! Returns bytes of the vertex buffers of vertex data
+    uint GetVertexDataSize(const Ogre::VertexData* data)
+    {
+        if (!data)
+            return 0;
+
+        uint size = 0;
+        const Ogre::VertexBufferBinding::VertexBufferBindingMap& buffers = data->vertexBufferBinding->getBindings();
+        for(Ogre::VertexBufferBinding::VertexBufferBindingMap::const_iterator i = buffers.begin(); i != buffers.end(); ++i)
+            size += i->second->getSizeInBytes();
+        return size;
+    }
+
+    //! Returns bytes of vertex and index data of a mesh
+    uint GetMeshDataSize(const Ogre::Mesh* mesh)
+    {
+        uint size = GetVertexDataSize(mesh->sharedVertexData);
+        for(uint i = 0; i < mesh->getNumSubMeshes(); ++i)
+        {
+            const Ogre::SubMesh* submesh = mesh->getSubMesh(i);
+            if (!submesh->useSharedVertices)
+                size += GetVertexDataSize(submesh->vertexData);
+            if ((submesh->indexData) && (!submesh->indexData->indexBuffer.isNull()))
+                size += submesh->indexData->indexBuffer->getSizeInBytes();
+        }
+        return size;
+    }
+}
+
+namespace OgreRenderer
+{
+    SharedMeshCache::SharedMeshCache()
+    {
+    }
+
+    SharedMeshCache::~SharedMeshCache()
+    {
+    }
+
+    std::string SharedMeshCache::Acquire(const std::string& key)
+    {
+        std::map<std::string, std::string>::iterator i = mesh_names_.find(key);
+        if (i == mesh_names_.end())
+            return std::string();
+
+        ++meshes_[i->second].refcount_;
+        return i->second;
+    }
+
+    void SharedMeshCache::Add(const std::string& key, const std::string& mesh_name)
+    {
+        if (mesh_names_.find(key) != mesh_names_.end())
+            return;
+
+        SharedMesh& shared = meshes_[mesh_name];
+        shared.key_ = key;
+        shared.refcount_ = 1;
+        shared.size_ = 0;
+        Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().getByName(mesh_name);
+        if (!mesh.isNull())
+            shared.size_ = GetMeshDataSize(mesh.get());
+
+        mesh_names_[key] = mesh_name;
+    }
+
+    bool SharedMeshCache::Release(const std::string& mesh_name)
+    {
+        std::map<std::string, SharedMesh>::iterator i = meshes_.find(mesh_name);
+        if (i == meshes_.end())
+            return false;
+
+        if (--i->second.refcount_)
+            return true;
+
+        mesh_names_.erase(i->second.key_);
+        meshes_.erase(i);
+        try
+        {
+            Ogre::MeshManager::getSingleton().remove(mesh_name);
+        }
+        catch (...) {}
+        return true;
+    }
+
+    uint SharedMeshCache::GetNumUsers() const
+    {
+        uint users = 0;
+        for(std::map<std::string, SharedMesh>::const_iterator i = meshes_.begin(); i != meshes_.end(); ++i)
+            users += i->second.refcount_;
+        return users;
+    }
+
+    uint SharedMeshCache::GetMeshMemory() const
+    {
+        uint size = 0;
+        for(std::map<std::string, SharedMesh>::const_iterator i = meshes_.begin(); i != meshes_.end(); ++i)
+            size += i->second.size_;
+        return size;
+    }
+
+    uint SharedMeshCache::GetUnsharedMemory() const
+    {
+        uint size = 0;
+        for(std::map<std::string, SharedMesh>::const_iterator i = meshes_.begin(); i != meshes_.end(); ++i)
+            size += i->second.size_ * i->second.refcount_;
+        return size;
+    }
+}
@@ -0,0 +1,79 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_OgreRenderer_SharedMeshCache_h
+#define incl_OgreRenderer_SharedMeshCache_h
+
+#include "CoreTypes.h"
+
+namespace OgreRenderer
+{
+    //! Reference counted meshes shared by custom objects of identical geometry. Used internally by Renderer.
+    /*! A mesh is registered under a key describing everything its geometry was generated from, such as the shape,
+        vertex color and material parameters of a prim. Custom objects committing the same key then create their
+        entities from the registered mesh, so they share its vertex and index buffers instead of each converting
+        a manual object of their own. A shared mesh is removed when the last entity using it is destroyed.
+     */
+    class SharedMeshCache
+    {
+    public:
+        //! Constructor
+        SharedMeshCache();
+
+        //! Destructor
+        ~SharedMeshCache();
+
+        //! Takes a reference to the mesh registered under a key
+        /*! \param key Geometry key
+            \return Mesh name, or empty if no mesh is registered under the key
+         */
+        std::string Acquire(const std::string& key);
+
+        //! Registers a mesh under a key, with one reference
+        /*! If a mesh is already registered under the key, the new mesh is not shared and Release() leaves it to
+            the caller.
+            \param key Geometry key
+            \param mesh_name Name of the mesh
+         */
+        void Add(const std::string& key, const std::string& mesh_name);
+
+        //! Releases a reference to a mesh, and removes the mesh when it is no longer used
+        /*! \param mesh_name Name of the mesh
+            \return true if the mesh is shared, false if not, in which case the caller owns it
+         */
+        bool Release(const std::string& mesh_name);
+
+        //! Returns number of shared meshes
+        uint GetNumMeshes() const { return meshes_.size(); }
+
+        //! Returns number of entities using the shared meshes
+        uint GetNumUsers() const;
+
+        //! Returns bytes of vertex and index data used by the shared meshes
+        uint GetMeshMemory() const;
+
+        //! Returns bytes of vertex and index data the users would need without sharing
+        uint GetUnsharedMemory() const;
+
+    private:
+        //! A shared mesh
+        struct SharedMesh
+        {
+            //! Geometry key
+            std::string key_;
+
+            //! Bytes of vertex and index data
+            uint size_;
+
+            //! Number of entities using the mesh
+            uint refcount_;
+        };
+
+        //! Shared meshes by mesh name
+        std::map<std::string, SharedMesh> meshes_;
+
+        //! Mesh names by geometry key
+        std::map<std::string, std::string> mesh_names_;
+    };
+}
+
+#endif
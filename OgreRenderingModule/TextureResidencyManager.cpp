@@ -0,0 +1,129 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "TextureResidencyManager.h"
+#include "OgreTextureResource.h"
+#include "ResourceHandler.h"
+#include "Renderer.h"
+
+#include "Framework.h"
+#include "ConfigurationManager.h"
+
+#include <Ogre.h>
+
+namespace OgreRenderer
+{
+    static const int DEFAULT_TEXTURE_MEMORY_BUDGET = 256;
+    static const f32 DEFAULT_TEXTURE_UNSEEN_TIME = 60.0f;
+    static const int DEFAULT_TEXTURE_UNSEEN_SIZE = 64;
+
+    //! Downgrades and evictions per sampled frame. Each reads texture data back from the GPU
+    static const uint MAX_DOWNGRADES_PER_SAMPLE = 4;
+
+    TextureResidencyManager::TextureResidencyManager(Foundation::Framework* framework, Renderer* renderer) :
+        framework_(framework),
+        renderer_(renderer),
+        time_(0.0),
+        texture_memory_(0)
+    {
+        int budget = framework_->GetDefaultConfig().DeclareSetting("OgreRenderer", "texture_memory_budget", DEFAULT_TEXTURE_MEMORY_BUDGET);
+        budget_ = (uint)std::min(std::max(budget, 0), 4095) * 1024 * 1024;
+        unseen_time_ = framework_->GetDefaultConfig().DeclareSetting("OgreRenderer", "texture_unseen_time", DEFAULT_TEXTURE_UNSEEN_TIME);
+        int unseen_size = framework_->GetDefaultConfig().DeclareSetting("OgreRenderer", "texture_unseen_size", DEFAULT_TEXTURE_UNSEEN_SIZE);
+        unseen_size_ = std::max(unseen_size, 1);
+    }
+
+    TextureResidencyManager::~TextureResidencyManager()
+    {
+    }
+
+    void TextureResidencyManager::Update(f64 frametime)
+    {
+        time_ += frametime;
+    }
+
+    void TextureResidencyManager::AddSample(const std::map<std::string, uint>& screen_sizes)
+    {
+        for(std::map<std::string, uint>::const_iterator i = screen_sizes.begin(); i != screen_sizes.end(); ++i)
+        {
+            TextureState& state = states_[i->first];
+            state.last_visible_ = time_;
+            state.screen_size_ = i->second;
+        }
+
+        ResourceHandlerPtr resource_handler = renderer_->GetResourceHandler();
+        if (!resource_handler)
+            return;
+        std::vector<Foundation::ResourcePtr> textures = resource_handler->GetResources(OgreTextureResource::GetTypeStatic());
+
+        // Request visible textures shown larger than they now are, and collect the unseen ones
+        std::set<std::string> loaded;
+        std::vector<std::pair<f64, OgreTextureResource*> > unseen;
+        texture_memory_ = 0;
+        for(uint i = 0; i < textures.size(); ++i)
+        {
+            OgreTextureResource* texture = checked_static_cast<OgreTextureResource*>(textures[i].get());
+            texture_memory_ += texture->GetMemorySize();
+            loaded.insert(texture->GetId());
+
+            std::map<std::string, TextureState>::iterator s = states_.find(texture->GetId());
+            if (s == states_.end())
+                continue;
+            TextureState& state = s->second;
+            if (!texture->IsDowngraded())
+                state.requested_ = false;
+
+            if (state.last_visible_ < time_)
+            {
+                unseen.push_back(std::make_pair(state.last_visible_, texture));
+                continue;
+            }
+
+            Ogre::TexturePtr ogre_texture = texture->GetTexture();
+            if ((texture->IsDowngraded()) && (!state.requested_) && (!ogre_texture.isNull()) &&
+                (state.screen_size_ > std::max(ogre_texture->getWidth(), ogre_texture->getHeight())))
+            {
+                renderer_->RequestResource(texture->GetId(), OgreTextureResource::GetTypeStatic());
+                state.requested_ = true;
+            }
+        }
+
+        // Forget textures that are no longer loaded
+        std::map<std::string, TextureState>::iterator s = states_.begin();
+        while (s != states_.end())
+        {
+            if (loaded.find(s->first) == loaded.end())
+                states_.erase(s++);
+            else
+                ++s;
+        }
+
+        // Seen longest ago first. Evict while over the budget, then downgrade the textures unseen for long enough
+        std::sort(unseen.begin(), unseen.end());
+        uint downgrades = 0;
+        for(uint i = 0; i < unseen.size() && budget_ && texture_memory_ > budget_ && downgrades < MAX_DOWNGRADES_PER_SAMPLE; ++i)
+        {
+            OgreTextureResource* texture = unseen[i].second;
+            uint size = texture->GetMemorySize();
+            if (texture->Downgrade(1))
+            {
+                texture_memory_ -= size - texture->GetMemorySize();
+                ++downgrades;
+            }
+        }
+
+        for(uint i = 0; i < unseen.size() && unseen_time_ > 0.0 && downgrades < MAX_DOWNGRADES_PER_SAMPLE; ++i)
+        {
+            if (time_ - unseen[i].first < unseen_time_)
+                break;
+
+            OgreTextureResource* texture = unseen[i].second;
+            uint size = texture->GetMemorySize();
+            if (texture->Downgrade(unseen_size_))
+            {
+                texture_memory_ -= size - texture->GetMemorySize();
+                ++downgrades;
+            }
+        }
+    }
+}
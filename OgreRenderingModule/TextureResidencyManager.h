@@ -0,0 +1,95 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_OgreRenderer_TextureResidencyManager_h
+#define incl_OgreRenderer_TextureResidencyManager_h
+
+#include "CoreTypes.h"
+
+namespace Foundation
+{
+    class Framework;
+}
+
+namespace OgreRenderer
+{
+    class Renderer;
+
+    //! Keeps the GPU memory of textures within a budget, by visibility. Used internally by Renderer.
+    /*! Fed with the on-screen texture sizes of each frame sampled by TextureVisibilityTracker. Only textures seen
+        in some sampled frame are managed; others, such as terrain and sky textures, are left as they are.
+
+        - Textures not seen for OgreRenderer/texture_unseen_time seconds are downgraded to at most
+          OgreRenderer/texture_unseen_size pixels.
+        - While the textures take more than OgreRenderer/texture_memory_budget megabytes, the textures seen
+          longest ago are evicted, which leaves a placeholder of their smallest mip level so that materials using
+          them stay valid. Textures seen in the latest sampled frame are not evicted.
+        - A downgraded or evicted texture seen at a larger size than it has is requested again, and loaded in
+          full from the texture service as usual.
+
+        Downgrades read the kept mip levels back from the GPU, so only a few are done per sampled frame.
+     */
+    class TextureResidencyManager
+    {
+    public:
+        //! Constructor
+        TextureResidencyManager(Foundation::Framework* framework, Renderer* renderer);
+
+        //! Destructor
+        ~TextureResidencyManager();
+
+        //! Advances time
+        /*! \param frametime Seconds since last frame
+         */
+        void Update(f64 frametime);
+
+        //! Updates visibility from a sampled frame, and downgrades, evicts and requests textures as needed
+        /*! \param screen_sizes Largest on-screen sizes in pixels by texture name
+         */
+        void AddSample(const std::map<std::string, uint>& screen_sizes);
+
+        //! Returns GPU memory used by the textures in bytes, as of the last sampled frame
+        uint GetTextureMemory() const { return texture_memory_; }
+
+    private:
+        //! Visibility of a texture
+        struct TextureState
+        {
+            TextureState() : last_visible_(0.0), screen_size_(0), requested_(false) {}
+
+            //! Time the texture was last seen
+            f64 last_visible_;
+
+            //! Largest on-screen size in pixels when last seen
+            uint screen_size_;
+
+            //! Whether the texture has been requested again after a downgrade
+            bool requested_;
+        };
+
+        //! Framework
+        Foundation::Framework* framework_;
+
+        //! Renderer
+        Renderer* renderer_;
+
+        //! Memory budget in bytes, 0 for unlimited
+        uint budget_;
+
+        //! Seconds a texture may be unseen before it is downgraded, 0 to never downgrade
+        f64 unseen_time_;
+
+        //! Size unseen textures are downgraded to
+        uint unseen_size_;
+
+        //! Time in seconds
+        f64 time_;
+
+        //! GPU memory used by the textures as of the last sampled frame
+        uint texture_memory_;
+
+        //! Visibility by texture name
+        std::map<std::string, TextureState> states_;
+    };
+}
+
+#endif
@@ -0,0 +1,101 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "TextureUploadQueue.h"
+
+#include "Framework.h"
+#include "ConfigurationManager.h"
+
+namespace OgreRenderer
+{
+    static const int DEFAULT_TEXTURE_UPLOAD_BUDGET = 4096;
+    static const f32 DEFAULT_TEXTURE_UPLOAD_TIME = 4.0f;
+
+    TextureUploadQueue::TextureUploadQueue(Foundation::Framework* framework) :
+        sequence_(0),
+        frame_time_(0.0),
+        frame_bytes_(0),
+        frame_uploads_(0)
+    {
+        int budget = framework->GetDefaultConfig().DeclareSetting("OgreRenderer", "texture_upload_budget", DEFAULT_TEXTURE_UPLOAD_BUDGET);
+        byte_budget_ = (uint)std::min(std::max(budget, 0), 1024 * 1024) * 1024;
+        f32 time = framework->GetDefaultConfig().DeclareSetting("OgreRenderer", "texture_upload_time", DEFAULT_TEXTURE_UPLOAD_TIME);
+        time_budget_ = std::max(time, 0.0f) / 1000.0;
+    }
+
+    TextureUploadQueue::~TextureUploadQueue()
+    {
+    }
+
+    void TextureUploadQueue::Add(Foundation::TexturePtr source, request_tag_t tag)
+    {
+        if (!source)
+            return;
+
+        std::map<std::string, Upload>::iterator i = uploads_.find(source->GetId());
+        if (i != uploads_.end())
+        {
+            // Lower level is better. A worse level arriving late is not worth uploading
+            if (source->GetLevel() > i->second.source_->GetLevel())
+                return;
+            i->second.source_ = source;
+            i->second.tag_ = tag;
+            return;
+        }
+
+        Upload& upload = uploads_[source->GetId()];
+        upload.source_ = source;
+        upload.tag_ = tag;
+        upload.sequence_ = sequence_++;
+    }
+
+    void TextureUploadQueue::Remove(const std::string& id)
+    {
+        uploads_.erase(id);
+    }
+
+    void TextureUploadQueue::BeginFrame()
+    {
+        frame_time_ = 0.0;
+        frame_bytes_ = 0;
+        frame_uploads_ = 0;
+    }
+
+    bool TextureUploadQueue::Next(const std::map<std::string, uint>& screen_sizes, Foundation::TexturePtr& source, request_tag_t& tag)
+    {
+        if (uploads_.empty())
+            return false;
+        if ((frame_uploads_) && (frame_time_ >= time_budget_))
+            return false;
+
+        // Largest on screen first, then oldest
+        std::map<std::string, Upload>::iterator best = uploads_.end();
+        uint best_size = 0;
+        for(std::map<std::string, Upload>::iterator i = uploads_.begin(); i != uploads_.end(); ++i)
+        {
+            std::map<std::string, uint>::const_iterator s = screen_sizes.find(i->first);
+            uint size = s != screen_sizes.end() ? s->second : 0;
+            if ((best == uploads_.end()) || (size > best_size) ||
+                ((size == best_size) && (i->second.sequence_ < best->second.sequence_)))
+            {
+                best = i;
+                best_size = size;
+            }
+        }
+
+        if ((frame_uploads_) && (frame_bytes_ + best->second.source_->GetDataSize() > byte_budget_))
+            return false;
+
+        source = best->second.source_;
+        tag = best->second.tag_;
+        uploads_.erase(best);
+        return true;
+    }
+
+    void TextureUploadQueue::AddUploaded(uint bytes, f64 time)
+    {
+        frame_bytes_ += bytes;
+        frame_time_ += time;
+        ++frame_uploads_;
+    }
+}
@@ -0,0 +1,108 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_OgreRenderer_TextureUploadQueue_h
+#define incl_OgreRenderer_TextureUploadQueue_h
+
+#include "TextureInterface.h"
+
+namespace Foundation
+{
+    class Framework;
+}
+
+namespace OgreRenderer
+{
+    //! Decoded textures waiting to be uploaded to the GPU, spread over frames. Used internally by ResourceHandler.
+    /*! Each texture has at most one queued upload: a decoded level replaces a queued level of the same texture that it
+        is at least as good as, since only the latest would be seen. Textures shown largest on screen are uploaded first,
+        then in the order they arrived.
+
+        Each frame, uploads are done until OgreRenderer/texture_upload_budget kilobytes or
+        OgreRenderer/texture_upload_time milliseconds have been used. At least one upload is done per frame, so that
+        a texture larger than the budget is not held back.
+     */
+    class TextureUploadQueue
+    {
+    public:
+        //! Constructor
+        explicit TextureUploadQueue(Foundation::Framework* framework);
+
+        //! Destructor
+        ~TextureUploadQueue();
+
+        //! Queues a decoded texture, or merges it with a queued level of the same texture
+        /*! \param source Decoded texture
+            \param tag Request tag from the raw texture resource event
+         */
+        void Add(Foundation::TexturePtr source, request_tag_t tag);
+
+        //! Drops a queued texture
+        void Remove(const std::string& id);
+
+        //! Starts the uploads of a frame
+        void BeginFrame();
+
+        //! Takes the next texture to upload, if the budget of the frame allows
+        /*! \param screen_sizes Largest on-screen sizes in pixels by texture name, for priority
+            \param source Returns the decoded texture
+            \param tag Returns the request tag
+            \return true if a texture was taken
+         */
+        bool Next(const std::map<std::string, uint>& screen_sizes, Foundation::TexturePtr& source, request_tag_t& tag);
+
+        //! Accounts a finished upload to the budget of the frame
+        /*! \param bytes Bytes uploaded
+            \param time Seconds taken
+         */
+        void AddUploaded(uint bytes, f64 time);
+
+        //! Returns number of queued textures
+        uint GetNumQueued() const { return uploads_.size(); }
+
+        //! Returns seconds spent uploading in the last frame
+        f64 GetFrameTime() const { return frame_time_; }
+
+        //! Returns bytes uploaded in the last frame
+        uint GetFrameBytes() const { return frame_bytes_; }
+
+        //! Returns number of textures uploaded in the last frame
+        uint GetFrameUploads() const { return frame_uploads_; }
+
+    private:
+        //! A queued upload
+        struct Upload
+        {
+            //! Decoded texture
+            Foundation::TexturePtr source_;
+
+            //! Request tag
+            request_tag_t tag_;
+
+            //! Arrival order
+            uint sequence_;
+        };
+
+        //! Bytes per frame
+        uint byte_budget_;
+
+        //! Seconds per frame
+        f64 time_budget_;
+
+        //! Queued uploads by texture name
+        std::map<std::string, Upload> uploads_;
+
+        //! Next arrival order
+        uint sequence_;
+
+        //! Seconds spent uploading in the frame
+        f64 frame_time_;
+
+        //! Bytes uploaded in the frame
+        uint frame_bytes_;
+
+        //! Textures uploaded in the frame
+        uint frame_uploads_;
+    };
+}
+
+#endif
@@ -0,0 +1,101 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "TextureVisibilityTracker.h"
+
+#include "Framework.h"
+#include "ServiceManager.h"
+#include "ConfigurationManager.h"
+#include "TextureServiceInterface.h"
+
+#include <Ogre.h>
+
+namespace OgreRenderer
+{
+    static const f32 DEFAULT_TEXTURE_PRIORITY_INTERVAL = 0.5f;
+
+    TextureVisibilityTracker::TextureVisibilityTracker(Foundation::Framework* framework) :
+        framework_(framework),
+        time_left_(0.0),
+        sampling_(false),
+        camera_(0),
+        viewport_height_(0),
+        size_scale_(0.0f)
+    {
+        interval_ = framework_->GetDefaultConfig().DeclareSetting("OgreRenderer", "texture_priority_interval",
+            DEFAULT_TEXTURE_PRIORITY_INTERVAL);
+    }
+
+    TextureVisibilityTracker::~TextureVisibilityTracker()
+    {
+    }
+
+    void TextureVisibilityTracker::Update(f64 frametime)
+    {
+        time_left_ -= frametime;
+    }
+
+    void TextureVisibilityTracker::BeginFrame(Ogre::Camera* camera, uint viewport_height)
+    {
+        sampling_ = false;
+        if (interval_ <= 0.0 || time_left_ > 0.0 || !camera || !viewport_height)
+            return;
+
+        time_left_ = interval_;
+        sampling_ = true;
+        camera_ = camera;
+        viewport_height_ = viewport_height;
+        size_scale_ = viewport_height / Ogre::Math::Tan(camera->getFOVy() * 0.5f);
+        screen_sizes_.clear();
+    }
+
+    void TextureVisibilityTracker::AddRenderable(Ogre::Renderable* renderable)
+    {
+        // Entities are drawn as Ogre entities; their parts are subentities sharing the bounds of the whole
+        Ogre::SubEntity* subentity = dynamic_cast<Ogre::SubEntity*>(renderable);
+        if (!subentity)
+            return;
+
+        const Ogre::MaterialPtr& material = subentity->getMaterial();
+        if (material.isNull())
+            return;
+        Ogre::Technique* technique = material->getBestTechnique();
+        if (!technique)
+            return;
+
+        const Ogre::Sphere& bounds = subentity->getParent()->getWorldBoundingSphere();
+        Ogre::Real radius = bounds.getRadius();
+        Ogre::Real distance = std::max((bounds.getCenter() - camera_->getDerivedPosition()).length(), radius);
+        uint screen_size = viewport_height_;
+        if (distance > 0.0f)
+            screen_size = (uint)std::min(radius * size_scale_ / distance, (Ogre::Real)viewport_height_);
+        screen_size = std::max(screen_size, 1u);
+
+        Ogre::Technique::PassIterator passes = technique->getPassIterator();
+        while (passes.hasMoreElements())
+        {
+            Ogre::Pass::TextureUnitStateIterator units = passes.getNext()->getTextureUnitStateIterator();
+            while (units.hasMoreElements())
+            {
+                const std::string& name = units.getNext()->getTextureName();
+                if (name.empty())
+                    continue;
+
+                uint& size = screen_sizes_[name];
+                size = std::max(size, screen_size);
+            }
+        }
+    }
+
+    void TextureVisibilityTracker::EndFrame()
+    {
+        if (!sampling_)
+            return;
+        sampling_ = false;
+
+        boost::shared_ptr<Foundation::TextureServiceInterface> texture_service = framework_->GetServiceManager()->
+            GetService<Foundation::TextureServiceInterface>(Foundation::Service::ST_Texture).lock();
+        if (texture_service)
+            texture_service->SetTextureScreenSizes(screen_sizes_);
+    }
+}
@@ -0,0 +1,87 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_OgreRenderer_TextureVisibilityTracker_h
+#define incl_OgreRenderer_TextureVisibilityTracker_h
+
+#include "CoreTypes.h"
+
+namespace Ogre
+{
+    class Camera;
+    class Renderable;
+}
+
+namespace Foundation
+{
+    class Framework;
+}
+
+namespace OgreRenderer
+{
+    //! Measures how large the textures of the visible entities are on screen. Used internally by Renderer.
+    /*! Every OgreRenderer/texture_priority_interval seconds a rendered frame is sampled: each renderable of an entity
+        that is queued for rendering is sized on screen from its bounding sphere and distance to the camera, and each
+        texture of its material gets the largest size of the renderables using it. The sizes are then passed to the
+        texture service, which downloads and decodes the textures in order of size, and only up to the resolution
+        they are shown at.
+     */
+    class TextureVisibilityTracker
+    {
+    public:
+        //! Constructor
+        explicit TextureVisibilityTracker(Foundation::Framework* framework);
+
+        //! Destructor
+        ~TextureVisibilityTracker();
+
+        //! Advances time to the next sampled frame
+        /*! \param frametime Seconds since last frame
+         */
+        void Update(f64 frametime);
+
+        //! Starts sampling a frame, if it is time to
+        /*! \param camera Camera the frame is rendered with
+            \param viewport_height Viewport height in pixels
+         */
+        void BeginFrame(Ogre::Camera* camera, uint viewport_height);
+
+        //! Returns whether the frame being rendered is sampled
+        bool IsSampling() const { return sampling_; }
+
+        //! Sizes an entity renderable queued for rendering the sampled frame
+        void AddRenderable(Ogre::Renderable* renderable);
+
+        //! Ends the sampled frame, and passes the sizes to the texture service
+        void EndFrame();
+
+        //! Returns largest on-screen sizes in pixels by texture name in the last sampled frame
+        const std::map<std::string, uint>& GetScreenSizes() const { return screen_sizes_; }
+
+    private:
+        //! Framework
+        Foundation::Framework* framework_;
+
+        //! Seconds between sampled frames, 0 to disable
+        f64 interval_;
+
+        //! Seconds until the next sampled frame
+        f64 time_left_;
+
+        //! Whether the frame being rendered is sampled
+        bool sampling_;
+
+        //! Camera of the sampled frame
+        Ogre::Camera* camera_;
+
+        //! Viewport height in pixels
+        uint viewport_height_;
+
+        //! On-screen size in pixels of a unit sized object at unit distance
+        f32 size_scale_;
+
+        //! Largest on-screen sizes by texture name
+        std::map<std::string, uint> screen_sizes_;
+    };
+}
+
+#endif
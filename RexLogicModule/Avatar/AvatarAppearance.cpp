@@ -1826,7 +1826,7 @@ namespace RexLogic
                 return false;
             }
             // The assettype doesn't matter here
-            Foundation::AssetPtr raw_asset = asset_service->GetAsset(asset.resource_id_, std::string());
+            Foundation::AssetPtr raw_asset = asset_service->GetAssetFromDisk(asset.resource_id_, std::string());
             if (!raw_asset)
             {
                 RexLogicModule::LogError("Could not get raw asset data for resource " + asset.resource_id_);
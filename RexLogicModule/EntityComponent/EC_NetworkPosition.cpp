@@ -4,6 +4,8 @@
 #include "ModuleInterface.h"
 #include "EntityComponent/EC_NetworkPosition.h"
 
+DEFINE_POOL_ALLOCATED(RexLogic::EC_NetworkPosition)
+
 namespace RexLogic
 {
     EC_NetworkPosition::EC_NetworkPosition(Foundation::ModuleInterface* module) :
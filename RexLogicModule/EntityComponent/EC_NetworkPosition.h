@@ -7,6 +7,7 @@
 #include "RexUUID.h"
 #include "RexLogicModuleApi.h"
 #include "Declare_EC.h"
+#include "PoolAllocator.h"
 #include "Vector3D.h"
 #include "Quaternion.h"
 #include "CoreTypes.h"
@@ -24,6 +25,7 @@ namespace RexLogic
         Q_OBJECT
             
         DECLARE_EC(EC_NetworkPosition);
+        DECLARE_POOL_ALLOCATED(EC_NetworkPosition)
 
         Q_PROPERTY(QVector3D Position READ GetQPosition WRITE SetQPosition)
         Q_PROPERTY(QQuaternion Orientation READ GetQOrientation WRITE SetQOrientation)
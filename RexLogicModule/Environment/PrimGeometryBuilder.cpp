@@ -0,0 +1,130 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "Environment/PrimGeometryBuilder.h"
+#include "Profiler.h"
+#include "HighPerfClock.h"
+
+#include <boost/bind.hpp>
+
+namespace RexLogic
+{
+    PrimGeometryBuilder::PrimGeometryBuilder(uint num_threads, uint max_results) :
+        active_(0),
+        max_results_(std::max(max_results, 1u)),
+        next_sequence_(0),
+        keep_running_(true)
+    {
+        for(uint i = 0; i < std::max(num_threads, 1u); ++i)
+            threads_.create_thread(boost::bind(&PrimGeometryBuilder::Work, this));
+    }
+
+    PrimGeometryBuilder::~PrimGeometryBuilder()
+    {
+        {
+            MutexLock lock(mutex_);
+            keep_running_ = false;
+            queue_.clear();
+            queued_.clear();
+        }
+        condition_.notify_all();
+        threads_.join_all();
+    }
+
+    void PrimGeometryBuilder::AddRequest(PrimGeometryRequestPtr request, f32 priority)
+    {
+        if (!request)
+            return;
+
+        {
+            MutexLock lock(mutex_);
+            std::map<entity_id_t, QueueKey>::iterator i = queued_.find(request->entity_id_);
+            if (i != queued_.end())
+                queue_.erase(i->second);
+
+            QueueKey key;
+            key.priority_ = priority;
+            key.sequence_ = next_sequence_++;
+            queue_[key] = request;
+            queued_[request->entity_id_] = key;
+        }
+
+        condition_.notify_one();
+    }
+
+    std::vector<PrimGeometryResultPtr> PrimGeometryBuilder::GetResults(uint max_results)
+    {
+        std::vector<PrimGeometryResultPtr> results;
+        {
+            MutexLock lock(mutex_);
+            if (results_.size() <= max_results)
+                results.swap(results_);
+            else
+            {
+                results.assign(results_.begin(), results_.begin() + max_results);
+                results_.erase(results_.begin(), results_.begin() + max_results);
+            }
+        }
+
+        // Workers waiting for the results to be collected may continue
+        if (!results.empty())
+            condition_.notify_all();
+        return results;
+    }
+
+    void PrimGeometryBuilder::Clear()
+    {
+        {
+            MutexLock lock(mutex_);
+            queue_.clear();
+            queued_.clear();
+            results_.clear();
+        }
+        condition_.notify_all();
+    }
+
+    uint PrimGeometryBuilder::GetPendingCount() const
+    {
+        MutexLock lock(mutex_);
+        return queue_.size() + active_;
+    }
+
+    void PrimGeometryBuilder::Work()
+    {
+        for(;;)
+        {
+            PrimGeometryRequestPtr request;
+            {
+                ScopedLock lock(mutex_);
+                while((queue_.empty() || results_.size() >= max_results_) && keep_running_)
+                    condition_.wait(lock);
+                if (!keep_running_)
+                    return;
+
+                request = queue_.begin()->second;
+                queued_.erase(request->entity_id_);
+                queue_.erase(queue_.begin());
+                ++active_;
+            }
+
+            PrimGeometryResultPtr result(new PrimGeometryResult());
+            result->entity_id_ = request->entity_id_;
+            result->sequence_ = request->sequence_;
+            result->key_ = request->key_;
+            {
+                PROFILE(PrimGeometryBuilder_Build);
+                Core::tick_t start = Core::GetCurrentClockTime();
+                result->success_ = BuildPrimGeometry(request->input_, result->data_);
+                result->build_time_ = (f64)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+            }
+
+            {
+                MutexLock lock(mutex_);
+                results_.push_back(result);
+                --active_;
+            }
+
+            RESETPROFILER
+        }
+    }
+}
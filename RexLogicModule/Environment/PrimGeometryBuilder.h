@@ -0,0 +1,148 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_RexLogicModule_PrimGeometryBuilder_h
+#define incl_RexLogicModule_PrimGeometryBuilder_h
+
+#include "Environment/PrimGeometryUtils.h"
+#include "CoreThread.h"
+
+namespace RexLogic
+{
+    //! Prim geometry build request
+    struct PrimGeometryRequest
+    {
+        //! Prim entity
+        entity_id_t entity_id_;
+
+        //! Request number of the entity, to recognize results of superseded requests
+        uint sequence_;
+
+        //! Geometry key, for sharing the mesh
+        std::string key_;
+
+        //! Parameters copied from the prim
+        PrimGeometryInput input_;
+    };
+
+    //! Prim geometry build result
+    struct PrimGeometryResult
+    {
+        PrimGeometryResult() : success_(false), build_time_(0.0) {}
+
+        //! Prim entity
+        entity_id_t entity_id_;
+
+        //! Request number of the entity
+        uint sequence_;
+
+        //! Geometry key
+        std::string key_;
+
+        //! Whether the geometry was built. False if it has illegal coordinates
+        bool success_;
+
+        //! Built geometry
+        PrimGeometryData data_;
+
+        //! Seconds the build took
+        f64 build_time_;
+    };
+
+    typedef boost::shared_ptr<PrimGeometryRequest> PrimGeometryRequestPtr;
+    typedef boost::shared_ptr<PrimGeometryResult> PrimGeometryResultPtr;
+
+    //! Builds prim geometry on a pool of worker threads, used internally by Primitive
+    /*! Only the CPU work, prim mesh extrusion and filling the vertex arrays, is done by the workers. Copying the
+        arrays into Ogre buffers is left to the main thread.
+
+        Queued requests are built highest priority first, and in request order within a priority. There is at most
+        one queued request per entity: a new request of an entity that is still queued replaces the old one.
+
+        Results are collected on the main thread with GetResults(). Workers do not start new builds while the
+        given maximum number of results is waiting to be collected.
+     */
+    class PrimGeometryBuilder
+    {
+    public:
+        //! Constructor. Starts the worker threads.
+        /*! \param num_threads Number of worker threads
+            \param max_results Number of uncollected results after which workers wait
+         */
+        PrimGeometryBuilder(uint num_threads, uint max_results);
+
+        //! Destructor. Discards queued requests and waits for the workers to finish.
+        ~PrimGeometryBuilder();
+
+        //! Queues a build request, replacing a queued request of the same entity
+        /*! \param request Build request
+            \param priority Priority, higher is built first
+         */
+        void AddRequest(PrimGeometryRequestPtr request, f32 priority);
+
+        //! Returns build results completed so far, in completion order
+        /*! \param max_results Maximum number of results to take, the rest are left for the next call
+         */
+        std::vector<PrimGeometryResultPtr> GetResults(uint max_results);
+
+        //! Discards queued requests and uncollected results. Builds in progress still produce results.
+        void Clear();
+
+        //! Returns number of queued and ongoing builds
+        uint GetPendingCount() const;
+
+    private:
+        PrimGeometryBuilder(const PrimGeometryBuilder &);
+        PrimGeometryBuilder &operator =(const PrimGeometryBuilder &);
+
+        //! Order in the queue: priority, highest first, then request order
+        struct QueueKey
+        {
+            f32 priority_;
+            uint sequence_;
+
+            bool operator <(const QueueKey& rhs) const
+            {
+                if (priority_ != rhs.priority_)
+                    return priority_ > rhs.priority_;
+                return sequence_ < rhs.sequence_;
+            }
+        };
+
+        typedef std::map<QueueKey, PrimGeometryRequestPtr> RequestQueue;
+
+        //! Worker thread function
+        void Work();
+
+        //! Worker threads
+        boost::thread_group threads_;
+
+        //! Queued requests in order
+        RequestQueue queue_;
+
+        //! Queue position of each queued entity
+        std::map<entity_id_t, QueueKey> queued_;
+
+        //! Completed results
+        std::vector<PrimGeometryResultPtr> results_;
+
+        //! Number of builds in progress
+        uint active_;
+
+        //! Number of uncollected results after which workers wait
+        uint max_results_;
+
+        //! Sequence number of the next request
+        uint next_sequence_;
+
+        //! Whether the workers should keep running
+        bool keep_running_;
+
+        //! Guards the queue, results and counters
+        mutable Mutex mutex_;
+
+        //! Signaled when requests are queued, results are collected, or the workers should stop
+        Condition condition_;
+    };
+}
+
+#endif
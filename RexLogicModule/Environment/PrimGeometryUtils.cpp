@@ -42,6 +42,7 @@
 #include "ServiceManager.h"
 #include "CoreException.h"
 #include "EC_OpenSimPrim.h"
+#include "EC_OgreCustomObject.h"
 
 #ifndef unix
 #include <float.h>
@@ -50,6 +51,7 @@
 #endif
 
 #include <Ogre.h>
+#include <sstream>
 
 namespace RexLogic
 {
@@ -57,7 +59,8 @@ namespace RexLogic
     
     void TransformUV(Ogre::Vector2& uv, float repeat_u, float repeat_v, float offset_u, float offset_v, float rot_sin, float rot_cos)
     {
-        const static Ogre::Vector2 half(0.5f, 0.5f);
+        // Not a static, as geometry is built on several threads
+        const Ogre::Vector2 half(0.5f, 0.5f);
         
         Ogre::Vector2 centered = uv - half;
 
@@ -82,14 +85,215 @@ namespace RexLogic
         
         return true;
     }
+    
+    int ClampFaceNumber(int facenum)
+    {
+        return std::min(std::max(facenum, 0), MAX_PRIM_FACES - 1);
+    }
+    
+    //! Sets up a prim mesher from prim parameters, ready for extrusion
+    void SetupPrimMesh(const PrimGeometryInput& input, PrimMesher::PrimMesh& primMesh)
+    {
+        float profileBegin = input.profile_begin_;
+        float profileEnd = 1.0f - input.profile_end_;
+        float profileHollow = input.profile_hollow_;
+
+        int sides = 4;
+        if ((input.profile_curve_ & 0x07) == RexTypes::SHAPE_EQUILATERAL_TRIANGLE)
+            sides = 3;
+        else if ((input.profile_curve_ & 0x07) == RexTypes::SHAPE_CIRCLE)
+            // Reduced prim lod!!!
+            sides = 12;
+            //sides = 24;
+        else if ((input.profile_curve_ & 0x07) == RexTypes::SHAPE_HALF_CIRCLE)
+        {
+            // half circle, prim is a sphere
+            // Reduced prim lod!!!
+            sides = 12;
+            //sides = 24;
+
+            profileBegin = 0.5f * profileBegin + 0.5f;
+            profileEnd = 0.5f * profileEnd + 0.5f;
+        }
+
+        int hollowSides = sides;
+        if ((input.profile_curve_ & 0xf0) == RexTypes::HOLLOW_CIRCLE)
+            // Reduced prim lod!!!
+            hollowSides = 12;
+            //hollowSides = 24;
+        else if ((input.profile_curve_ & 0xf0) == RexTypes::HOLLOW_SQUARE)
+            hollowSides = 4;
+        else if ((input.profile_curve_ & 0xf0) == RexTypes::HOLLOW_TRIANGLE)
+            hollowSides = 3;
+        
+        primMesh = PrimMesher::PrimMesh(sides, profileBegin, profileEnd, profileHollow, hollowSides);
+        primMesh.topShearX = input.path_shear_x_;
+        primMesh.topShearY = input.path_shear_y_;
+        primMesh.pathCutBegin = input.path_begin_;
+        primMesh.pathCutEnd = 1.0f - input.path_end_;
+
+        if (input.path_curve_ == RexTypes::EXTRUSION_STRAIGHT)
+        {
+            primMesh.twistBegin = input.path_twist_begin_ * 180;
+            primMesh.twistEnd = input.path_twist_ * 180;
+            primMesh.taperX = input.path_scale_x_ - 1.0f;
+            primMesh.taperY = input.path_scale_y_ - 1.0f;
+        }
+        else
+        {
+            primMesh.holeSizeX = (2.0f - input.path_scale_x_);
+            primMesh.holeSizeY = (2.0f - input.path_scale_y_);
+            primMesh.radius = input.path_radius_offset_;
+            primMesh.revolutions = input.path_revolutions_;
+            primMesh.skew = input.path_skew_;
+            primMesh.twistBegin = input.path_twist_begin_ * 360;
+            primMesh.twistEnd = input.path_twist_ * 360;
+            primMesh.taperX = input.path_taper_x_;
+            primMesh.taperY = input.path_taper_y_;
+        }
+    }
+    
+    //! Finds the face numbers the prim shape produces, without extruding it
+    /*! Uses the same profile as the extrusion, whose face numbering depends only on the sides, profile cut and
+        whether there is a hollow, and adds the end faces unless the extrusion leaves them out.
+     */
+    void GetUsedFaces(const PrimGeometryInput& input, bool used[MAX_PRIM_FACES])
+    {
+        for (int facenum = 0; facenum < MAX_PRIM_FACES; ++facenum)
+            used[facenum] = false;
+        
+        try
+        {
+            PrimMesher::PrimMesh primMesh;
+            SetupPrimMesh(input, primMesh);
+            PrimMesher::Profile profile(primMesh.sides, primMesh.profileStart, primMesh.profileEnd, primMesh.hollow,
+                primMesh.hollowSides, false);
+            for (uint i = 0; i < profile.faceNumbers.size(); ++i)
+                used[ClampFaceNumber(profile.faceNumbers[i])] = true;
+            
+            // A circular path that closes on itself has no end faces, see PrimMesh::ExtrudeCircular()
+            bool end_faces = true;
+            if (input.path_curve_ != RexTypes::EXTRUSION_STRAIGHT)
+                end_faces = primMesh.pathCutBegin != 0.0f || primMesh.pathCutEnd != 1.0f || primMesh.taperX != 0.0f ||
+                    primMesh.taperY != 0.0f || primMesh.skew != 0.0f || primMesh.twistBegin != primMesh.twistEnd ||
+                    primMesh.radius != 0.0f;
+            if (end_faces)
+            {
+                used[0] = true;
+                used[ClampFaceNumber(profile.bottomFaceNumber)] = true;
+            }
+        }
+        catch (...)
+        {
+            for (int facenum = 0; facenum < MAX_PRIM_FACES; ++facenum)
+                used[facenum] = true;
+        }
+    }
+    
+    std::string GetMaterialOverride(Foundation::Framework* framework, EC_OpenSimPrim& primitive)
+    {
+        std::string mat_override;
+        if ((primitive.Materials[0].Type == RexTypes::RexAT_MaterialScript) && (!RexTypes::IsNull(primitive.Materials[0].asset_id)))
+        {
+            mat_override = primitive.Materials[0].asset_id;
 
+            // If cannot find the override material, use default
+            // We will probably get resource ready event later for the material & redo this prim
+            boost::shared_ptr<OgreRenderer::Renderer> renderer = framework->GetServiceManager()->
+                GetService<OgreRenderer::Renderer>(Foundation::Service::ST_Renderer).lock();
+            if (!renderer->GetResource(mat_override, OgreRenderer::OgreMaterialResource::GetTypeStatic()))
+            {
+                mat_override = "LitTextured";
+            }
+        }
+        return mat_override;
+    }
+    
+    //! Gets parameters of a prim face
+    void GetFaceParams(EC_OpenSimPrim& primitive, int facenum, const std::string& mat_override, PrimFaceParams& params)
+    {
+        params.color_ = primitive.PrimDefaultColor;
+        ColorMap::const_iterator c = primitive.PrimColors.find(facenum);
+        if (c != primitive.PrimColors.end())
+            params.color_ = c->second;
+        
+        // Skip face if very transparent
+        params.drawn_ = params.color_.a > 0.11f;
+        if (!params.drawn_)
+            return;
+        
+        if (!mat_override.empty())
+            params.mat_name_ = mat_override;
+        else
+        {
+            unsigned variation = OgreRenderer::LEGACYMAT_VERTEXCOL;
+            
+            // Check for transparency
+            if (params.color_.a < 1.0f)
+                variation = OgreRenderer::LEGACYMAT_VERTEXCOLALPHA;
+            
+            // Check for fullbright
+            bool fullbright = (primitive.PrimDefaultMaterialType & RexTypes::MATERIALTYPE_FULLBRIGHT) != 0;
+            MaterialTypeMap::const_iterator mt = primitive.PrimMaterialTypes.find(facenum);
+            if (mt != primitive.PrimMaterialTypes.end())
+                fullbright = (mt->second & RexTypes::MATERIALTYPE_FULLBRIGHT) != 0;
+            if (fullbright)
+                variation |= OgreRenderer::LEGACYMAT_FULLBRIGHT;
+            
+            std::string suffix = OgreRenderer::GetMaterialSuffix(variation);
+            
+            // Try to find face's texture in texturemap, use default if not found
+            std::string texture_name = primitive.PrimDefaultTextureID;
+            TextureMap::const_iterator t = primitive.PrimTextures.find(facenum);
+            if (t != primitive.PrimTextures.end())
+                texture_name = t->second;
+            
+            params.mat_name_ = texture_name + suffix;
+            
+            // Create the material here if texture yet missing, the material will be updated later
+            OgreRenderer::GetOrCreateLegacyMaterial(texture_name, variation);
+        }
+        
+        // Get texture mapping parameters
+        params.repeat_u_ = primitive.PrimDefaultRepeatU;
+        params.repeat_v_ = primitive.PrimDefaultRepeatV;
+        params.offset_u_ = primitive.PrimDefaultOffsetU;
+        params.offset_v_ = primitive.PrimDefaultOffsetV;
+        params.rot_ = primitive.PrimDefaultUVRotation;
+        if (primitive.PrimRepeatU.find(facenum) != primitive.PrimRepeatU.end())
+            params.repeat_u_ = primitive.PrimRepeatU[facenum];
+        if (primitive.PrimRepeatV.find(facenum) != primitive.PrimRepeatV.end())
+            params.repeat_v_ = primitive.PrimRepeatV[facenum];
+        if (primitive.PrimOffsetU.find(facenum) != primitive.PrimOffsetU.end())
+            params.offset_u_ = primitive.PrimOffsetU[facenum];
+        if (primitive.PrimOffsetV.find(facenum) != primitive.PrimOffsetV.end())
+            params.offset_v_ = primitive.PrimOffsetV[facenum];
+        if (primitive.PrimUVRotation.find(facenum) != primitive.PrimUVRotation.end())
+            params.rot_ = primitive.PrimUVRotation[facenum];
+    }
+    
     Ogre::ManualObject* CreatePrimGeometry(Foundation::Framework* framework, EC_OpenSimPrim& primitive, bool optimisations_enabled)
     {
         PROFILE(Primitive_CreateGeometry)
         
-        if (!primitive.HasPrimShapeData)
+        PrimGeometryInput input;
+        if (!GetPrimGeometryInput(framework, primitive, optimisations_enabled, input))
             return 0;
         
+        PrimGeometryData data;
+        if (!BuildPrimGeometry(input, data))
+        {
+            RexLogicModule::LogError("NaN or infinite number encountered in prim face coordinates, or exception while creating primitive geometry. Skipping geometry creation.");
+            return 0;
+        }
+        
+        return CreatePrimGeometry(framework, data);
+    }
+    
+    Ogre::ManualObject* CreatePrimGeometry(Foundation::Framework* framework, const PrimGeometryData& data)
+    {
+        PROFILE(Primitive_CreateManualObject)
+        
         // Create only a single manual object for prim geometry and reuse it over and over, to avoid Ogre generating
         // a huge load of unnecessary D3D resources, that are never used for anything visible (the manual object will
         // be converted to a mesh anyway)
@@ -104,236 +308,220 @@ namespace RexLogic
                 return 0;
         }
         
-        std::string mat_override;
-        if ((primitive.Materials[0].Type == RexTypes::RexAT_MaterialScript) && (!RexTypes::IsNull(primitive.Materials[0].asset_id)))
+        prim_manual_object->clear();
+        prim_manual_object->setBoundingBox(Ogre::AxisAlignedBox());
+        
+        for (uint i = 0; i < data.sections_.size(); ++i)
         {
-            mat_override = primitive.Materials[0].asset_id;
-
-            // If cannot find the override material, use default
-            // We will probably get resource ready event later for the material & redo this prim
-            boost::shared_ptr<OgreRenderer::Renderer> renderer = framework->GetServiceManager()->
-                GetService<OgreRenderer::Renderer>(Foundation::Service::ST_Renderer).lock();
-            if (!renderer->GetResource(mat_override, OgreRenderer::OgreMaterialResource::GetTypeStatic()))
+            const PrimGeometrySection& section = data.sections_[i];
+            uint num_vertices = section.vertices_.size();
+            prim_manual_object->estimateVertexCount(num_vertices);
+            prim_manual_object->estimateIndexCount(num_vertices);
+            prim_manual_object->begin(section.mat_name_, Ogre::RenderOperation::OT_TRIANGLE_LIST);
+            for (uint j = 0; j < num_vertices; ++j)
             {
-                mat_override = "LitTextured";
+                const PrimVertex& vertex = section.vertices_[j];
+                prim_manual_object->position(vertex.position_.x, vertex.position_.y, vertex.position_.z);
+                prim_manual_object->normal(vertex.normal_.x, vertex.normal_.y, vertex.normal_.z);
+                prim_manual_object->textureCoord(vertex.u_, vertex.v_);
+                prim_manual_object->colour(vertex.color_.r, vertex.color_.g, vertex.color_.b, vertex.color_.a);
+                prim_manual_object->index(j);
             }
+            prim_manual_object->end();
         }
-            
+        
+        return prim_manual_object;
+    }
+    
+    bool GetPrimGeometryInput(Foundation::Framework* framework, EC_OpenSimPrim& primitive, bool optimisations_enabled, PrimGeometryInput& input)
+    {
+        if (!primitive.HasPrimShapeData)
+            return false;
+        
+        input.batch_materials_ = optimisations_enabled || primitive.DrawType == RexTypes::DRAWTYPE_MESH;
+        input.profile_curve_ = primitive.ProfileCurve.Get();
+        input.profile_begin_ = primitive.ProfileBegin.Get();
+        input.profile_end_ = primitive.ProfileEnd.Get();
+        input.profile_hollow_ = primitive.ProfileHollow.Get();
+        input.path_curve_ = primitive.PathCurve.Get();
+        input.path_begin_ = primitive.PathBegin.Get();
+        input.path_end_ = primitive.PathEnd.Get();
+        input.path_shear_x_ = primitive.PathShearX.Get();
+        input.path_shear_y_ = primitive.PathShearY.Get();
+        input.path_twist_ = primitive.PathTwist.Get();
+        input.path_twist_begin_ = primitive.PathTwistBegin.Get();
+        input.path_scale_x_ = primitive.PathScaleX.Get();
+        input.path_scale_y_ = primitive.PathScaleY.Get();
+        input.path_radius_offset_ = primitive.PathRadiusOffset.Get();
+        input.path_revolutions_ = primitive.PathRevolutions.Get();
+        input.path_skew_ = primitive.PathSkew.Get();
+        input.path_taper_x_ = primitive.PathTaperX.Get();
+        input.path_taper_y_ = primitive.PathTaperY.Get();
+        
+        // Only faces the shape produces, so that materials are not created for the rest and they do not end up in
+        // the geometry key
+        bool used[MAX_PRIM_FACES];
+        GetUsedFaces(input, used);
+        std::string mat_override = GetMaterialOverride(framework, primitive);
+        for (int facenum = 0; facenum < MAX_PRIM_FACES; ++facenum)
+        {
+            if (used[facenum])
+                GetFaceParams(primitive, facenum, mat_override, input.faces_[facenum]);
+            else
+                input.faces_[facenum] = PrimFaceParams();
+        }
+        
+        return true;
+    }
+    
+    bool BuildPrimGeometry(const PrimGeometryInput& input, PrimGeometryData& data)
+    {
+        data.sections_.clear();
+        
         try
         {
-            float profileBegin = primitive.ProfileBegin.Get();
-            float profileEnd = 1.0f - primitive.ProfileEnd.Get();
-            float profileHollow = primitive.ProfileHollow.Get();
-
-            int sides = 4;
-            if ((primitive.ProfileCurve.Get() & 0x07) == RexTypes::SHAPE_EQUILATERAL_TRIANGLE)
-                sides = 3;
-            else if ((primitive.ProfileCurve.Get() & 0x07) == RexTypes::SHAPE_CIRCLE)
-                // Reduced prim lod!!!
-                sides = 12;
-                //sides = 24;
-            else if ((primitive.ProfileCurve.Get() & 0x07) == RexTypes::SHAPE_HALF_CIRCLE)
-            {
-                // half circle, prim is a sphere
-                // Reduced prim lod!!!
-                sides = 12;
-                //sides = 24;
-
-                profileBegin = 0.5f * profileBegin + 0.5f;
-                profileEnd = 0.5f * profileEnd + 0.5f;
-            }
-
-            int hollowSides = sides;
-            if ((primitive.ProfileCurve.Get() & 0xf0) == RexTypes::HOLLOW_CIRCLE)
-                // Reduced prim lod!!!
-                hollowSides = 12;
-                //hollowSides = 24;
-            else if ((primitive.ProfileCurve.Get() & 0xf0) == RexTypes::HOLLOW_SQUARE)
-                hollowSides = 4;
-            else if ((primitive.ProfileCurve.Get() & 0xf0) == RexTypes::HOLLOW_TRIANGLE)
-                hollowSides = 3;
-            
-            PrimMesher::PrimMesh primMesh(sides, profileBegin, profileEnd, profileHollow, hollowSides);
-            primMesh.topShearX = primitive.PathShearX.Get();
-            primMesh.topShearY = primitive.PathShearY.Get();
-            primMesh.pathCutBegin = primitive.PathBegin.Get();
-            primMesh.pathCutEnd = 1.0f - primitive.PathEnd.Get();
-
-            if (primitive.PathCurve.Get() == RexTypes::EXTRUSION_STRAIGHT)
-            {
-                primMesh.twistBegin = primitive.PathTwistBegin.Get() * 180;
-                primMesh.twistEnd = primitive.PathTwist.Get() * 180;
-                primMesh.taperX = primitive.PathScaleX.Get() - 1.0f;
-                primMesh.taperY = primitive.PathScaleY.Get() - 1.0f;
+            PrimMesher::PrimMesh primMesh;
+            SetupPrimMesh(input, primMesh);
+            if (input.path_curve_ == RexTypes::EXTRUSION_STRAIGHT)
                 primMesh.ExtrudeLinear();
-            }
             else
-            {
-                primMesh.holeSizeX = (2.0f - primitive.PathScaleX.Get());
-                primMesh.holeSizeY = (2.0f - primitive.PathScaleY.Get());
-                primMesh.radius = primitive.PathRadiusOffset.Get();
-                primMesh.revolutions = primitive.PathRevolutions.Get();
-                primMesh.skew = primitive.PathSkew.Get();
-                primMesh.twistBegin = primitive.PathTwistBegin.Get() * 360;
-                primMesh.twistEnd = primitive.PathTwist.Get() * 360;
-                primMesh.taperX = primitive.PathTaperX.Get();
-                primMesh.taperY = primitive.PathTaperY.Get();
                 primMesh.ExtrudeCircular();
-            }
-            
-            PROFILE(Primitive_CreateManualObject)
-            prim_manual_object->clear();
-            prim_manual_object->setBoundingBox(Ogre::AxisAlignedBox());
             
             // Check for highly illegal coordinates in any of the faces
             for (int i = 0; i < primMesh.viewerFaces.size(); ++i)
             {
                 if (!(CheckCoord(primMesh.viewerFaces[i].v1) && CheckCoord(primMesh.viewerFaces[i].v2) && CheckCoord(primMesh.viewerFaces[i].v3)))
-                {
-                    RexLogicModule::LogError("NaN or infinite number encountered in prim face coordinates. Skipping geometry creation.");
-                    return 0;
-                }
+                    return false;
             }
             
-            std::string mat_name;
-            std::string prev_mat_name;
-            
-            uint indices = 0;
-            bool first_face = true;
+            PrimGeometrySection* section = 0;
             
             for (int i = 0; i < primMesh.viewerFaces.size(); ++i)
             {
-                int facenum = primMesh.viewerFaces[i].primFaceNumber;
-                
-                Color color = primitive.PrimDefaultColor;
-                ColorMap::const_iterator c = primitive.PrimColors.find(facenum);
-                if (c != primitive.PrimColors.end())
-                    color = c->second;
-                
-                // Skip face if very transparent
-                if (color.a <= 0.11f)
+                const PrimMesher::ViewerFace& face = primMesh.viewerFaces[i];
+                const PrimFaceParams& params = input.faces_[ClampFaceNumber(face.primFaceNumber)];
+                if (!params.drawn_)
                     continue;
                 
-                if (!mat_override.empty())
-                    mat_name = mat_override;
+                // Start a new section when the material changes, or without optimisations, every other face
+                bool new_section = !section;
+                if (input.batch_materials_)
+                    new_section |= section && section->mat_name_ != params.mat_name_;
                 else
+                    new_section |= i % 2 == 0;
+                if (new_section)
                 {
-                    unsigned variation = OgreRenderer::LEGACYMAT_VERTEXCOL;
-                    
-                    // Check for transparency
-                    if (color.a < 1.0f)
-                        variation = OgreRenderer::LEGACYMAT_VERTEXCOLALPHA;
-                    
-                    // Check for fullbright
-                    bool fullbright = (primitive.PrimDefaultMaterialType & RexTypes::MATERIALTYPE_FULLBRIGHT) != 0;
-                    MaterialTypeMap::const_iterator mt = primitive.PrimMaterialTypes.find(facenum);
-                    if (mt != primitive.PrimMaterialTypes.end())
-                        fullbright = (mt->second & RexTypes::MATERIALTYPE_FULLBRIGHT) != 0;
-                    if (fullbright)
-                        variation |= OgreRenderer::LEGACYMAT_FULLBRIGHT;
-                    
-                    std::string suffix = OgreRenderer::GetMaterialSuffix(variation);
-                    
-                    // Try to find face's texture in texturemap, use default if not found
-                    std::string texture_name = primitive.PrimDefaultTextureID;
-                    TextureMap::const_iterator t = primitive.PrimTextures.find(facenum);
-                    if (t != primitive.PrimTextures.end())
-                        texture_name = t->second;
-                    
-                    mat_name = texture_name + suffix;
-                    
-                    // Create the material here if texture yet missing, the material will be updated later
-                    OgreRenderer::GetOrCreateLegacyMaterial(texture_name, variation);
+                    data.sections_.push_back(PrimGeometrySection());
+                    section = &data.sections_.back();
+                    section->mat_name_ = params.mat_name_;
                 }
                 
-                // Get texture mapping parameters
-                float repeat_u = primitive.PrimDefaultRepeatU;
-                float repeat_v = primitive.PrimDefaultRepeatV;
-                float offset_u = primitive.PrimDefaultOffsetU;
-                float offset_v = primitive.PrimDefaultOffsetV;
-                float rot = primitive.PrimDefaultUVRotation;
-                if (primitive.PrimRepeatU.find(facenum) != primitive.PrimRepeatU.end())
-                    repeat_u = primitive.PrimRepeatU[facenum];
-                if (primitive.PrimRepeatV.find(facenum) != primitive.PrimRepeatV.end())
-                    repeat_v = primitive.PrimRepeatV[facenum];
-                if (primitive.PrimOffsetU.find(facenum) != primitive.PrimOffsetU.end())
-                    offset_u = primitive.PrimOffsetU[facenum];
-                if (primitive.PrimOffsetV.find(facenum) != primitive.PrimOffsetV.end())
-                    offset_v = primitive.PrimOffsetV[facenum];
-                if (primitive.PrimUVRotation.find(facenum) != primitive.PrimUVRotation.end())
-                    rot = primitive.PrimUVRotation[facenum];
-                float rot_sin = sin(-rot);
-                float rot_cos = cos(-rot);
-
-                if (optimisations_enabled || primitive.DrawType == RexTypes::DRAWTYPE_MESH)
-                {
-                    if ((first_face) || (mat_name != prev_mat_name))
-                    {
-                        if (indices)
-                            prim_manual_object->end();
-                        indices = 0;
-                        prim_manual_object->begin(mat_name, Ogre::RenderOperation::OT_TRIANGLE_LIST);
-                        prev_mat_name = mat_name;
-                        first_face = false;
-                    }
-                }
-                else
-                {
-                    if (i % 2 == 0)
-                    {
-                        if (indices)
-                            prim_manual_object->end();
-                        indices = 0;
-                        prim_manual_object->begin(mat_name, Ogre::RenderOperation::OT_TRIANGLE_LIST);
-                    }
-                }
+                float rot_sin = sin(-params.rot_);
+                float rot_cos = cos(-params.rot_);
                 
-                Ogre::Vector3 pos1(primMesh.viewerFaces[i].v1.X, primMesh.viewerFaces[i].v1.Y, primMesh.viewerFaces[i].v1.Z);
-                Ogre::Vector3 pos2(primMesh.viewerFaces[i].v2.X, primMesh.viewerFaces[i].v2.Y, primMesh.viewerFaces[i].v2.Z);
-                Ogre::Vector3 pos3(primMesh.viewerFaces[i].v3.X, primMesh.viewerFaces[i].v3.Y, primMesh.viewerFaces[i].v3.Z);
+                Ogre::Vector2 uv1(face.uv1.U, face.uv1.V);
+                Ogre::Vector2 uv2(face.uv2.U, face.uv2.V);
+                Ogre::Vector2 uv3(face.uv3.U, face.uv3.V);
 
-                Ogre::Vector3 n1(primMesh.viewerFaces[i].n1.X, primMesh.viewerFaces[i].n1.Y, primMesh.viewerFaces[i].n1.Z);
-                Ogre::Vector3 n2(primMesh.viewerFaces[i].n2.X, primMesh.viewerFaces[i].n2.Y, primMesh.viewerFaces[i].n2.Z);
-                Ogre::Vector3 n3(primMesh.viewerFaces[i].n3.X, primMesh.viewerFaces[i].n3.Y, primMesh.viewerFaces[i].n3.Z);
+                TransformUV(uv1, params.repeat_u_, params.repeat_v_, params.offset_u_, params.offset_v_, rot_sin, rot_cos);
+                TransformUV(uv2, params.repeat_u_, params.repeat_v_, params.offset_u_, params.offset_v_, rot_sin, rot_cos);
+                TransformUV(uv3, params.repeat_u_, params.repeat_v_, params.offset_u_, params.offset_v_, rot_sin, rot_cos);
                 
-                Ogre::Vector2 uv1(primMesh.viewerFaces[i].uv1.U, primMesh.viewerFaces[i].uv1.V);
-                Ogre::Vector2 uv2(primMesh.viewerFaces[i].uv2.U, primMesh.viewerFaces[i].uv2.V);
-                Ogre::Vector2 uv3(primMesh.viewerFaces[i].uv3.U, primMesh.viewerFaces[i].uv3.V);
-
-                TransformUV(uv1, repeat_u, repeat_v, offset_u, offset_v, rot_sin, rot_cos);
-                TransformUV(uv2, repeat_u, repeat_v, offset_u, offset_v, rot_sin, rot_cos);
-                TransformUV(uv3, repeat_u, repeat_v, offset_u, offset_v, rot_sin, rot_cos);
-
-                prim_manual_object->position(pos1);
-                prim_manual_object->normal(n1);
-                prim_manual_object->textureCoord(uv1);
-                prim_manual_object->colour(color.r, color.g, color.b, color.a);
+                PrimVertex vertex;
+                vertex.color_ = params.color_;
                 
-                prim_manual_object->position(pos2);
-                prim_manual_object->normal(n2);
-                prim_manual_object->textureCoord(uv2);
-                prim_manual_object->colour(color.r, color.g, color.b, color.a);
+                vertex.position_ = Vector3df(face.v1.X, face.v1.Y, face.v1.Z);
+                vertex.normal_ = Vector3df(face.n1.X, face.n1.Y, face.n1.Z);
+                vertex.u_ = uv1.x;
+                vertex.v_ = uv1.y;
+                section->vertices_.push_back(vertex);
                 
-                prim_manual_object->position(pos3);
-                prim_manual_object->normal(n3);
-                prim_manual_object->textureCoord(uv3);
-                prim_manual_object->colour(color.r, color.g, color.b, color.a);
+                vertex.position_ = Vector3df(face.v2.X, face.v2.Y, face.v2.Z);
+                vertex.normal_ = Vector3df(face.n2.X, face.n2.Y, face.n2.Z);
+                vertex.u_ = uv2.x;
+                vertex.v_ = uv2.y;
+                section->vertices_.push_back(vertex);
                 
-                prim_manual_object->index(indices++);
-                prim_manual_object->index(indices++);
-                prim_manual_object->index(indices++);
+                vertex.position_ = Vector3df(face.v3.X, face.v3.Y, face.v3.Z);
+                vertex.normal_ = Vector3df(face.n3.X, face.n3.Y, face.n3.Z);
+                vertex.u_ = uv3.x;
+                vertex.v_ = uv3.y;
+                section->vertices_.push_back(vertex);
             }
-            
-            // End last subsection
-            if (indices)
-                prim_manual_object->end();
         }
-        catch (Exception& e)
+        // Runs on the geometry builder threads, so nothing may escape: a worker would die with its build unfinished
+        catch (Exception&)
         {
-            RexLogicModule::LogError(std::string("Exception while creating primitive geometry: ") + e.what());
-            return 0;
+            data.sections_.clear();
+            return false;
+        }
+        catch (std::exception&)
+        {
+            data.sections_.clear();
+            return false;
+        }
+        catch (...)
+        {
+            data.sections_.clear();
+            return false;
         }
         
-        return prim_manual_object;
+        return true;
+    }
+    
+    std::string GetPrimGeometryKey(const PrimGeometryInput& input)
+    {
+        // Everything BuildPrimGeometry() uses. Floats in full precision, so that only identical geometry is shared
+        std::ostringstream key;
+        key.precision(9);
+        key << input.batch_materials_ << ' ' << input.profile_curve_ << ' ' << input.profile_begin_ << ' '
+            << input.profile_end_ << ' ' << input.profile_hollow_ << ' ' << input.path_curve_ << ' ' << input.path_begin_ << ' '
+            << input.path_end_ << ' ' << input.path_shear_x_ << ' ' << input.path_shear_y_ << ' ' << input.path_twist_ << ' '
+            << input.path_twist_begin_ << ' ' << input.path_scale_x_ << ' ' << input.path_scale_y_ << ' '
+            << input.path_radius_offset_ << ' ' << input.path_revolutions_ << ' ' << input.path_skew_ << ' '
+            << input.path_taper_x_ << ' ' << input.path_taper_y_;
+        
+        for (int facenum = 0; facenum < MAX_PRIM_FACES; ++facenum)
+        {
+            const PrimFaceParams& params = input.faces_[facenum];
+            if (!params.drawn_)
+                continue;
+            key << ' ' << facenum << ' ' << params.mat_name_ << ' ' << params.color_.r << ' ' << params.color_.g << ' '
+                << params.color_.b << ' ' << params.color_.a << ' ' << params.repeat_u_ << ' ' << params.repeat_v_ << ' '
+                << params.offset_u_ << ' ' << params.offset_v_ << ' ' << params.rot_;
+        }
+        
+        return key.str();
+    }
+    
+    std::string GetPrimGeometryKey(Foundation::Framework* framework, EC_OpenSimPrim& primitive, bool optimisations_enabled)
+    {
+        PrimGeometryInput input;
+        if (!GetPrimGeometryInput(framework, primitive, optimisations_enabled, input))
+            return std::string();
+        
+        return GetPrimGeometryKey(input);
+    }
+    
+    bool CommitPrimGeometry(Foundation::Framework* framework, EC_OpenSimPrim& primitive, OgreRenderer::EC_OgreCustomObject& custom)
+    {
+        PROFILE(Primitive_CreateGeometry)
+        
+        PrimGeometryInput input;
+        if (!GetPrimGeometryInput(framework, primitive, true, input))
+            return false;
+        
+        std::string key = GetPrimGeometryKey(input);
+        if (custom.CommitSharedMesh(key))
+            return true;
+        
+        PrimGeometryData data;
+        if (!BuildPrimGeometry(input, data))
+        {
+            RexLogicModule::LogError("NaN or infinite number encountered in prim face coordinates, or exception while creating primitive geometry. Skipping geometry creation.");
+            return false;
+        }
+        
+        return custom.CommitChanges(CreatePrimGeometry(framework, data), key);
     }
 }
@@ -4,6 +4,8 @@
 #define incl_RexLogicModule_PrimGeometryUtils_h
 
 #include "RexLogicModuleApi.h"
+#include "Vector3D.h"
+#include "Color.h"
 
 class EC_OpenSimPrim;
 
@@ -12,13 +14,119 @@ namespace Ogre
     class ManualObject;
 }
 
+namespace OgreRenderer
+{
+    class EC_OgreCustomObject;
+}
+
 namespace RexLogic
 {
+    //! Number of face numbers a prim can have. Higher face numbers, if any, use the parameters of the last.
+    const int MAX_PRIM_FACES = 9;
+
+    //! Material, vertex color and texture mapping of a prim face
+    struct PrimFaceParams
+    {
+        PrimFaceParams() : drawn_(false), repeat_u_(1.0f), repeat_v_(1.0f), offset_u_(0.0f), offset_v_(0.0f), rot_(0.0f) {}
+
+        //! Whether the face is drawn. Very transparent faces are not
+        bool drawn_;
+        std::string mat_name_;
+        Color color_;
+        float repeat_u_;
+        float repeat_v_;
+        float offset_u_;
+        float offset_v_;
+        float rot_;
+    };
+
+    //! Everything prim geometry is generated from, copied from a prim on the main thread
+    /*! Materials are resolved, and created if missing, when the copy is made. Faces the shape does not produce are
+        left undrawn, without materials. Building geometry from the copy needs no access to the prim, the framework
+        or Ogre, so it can be done on any thread.
+     */
+    struct PrimGeometryInput
+    {
+        //! Whether consecutive faces of the same material are batched into one section
+        bool batch_materials_;
+        int profile_curve_;
+        float profile_begin_;
+        float profile_end_;
+        float profile_hollow_;
+        int path_curve_;
+        float path_begin_;
+        float path_end_;
+        float path_shear_x_;
+        float path_shear_y_;
+        float path_twist_;
+        float path_twist_begin_;
+        float path_scale_x_;
+        float path_scale_y_;
+        float path_radius_offset_;
+        float path_revolutions_;
+        float path_skew_;
+        float path_taper_x_;
+        float path_taper_y_;
+        PrimFaceParams faces_[MAX_PRIM_FACES];
+    };
+
+    //! Vertex of built prim geometry
+    struct PrimVertex
+    {
+        Vector3df position_;
+        Vector3df normal_;
+        float u_;
+        float v_;
+        Color color_;
+    };
+
+    //! Section of built prim geometry: a triangle list of one material, three vertices per triangle
+    struct PrimGeometrySection
+    {
+        std::string mat_name_;
+        std::vector<PrimVertex> vertices_;
+    };
+
+    //! Built prim geometry as plain vertex arrays, ready to be copied into Ogre buffers
+    struct PrimGeometryData
+    {
+        std::vector<PrimGeometrySection> sections_;
+    };
+
     //! Generates prim geometry into an Ogre manual object from prim parameters and returns it or 0 if something went wrong
     /*! Note that the same manual object is returned for each call, so you should immediately CommitChanges() into an
         EC_OgreCustomObject before calling CreatePrimGeometry again.
      */
     REXLOGIC_MODULE_API Ogre::ManualObject* CreatePrimGeometry(Foundation::Framework* framework, EC_OpenSimPrim& primitive, bool optimisations_enabled = true);
+
+    //! Copies built prim geometry into an Ogre manual object and returns it or 0 if something went wrong
+    /*! Only to be called from the main thread. The same manual object as from CreatePrimGeometry() above is returned.
+     */
+    REXLOGIC_MODULE_API Ogre::ManualObject* CreatePrimGeometry(Foundation::Framework* framework, const PrimGeometryData& data);
+
+    //! Copies the parameters prim geometry is generated from. Only to be called from the main thread.
+    /*! \return true if successful, false if the prim has no shape data
+     */
+    REXLOGIC_MODULE_API bool GetPrimGeometryInput(Foundation::Framework* framework, EC_OpenSimPrim& primitive, bool optimisations_enabled, PrimGeometryInput& input);
+
+    //! Builds prim geometry from copied parameters. May be called from any thread.
+    /*! \return true if successful, false if the geometry has illegal coordinates or could not be generated
+     */
+    REXLOGIC_MODULE_API bool BuildPrimGeometry(const PrimGeometryInput& input, PrimGeometryData& data);
+
+    //! Returns a key describing everything the prim geometry is generated from
+    /*! Prims with the same key have identical geometry: shape, vertex colors, materials and texture mapping.
+     */
+    REXLOGIC_MODULE_API std::string GetPrimGeometryKey(const PrimGeometryInput& input);
+
+    //! Returns a key describing everything the prim geometry is generated from, or empty if the prim has no shape data
+    REXLOGIC_MODULE_API std::string GetPrimGeometryKey(Foundation::Framework* framework, EC_OpenSimPrim& primitive, bool optimisations_enabled = true);
+
+    //! Generates prim geometry and commits it into a custom object, sharing the mesh with prims of identical geometry
+    /*! If a prim with the same geometry key has a mesh, its mesh is used and no geometry is generated.
+        \return true if successful
+     */
+    REXLOGIC_MODULE_API bool CommitPrimGeometry(Foundation::Framework* framework, EC_OpenSimPrim& primitive, OgreRenderer::EC_OgreCustomObject& custom);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -29,12 +29,14 @@
 #include "SceneEvents.h"
 #include "ResourceInterface.h"
 #include "Environment/PrimGeometryUtils.h"
+#include "Environment/PrimGeometryBuilder.h"
 #include "SceneManager.h"
 #include "AssetServiceInterface.h"
 #include "SoundServiceInterface.h"
 #include "GenericMessageUtils.h"
 #include "EventManager.h"
 #include "ServiceManager.h"
+#include "ConfigurationManager.h"
 #include "WorldStream.h"
 #include "EC_HoveringText.h"
 #include "EC_OpenSimPrim.h"
@@ -43,6 +45,7 @@
 #include "AttributeInterface.h"
 
 #include <OgreSceneNode.h>
+#include <OgreCamera.h>
 
 #include <QUrl>
 #include <QColor>
@@ -51,8 +54,28 @@
 namespace RexLogic
 {
 
-Primitive::Primitive(RexLogicModule *rexlogicmodule) : rexlogicmodule_(rexlogicmodule)
+static const int DEFAULT_GEOMETRY_THREADS = 0;
+static const int DEFAULT_MAX_GEOMETRY_COMMITS = 32;
+
+Primitive::Primitive(RexLogicModule *rexlogicmodule) :
+    rexlogicmodule_(rexlogicmodule),
+    geometry_sequence_(0),
+    num_geometry_builds_(0),
+    geometry_build_time_(0.0),
+    geometry_wall_time_(0.0)
 {
+    Foundation::Framework* framework = rexlogicmodule_->GetFramework();
+
+    // Leave one hardware thread for the main thread
+    int geometry_threads = framework->GetDefaultConfig().DeclareSetting("RexPrim", "geometry_threads", DEFAULT_GEOMETRY_THREADS);
+    if (geometry_threads <= 0)
+        geometry_threads = std::max((int)boost::thread::hardware_concurrency() - 1, 1);
+
+    // Copying built geometry into Ogre buffers is done on the main thread, so spread it over frames
+    int max_commits = framework->GetDefaultConfig().DeclareSetting("RexPrim", "max_geometry_commits_per_frame", DEFAULT_MAX_GEOMETRY_COMMITS);
+    max_geometry_commits_ = std::max(max_commits, 1);
+
+    geometry_builder_.reset(new PrimGeometryBuilder(geometry_threads, max_geometry_commits_));
 }
 
 Primitive::~Primitive()
@@ -62,6 +85,10 @@ Primitive::~Primitive()
 void Primitive::Update(f64 frametime)
 {
     SerializeECsToNetwork();
+
+    if (!pending_geometry_.empty())
+        geometry_wall_time_ += frametime;
+    HandlePrimGeometryResults();
 }
 
 Scene::EntityPtr Primitive::GetOrCreatePrimEntity(entity_id_t entityid, const RexUUID &fullid, bool *created)
@@ -863,10 +890,11 @@ void Primitive::HandleDrawType(entity_id_t entityid)
     EC_OpenSimPrim &prim = *(entity->GetComponent<EC_OpenSimPrim>().get());
     if ((prim.DrawType == RexTypes::DRAWTYPE_MESH) && (!RexTypes::IsNull(prim.MeshID)))
     {
-        // Remove custom object component if exists
+        // Remove custom object component if exists, and forget geometry still being built for it
         Foundation::ComponentPtr customptr = entity->GetComponent(OgreRenderer::EC_OgreCustomObject::TypeNameStatic());
         if (customptr)
             entity->RemoveComponent(customptr);
+        pending_geometry_.erase(entityid);
 
         // Get/create mesh component 
         Foundation::ComponentPtr meshptr = entity->GetOrCreateComponent(OgreRenderer::EC_OgreMesh::TypeNameStatic());
@@ -953,15 +981,7 @@ void Primitive::HandleDrawType(entity_id_t entityid)
 
         // Create/update geometry
         if (prim.HasPrimShapeData)
-        {
-            Ogre::ManualObject* manual = CreatePrimGeometry(rexlogicmodule_->GetFramework(), prim);
-            custom.CommitChanges(manual);
-            
-            Scene::Events::EntityEventData event_data;
-            event_data.entity = entity;
-            Foundation::EventManagerPtr event_manager = rexlogicmodule_->GetFramework()->GetEventManager();
-            event_manager->SendEvent("Scene", Scene::Events::EVENT_ENTITY_VISUALS_MODIFIED, &event_data);
-        }
+            RequestPrimGeometry(entityid);
     }
 
     if (!RexTypes::IsNull(prim.ParticleScriptID))
@@ -1493,15 +1513,7 @@ void Primitive::HandleMaterialResourceReady(entity_id_t entityid, Foundation::Re
         {
             // Update geometry now that the material exists
             if (prim->HasPrimShapeData)
-            {
-                Ogre::ManualObject* manual = CreatePrimGeometry(rexlogicmodule_->GetFramework(), *prim);
-                custom->CommitChanges(manual);
-
-                Scene::Events::EntityEventData event_data;
-                event_data.entity = entity;
-                Foundation::EventManagerPtr event_manager = rexlogicmodule_->GetFramework()->GetEventManager();
-                event_manager->SendEvent("Scene", Scene::Events::EVENT_ENTITY_VISUALS_MODIFIED, &event_data);
-            }
+                RequestPrimGeometry(entityid);
         }
     }
     
@@ -1616,6 +1628,111 @@ void Primitive::HandlePrimScaleAndVisibility(entity_id_t entityid)
     ogrepos->GetSceneNode()->setVisible(prim->IsVisible.Get());
 }
 
+void Primitive::RequestPrimGeometry(entity_id_t entityid)
+{
+    Scene::EntityPtr entity = rexlogicmodule_->GetPrimEntity(entityid);
+    if (!entity)
+        return;
+    EC_OpenSimPrim* prim = entity->GetComponent<EC_OpenSimPrim>().get();
+    OgreRenderer::EC_OgreCustomObject* custom = entity->GetComponent<OgreRenderer::EC_OgreCustomObject>().get();
+    if (!prim || !custom)
+        return;
+
+    PrimGeometryRequestPtr request(new PrimGeometryRequest());
+    if (!GetPrimGeometryInput(rexlogicmodule_->GetFramework(), *prim, true, request->input_))
+        return;
+    request->key_ = GetPrimGeometryKey(request->input_);
+
+    // A prim of identical geometry already has a mesh, so nothing needs to be built
+    if (custom->CommitSharedMesh(request->key_))
+    {
+        pending_geometry_.erase(entityid);
+        SendVisualsModified(entity);
+        return;
+    }
+
+    request->entity_id_ = entityid;
+    request->sequence_ = ++geometry_sequence_;
+    pending_geometry_[entityid] = request->sequence_;
+    geometry_builder_->AddRequest(request, GetPrimGeometryPriority(entity, *prim));
+}
+
+void Primitive::HandlePrimGeometryResults()
+{
+    std::vector<PrimGeometryResultPtr> results = geometry_builder_->GetResults(max_geometry_commits_);
+    for(uint i = 0; i < results.size(); ++i)
+    {
+        const PrimGeometryResult& result = *results[i];
+        ++num_geometry_builds_;
+        geometry_build_time_ += result.build_time_;
+
+        // Skip results of superseded requests
+        std::map<entity_id_t, uint>::iterator p = pending_geometry_.find(result.entity_id_);
+        if ((p == pending_geometry_.end()) || (p->second != result.sequence_))
+            continue;
+        pending_geometry_.erase(p);
+
+        Scene::EntityPtr entity = rexlogicmodule_->GetPrimEntity(result.entity_id_);
+        if (!entity)
+            continue;
+        OgreRenderer::EC_OgreCustomObject* custom = entity->GetComponent<OgreRenderer::EC_OgreCustomObject>().get();
+        if (!custom)
+            continue;
+
+        if (!result.success_)
+        {
+            RexLogicModule::LogError("NaN or infinite number encountered in prim face coordinates, or exception while creating primitive geometry. Skipping geometry creation.");
+            continue;
+        }
+
+        // Another prim of identical geometry may have been committed since the request
+        if (!custom->CommitSharedMesh(result.key_))
+        {
+            PROFILE(Primitive_CommitGeometry);
+            custom->CommitChanges(CreatePrimGeometry(rexlogicmodule_->GetFramework(), result.data_), result.key_);
+        }
+
+        SendVisualsModified(entity);
+    }
+
+    if ((pending_geometry_.empty()) && (num_geometry_builds_))
+    {
+        RexLogicModule::LogDebug("Built " + ToString<uint>(num_geometry_builds_) + " prim geometries in " +
+            ToString<int>((int)(geometry_wall_time_ * 1000.0)) + " ms, " +
+            ToString<int>((int)(geometry_build_time_ * 1000.0)) + " ms of worker time");
+        num_geometry_builds_ = 0;
+        geometry_build_time_ = 0.0;
+        geometry_wall_time_ = 0.0;
+    }
+}
+
+f32 Primitive::GetPrimGeometryPriority(Scene::EntityPtr entity, const EC_OpenSimPrim& prim)
+{
+    boost::shared_ptr<OgreRenderer::Renderer> renderer = rexlogicmodule_->GetFramework()->GetServiceManager()->
+        GetService<OgreRenderer::Renderer>(Foundation::Service::ST_Renderer).lock();
+    OgreRenderer::EC_OgrePlaceable* placeable = entity->GetComponent<OgreRenderer::EC_OgrePlaceable>().get();
+    if (!renderer || !renderer->GetCurrentCamera() || !placeable)
+        return 0.0f;
+    Ogre::Camera* camera = renderer->GetCurrentCamera();
+
+    // Apparent size, between 0 and 1, plus 1 when in view
+    Ogre::Vector3 position = placeable->GetSceneNode()->_getDerivedPosition();
+    float radius = std::max(prim.Scale.getLength() * 0.5f, 0.01f);
+    float distance = std::max(camera->getDerivedPosition().distance(position), radius);
+    f32 priority = radius / distance;
+    if (camera->isVisible(Ogre::Sphere(position, radius)))
+        priority += 1.0f;
+    return priority;
+}
+
+void Primitive::SendVisualsModified(Scene::EntityPtr entity)
+{
+    Scene::Events::EntityEventData event_data;
+    event_data.entity = entity;
+    Foundation::EventManagerPtr event_manager = rexlogicmodule_->GetFramework()->GetEventManager();
+    event_manager->SendEvent("Scene", Scene::Events::EVENT_ENTITY_VISUALS_MODIFIED, &event_data);
+}
+
 void SkipTextureEntrySection(const uint8_t* bytes, int& idx, int length, int elementsize)
 {
     idx += elementsize; // Default value
@@ -1918,6 +2035,8 @@ void Primitive::HandleLogout()
     pending_rexfreedata_.clear();
     local_dirty_entities_.clear();
     network_dirty_entities_.clear();
+    pending_geometry_.clear();
+    geometry_builder_->Clear();
 }
 
 
@@ -1950,8 +2069,8 @@ std::string Primitive::UrlForRexObjectUpdatePacket(RexTypes::RexAssetID id)
 
 void Primitive::RegisterToComponentChangeSignals(Scene::ScenePtr scene)
 {
-    connect(scene.get(), SIGNAL( ComponentChanged(Foundation::ComponentInterface*, AttributeChange::Type) ),
-        this, SLOT( OnComponentChanged(Foundation::ComponentInterface*, AttributeChange::Type) ));
+    connect(scene.get(), SIGNAL( ChangesPublished(const Scene::SceneChangeSet &) ),
+        this, SLOT( OnSceneChanges(const Scene::SceneChangeSet &) ));
     connect(scene.get(), SIGNAL( ComponentAdded(Scene::Entity*, Foundation::ComponentInterface*, AttributeChange::Type) ),
         this, SLOT( OnEntityChanged(Scene::Entity*, Foundation::ComponentInterface*, AttributeChange::Type) ));
     connect(scene.get(), SIGNAL( ComponentRemoved(Scene::Entity*, Foundation::ComponentInterface*, AttributeChange::Type) ),
@@ -1971,6 +2090,20 @@ void Primitive::OnComponentChanged(Foundation::ComponentInterface* comp, Attribu
         network_dirty_entities_.insert(entityid);
 }
 
+void Primitive::OnSceneChanges(const Scene::SceneChangeSet &changes)
+{
+    for(uint i = 0; i < changes.size(); ++i)
+    {
+        // Only whole-component changes trigger EC sync, like ComponentChanged does
+        if (changes[i].attribute)
+            continue;
+        if (changes[i].change == AttributeChange::Local)
+            local_dirty_entities_.insert(changes[i].entity);
+        if (changes[i].change == AttributeChange::Network)
+            network_dirty_entities_.insert(changes[i].entity);
+    }
+}
+
 void Primitive::OnEntityChanged(Scene::Entity* entity, Foundation::ComponentInterface* comp, AttributeChange::Type change)
 {
     if (!entity)
@@ -31,6 +31,7 @@ namespace RexLogic
 {
     class RexLogicModule;
     class EC_AttachedSound;
+    class PrimGeometryBuilder;
 
     class Primitive : public QObject
     {
@@ -81,6 +82,8 @@ namespace RexLogic
     public slots:
         //! Trigger EC sync because of component attributes changing
         void OnComponentChanged(Foundation::ComponentInterface* comp, AttributeChange::Type change);
+        //! Trigger EC sync because of component attributes changing, for all changes of a frame
+        void OnSceneChanges(const Scene::SceneChangeSet &changes);
         //! Trigger EC sync because of components added/removed to entity
         void OnEntityChanged(Scene::Entity* entity, Foundation::ComponentInterface* comp, AttributeChange::Type change);
         //! When rex prim propeties have changed, send update to sim
@@ -181,6 +184,19 @@ namespace RexLogic
         //! handles prim size and visibility
         void HandlePrimScaleAndVisibility(entity_id_t entityid);
 
+        //! requests prim geometry to be built on the worker threads, or uses the mesh of a prim of identical geometry
+        //! @param entityid Entity id.
+        void RequestPrimGeometry(entity_id_t entityid);
+
+        //! commits prim geometry built on the worker threads
+        void HandlePrimGeometryResults();
+
+        //! returns build priority of prim geometry: prims in view first, then by apparent size
+        f32 GetPrimGeometryPriority(Scene::EntityPtr entity, const EC_OpenSimPrim& prim);
+
+        //! sends the visuals modified event of an entity
+        void SendVisualsModified(Scene::EntityPtr entity);
+
         //! discards request tags for certain entity
         void DiscardRequestTags(entity_id_t, EntityResourceRequestMap& map);
 
@@ -215,6 +231,28 @@ namespace RexLogic
         EntityIdSet local_dirty_entities_;
         //! entities with EC changes from the network
         EntityIdSet network_dirty_entities_;
+
+
+        //! builds prim geometry on worker threads
+        boost::shared_ptr<PrimGeometryBuilder> geometry_builder_;
+
+        //! latest geometry request number of each prim waiting for its geometry
+        std::map<entity_id_t, uint> pending_geometry_;
+
+        //! number of the next geometry request
+        uint geometry_sequence_;
+
+        //! maximum number of built geometries committed per frame
+        uint max_geometry_commits_;
+
+        //! number of geometries built since the workers were last idle
+        uint num_geometry_builds_;
+
+        //! worker seconds spent building them
+        f64 geometry_build_time_;
+
+        //! seconds taken in all
+        f64 geometry_wall_time_;
     };
 }
 #endif
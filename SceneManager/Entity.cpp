@@ -16,6 +16,8 @@
 
 DEFINE_POCO_LOGGING_FUNCTIONS("Entity")
 
+DEFINE_POOL_ALLOCATED(Scene::Entity)
+
 #include "MemoryLeakCheck.h"
 
 namespace Scene
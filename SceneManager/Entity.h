@@ -7,6 +7,7 @@
 #include "CoreTypes.h"
 #include "ComponentInterface.h"
 #include "AttributeInterface.h"
+#include "PoolAllocator.h"
 
 #include <QObject>
 #include <QMap>
@@ -33,6 +34,8 @@ namespace Scene
 
         friend class SceneManager;
 
+        DECLARE_POOL_ALLOCATED(Entity)
+
     private:
         //! constructor
         /*!
@@ -0,0 +1,525 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneBinaryFormat.h"
+
+#include <QDomDocument>
+#include <QXmlStreamWriter>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    void AppendU32(QByteArray &dest, u32 value)
+    {
+        char bytes[4];
+        bytes[0] = (char)(value & 0xff);
+        bytes[1] = (char)((value >> 8) & 0xff);
+        bytes[2] = (char)((value >> 16) & 0xff);
+        bytes[3] = (char)((value >> 24) & 0xff);
+        dest.append(bytes, 4);
+    }
+
+    void AppendU64(QByteArray &dest, quint64 value)
+    {
+        AppendU32(dest, (u32)(value & 0xffffffff));
+        AppendU32(dest, (u32)(value >> 32));
+    }
+
+    u32 ReadU32(const uchar *data)
+    {
+        return (u32)data[0] | ((u32)data[1] << 8) | ((u32)data[2] << 16) | ((u32)data[3] << 24);
+    }
+
+    quint64 ReadU64(const uchar *data)
+    {
+        return (quint64)ReadU32(data) | ((quint64)ReadU32(data + 4) << 32);
+    }
+
+    QByteArray MakeHeader(u32 num_entities, u32 num_strings, u32 num_types, quint64 entity_offset, quint64 string_offset, quint64 type_offset)
+    {
+        QByteArray header;
+        AppendU32(header, Scene::BinaryScene::Magic);
+        AppendU32(header, Scene::BinaryScene::Version);
+        AppendU32(header, num_entities);
+        AppendU32(header, num_strings);
+        AppendU32(header, num_types);
+        AppendU32(header, 0);
+        AppendU64(header, entity_offset);
+        AppendU64(header, string_offset);
+        AppendU64(header, type_offset);
+        return header;
+    }
+}
+
+namespace Scene
+{
+    BinarySceneWriter::BinarySceneWriter(const QString &filename) :
+        file_(filename),
+        entity_num_components_(0),
+        num_entities_(0),
+        failed_(false)
+    {
+    }
+
+    BinarySceneWriter::~BinarySceneWriter()
+    {
+        if (file_.isOpen())
+            file_.close();
+    }
+
+    bool BinarySceneWriter::Open()
+    {
+        if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        QByteArray header = MakeHeader(0, 0, 0, 0, 0, 0);
+        if (file_.write(header) != header.size())
+            failed_ = true;
+
+        return !failed_;
+    }
+
+    void BinarySceneWriter::BeginEntity(entity_id_t id)
+    {
+        entity_block_.clear();
+        AppendU32(entity_block_, id);
+        // Placeholders for block size & component count, filled in EndEntity
+        AppendU32(entity_block_, 0);
+        AppendU32(entity_block_, 0);
+        entity_num_components_ = 0;
+    }
+
+    void BinarySceneWriter::WriteComponent(const QString &type_name, const QString &name, const Foundation::SerializedAttributeVector &attributes)
+    {
+        AppendU32(entity_block_, InternType(type_name));
+        AppendU32(entity_block_, name.isEmpty() ? BinaryScene::NoString : InternString(name.toUtf8()));
+        AppendU32(entity_block_, attributes.size());
+        for(uint i = 0; i < attributes.size(); ++i)
+        {
+            const Foundation::SerializedAttribute &attr = attributes[i];
+            AppendU32(entity_block_, InternString(QByteArray(attr.name.c_str(), attr.name.size())));
+            AppendU32(entity_block_, InternString(QByteArray(attr.value.c_str(), attr.value.size())));
+            AppendU32(entity_block_, attr.type.empty() ? BinaryScene::NoString : InternString(QByteArray(attr.type.c_str(), attr.type.size())));
+        }
+        ++entity_num_components_;
+    }
+
+    void BinarySceneWriter::EndEntity()
+    {
+        QByteArray counts;
+        AppendU32(counts, entity_block_.size() - 8);
+        AppendU32(counts, entity_num_components_);
+        entity_block_.replace(4, 8, counts);
+
+        if (file_.write(entity_block_) != entity_block_.size())
+            failed_ = true;
+        entity_block_.clear();
+        ++num_entities_;
+    }
+
+    bool BinarySceneWriter::Close()
+    {
+        if (!file_.isOpen())
+            return false;
+
+        quint64 string_offset = file_.pos();
+
+        // String offsets, then string data
+        QByteArray offsets;
+        quint64 data_pos = 0;
+        for(uint i = 0; i < strings_.size(); ++i)
+        {
+            AppendU64(offsets, data_pos);
+            data_pos += 4 + strings_[i].size();
+        }
+        if (file_.write(offsets) != offsets.size())
+            failed_ = true;
+        for(uint i = 0; i < strings_.size() && !failed_; ++i)
+        {
+            QByteArray length;
+            AppendU32(length, strings_[i].size());
+            if (file_.write(length) != length.size() || file_.write(strings_[i]) != strings_[i].size())
+                failed_ = true;
+        }
+
+        quint64 type_offset = file_.pos();
+        QByteArray types;
+        for(uint i = 0; i < types_.size(); ++i)
+            AppendU32(types, types_[i]);
+        if (file_.write(types) != types.size())
+            failed_ = true;
+
+        QByteArray header = MakeHeader(num_entities_, strings_.size(), types_.size(), BinaryScene::HeaderSize, string_offset, type_offset);
+        if (!file_.seek(0) || file_.write(header) != header.size())
+            failed_ = true;
+
+        file_.close();
+        strings_.clear();
+        string_indices_.clear();
+        return !failed_;
+    }
+
+    u32 BinarySceneWriter::InternString(const QByteArray &str)
+    {
+        QHash<QByteArray, u32>::const_iterator iter = string_indices_.find(str);
+        if (iter != string_indices_.end())
+            return iter.value();
+
+        u32 index = strings_.size();
+        strings_.push_back(str);
+        string_indices_[str] = index;
+        return index;
+    }
+
+    u32 BinarySceneWriter::InternType(const QString &type_name)
+    {
+        QHash<QString, u32>::const_iterator iter = type_indices_.find(type_name);
+        if (iter != type_indices_.end())
+            return iter.value();
+
+        u32 index = types_.size();
+        types_.push_back(InternString(type_name.toUtf8()));
+        type_indices_[type_name] = index;
+        return index;
+    }
+
+    BinarySceneReader::BinarySceneReader(const QString &filename) :
+        file_(filename),
+        data_(0),
+        size_(0),
+        num_entities_(0),
+        entities_read_(0),
+        num_strings_(0),
+        string_table_offset_(0),
+        string_data_offset_(0),
+        pos_(0),
+        corrupt_(false)
+    {
+    }
+
+    BinarySceneReader::~BinarySceneReader()
+    {
+        if (data_ && buffer_.isEmpty())
+            file_.unmap(const_cast<uchar*>(data_));
+        file_.close();
+    }
+
+    bool BinarySceneReader::Open()
+    {
+        if (!file_.open(QIODevice::ReadOnly))
+            return false;
+
+        size_ = file_.size();
+        if (size_ < BinaryScene::HeaderSize)
+            return false;
+
+        data_ = file_.map(0, size_);
+        if (!data_)
+        {
+            buffer_ = file_.readAll();
+            if (buffer_.size() != size_)
+                return false;
+            data_ = reinterpret_cast<const uchar*>(buffer_.constData());
+        }
+
+        if (ReadU32(data_) != BinaryScene::Magic || ReadU32(data_ + 4) != BinaryScene::Version)
+            return false;
+
+        num_entities_ = ReadU32(data_ + 8);
+        num_strings_ = ReadU32(data_ + 12);
+        u32 num_types = ReadU32(data_ + 16);
+        quint64 entity_offset = ReadU64(data_ + 24);
+        quint64 string_offset = ReadU64(data_ + 32);
+        quint64 type_offset = ReadU64(data_ + 40);
+
+        if (entity_offset < BinaryScene::HeaderSize || entity_offset > string_offset || string_offset > type_offset)
+            return false;
+        if (type_offset + (quint64)num_types * 4 > (quint64)size_)
+            return false;
+        if (string_offset + (quint64)num_strings_ * 8 > type_offset)
+            return false;
+
+        string_table_offset_ = string_offset;
+        string_data_offset_ = string_offset + (qint64)num_strings_ * 8;
+        pos_ = entity_offset;
+
+        types_.clear();
+        for(u32 i = 0; i < num_types; ++i)
+        {
+            QString type_name;
+            if (!GetString(ReadU32(data_ + type_offset + i * 4), type_name))
+                return false;
+            types_.push_back(type_name);
+        }
+
+        return true;
+    }
+
+    bool BinarySceneReader::ReadEntity(BinarySceneEntity &entity)
+    {
+        if (!data_ || corrupt_ || entities_read_ >= num_entities_)
+            return false;
+
+        entity.components.clear();
+
+        if (pos_ + 12 > string_table_offset_)
+        {
+            corrupt_ = true;
+            return false;
+        }
+
+        entity.id = ReadU32(data_ + pos_);
+        u32 block_size = ReadU32(data_ + pos_ + 4);
+        u32 num_components = ReadU32(data_ + pos_ + 8);
+        qint64 block_end = pos_ + 8 + block_size;
+        if (block_end > string_table_offset_)
+        {
+            corrupt_ = true;
+            return false;
+        }
+
+        // Each component takes at least 12 bytes, check the count before allocating for it
+        qint64 pos = pos_ + 12;
+        if (pos + (qint64)num_components * 12 > block_end)
+        {
+            corrupt_ = true;
+            return false;
+        }
+        entity.components.resize(num_components);
+        for(u32 i = 0; i < num_components; ++i)
+        {
+            BinarySceneComponent &comp = entity.components[i];
+            if (pos + 12 > block_end)
+            {
+                corrupt_ = true;
+                return false;
+            }
+            u32 type_index = ReadU32(data_ + pos);
+            u32 name_index = ReadU32(data_ + pos + 4);
+            u32 num_attributes = ReadU32(data_ + pos + 8);
+            pos += 12;
+
+            if (type_index >= (u32)types_.size() || pos + (qint64)num_attributes * 12 > block_end)
+            {
+                corrupt_ = true;
+                return false;
+            }
+            comp.type_name = types_[type_index];
+            comp.name.clear();
+            if (name_index != BinaryScene::NoString && !GetString(name_index, comp.name))
+            {
+                corrupt_ = true;
+                return false;
+            }
+
+            comp.attributes.resize(num_attributes);
+            for(u32 j = 0; j < num_attributes; ++j)
+            {
+                Foundation::SerializedAttribute &attr = comp.attributes[j];
+                u32 type_str = ReadU32(data_ + pos + 8);
+                attr.type.clear();
+                if (!GetString(ReadU32(data_ + pos), attr.name) || !GetString(ReadU32(data_ + pos + 4), attr.value) ||
+                    (type_str != BinaryScene::NoString && !GetString(type_str, attr.type)))
+                {
+                    corrupt_ = true;
+                    return false;
+                }
+                pos += 12;
+            }
+        }
+
+        pos_ = block_end;
+        ++entities_read_;
+        return true;
+    }
+
+    bool BinarySceneReader::GetStringData(u32 index, const char *&data, u32 &length) const
+    {
+        if (index >= num_strings_)
+            return false;
+
+        quint64 offset = string_data_offset_ + ReadU64(data_ + string_table_offset_ + (qint64)index * 8);
+        if (offset + 4 > (quint64)size_)
+            return false;
+        length = ReadU32(data_ + offset);
+        if (offset + 4 + length > (quint64)size_)
+            return false;
+
+        data = reinterpret_cast<const char*>(data_ + offset + 4);
+        return true;
+    }
+
+    bool BinarySceneReader::GetString(u32 index, std::string &str) const
+    {
+        const char *data = 0;
+        u32 length = 0;
+        if (!GetStringData(index, data, length))
+            return false;
+        str.assign(data, length);
+        return true;
+    }
+
+    bool BinarySceneReader::GetString(u32 index, QString &str) const
+    {
+        const char *data = 0;
+        u32 length = 0;
+        if (!GetStringData(index, data, length))
+            return false;
+        str = QString::fromUtf8(data, length);
+        return true;
+    }
+
+    bool ParseXmlScene(const QString &filename, std::vector<BinarySceneEntity> &entities, const volatile bool *cancel)
+    {
+        QDomDocument scene_doc("Scene");
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        if (!scene_doc.setContent(&file))
+            return false;
+        file.close();
+
+        QDomElement scene_elem = scene_doc.firstChildElement("scene");
+        if (scene_elem.isNull())
+            return false;
+
+        QDomElement ent_elem = scene_elem.firstChildElement("entity");
+        while (!ent_elem.isNull())
+        {
+            if (cancel && *cancel)
+                return false;
+
+            QString id_str = ent_elem.attribute("id");
+            if (!id_str.isEmpty())
+            {
+                entities.push_back(BinarySceneEntity());
+                BinarySceneEntity &entity = entities.back();
+                entity.id = ParseString<entity_id_t>(id_str.toStdString());
+                QDomElement comp_elem = ent_elem.firstChildElement("component");
+                while (!comp_elem.isNull())
+                {
+                    entity.components.push_back(BinarySceneComponent());
+                    BinarySceneComponent &comp = entity.components.back();
+                    comp.type_name = comp_elem.attribute("type");
+                    comp.name = comp_elem.attribute("name");
+                    QDomElement attr_elem = comp_elem.firstChildElement("attribute");
+                    while (!attr_elem.isNull())
+                    {
+                        Foundation::SerializedAttribute attr;
+                        attr.name = attr_elem.attribute("name").toStdString();
+                        attr.value = attr_elem.attribute("value").toStdString();
+                        attr.type = attr_elem.attribute("type").toStdString();
+                        comp.attributes.push_back(attr);
+                        attr_elem = attr_elem.nextSiblingElement("attribute");
+                    }
+                    comp_elem = comp_elem.nextSiblingElement("component");
+                }
+            }
+            ent_elem = ent_elem.nextSiblingElement("entity");
+        }
+
+        return true;
+    }
+
+    bool ConvertXmlSceneToBinary(const QString &xml_filename, const QString &binary_filename)
+    {
+        QDomDocument scene_doc("Scene");
+        QFile file(xml_filename);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        if (!scene_doc.setContent(&file))
+            return false;
+        file.close();
+
+        QDomElement scene_elem = scene_doc.firstChildElement("scene");
+        if (scene_elem.isNull())
+            return false;
+
+        BinarySceneWriter writer(binary_filename);
+        if (!writer.Open())
+            return false;
+
+        QDomElement ent_elem = scene_elem.firstChildElement("entity");
+        while (!ent_elem.isNull())
+        {
+            QString id_str = ent_elem.attribute("id");
+            if (!id_str.isEmpty())
+            {
+                writer.BeginEntity(ParseString<entity_id_t>(id_str.toStdString()));
+                QDomElement comp_elem = ent_elem.firstChildElement("component");
+                while (!comp_elem.isNull())
+                {
+                    Foundation::SerializedAttributeVector attributes;
+                    QDomElement attr_elem = comp_elem.firstChildElement("attribute");
+                    while (!attr_elem.isNull())
+                    {
+                        Foundation::SerializedAttribute attr;
+                        attr.name = attr_elem.attribute("name").toStdString();
+                        attr.value = attr_elem.attribute("value").toStdString();
+                        attr.type = attr_elem.attribute("type").toStdString();
+                        attributes.push_back(attr);
+                        attr_elem = attr_elem.nextSiblingElement("attribute");
+                    }
+                    writer.WriteComponent(comp_elem.attribute("type"), comp_elem.attribute("name"), attributes);
+                    comp_elem = comp_elem.nextSiblingElement("component");
+                }
+                writer.EndEntity();
+            }
+            ent_elem = ent_elem.nextSiblingElement("entity");
+        }
+
+        return writer.Close();
+    }
+
+    bool ConvertBinarySceneToXml(const QString &binary_filename, const QString &xml_filename)
+    {
+        BinarySceneReader reader(binary_filename);
+        if (!reader.Open())
+            return false;
+
+        QFile file(xml_filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        QXmlStreamWriter xml(&file);
+        xml.setAutoFormatting(true);
+        xml.writeDTD("<!DOCTYPE Scene>");
+        xml.writeStartElement("scene");
+
+        BinarySceneEntity entity;
+        while (reader.ReadEntity(entity))
+        {
+            xml.writeStartElement("entity");
+            xml.writeAttribute("id", QString::number(entity.id));
+            for(uint i = 0; i < entity.components.size(); ++i)
+            {
+                const BinarySceneComponent &comp = entity.components[i];
+                xml.writeStartElement("component");
+                xml.writeAttribute("type", comp.type_name);
+                if (!comp.name.isEmpty())
+                    xml.writeAttribute("name", comp.name);
+                for(uint j = 0; j < comp.attributes.size(); ++j)
+                {
+                    const Foundation::SerializedAttribute &attr = comp.attributes[j];
+                    xml.writeStartElement("attribute");
+                    xml.writeAttribute("name", QString::fromStdString(attr.name));
+                    xml.writeAttribute("value", QString::fromStdString(attr.value));
+                    if (!attr.type.empty())
+                        xml.writeAttribute("type", QString::fromStdString(attr.type));
+                    xml.writeEndElement();
+                }
+                xml.writeEndElement();
+            }
+            xml.writeEndElement();
+        }
+
+        xml.writeEndElement();
+        xml.writeEndDocument();
+        file.close();
+
+        return !reader.IsCorrupt();
+    }
+}
@@ -0,0 +1,223 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_SceneManager_SceneBinaryFormat_h
+#define incl_SceneManager_SceneBinaryFormat_h
+
+#include "CoreTypes.h"
+#include "ComponentInterface.h"
+
+#include <QFile>
+#include <QHash>
+#include <QByteArray>
+#include <QString>
+
+namespace Scene
+{
+    //! Constants of the binary scene container.
+    /*! The binary scene is an alternative to the XML scene file produced by SceneManager::SaveScene. It carries the same
+        information (entities, components and their serialized attributes), but can be read through a memory mapping
+        without building a DOM, and written in a streaming fashion one entity at a time.
+
+        All integers are little-endian. The layout is:
+
+        - Header (HeaderSize bytes): magic, version, entity count, string count, component type count, reserved,
+          followed by the 64-bit offsets of the entity data, the string table and the component type table.
+        - Entity data: one block per entity. Block = entity id, block size in bytes, component count, and for each
+          component its type index, name string, attribute count and (name, value, type) string triples.
+        - String table: 64-bit offset of each string relative to the start of the string data, followed by the
+          string data. Each string is a 32-bit byte length followed by the bytes.
+        - Component type table: one string index per component type.
+
+        Strings that are not present (for example the attribute type of fixed-attribute components) are stored as NoString.
+
+        \ingroup Scene_group
+    */
+    namespace BinaryScene
+    {
+        //! File magic, "NSCB" when read as bytes
+        const u32 Magic = 0x4243534e;
+        //! Current format version
+        const u32 Version = 1;
+        //! Size of the fixed header in bytes
+        const uint HeaderSize = 48;
+        //! String index meaning "no string"
+        const u32 NoString = 0xffffffff;
+    }
+
+    //! A component read from a scene file. Also used as the intermediate form when parsing XML scenes off the main thread.
+    struct BinarySceneComponent
+    {
+        QString type_name;
+        QString name;
+        Foundation::SerializedAttributeVector attributes;
+    };
+
+    //! An entity read from a scene file. Also used as the intermediate form when parsing XML scenes off the main thread.
+    struct BinarySceneEntity
+    {
+        entity_id_t id;
+        std::vector<BinarySceneComponent> components;
+    };
+
+    //! Writes a binary scene file in a streaming fashion.
+    /*! Usage: Open(), then for each entity BeginEntity(), WriteComponent() for each component and EndEntity(), and
+        finally Close(). Only one entity is kept in memory at a time, in addition to the string table.
+
+        \ingroup Scene_group
+    */
+    class BinarySceneWriter
+    {
+    public:
+        //! Constructor.
+        /*! \param filename File to write to. Will be overwritten.
+         */
+        explicit BinarySceneWriter(const QString &filename);
+
+        //! Destructor. Closes the file if still open, discarding an unfinished scene.
+        ~BinarySceneWriter();
+
+        //! Opens the file and writes a placeholder header. Returns true if successful.
+        bool Open();
+
+        //! Begins a new entity.
+        void BeginEntity(entity_id_t id);
+
+        //! Writes a component of the current entity.
+        void WriteComponent(const QString &type_name, const QString &name, const Foundation::SerializedAttributeVector &attributes);
+
+        //! Ends the current entity and writes it to the file.
+        void EndEntity();
+
+        //! Writes the string and component type tables, finalizes the header and closes the file. Returns true if successful.
+        bool Close();
+
+        //! Returns number of entities written so far
+        uint GetNumEntities() const { return num_entities_; }
+
+    private:
+        //! Returns index of a string in the string table, adding it if necessary.
+        u32 InternString(const QByteArray &str);
+
+        //! Returns index of a component type in the type table, adding it if necessary.
+        u32 InternType(const QString &type_name);
+
+        //! Output file
+        QFile file_;
+
+        //! Block of the entity currently being written
+        QByteArray entity_block_;
+
+        //! Number of components in the current entity
+        u32 entity_num_components_;
+
+        //! Strings in order of their index
+        std::vector<QByteArray> strings_;
+
+        //! String to index lookup
+        QHash<QByteArray, u32> string_indices_;
+
+        //! Component types (as string indices) in order of their index
+        std::vector<u32> types_;
+
+        //! Component type name to type index lookup
+        QHash<QString, u32> type_indices_;
+
+        //! Number of entities written
+        u32 num_entities_;
+
+        //! Write error flag
+        bool failed_;
+    };
+
+    //! Reads a binary scene file through a memory mapping.
+    /*! Entities are parsed sequentially with ReadEntity(). The file is mapped read-only; if mapping is not possible, the
+        file is read into memory instead. All offsets and indices are validated against the file size.
+
+        \ingroup Scene_group
+    */
+    class BinarySceneReader
+    {
+    public:
+        //! Constructor.
+        /*! \param filename File to read from.
+         */
+        explicit BinarySceneReader(const QString &filename);
+
+        //! Destructor. Unmaps the file.
+        ~BinarySceneReader();
+
+        //! Opens & maps the file and validates the header and tables. Returns true if successful.
+        bool Open();
+
+        //! Returns number of entities in the scene.
+        uint GetNumEntities() const { return num_entities_; }
+
+        //! Reads the next entity. Returns false when there are no more entities, or if the data is corrupt.
+        bool ReadEntity(BinarySceneEntity &entity);
+
+        //! Returns true if the data was found to be corrupt.
+        bool IsCorrupt() const { return corrupt_; }
+
+    private:
+        //! Returns string by index as raw bytes. Returns false if the index or string is invalid.
+        bool GetString(u32 index, std::string &str) const;
+
+        //! Returns string by index as unicode. Returns false if the index or string is invalid.
+        bool GetString(u32 index, QString &str) const;
+
+        //! Returns pointer to and length of a string. Returns false if invalid.
+        bool GetStringData(u32 index, const char *&data, u32 &length) const;
+
+        //! Input file
+        QFile file_;
+
+        //! Start of the mapped (or read) data
+        const uchar *data_;
+
+        //! Size of the data
+        qint64 size_;
+
+        //! Fallback buffer if mapping was not possible
+        QByteArray buffer_;
+
+        //! Number of entities
+        u32 num_entities_;
+
+        //! Number of entities read so far
+        u32 entities_read_;
+
+        //! Number of strings
+        u32 num_strings_;
+
+        //! Offset of the string offset array
+        qint64 string_table_offset_;
+
+        //! Offset of the string data
+        qint64 string_data_offset_;
+
+        //! Read position in the entity data
+        qint64 pos_;
+
+        //! Component type names, decoded once on open
+        QStringVector types_;
+
+        //! Corrupt data flag
+        bool corrupt_;
+    };
+
+    //! Parses an XML scene file (as written by SceneManager::SaveScene) into entity data. Returns true if successful.
+    /*! Does not touch any scene, so can be called from any thread.
+        \param filename File name
+        \param entities Entity data will be appended here
+        \param cancel If non-null, parsing is aborted (returning false) as soon as the pointed flag becomes true
+     */
+    bool ParseXmlScene(const QString &filename, std::vector<BinarySceneEntity> &entities, const volatile bool *cancel = 0);
+
+    //! Converts an XML scene file (as written by SceneManager::SaveScene) to the binary form. Returns true if successful.
+    bool ConvertXmlSceneToBinary(const QString &xml_filename, const QString &binary_filename);
+
+    //! Converts a binary scene file to the XML form. The XML is written in a streaming fashion. Returns true if successful.
+    bool ConvertBinarySceneToXml(const QString &binary_filename, const QString &xml_filename);
+}
+
+#endif
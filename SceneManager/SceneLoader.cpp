@@ -0,0 +1,234 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneLoader.h"
+#include "SceneManager.h"
+#include "Framework.h"
+#include "Profiler.h"
+#include "HighPerfClock.h"
+
+#include <QStringList>
+#include <QRegExp>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    //! Entity index & squared distance, for sorting
+    struct EntityDistance
+    {
+        uint index;
+        float distance;
+        bool operator < (const EntityDistance &rhs) const { return distance < rhs.distance; }
+    };
+}
+
+namespace Scene
+{
+    SceneParser::SceneParser() :
+        Foundation::ThreadTask("SceneParser"),
+        cancelled_(false)
+    {
+    }
+
+    void SceneParser::Work()
+    {
+        SceneParserResultPtr result(new SceneParserResult());
+        result->success_ = false;
+
+        SceneParserRequestPtr request = GetNextRequest<SceneParserRequest>();
+        if (request)
+        {
+            QString filename = QString::fromStdString(request->filename_);
+            BinarySceneReader reader(filename);
+            if (reader.Open())
+            {
+                result->entities_.reserve(reader.GetNumEntities());
+                BinarySceneEntity entity;
+                while (!cancelled_ && reader.ReadEntity(entity))
+                    result->entities_.push_back(entity);
+                result->success_ = !cancelled_ && !reader.IsCorrupt();
+            }
+            else
+                result->success_ = ParseXmlScene(filename, result->entities_, &cancelled_);
+        }
+
+        SetResult(result);
+    }
+
+    SceneLoader::SceneLoader(SceneManager *scene, Foundation::Framework *framework) :
+        scene_(scene),
+        framework_(framework),
+        next_entity_(0),
+        state_(Idle),
+        change_(AttributeChange::LocalOnly),
+        use_position_(false),
+        position_attribute_("Transform"),
+        time_budget_(0.005)
+    {
+        connect(framework_, SIGNAL(FrameProcessed(double)), this, SLOT(OnFrameProcessed(double)));
+    }
+
+    SceneLoader::~SceneLoader()
+    {
+        if (parser_)
+            parser_->Cancel();
+        // Parser thread tasks join their threads on destruction
+        parser_.reset();
+        cancelled_parsers_.clear();
+    }
+
+    bool SceneLoader::Start(const std::string& filename, AttributeChange::Type change, const Vector3df *position)
+    {
+        if (IsLoading())
+            Cancel();
+
+        change_ = change;
+        use_position_ = (position != 0);
+        if (position)
+            position_ = *position;
+
+        SceneParserRequestPtr request(new SceneParserRequest());
+        request->filename_ = filename;
+        parser_ = SceneParserPtr(new SceneParser());
+        parser_->AddRequest<SceneParserRequest>(request);
+
+        state_ = Parsing;
+        return true;
+    }
+
+    void SceneLoader::Cancel()
+    {
+        if (!IsLoading())
+            return;
+
+        // Do not wait for the parser, let it finish in the background
+        if (parser_)
+        {
+            parser_->Cancel();
+            cancelled_parsers_.push_back(parser_);
+            parser_.reset();
+        }
+
+        Finish(false);
+    }
+
+    void SceneLoader::OnFrameProcessed(double frametime)
+    {
+        std::list<SceneParserPtr>::iterator iter = cancelled_parsers_.begin();
+        while(iter != cancelled_parsers_.end())
+        {
+            if ((*iter)->HasFinished())
+                iter = cancelled_parsers_.erase(iter);
+            else
+                ++iter;
+        }
+
+        if (state_ == Parsing)
+        {
+            if (!parser_ || !parser_->HasFinished())
+                return;
+
+            SceneParserResultPtr result = parser_->GetResult<SceneParserResult>();
+            parser_.reset();
+            if (!result || !result->success_)
+            {
+                Finish(false);
+                return;
+            }
+
+            entities_.swap(result->entities_);
+            next_entity_ = 0;
+            if (use_position_)
+                SortByDistance();
+
+            // Purge all old entities. Send events for the removal
+            scene_->RemoveAllEntities(true, change_);
+            state_ = Creating;
+        }
+
+        if (state_ == Creating)
+        {
+            PROFILE(SceneLoader_CreateEntities);
+
+            Core::tick_t start = Core::GetCurrentClockTime();
+            Core::tick_t budget = (Core::tick_t)(time_budget_ * Core::GetCurrentClockFreq());
+            while(next_entity_ < entities_.size())
+            {
+                scene_->CreateEntityFromData(entities_[next_entity_], change_);
+                // Release the parsed data right away, it is not needed anymore
+                std::vector<BinarySceneComponent>().swap(entities_[next_entity_].components);
+                ++next_entity_;
+                if (Core::GetCurrentClockTime() - start >= budget)
+                    break;
+            }
+
+            emit Progress(next_entity_, entities_.size());
+
+            if (next_entity_ >= entities_.size())
+                Finish(true);
+        }
+    }
+
+    void SceneLoader::Finish(bool success)
+    {
+        state_ = Idle;
+        std::vector<BinarySceneEntity>().swap(entities_);
+        next_entity_ = 0;
+        emit Finished(success);
+    }
+
+    void SceneLoader::SortByDistance()
+    {
+        std::vector<EntityDistance> positioned;
+        std::vector<uint> unpositioned;
+        for(uint i = 0; i < entities_.size(); ++i)
+        {
+            Vector3df pos;
+            if (GetEntityPosition(entities_[i], pos))
+            {
+                EntityDistance dist;
+                dist.index = i;
+                dist.distance = (pos - position_).getLengthSQ();
+                positioned.push_back(dist);
+            }
+            else
+                unpositioned.push_back(i);
+        }
+
+        std::stable_sort(positioned.begin(), positioned.end());
+
+        std::vector<BinarySceneEntity> sorted(entities_.size());
+        uint n = 0;
+        for(uint i = 0; i < positioned.size(); ++i)
+            std::swap(sorted[n++], entities_[positioned[i].index]);
+        for(uint i = 0; i < unpositioned.size(); ++i)
+            std::swap(sorted[n++], entities_[unpositioned[i]]);
+        entities_.swap(sorted);
+    }
+
+    bool SceneLoader::GetEntityPosition(const BinarySceneEntity &entity, Vector3df &position) const
+    {
+        for(uint i = 0; i < entity.components.size(); ++i)
+        {
+            const Foundation::SerializedAttributeVector &attributes = entity.components[i].attributes;
+            for(uint j = 0; j < attributes.size(); ++j)
+            {
+                if (attributes[j].name != position_attribute_)
+                    continue;
+
+                QStringList values = QString::fromStdString(attributes[j].value).split(QRegExp("[, ]"), QString::SkipEmptyParts);
+                if (values.size() < 3)
+                    continue;
+                position.x = ParseString<float>(values[0].toStdString(), 0.0f);
+                position.y = ParseString<float>(values[1].toStdString(), 0.0f);
+                position.z = ParseString<float>(values[2].toStdString(), 0.0f);
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
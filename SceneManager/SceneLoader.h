@@ -0,0 +1,166 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_SceneManager_SceneLoader_h
+#define incl_SceneManager_SceneLoader_h
+
+#include "ForwardDefines.h"
+#include "ThreadTask.h"
+#include "AttributeChangeType.h"
+#include "SceneBinaryFormat.h"
+#include "Vector3D.h"
+
+#include <QObject>
+
+namespace Scene
+{
+    class SceneManager;
+
+    //! Request for parsing a scene file
+    class SceneParserRequest : public Foundation::ThreadTaskRequest
+    {
+    public:
+        //! Scene file, XML or binary
+        std::string filename_;
+    };
+
+    //! Result of parsing a scene file
+    class SceneParserResult : public Foundation::ThreadTaskResult
+    {
+    public:
+        //! Success flag
+        bool success_;
+        //! Parsed entities, in file order
+        std::vector<BinarySceneEntity> entities_;
+    };
+
+    typedef boost::shared_ptr<SceneParserRequest> SceneParserRequestPtr;
+    typedef boost::shared_ptr<SceneParserResult> SceneParserResultPtr;
+
+    //! Threadtask that parses a scene file (XML or binary) into entity data, without touching any scene.
+    class SceneParser : public Foundation::ThreadTask
+    {
+    public:
+        SceneParser();
+
+        virtual void Work();
+
+        //! Asks the parser to abandon its work as soon as possible. Does not block.
+        void Cancel() { cancelled_ = true; }
+
+    private:
+        //! Cancel flag, polled by the work thread between entities
+        volatile bool cancelled_;
+    };
+
+    typedef boost::shared_ptr<SceneParser> SceneParserPtr;
+
+    //! Loads a scene asynchronously, see SceneManager::LoadSceneAsync.
+    /*! The scene file is parsed in a SceneParser thread task. Once parsing has finished, the old entities are removed
+        and new ones are created on the main thread, after each processed frame, until the per-frame time budget is used.
+        If a priority position is given, entities are created in order of distance from it. The position of an entity
+        is read from its first attribute with the position attribute name (by default "Transform"), in either the
+        transform ("x,y,z,...") or vector ("x y z") string form. Entities without such an attribute are created last.
+
+        \ingroup Scene_group
+    */
+    class SceneLoader : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        //! Constructor.
+        /*! \param scene Scene to load into
+            \param framework Framework, for per-frame updates
+         */
+        SceneLoader(SceneManager *scene, Foundation::Framework *framework);
+
+        //! Destructor. Cancels a load in progress.
+        ~SceneLoader();
+
+        //! Starts loading. Cancels a load already in progress.
+        /*! \param filename Scene file, XML or binary
+            \param change Changetype that will be used, when removing the old scene, and deserializing the new
+            \param position Position to prioritize around, or null to create entities in file order
+            \return true if started
+         */
+        bool Start(const std::string& filename, AttributeChange::Type change, const Vector3df *position = 0);
+
+        //! Cancels the load in progress. Entities already created stay in the scene.
+        void Cancel();
+
+        //! Returns true if a load is in progress
+        bool IsLoading() const { return state_ != Idle; }
+
+        //! Sets time spent creating entities per frame, in seconds. Default 0.005.
+        void SetTimeBudget(double seconds) { time_budget_ = seconds; }
+
+        //! Sets attribute name used to find the position of an entity when prioritizing by position.
+        void SetPositionAttributeName(const std::string &name) { position_attribute_ = name; }
+
+    signals:
+        //! Emitted after each frame's chunk of entities has been created
+        void Progress(int created, int total);
+
+        //! Emitted when the load has finished, failed or been cancelled
+        void Finished(bool success);
+
+    private slots:
+        //! Polls the parser, and creates entities within the time budget
+        void OnFrameProcessed(double frametime);
+
+    private:
+        enum State
+        {
+            Idle,
+            Parsing,
+            Creating
+        };
+
+        //! Orders parsed entities by distance from the priority position
+        void SortByDistance();
+
+        //! Reads position of an entity from its attributes. Returns false if not found.
+        bool GetEntityPosition(const BinarySceneEntity &entity, Vector3df &position) const;
+
+        //! Ends the load and emits Finished
+        void Finish(bool success);
+
+        //! Scene to load into
+        SceneManager *scene_;
+
+        //! Framework
+        Foundation::Framework *framework_;
+
+        //! Parser task of the current load
+        SceneParserPtr parser_;
+
+        //! Parser tasks of cancelled loads that are still running. Released once finished.
+        std::list<SceneParserPtr> cancelled_parsers_;
+
+        //! Parsed entities
+        std::vector<BinarySceneEntity> entities_;
+
+        //! Index of the next entity to create
+        uint next_entity_;
+
+        //! Load state
+        State state_;
+
+        //! Change type of the load
+        AttributeChange::Type change_;
+
+        //! Whether to prioritize by position
+        bool use_position_;
+
+        //! Priority position
+        Vector3df position_;
+
+        //! Position attribute name
+        std::string position_attribute_;
+
+        //! Time budget per frame in seconds
+        double time_budget_;
+    };
+}
+
+#endif
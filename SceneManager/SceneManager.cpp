@@ -6,23 +6,41 @@
 #include "SceneManager.h"
 #include "Entity.h"
 #include "SceneEvents.h"
+#include "SceneBinaryFormat.h"
+#include "SceneLoader.h"
 #include "Framework.h"
 #include "ComponentManager.h"
 #include "EventManager.h"
+#include "Profiler.h"
 #include "ComponentInterface.h"
 #include "ForwardDefines.h"
 
 #include <QDomDocument>
 #include <QFile>
 
+#include <algorithm>
+
 #include "MemoryLeakCheck.h"
 
 namespace Scene
 {
     uint SceneManager::gid_ = 0;
 
+    SceneManager::SceneManager(const std::string &name, Foundation::Framework *framework) :
+        name_(name),
+        framework_(framework),
+        loader_(0),
+        track_changes_(false),
+        snapshots_enabled_(false),
+        snapshot_version_(0),
+        snapshot_entities_dirty_(false)
+    {
+    }
+    
     SceneManager::~SceneManager()
     {
+        // Stop a possible background load first, it would otherwise keep creating entities
+        SAFE_DELETE(loader_);
         RemoveAllEntities(false);
     }
     
@@ -48,6 +66,7 @@ namespace Scene
             entity->AddComponent(framework_->GetComponentManager()->CreateComponent(components[i])); //change the param to a qstringlist or so \todo XXX
 
         entities_[entity->GetId()] = entity;
+        snapshot_entities_dirty_ = true;
 
         // Send event.
         Events::SceneEventData event_data(entity->GetId());
@@ -83,12 +102,20 @@ namespace Scene
             
             EmitEntityRemoved(del_entity.get(), change);
             
+            if (!pending_components_.empty())
+            {
+                const Scene::Entity::ComponentVector &components = del_entity->GetComponentVector();
+                for(uint i = 0; i < components.size(); ++i)
+                    DropPendingChanges(components[i].get());
+            }
+            
             // Send event.
             Events::SceneEventData event_data(id);
             event_category_id_t cat_id = framework_->GetEventManager()->QueryEventCategory("Scene");
             framework_->GetEventManager()->SendEvent(cat_id, Events::EVENT_ENTITY_DELETED, &event_data);
             
             entities_.erase(it);
+            snapshot_entities_dirty_ = true;
             // If entity somehow manages to live, at least it doesn't belong to the scene anymore
             del_entity->SetScene(0);
             del_entity.reset();
@@ -114,6 +141,9 @@ namespace Scene
             ++it;
         }
         entities_.clear();
+        snapshot_entities_dirty_ = true;
+        pending_changes_.clear();
+        pending_components_.clear();
     }
     
     EntityList SceneManager::GetEntitiesWithComponent(const QString &type_name)
@@ -133,23 +163,212 @@ namespace Scene
     
     void SceneManager::EmitComponentChanged(Foundation::ComponentInterface* comp, AttributeChange::Type change)
     {
+        if (track_changes_)
+            RecordChange(comp, 0, change);
+        SnapshotEntityChanged(comp->GetParentEntity());
         emit ComponentChanged(comp, change);
     }
     
     void SceneManager::EmitComponentAdded(Scene::Entity* entity, Foundation::ComponentInterface* comp, AttributeChange::Type change)
     {
+        SnapshotEntityChanged(entity);
         emit ComponentAdded(entity, comp, change);
     }
     
     void SceneManager::EmitComponentRemoved(Scene::Entity* entity, Foundation::ComponentInterface* comp, AttributeChange::Type change)
     {
+        DropPendingChanges(comp);
+        SnapshotEntityChanged(entity);
         emit ComponentRemoved(entity, comp, change);
     }
 
     void SceneManager::EmitAttributeChanged(Foundation::ComponentInterface* comp, AttributeInterface* attribute, AttributeChange::Type change)
     {
+        if (track_changes_)
+            RecordChange(comp, attribute, change);
+        SnapshotEntityChanged(comp->GetParentEntity());
         emit AttributeChanged(comp, attribute, change);
     }
+    
+    void SceneManager::RecordChange(Foundation::ComponentInterface* comp, AttributeInterface* attribute, AttributeChange::Type change)
+    {
+        Scene::Entity* entity = comp->GetParentEntity();
+        if (!entity)
+            return;
+        
+        int attribute_index = -1;
+        if (attribute)
+        {
+            const AttributeVector &attributes = comp->GetAttributes();
+            AttributeVector::const_iterator iter = std::find(attributes.begin(), attributes.end(), attribute);
+            if (iter == attributes.end())
+                return;
+            attribute_index = iter - attributes.begin();
+        }
+        
+        std::vector<uint> &indices = pending_components_[comp];
+        for(uint i = 0; i < indices.size(); ++i)
+        {
+            const PendingChange &pending = pending_changes_[indices[i]];
+            if (pending.attribute_index_ == attribute_index && pending.change_.change == change)
+                return;
+        }
+        
+        PendingChange new_change;
+        new_change.change_.entity = entity->GetId();
+        new_change.change_.component = comp;
+        new_change.change_.attribute = attribute;
+        new_change.change_.change = change;
+        new_change.attribute_index_ = attribute_index;
+        indices.push_back(pending_changes_.size());
+        pending_changes_.push_back(new_change);
+    }
+    
+    void SceneManager::DropPendingChanges(Foundation::ComponentInterface* comp)
+    {
+        PendingComponentMap::iterator iter = pending_components_.find(comp);
+        if (iter == pending_components_.end())
+            return;
+        
+        for(uint i = 0; i < iter->second.size(); ++i)
+            pending_changes_[iter->second[i]].change_.component = 0;
+        pending_components_.erase(iter);
+    }
+    
+    void SceneManager::PublishChanges()
+    {
+        if (snapshots_enabled_)
+            PublishSnapshot();
+        
+        if (pending_changes_.empty())
+            return;
+        
+        std::vector<PendingChange> pending;
+        pending.swap(pending_changes_);
+        pending_components_.clear();
+        
+        // Drop changes of components removed during the frame, and of attributes removed from dynamic components
+        SceneChangeSet changes;
+        changes.reserve(pending.size());
+        for(uint i = 0; i < pending.size(); ++i)
+        {
+            const SceneChange &change = pending[i].change_;
+            if (!change.component)
+                continue;
+            if (change.attribute)
+            {
+                const AttributeVector &attributes = change.component->GetAttributes();
+                uint index = pending[i].attribute_index_;
+                if (index >= attributes.size() || attributes[index] != change.attribute)
+                    continue;
+            }
+            changes.push_back(change);
+        }
+        
+        if (!changes.empty())
+            emit ChangesPublished(changes);
+    }
+    
+    void SceneManager::SetSnapshotsEnabled(bool enabled)
+    {
+        snapshots_enabled_ = enabled;
+        snapshot_dirty_entities_.clear();
+        snapshot_entities_dirty_ = true;
+        
+        MutexLock lock(snapshot_mutex_);
+        snapshot_.reset();
+    }
+    
+    SceneSnapshotPtr SceneManager::GetSnapshot() const
+    {
+        MutexLock lock(snapshot_mutex_);
+        return snapshot_;
+    }
+    
+    void SceneManager::PublishSnapshot()
+    {
+        if (snapshot_ && !snapshot_entities_dirty_ && snapshot_dirty_entities_.empty())
+            return;
+        
+        PROFILE(Scene_PublishSnapshot);
+        
+        // Both maps are ordered by entity id, so walk them in parallel and reuse the snapshots of unchanged entities
+        SceneSnapshot::EntitySnapshotMap entities;
+        SceneSnapshot::EntitySnapshotMap::const_iterator prev;
+        SceneSnapshot::EntitySnapshotMap::const_iterator prev_end;
+        if (snapshot_)
+        {
+            prev = snapshot_->GetEntities().begin();
+            prev_end = snapshot_->GetEntities().end();
+        }
+        
+        for(EntityMap::const_iterator it = entities_.begin(); it != entities_.end(); ++it)
+        {
+            EntitySnapshotPtr entity_snapshot;
+            if (snapshot_)
+            {
+                while(prev != prev_end && prev->first < it->first)
+                    ++prev;
+                if (prev != prev_end && prev->first == it->first && snapshot_dirty_entities_.find(it->first) == snapshot_dirty_entities_.end())
+                    entity_snapshot = prev->second;
+            }
+            if (!entity_snapshot)
+                entity_snapshot = CreateEntitySnapshot(it->second.get());
+            entities.insert(entities.end(), std::make_pair(it->first, entity_snapshot));
+        }
+        
+        SceneSnapshotPtr new_snapshot(new SceneSnapshot(snapshot_version_++, entities));
+        snapshot_dirty_entities_.clear();
+        snapshot_entities_dirty_ = false;
+        
+        MutexLock lock(snapshot_mutex_);
+        snapshot_ = new_snapshot;
+    }
+    
+    EntitySnapshotPtr SceneManager::CreateEntitySnapshot(const Scene::Entity* entity) const
+    {
+        boost::shared_ptr<BinarySceneEntity> entity_snapshot(new BinarySceneEntity());
+        entity_snapshot->id = entity->GetId();
+        
+        const Scene::Entity::ComponentVector &components = entity->GetComponentVector();
+        entity_snapshot->components.resize(components.size());
+        for(uint i = 0; i < components.size(); ++i)
+        {
+            BinarySceneComponent &comp_snapshot = entity_snapshot->components[i];
+            comp_snapshot.type_name = components[i]->TypeName();
+            comp_snapshot.name = components[i]->Name();
+            if (components[i]->IsSerializable())
+                components[i]->SerializeToAttributes(comp_snapshot.attributes);
+            else
+            {
+                // SerializeToAttributes skips non-serializable components, but the snapshot wants their attributes too
+                const AttributeVector &attributes = components[i]->GetAttributes();
+                comp_snapshot.attributes.resize(attributes.size());
+                for(uint j = 0; j < attributes.size(); ++j)
+                {
+                    comp_snapshot.attributes[j].name = attributes[j]->GetNameString();
+                    comp_snapshot.attributes[j].value = attributes[j]->ToString();
+                }
+            }
+        }
+        
+        return entity_snapshot;
+    }
+    
+    void SceneManager::connectNotify(const char *signal)
+    {
+        track_changes_ = receivers(SIGNAL(ChangesPublished(const Scene::SceneChangeSet &))) > 0;
+    }
+    
+    void SceneManager::disconnectNotify(const char *signal)
+    {
+        track_changes_ = receivers(SIGNAL(ChangesPublished(const Scene::SceneChangeSet &))) > 0;
+        if (!track_changes_)
+        {
+            pending_changes_.clear();
+            pending_components_.clear();
+        }
+    }
 
   /*void SceneManager::EmitComponentInitialized(Foundation::ComponentInterface* comp)
     {
@@ -282,5 +501,106 @@ namespace Scene
         }
         else return false;
     }
+    
+    bool SceneManager::LoadSceneBinary(const std::string& filename, AttributeChange::Type change)
+    {
+        BinarySceneReader reader(filename.c_str());
+        if (!reader.Open())
+            return false;
+        
+        // Purge all old entities. Send events for the removal
+        RemoveAllEntities(true, change);
+        
+        BinarySceneEntity ent_data;
+        while (reader.ReadEntity(ent_data))
+            CreateEntityFromData(ent_data, change);
+        
+        return !reader.IsCorrupt();
+    }
+    
+    EntityPtr SceneManager::CreateEntityFromData(const BinarySceneEntity &data, AttributeChange::Type change)
+    {
+        EntityPtr entity = CreateEntity(data.id, QStringList());
+        if (!entity)
+            return entity;
+        
+        for(uint i = 0; i < data.components.size(); ++i)
+        {
+            const BinarySceneComponent &comp_data = data.components[i];
+            Foundation::ComponentPtr new_comp = entity->GetOrCreateComponent(comp_data.type_name, comp_data.name);
+            if (new_comp)
+                new_comp->DeserializeFromAttributes(comp_data.name, comp_data.attributes, change);
+        }
+        EmitEntityCreated(entity, change);
+        // Same as in LoadScene, call OnChanged to the components only after all components have been loaded
+        const Scene::Entity::ComponentVector &components = entity->GetComponentVector();
+        for(uint i = 0; i < components.size(); ++i)
+            components[i]->ComponentChanged(change);
+        
+        return entity;
+    }
+    
+    bool SceneManager::LoadSceneAsync(const std::string& filename, AttributeChange::Type change)
+    {
+        return StartSceneLoader(filename, change, 0);
+    }
+    
+    bool SceneManager::LoadSceneAsync(const std::string& filename, AttributeChange::Type change, const Vector3df &position)
+    {
+        return StartSceneLoader(filename, change, &position);
+    }
+    
+    bool SceneManager::StartSceneLoader(const std::string& filename, AttributeChange::Type change, const Vector3df *position)
+    {
+        if (!loader_)
+        {
+            loader_ = new SceneLoader(this, framework_);
+            connect(loader_, SIGNAL(Progress(int, int)), this, SIGNAL(SceneLoadProgress(int, int)));
+            connect(loader_, SIGNAL(Finished(bool)), this, SIGNAL(SceneLoadFinished(bool)));
+        }
+        return loader_->Start(filename, change, position);
+    }
+    
+    void SceneManager::CancelSceneLoad()
+    {
+        if (loader_)
+            loader_->Cancel();
+    }
+    
+    bool SceneManager::IsLoadingScene() const
+    {
+        return loader_ && loader_->IsLoading();
+    }
+    
+    bool SceneManager::SaveSceneBinary(const std::string& filename)
+    {
+        BinarySceneWriter writer(filename.c_str());
+        if (!writer.Open())
+            return false;
+        
+        Foundation::SerializedAttributeVector attributes;
+        EntityMap::iterator it = entities_.begin();
+        while(it != entities_.end())
+        {
+            Scene::Entity *entity = it->second.get();
+            if (entity)
+            {
+                writer.BeginEntity(entity->GetId());
+                const Scene::Entity::ComponentVector &components = entity->GetComponentVector();
+                for(uint i = 0; i < components.size(); ++i)
+                {
+                    if (components[i]->IsSerializable())
+                    {
+                        attributes.clear();
+                        components[i]->SerializeToAttributes(attributes);
+                        writer.WriteComponent(components[i]->TypeName(), components[i]->Name(), attributes);
+                    }
+                }
+                writer.EndEntity();
+            }
+            ++it;
+        }
+        
+        return writer.Close();
+    }
 }
-
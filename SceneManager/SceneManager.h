@@ -8,16 +8,40 @@
 #include "CoreAnyIterator.h"
 #include "Entity.h"
 #include "ComponentInterface.h"
+#include "Vector3D.h"
+#include "CoreThread.h"
+#include "SceneSnapshot.h"
 
 #include <QObject>
 #include <QVariant>
 #include <QStringList>
 
+#include <boost/unordered_map.hpp>
+#include <set>
+
 namespace Scene
 {
+    class SceneLoader;
+
     typedef std::list<EntityPtr> EntityList;
     typedef std::list<EntityPtr>::iterator EntityListIterator;
 
+    //! One change recorded during a frame, see SceneManager::ChangesPublished.
+    struct SceneChange
+    {
+        //! Id of the entity the component belongs to
+        entity_id_t entity;
+        //! Changed component
+        Foundation::ComponentInterface *component;
+        //! Changed attribute, or null if the change was signalled for the whole component (ComponentChanged)
+        AttributeInterface *attribute;
+        //! Type of change
+        AttributeChange::Type change;
+    };
+
+    //! Changes of one frame, in order of their first occurrence. Each (component, attribute, change type) appears once.
+    typedef std::vector<SceneChange> SceneChangeSet;
+
     //! Acts as a generic scenegraph for all entities in the world.
     /*! Contains all entities in the world in a generic fashion.
         Acts as a factory for all entities.
@@ -36,10 +60,11 @@ namespace Scene
         SceneManager();
 
         //! constructor that takes a name and parent module
-        SceneManager(const std::string &name, Foundation::Framework *framework) :  name_(name), framework_(framework) {}
+        SceneManager(const std::string &name, Foundation::Framework *framework);
 
         //! copy constructor that also takes a name
-        SceneManager(const SceneManager &other, const std::string &name ) : framework_(other.framework_), entities_(other.entities_) { }
+        SceneManager(const SceneManager &other, const std::string &name ) : framework_(other.framework_), entities_(other.entities_), loader_(0), track_changes_(false),
+            snapshots_enabled_(false), snapshot_version_(0), snapshot_entities_dirty_(false) { }
 
         //! copy constuctor
         SceneManager(const SceneManager &other);
@@ -111,6 +136,28 @@ namespace Scene
         */
         void RemoveEntity(entity_id_t id, AttributeChange::Type change = AttributeChange::LocalOnly);
 
+        //! Publish the changes recorded during this frame as one ChangesPublished signal, and clear them.
+        /*! Called by the framework once per frame, after modules have been updated and delayed events processed.
+            Changes to components or attributes that no longer exist are dropped. If snapshots are enabled, also
+            publishes a new snapshot if the scene has changed.
+         */
+        void PublishChanges();
+
+        //! Enable or disable publishing of read-only scene snapshots. Disabled by default.
+        /*! When enabled, a new SceneSnapshot is published once per frame if the scene has changed, and can be
+            retrieved from any thread with GetSnapshot().
+         */
+        void SetSnapshotsEnabled(bool enabled);
+
+        //! Returns true if snapshots are being published
+        bool GetSnapshotsEnabled() const { return snapshots_enabled_; }
+
+        //! Returns the latest published snapshot, or null if snapshots are not enabled. Can be called from any thread.
+        SceneSnapshotPtr GetSnapshot() const;
+
+        //! Returns true if changes are being recorded, ie. something is connected to ChangesPublished
+        bool IsTrackingChanges() const { return track_changes_; }
+
         //! Remove all entities
         /*! The entities may not get deleted if dangling references to a pointer to them exist.
             \param send_events whether to send events & signals of each delete
@@ -199,10 +246,79 @@ namespace Scene
             \return true if successful
          */
         bool SaveScene(const std::string& filename);
+
+        //! Load the scene from a binary scene file (see BinarySceneReader). Only serializable components.
+        /*! The file is memory mapped and parsed without building a DOM.
+            Note: will remove all existing entities
+            \param filename File name
+            \param change Changetype that will be used, when removing the old scene, and deserializing the new
+            
+            \return true if successful
+         */
+        bool LoadSceneBinary(const std::string& filename, AttributeChange::Type change);
+
+        //! Save the scene into a binary scene file (see BinarySceneWriter). Only serializable components.
+        /*! Entities are streamed into the file one at a time.
+            \param filename File name
+            \return true if successful
+         */
+        bool SaveSceneBinary(const std::string& filename);
+
+        //! Start loading the scene asynchronously from an XML or binary scene file.
+        /*! The file is parsed in a worker thread, after which the entities are created on the main thread a few at a
+            time, within a per-frame time budget (see SceneLoader). SceneLoadProgress is emitted after each frame's
+            chunk and SceneLoadFinished once done. A load already in progress is cancelled.
+            Note: will remove all existing entities once parsing has succeeded
+            \param filename File name
+            \param change Changetype that will be used, when removing the old scene, and deserializing the new
+            
+            \return true if the load was started
+         */
+        bool LoadSceneAsync(const std::string& filename, AttributeChange::Type change);
+
+        //! Start loading the scene asynchronously, creating entities nearest to a position (for example the camera) first.
+        /*! \param filename File name
+            \param change Changetype that will be used, when removing the old scene, and deserializing the new
+            \param position Position to prioritize around
+            
+            \return true if the load was started
+         */
+        bool LoadSceneAsync(const std::string& filename, AttributeChange::Type change, const Vector3df &position);
+
+        //! Cancel an asynchronous scene load. Entities that were already created are left in the scene.
+        void CancelSceneLoad();
+
+        //! Returns true if an asynchronous scene load is in progress
+        bool IsLoadingScene() const;
+
+        //! Create an entity and its components from parsed scene data, as LoadScene does for each entity.
+        /*! \param data Entity data
+            \param change Changetype that will be used for deserializing
+            \return The new entity, or null if the id was already in use
+         */
+        EntityPtr CreateEntityFromData(const BinarySceneEntity &data, AttributeChange::Type change);
         
     private:
         SceneManager &operator =(const SceneManager &other);
 
+        //! Records a change for the next ChangesPublished, unless the same change is already pending
+        void RecordChange(Foundation::ComponentInterface* comp, AttributeInterface* attribute, AttributeChange::Type change);
+
+        //! Drops the pending changes of a component that is being removed, so that its pointer is not published
+        void DropPendingChanges(Foundation::ComponentInterface* comp);
+
+        //! Publishes a new snapshot, re-serializing only the entities that have changed since the previous one
+        void PublishSnapshot();
+
+        //! Creates snapshot of an entity
+        EntitySnapshotPtr CreateEntitySnapshot(const Scene::Entity* entity) const;
+
+        //! Marks an entity changed for the next snapshot
+        void SnapshotEntityChanged(Scene::Entity* entity) { if (snapshots_enabled_ && entity) snapshot_dirty_entities_.insert(entity->GetId()); }
+
+        //! Creates the scene loader if necessary and starts an asynchronous load
+        bool StartSceneLoader(const std::string& filename, AttributeChange::Type change, const Vector3df *position);
+
         //! Entities in a map
         EntityMap entities_;
 
@@ -212,12 +328,68 @@ namespace Scene
         //! Name of the scene
         const std::string name_;
 
+        //! Asynchronous scene loader, created on first use
+        SceneLoader *loader_;
+
+        //! Change recorded during the frame
+        struct PendingChange
+        {
+            //! The change. The component is null if it has been removed during the frame.
+            SceneChange change_;
+            //! Index of the attribute in the component, or -1 for a change of the whole component. Attributes of
+            //! dynamic components can be removed at any time, so the attribute is checked against it when published.
+            int attribute_index_;
+        };
+
+        //! Changes recorded during this frame
+        std::vector<PendingChange> pending_changes_;
+
+        //! Indices of the pending changes of each component, for de-duplication and for dropping them on removal.
+        //! Components are removed through the scene, so a recorded component stays valid until its changes are dropped.
+        typedef boost::unordered_map<Foundation::ComponentInterface*, std::vector<uint> > PendingComponentMap;
+        PendingComponentMap pending_components_;
+
+        //! Whether to record changes, true while ChangesPublished has receivers
+        bool track_changes_;
+
+        //! Whether to publish snapshots
+        bool snapshots_enabled_;
+
+        //! Latest published snapshot
+        SceneSnapshotPtr snapshot_;
+
+        //! Guards snapshot_ for readers in other threads
+        mutable Mutex snapshot_mutex_;
+
+        //! Version number of the next snapshot
+        uint snapshot_version_;
+
+        //! Entities whose components or attributes changed since the latest snapshot
+        std::set<entity_id_t> snapshot_dirty_entities_;
+
+        //! Whether entities were added or removed since the latest snapshot
+        bool snapshot_entities_dirty_;
+
+    protected:
+        //! QObject override. Starts tracking changes when something connects to ChangesPublished.
+        void connectNotify(const char *signal);
+
+        //! QObject override. Stops tracking changes when nothing is connected to ChangesPublished anymore.
+        void disconnectNotify(const char *signal);
+
     signals:
         //! Signal when a component is changed and should possibly be replicated (if the change originates from local)
         /*! Network synchronization managers should connect to this
          */
         void ComponentChanged(Foundation::ComponentInterface* comp, AttributeChange::Type change);
 
+        //! Signal with all component and attribute changes of the frame, de-duplicated. Emitted once per frame, if there were changes.
+        /*! Prefer this to ComponentChanged and AttributeChanged unless you need to react immediately: listeners get
+            one call per frame instead of one per change, and see each changed attribute only once.
+            Changes are recorded only while something is connected to this signal.
+         */
+        void ChangesPublished(const Scene::SceneChangeSet &changes);
+
         //! Signal when an attribute of a component has changed
         void AttributeChanged(Foundation::ComponentInterface* comp, AttributeInterface* attribute, AttributeChange::Type change);
 
@@ -245,6 +417,17 @@ namespace Scene
         /*! Note: currently there is also Naali scene event that duplicates this notification
          */
         void EntityRemoved(Scene::Entity* entity, AttributeChange::Type change);
+
+        //! Signal of asynchronous scene load progress
+        /*! \param created Number of entities created so far
+            \param total Total number of entities in the scene file
+         */
+        void SceneLoadProgress(int created, int total);
+
+        //! Signal when an asynchronous scene load has finished, failed or been cancelled
+        /*! \param success True if all entities were loaded
+         */
+        void SceneLoadFinished(bool success);
     };
 }
 
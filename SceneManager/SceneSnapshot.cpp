@@ -0,0 +1,61 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "SceneSnapshot.h"
+
+#include "MemoryLeakCheck.h"
+
+namespace Scene
+{
+    EntitySnapshotPtr SceneSnapshot::GetEntity(entity_id_t id) const
+    {
+        EntitySnapshotMap::const_iterator it = entities_.find(id);
+        if (it != entities_.end())
+            return it->second;
+
+        return EntitySnapshotPtr();
+    }
+
+    std::vector<entity_id_t> SceneSnapshot::GetEntityIdsWithComponent(const QString &type_name) const
+    {
+        std::vector<entity_id_t> ids;
+        for(EntitySnapshotMap::const_iterator it = entities_.begin(); it != entities_.end(); ++it)
+        {
+            const std::vector<BinarySceneComponent> &components = it->second->components;
+            for(uint i = 0; i < components.size(); ++i)
+            {
+                if (components[i].type_name == type_name)
+                {
+                    ids.push_back(it->first);
+                    break;
+                }
+            }
+        }
+
+        return ids;
+    }
+
+    bool SceneSnapshot::SaveBinary(const QString &filename, const std::set<QString> &serializable_types) const
+    {
+        BinarySceneWriter writer(filename);
+        if (!writer.Open())
+            return false;
+
+        for(EntitySnapshotMap::const_iterator it = entities_.begin(); it != entities_.end(); ++it)
+        {
+            writer.BeginEntity(it->first);
+            const std::vector<BinarySceneComponent> &components = it->second->components;
+            for(uint i = 0; i < components.size(); ++i)
+            {
+                const BinarySceneComponent &comp = components[i];
+                if (serializable_types.empty() || serializable_types.find(comp.type_name) != serializable_types.end())
+                    writer.WriteComponent(comp.type_name, comp.name, comp.attributes);
+            }
+            writer.EndEntity();
+        }
+
+        return writer.Close();
+    }
+}
@@ -0,0 +1,75 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_SceneManager_SceneSnapshot_h
+#define incl_SceneManager_SceneSnapshot_h
+
+#include "CoreTypes.h"
+#include "SceneBinaryFormat.h"
+
+#include <map>
+#include <set>
+
+namespace Scene
+{
+    //! Immutable snapshot of one entity: its id, and type, name and attribute values of each component.
+    typedef boost::shared_ptr<const BinarySceneEntity> EntitySnapshotPtr;
+
+    //! Immutable, versioned view of a scene that can be read from any thread.
+    /*! Published by SceneManager once per frame when snapshots are enabled, see SceneManager::SetSnapshotsEnabled.
+        A snapshot is never modified after it has been published, so worker threads can keep reading an old snapshot
+        while the main thread keeps mutating the live scene. Entities that did not change between frames share their
+        entity snapshot with the previous version (copy-on-write), so publishing costs a map copy plus the
+        serialization of the changed entities only.
+
+        Attribute values are stored in their string form, as used for serialization. All components are included,
+        also those that are not serializable to scene files.
+
+        \ingroup Scene_group
+    */
+    class SceneSnapshot
+    {
+    public:
+        //! Entity snapshots by id
+        typedef std::map<entity_id_t, EntitySnapshotPtr> EntitySnapshotMap;
+
+        //! Constructor.
+        /*! \param version Version number
+            \param entities Entity snapshots
+         */
+        SceneSnapshot(uint version, const EntitySnapshotMap &entities) : version_(version), entities_(entities) {}
+
+        //! Returns version number. Increases by one for each published snapshot of a scene.
+        uint GetVersion() const { return version_; }
+
+        //! Returns all entity snapshots.
+        const EntitySnapshotMap &GetEntities() const { return entities_; }
+
+        //! Returns snapshot of an entity, or null if no such entity.
+        EntitySnapshotPtr GetEntity(entity_id_t id) const;
+
+        //! Returns true if entity exists in the snapshot.
+        bool HasEntity(entity_id_t id) const { return entities_.find(id) != entities_.end(); }
+
+        //! Returns ids of entities with a specific component type.
+        std::vector<entity_id_t> GetEntityIdsWithComponent(const QString &type_name) const;
+
+        //! Writes the snapshot into a binary scene file. Can be called from any thread.
+        /*! \param filename File name
+            \param serializable_types If non-empty, only component types in this set are written, like SceneManager::SaveScene
+                   writes only serializable components
+            \return true if successful
+         */
+        bool SaveBinary(const QString &filename, const std::set<QString> &serializable_types = std::set<QString>()) const;
+
+    private:
+        //! Version number
+        const uint version_;
+
+        //! Entity snapshots
+        const EntitySnapshotMap entities_;
+    };
+
+    typedef boost::shared_ptr<const SceneSnapshot> SceneSnapshotPtr;
+}
+
+#endif
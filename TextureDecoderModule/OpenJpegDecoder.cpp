@@ -38,9 +38,13 @@
 #include "CoreDefines.h"
 #include "TextureResource.h"
 #include "TextureDecoderModule.h"
-#include "ThreadTaskManager.h"
 #include "OpenJpegDecoder.h"
 #include "Profiler.h"
+#include "HighPerfClock.h"
+#include "PixelConversion.h"
+#include "BlockCompression.h"
+
+#include <boost/bind.hpp>
 
 #include <openjpeg.h>
 
@@ -48,49 +52,144 @@
 
 namespace TextureDecoder
 {
-    OpenJpegDecoder::OpenJpegDecoder() :
-        Foundation::ThreadTask("TextureDecoder"),
-        decodes_per_frame_(1)
+    OpenJpegDecoder::OpenJpegDecoder(uint num_threads, uint max_results, bool compress) :
+        active_(0),
+        max_results_(std::max(max_results, 1u)),
+        compress_(compress),
+        next_sequence_(0),
+        keep_running_(true)
     {
+        for(uint i = 0; i < std::max(num_threads, 1u); ++i)
+            threads_.create_thread(boost::bind(&OpenJpegDecoder::Work, this));
     }
-    
-    void OpenJpegDecoder::SetDecodesPerFrame(uint decodes) 
-    { 
-        if (decodes)
-            decodes_per_frame_ = decodes;
+
+    OpenJpegDecoder::~OpenJpegDecoder()
+    {
+        {
+            MutexLock lock(mutex_);
+            keep_running_ = false;
+            queue_.clear();
+            queued_.clear();
+        }
+        condition_.notify_all();
+        threads_.join_all();
     }
-    
+
+    void OpenJpegDecoder::AddRequest(DecodeRequestPtr request, f32 priority)
+    {
+        if (!request)
+            return;
+
+        {
+            MutexLock lock(mutex_);
+            std::map<std::string, QueueKey>::iterator i = queued_.find(request->id_);
+            if (i != queued_.end())
+                queue_.erase(i->second);
+
+            QueueKey key;
+            key.priority_ = priority;
+            key.sequence_ = next_sequence_++;
+            queue_[key] = request;
+            queued_[request->id_] = key;
+        }
+
+        condition_.notify_one();
+    }
+
+    bool OpenJpegDecoder::ReplaceRequest(DecodeRequestPtr request)
+    {
+        if (!request)
+            return false;
+
+        MutexLock lock(mutex_);
+        std::map<std::string, QueueKey>::iterator i = queued_.find(request->id_);
+        if (i == queued_.end())
+            return false;
+
+        queue_[i->second] = request;
+        return true;
+    }
+
+    void OpenJpegDecoder::SetPriority(const std::string& id, f32 priority)
+    {
+        MutexLock lock(mutex_);
+        std::map<std::string, QueueKey>::iterator i = queued_.find(id);
+        if (i == queued_.end() || i->second.priority_ == priority)
+            return;
+
+        RequestQueue::iterator q = queue_.find(i->second);
+        DecodeRequestPtr request = q->second;
+        queue_.erase(q);
+        i->second.priority_ = priority;
+        queue_[i->second] = request;
+    }
+
+    std::vector<DecodeResultPtr> OpenJpegDecoder::GetResults(uint max_results)
+    {
+        std::vector<DecodeResultPtr> results;
+        {
+            MutexLock lock(mutex_);
+            if (results_.size() <= max_results)
+                results.swap(results_);
+            else
+            {
+                results.assign(results_.begin(), results_.begin() + max_results);
+                results_.erase(results_.begin(), results_.begin() + max_results);
+            }
+        }
+
+        // Workers waiting for the results to be collected may continue
+        if (!results.empty())
+            condition_.notify_all();
+        return results;
+    }
+
+    uint OpenJpegDecoder::GetPendingCount() const
+    {
+        MutexLock lock(mutex_);
+        return queue_.size() + active_;
+    }
+
+    void OpenJpegDecoder::WaitForResults(uint count)
+    {
+        ScopedLock lock(mutex_);
+        while(results_.size() < count && (!queue_.empty() || active_))
+            condition_.wait(lock);
+    }
+
     void OpenJpegDecoder::Work()
     {
-        while (ShouldRun())
+        for(;;)
         {
-            WaitForRequests();
-            
-            DecodeRequestPtr request = GetNextRequest<DecodeRequest>();
-            if (request)
+            DecodeRequestPtr request;
             {
-                // Wait if "too many" results already produced, to prevent slowing down the main thread with 
-                // too many texture creations per frame
-                Foundation::ThreadTaskManager* manager = GetThreadTaskManager();
-                if (manager)
-                {
-                    for (;;)
-                    {
-                        uint results = manager->GetNumResults(GetTaskDescription());
-                        if (results < decodes_per_frame_)
-                            break;
-                        if (!ShouldRun())
-                            return;
-                        boost::this_thread::sleep(boost::posix_time::milliseconds(20));
-                    }
-                }
-                
-                {
-                    PROFILE(OpenJpegDecoder_Decode);
-                    PerformDecode(request);
-                }
+                ScopedLock lock(mutex_);
+                while((queue_.empty() || results_.size() >= max_results_) && keep_running_)
+                    condition_.wait(lock);
+                if (!keep_running_)
+                    return;
+
+                request = queue_.begin()->second;
+                queued_.erase(request->id_);
+                queue_.erase(queue_.begin());
+                ++active_;
             }
 
+            DecodeResultPtr result;
+            {
+                PROFILE(OpenJpegDecoder_Decode);
+                Core::tick_t start = Core::GetCurrentClockTime();
+                result = PerformDecode(request);
+                result->decode_time_ = (f64)(Core::GetCurrentClockTime() - start) / Core::GetCurrentClockFreq();
+            }
+
+            {
+                MutexLock lock(mutex_);
+                results_.push_back(result);
+                --active_;
+            }
+            condition_.notify_all();
+
             RESETPROFILER
         }
     }
@@ -109,11 +208,8 @@ namespace TextureDecoder
     {
     }
 
-    void OpenJpegDecoder::PerformDecode(DecodeRequestPtr request)
+    DecodeResultPtr OpenJpegDecoder::PerformDecode(DecodeRequestPtr request)
     {
-        if (!request)
-            return;
-
         bool texture_id_is_url = QString(request->id_.c_str()).startsWith("http");
 
         DecodeResultPtr result(new DecodeResult());
@@ -124,17 +220,17 @@ namespace TextureDecoder
         result->original_width_ = 0;
         result->original_height_ = 0;
         result->components_ = 0;
-        result->tag_ = request->tag_;
+        result->is_jpeg2000_ = false;
+        result->decode_time_ = 0.0;
 
-        if (!texture_id_is_url)
+        if ((!request->image_) && (!texture_id_is_url))
         {
             // Guard against OpenJpeg crash on illegal data at an early phase
             unsigned char *data = (unsigned char *)request->source_->GetData();
             if (data[0] != 0xFF)
             {
                 TextureDecoderModule::LogError("Invalid data passed to PerformDecode!");
-                QueueResult<DecodeResult>(result);
-                return;
+                return result;
             }
 
             opj_dinfo_t* dinfo = 0; // decoder
@@ -165,39 +261,56 @@ namespace TextureDecoder
             opj_cio_close(cio);
             opj_destroy_decompress(dinfo);
             
-            if ((image) && (image->numcomps))
+            // Components are interleaved as they are, so they must be of the same size, and at most RGBA
+            bool same_size = (image) && (image->numcomps);
+            for (int c = 1; same_size && c < image->numcomps; ++c)
+                same_size = (image->comps[c].w == image->comps[0].w) && (image->comps[c].h == image->comps[0].h);
+
+            if ((same_size) && (image->numcomps <= 4))
             {
                 result->original_width_ = image->x1 - image->x0;
                 result->original_height_ = image->y1 - image->y0;
                 result->components_ = image->numcomps;
                 result->level_ = request->level_;
 
-                // Assume all components are same size
                 int actual_width = image->comps[0].w;
                 int actual_height = image->comps[0].h;
 
                 // Create a (possibly temporary, if no-one stores the pointer) raw texture resource
                 Foundation::ResourcePtr resource(new TextureResource(request->source_->GetId(), actual_width, actual_height, image->numcomps));
                 TextureResource* texture = checked_static_cast<TextureResource*>(resource.get());
-                u8* data = texture->GetData();
                 texture->SetLevel(request->level_);
                 texture->SetDataSize(actual_width * actual_height * image->numcomps);
 
-                for (int y = 0; y < actual_height; ++y)
+                // Interleave straight into the byte layout the Ogre texture is created with
+                Foundation::PixelConversion::Plane planes[4];
+                for (int c = 0; c < image->numcomps; ++c)
                 {
-                    for (int x = 0; x < actual_width; ++x)
-                    {
-                        for (int c = 0; c < image->numcomps; ++c)
-                        {
-                            *data = image->comps[c].data[y * actual_width + x];
-                            data++;
-                        }
-                    }
+                    planes[c].data_ = image->comps[c].data;
+                    planes[c].precision_ = image->comps[c].prec;
+                    planes[c].signed_ = image->comps[c].sgnd != 0;
                 }
+
+                // Compress whole blocks only. Opaque textures use DXT1, the rest DXT5
+                if ((compress_) && (actual_width % 4 == 0) && (actual_height % 4 == 0))
+                {
+                    std::vector<u8> pixels(actual_width * actual_height * image->numcomps);
+                    Foundation::PixelConversion::Interleave(planes, image->numcomps, actual_width * actual_height, &pixels[0]);
+                    Foundation::BlockCompression::Format format = Foundation::BlockCompression::HasTranslucency(&pixels[0],
+                        actual_width * actual_height, image->numcomps) ? Foundation::BlockCompression::DXT5 : Foundation::BlockCompression::DXT1;
+
+                    texture->SetFormat(format);
+                    texture->SetDataSize(Foundation::BlockCompression::GetChainSize(actual_width, actual_height, format));
+                    Foundation::BlockCompression::CompressChain(&pixels[0], actual_width, actual_height, image->numcomps, format, texture->GetData());
+                }
+                else
+                    Foundation::PixelConversion::Interleave(planes, image->numcomps, actual_width * actual_height, texture->GetData());
          
                 result->texture_ = resource;
                 result->is_jpeg2000_ = true;
             }
+            else if (image)
+                TextureDecoderModule::LogError("Texture " + request->id_ + " has components of different sizes, or more than 4");
 
             if (image)
                 opj_image_destroy(image);
@@ -206,71 +319,70 @@ namespace TextureDecoder
         {
             // Try to load image with qt, see supported image types from
             // http://doc.trolltech.com/4.6/qimagereader.html#supportedImageFormats
-
             QImage raw_image = QImage::fromData((const uchar *)request->source_->GetData(), request->source_->GetSize());
             if (!raw_image.isNull())
             {
+                // Convert to 32-bit pixels, which have no row padding and map to Ogre formats. Premultiplied alpha
+                // would darken translucent pixels
+                bool alpha = raw_image.hasAlphaChannel();
+                QImage::Format format = alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+                if (raw_image.format() != format)
+                    raw_image = raw_image.convertToFormat(format);
+
                 int width = raw_image.width();
                 int height = raw_image.height();
-                int ogre_format = -1;
-                uint comps = 0;
+                uint comps = 4;
 
-                // Check image format, support the ones 
-                // we can map to ogres image formats later
-                switch (raw_image.format())
-                {
-                    case QImage::Format_RGB16:
-                        ogre_format = 6;
-                        comps = 3;
-                        break;
-
-                    case QImage::Format_RGB32:
-                        ogre_format = 26;
-                        comps = 4;
-                        break;
-
-                    case QImage::Format_ARGB32:
-                    case QImage::Format_ARGB32_Premultiplied:
-                        ogre_format = 12;
-                        comps = 4;
-                        break;
-
-                    default:
-                        ogre_format = -1;
-                        comps = 0;
-                        break;
-                }
+                result->original_width_ = width;
+                result->original_height_ = height;
+                result->components_ = comps;
+                result->level_ = 0;
+
+                Foundation::ResourcePtr resource(new TextureResource(request->source_->GetId(), width, height, comps));
+                TextureResource* texture = checked_static_cast<TextureResource*>(resource.get());
+                texture->SetLevel(0);
 
-                if (comps != 0 && ogre_format != -1)
+                if ((compress_) && (width % 4 == 0) && (height % 4 == 0))
                 {
-                    result->original_width_ = width;
-                    result->original_height_ = height;
-                    result->components_ = comps;
-                    result->level_ = 0;
-
-                    Foundation::ResourcePtr resource(new TextureResource(request->source_->GetId(), width, height, comps));
-                    TextureResource* texture = checked_static_cast<TextureResource*>(resource.get());
-                    texture->SetFormat(ogre_format);
-                    texture->SetLevel(0);
-                    texture->SetDataSize(raw_image.byteCount());
-                    u8* data = texture->GetData();
-                    
-                    memcpy(data, raw_image.bits(), raw_image.byteCount());
-                    result->texture_ = resource;
-                    result->is_jpeg2000_ = false;
+                    // Qt stores the 32-bit pixels as BGRA bytes, compression takes RGBA
+                    std::vector<u8> pixels(width * height * 4);
+                    const u8* bits = raw_image.bits();
+                    for (int i = 0; i < width * height; ++i)
+                    {
+                        pixels[i * 4] = bits[i * 4 + 2];
+                        pixels[i * 4 + 1] = bits[i * 4 + 1];
+                        pixels[i * 4 + 2] = bits[i * 4];
+                        pixels[i * 4 + 3] = alpha ? bits[i * 4 + 3] : 255;
+                    }
+                    Foundation::BlockCompression::Format compressed_format = Foundation::BlockCompression::HasTranslucency(&pixels[0],
+                        width * height, comps) ? Foundation::BlockCompression::DXT5 : Foundation::BlockCompression::DXT1;
+
+                    texture->SetFormat(compressed_format);
+                    texture->SetDataSize(Foundation::BlockCompression::GetChainSize(width, height, compressed_format));
+                    Foundation::BlockCompression::CompressChain(&pixels[0], width, height, comps, compressed_format, texture->GetData());
                 }
                 else
                 {
-                    TextureDecoderModule::LogError(QString("Your image was loaded as but QImage::Format = %1 is not supported. Canceling texture usage.").arg(raw_image.format()).toStdString());
+                    // Same values as Ogre::PF_A8R8G8B8 and Ogre::PF_X8R8G8B8
+                    texture->SetFormat(alpha ? 12 : 26);
+                    texture->SetDataSize(raw_image.byteCount());
+                    memcpy(texture->GetData(), raw_image.bits(), raw_image.byteCount());
                 }
+
+                result->texture_ = resource;
+                result->is_jpeg2000_ = false;
+            }
+            else if (request->image_)
+            {
+                // The requester decodes the formats qt does not know, such as DDS
+                TextureDecoderModule::LogDebug("Could not load image " + request->id_ + " with qt");
             }
             else
             {
-                TextureDecoderModule::LogError("Could load texture image with qt. Are you sure you have all qt image format plugins loaded? Canceling texture usage.");
+                TextureDecoderModule::LogError("Could not load texture image " + request->id_ + " with qt. Are you sure you have all qt image format plugins loaded?");
             }
-
         }
 
-        QueueResult<DecodeResult>(result);
+        return result;
     }
 }
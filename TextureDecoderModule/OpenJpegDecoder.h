@@ -6,33 +6,119 @@
 #include "AssetInterface.h"
 #include "TextureInterface.h"
 #include "TextureRequest.h"
-
-#include "ThreadTask.h"
+#include "CoreThread.h"
 
 namespace TextureDecoder
 {
-    //! OpenJpeg decoder that runs in a thread and serves decode requests, used internally by TextureService
-    class OpenJpegDecoder : public Foundation::ThreadTask
+    //! OpenJpeg decoder that serves decode requests on a pool of worker threads, used internally by TextureService
+    /*! Queued requests are decoded highest priority first, and in request order within a priority. There is at most
+        one queued request per texture: a new request of a texture that is still queued replaces the old one, so a
+        decode of a level that has been superseded is never performed.
+
+        Results are collected on the main thread with GetResults(). Workers do not start new decodes while the
+        given maximum number of results is waiting to be collected, so that decoding does not run ahead of the
+        texture creations the main thread can do per frame.
+     */
+    class OpenJpegDecoder
     {
     public:
-        //! Constructor
-        OpenJpegDecoder();
-        
-        //! Work function
-        virtual void Work();
-        
-        //! Set maximum amount of decodes to perform per frame
-        /*! \param decodes Amount of decodes per frame
+        //! Constructor. Starts the worker threads.
+        /*! \param num_threads Number of worker threads
+            \param max_results Number of uncollected results after which workers wait
+            \param compress Whether to compress decoded textures to DXT1/DXT5 with their mip chain
+         */
+        OpenJpegDecoder(uint num_threads, uint max_results, bool compress);
+
+        //! Destructor. Discards queued requests and waits for the workers to finish.
+        ~OpenJpegDecoder();
+
+        //! Queues a decode request, replacing a queued request of the same texture
+        /*! \param request Decode request
+            \param priority Priority, higher is decoded first
+         */
+        void AddRequest(DecodeRequestPtr request, f32 priority);
+
+        //! Replaces a queued request of the same texture. Returns false if none is queued, in which case nothing is done.
+        bool ReplaceRequest(DecodeRequestPtr request);
+
+        //! Changes priority of a queued request
+        /*! \param id Texture asset ID
+            \param priority Priority, higher is decoded first
          */
-        void SetDecodesPerFrame(uint decodes);
-        
+        void SetPriority(const std::string& id, f32 priority);
+
+        //! Returns decode results completed so far
+        /*! \param max_results Maximum number of results to take, the rest are left for the next call
+         */
+        std::vector<DecodeResultPtr> GetResults(uint max_results);
+
+        //! Returns number of queued and ongoing decodes
+        uint GetPendingCount() const;
+
+        //! Waits until the given number of results is waiting to be collected, or no decodes are pending
+        void WaitForResults(uint count);
+
     private:
-        //! perform a decode & queue result
-        /*! \param request decode request to serve
+        OpenJpegDecoder(const OpenJpegDecoder &);
+        OpenJpegDecoder &operator =(const OpenJpegDecoder &);
+
+        //! Order in the queue: priority, highest first, then request order
+        struct QueueKey
+        {
+            f32 priority_;
+            uint sequence_;
+
+            bool operator <(const QueueKey& rhs) const
+            {
+                if (priority_ != rhs.priority_)
+                    return priority_ > rhs.priority_;
+                return sequence_ < rhs.sequence_;
+            }
+        };
+
+        typedef std::map<QueueKey, DecodeRequestPtr> RequestQueue;
+
+        //! Worker thread function
+        void Work();
+
+        //! Performs a decode
+        /*! \param request Decode request to serve
+            \return Decode result
          */
-        void PerformDecode(DecodeRequestPtr request);
-        
-        uint decodes_per_frame_;
+        DecodeResultPtr PerformDecode(DecodeRequestPtr request);
+
+        //! Worker threads
+        boost::thread_group threads_;
+
+        //! Queued requests in order
+        RequestQueue queue_;
+
+        //! Queue position of each queued texture
+        std::map<std::string, QueueKey> queued_;
+
+        //! Completed results
+        std::vector<DecodeResultPtr> results_;
+
+        //! Number of decodes in progress
+        uint active_;
+
+        //! Number of uncollected results after which workers wait
+        uint max_results_;
+
+        //! Whether to compress decoded textures
+        bool compress_;
+
+        //! Sequence number of the next request
+        uint next_sequence_;
+
+        //! Whether the workers should keep running
+        bool keep_running_;
+
+        //! Guards the queue, results and counters
+        mutable Mutex mutex_;
+
+        //! Signaled when requests are queued, results are collected or completed, or the workers should stop
+        Condition condition_;
     };
 }
-#endif
\ No newline at end of file
+#endif
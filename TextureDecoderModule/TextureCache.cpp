@@ -4,18 +4,62 @@
 #include "TextureCache.h"
 #include "TextureDecoderModule.h"
 #include "AssetServiceInterface.h"
+#include "BlockCompression.h"
+#include "MappedFile.h"
 
 #include "UiSettingsServiceInterface.h"
 
 #include <QFile>
 #include <QDataStream>
 #include <QCryptographicHash>
+#include <QFileInfo>
 #include <QSettings>
+#include <QDateTime>
 
 #include <QMessageBox>
 
 namespace TextureDecoder
 {
+    const char *DEFAULT_TEXTURE_CACHE_LAYOUT = "files";
+    const qint64 TEXTURE_PACK_SEGMENT_SIZE = 64 * 1024 * 1024;
+    const uint MIGRATE_FILES_PER_UPDATE = 8;
+    const char *PACKED_TEXTURE_TYPE = "decoded.Texture";
+
+    //! Entry header, little-endian: magic, version, format, level, mip levels, width, height, components, data size
+    //! and a checksum of the preceding fields. The data follows.
+    const u32 TEXTURE_MAGIC = 0x58544e44; // "DNTX"
+    const u32 TEXTURE_VERSION = 1;
+    const uint TEXTURE_HEADER_FIELDS = 10;
+    const uint TEXTURE_HEADER_SIZE = TEXTURE_HEADER_FIELDS * 4;
+
+    namespace
+    {
+        void WriteU32(u8 *data, u32 value)
+        {
+            for(uint i = 0; i < 4; ++i)
+                data[i] = (u8)(value >> (i * 8));
+        }
+
+        u32 ReadU32(const u8 *data)
+        {
+            return data[0] | (data[1] << 8) | (data[2] << 16) | ((u32)data[3] << 24);
+        }
+
+        //! FNV-1a hash of the header fields before the checksum
+        u32 HeaderChecksum(const u8 *header)
+        {
+            u32 hash = 2166136261u;
+            for(uint i = 0; i < TEXTURE_HEADER_SIZE - 4; ++i)
+                hash = (hash ^ header[i]) * 16777619u;
+            return hash;
+        }
+
+        uint CurrentTime()
+        {
+            return QDateTime::currentDateTime().toTime_t();
+        }
+    }
+
     TextureCache::TextureCache(Foundation::Framework* framework) :
         QObject(),
         framework_(framework),
@@ -45,94 +89,395 @@ namespace TextureDecoder
             }
         }
 
-        // Check the current cache size
+        // Check the current cache size and contents
         QFileInfoList file_info_list = cache_dir_.entryInfoList(QDir::Files);
         foreach(QFileInfo info, file_info_list)
-            current_cache_size_ += info.size();
+        {
+            // Remove temporary files left by interrupted writes
+            if (info.fileName().endsWith(".tmp"))
+            {
+                cache_dir_.remove(info.fileName());
+                continue;
+            }
+
+            CachedFile file;
+            file.size_ = info.size();
+            file.last_access_ = info.lastModified().toTime_t();
+            current_cache_size_ += file.size_;
+            cached_hashes_.insert(info.fileName().section('.', 0, 0), file);
+        }
+
+        file_io_.reset(new Foundation::AsyncFileIO());
+
+        std::string layout = framework_->GetDefaultConfig().DeclareSetting("TextureDecoder", "texture_cache_layout", std::string(DEFAULT_TEXTURE_CACHE_LAYOUT));
+        if (layout == "pack")
+        {
+            pack_cache_.reset(new Foundation::PackFileCache(cache_dir_.absolutePath() + "/pack", TEXTURE_PACK_SEGMENT_SIZE));
+            bool loaded = pack_cache_->Open();
+            pack_cache_->SetMaxSize(cache_max_size_);
+            TextureDecoderModule::LogInfo("Texture pack cache: " + ToString(pack_cache_->GetRecords().size()) + " textures in " +
+                ToString(pack_cache_->GetSegmentCount()) + " segments" + (loaded ? "" : ", segments scanned"));
+        }
+        else if (layout != DEFAULT_TEXTURE_CACHE_LAYOUT)
+            TextureDecoderModule::LogError("Unknown texture cache layout " + layout + ", using " + DEFAULT_TEXTURE_CACHE_LAYOUT);
     }
 
     TextureCache::~TextureCache()
     {
     }
 
-    void TextureCache::StoreTexture(Foundation::TextureInterface *texture)
+    bool TextureCache::RequestTexture(const std::string &texture_id)
     {
-        QString id = GetHash(texture->GetId());
-        QFile decoded_texture(GetFullPath(id));
-        if (!decoded_texture.exists())
+        QString id = GetHash(texture_id);
+        if (pack_cache_ && pack_cache_->Find(id.toStdString()))
         {
-            if (!decoded_texture.open(QIODevice::ReadWrite))
-                return;
+            // The segment is mapped already, so the read completes at once
+            CompletedRead read;
+            read.texture_id_ = texture_id;
+            TextureResource *texture = LoadTexture(texture_id);
+            if (texture)
+                read.texture_ = Foundation::ResourcePtr(texture);
+            completed_reads_.push_back(read);
+            return true;
+        }
+        if (!cached_hashes_.contains(id))
+            return false;
+
+        // Open and map the file in the background, touching the pages so that uploading does not wait for the disk
+        uint request_id = file_io_->Map(GetFullPath(id).toStdString(), true);
+        pending_maps_[request_id] = texture_id;
+        return true;
+    }
+
+    void TextureCache::Update()
+    {
+        if (pack_cache_)
+            UpdatePack();
+
+        Foundation::FileIOResultVector results = file_io_->GetResults();
+        for(uint i = 0; i < results.size(); ++i)
+        {
+            Foundation::FileIOResult &result = results[i];
+            std::map<uint, std::string>::iterator m = pending_maps_.find(result.id_);
+            if (m != pending_maps_.end())
+            {
+                CompletedRead read;
+                read.texture_id_ = m->second;
+                pending_maps_.erase(m);
+                TextureResource *texture = LoadMappedTexture(read.texture_id_, result.mapping_);
+                if (texture)
+                    read.texture_ = Foundation::ResourcePtr(texture);
+                completed_reads_.push_back(read);
+                continue;
+            }
+
+            std::map<uint, std::string>::iterator w = pending_writes_.find(result.id_);
+            if (w == pending_writes_.end())
+                continue;
+            std::string texture_id = w->second;
+            pending_writes_.erase(w);
+
+            // Failure means the file existed already or could not be written
+            if (!result.success_)
+                continue;
 
-            // Write metadata
-            QDataStream data_stream(&decoded_texture);
-            data_stream << texture->GetComponents()
-                        << texture->GetWidth()
-                        << texture->GetHeight()
-                        << texture->GetLevel()
-                        << texture->GetFormat()
-                        << (int)texture->GetDataSize();
-
-            // Write data
-            data_stream.writeRawData((const char *)texture->GetData(), texture->GetDataSize());
-      
-            decoded_texture.close();
-            current_cache_size_ += decoded_texture.size();
+            QString id = GetHash(texture_id);
+            CachedFile file;
+            file.size_ = result.stored_size_;
+            file.last_access_ = CurrentTime();
+            cached_hashes_.insert(id, file);
+            current_cache_size_ += file.size_;
 
             // Remove unneeded encoded asset cache entry for this texture
             boost::shared_ptr<Foundation::AssetServiceInterface> asset_service = framework_->GetServiceManager()->GetService<Foundation::AssetServiceInterface>(Foundation::Service::ST_Asset).lock();
             if (asset_service)
-                asset_service->RemoveAssetFromCache(texture->GetId());
+                asset_service->RemoveAssetFromCache(texture_id);
 
             TextureDecoderModule::LogDebug("Stored decoded texture " + id.left(7).toStdString() + "... to texture cache");
             CheckCacheSize();
         }
     }
 
-    TextureResource *TextureCache::GetTexture(const std::string &texture_id)
+    std::vector<TextureCache::CompletedRead> TextureCache::TakeCompletedReads()
     {
-        QString id = GetHash(texture_id);
-        QFile decoded_texture(GetFullPath(id));
-        if (decoded_texture.exists())
+        std::vector<CompletedRead> reads;
+        reads.swap(completed_reads_);
+        return reads;
+    }
+
+    void TextureCache::UpdatePack()
+    {
+        pack_cache_->Update();
+
+        std::vector<Foundation::PackFileCache::StoreResult> stores = pack_cache_->TakeCompletedStores();
+        for(uint i = 0; i < stores.size(); ++i)
+        {
+            const std::string &key = stores[i].key_;
+            if (stores[i].imported_)
+            {
+                std::map<std::string, qint64>::iterator m = pack_imports_.find(key);
+                if (m != pack_imports_.end())
+                {
+                    cached_hashes_.remove(QString::fromStdString(key));
+                    current_cache_size_ -= m->second;
+                    pack_imports_.erase(m);
+                }
+                continue;
+            }
+
+            std::map<std::string, std::string>::iterator s = pack_stores_.find(key);
+            if (s == pack_stores_.end())
+                continue;
+            std::string texture_id = s->second;
+            pack_stores_.erase(s);
+            if (!stores[i].success_)
+                continue;
+
+            // Remove unneeded encoded asset cache entry for this texture
+            boost::shared_ptr<Foundation::AssetServiceInterface> asset_service = framework_->GetServiceManager()->GetService<Foundation::AssetServiceInterface>(Foundation::Service::ST_Asset).lock();
+            if (asset_service)
+                asset_service->RemoveAssetFromCache(texture_id);
+
+            TextureDecoderModule::LogDebug("Stored decoded texture " + key.substr(0, 7) + "... to texture cache");
+        }
+
+        // Move files into the pack while it is otherwise idle
+        if (cached_hashes_.size() > (int)pack_imports_.size() && !pack_cache_->GetPendingCount())
+        {
+            uint queued = 0;
+            foreach(QString hash, cached_hashes_.keys())
+            {
+                if (queued >= MIGRATE_FILES_PER_UPDATE)
+                    break;
+                std::string key = hash.toStdString();
+                if (pack_imports_.find(key) != pack_imports_.end())
+                    continue;
+
+                QString path = GetFullPath(hash);
+                if (pack_cache_->Find(key))
+                {
+                    // Already stored again in the pack, only the file is removed
+                    RemoveFile(hash);
+                    continue;
+                }
+                pack_imports_[key] = cached_hashes_[hash].size_;
+                pack_cache_->Import(key, PACKED_TEXTURE_TYPE, path.toStdString());
+                ++queued;
+            }
+        }
+    }
+
+    TextureResource *TextureCache::ParseTexture(const std::string &texture_id, const u8 *data, uint size, boost::shared_ptr<const void> owner)
+    {
+        if (!data || !size)
+            return 0;
+        if (size < TEXTURE_HEADER_SIZE || ReadU32(data) != TEXTURE_MAGIC)
+            return ParseLegacyTexture(texture_id, data, size);
+
+        u32 fields[TEXTURE_HEADER_FIELDS];
+        for(uint i = 0; i < TEXTURE_HEADER_FIELDS; ++i)
+            fields[i] = ReadU32(data + i * 4);
+        if (fields[1] != TEXTURE_VERSION || fields[9] != HeaderChecksum(data))
+            return 0;
+
+        int format = (int)fields[2];
+        int level = (int)fields[3];
+        uint mip_levels = fields[4];
+        uint width = fields[5];
+        uint height = fields[6];
+        uint components = fields[7];
+        uint data_length = fields[8];
+        if (data_length > size - TEXTURE_HEADER_SIZE || components < 1 || components > 4)
+            return 0;
+
+        // Compressed data holds exactly the mip chain, and may be larger than the pixels
+        if (Foundation::BlockCompression::IsCompressed(format))
         {
-            if (!decoded_texture.open(QIODevice::ReadOnly))
+            if (data_length != Foundation::BlockCompression::GetChainSize(width, height, (Foundation::BlockCompression::Format)format))
                 return 0;
+        }
+        else if (data_length > width * height * components)
+            return 0;
+
+        // Only the header is set up here, the data is either referred to or copied once
+        TextureResource *texture = new TextureResource(texture_id);
+        texture->SetWidth(width);
+        texture->SetHeight(height);
+        texture->SetComponents(components);
+        texture->SetLevel(level);
+        texture->SetFormat(format);
+        if (texture->GetMipLevels() != mip_levels)
+        {
+            delete texture;
+            return 0;
+        }
 
-            int data_length, format, level;
-            uint components, width, height;
+        const u8 *pixels = data + TEXTURE_HEADER_SIZE;
+        if (owner)
+            texture->SetDataView(pixels, data_length, owner);
+        else
+        {
+            texture->SetDataSize(data_length);
+            if (data_length)
+                memcpy(texture->GetData(), pixels, data_length);
+        }
+
+        return texture;
+    }
 
-            // Read metadata
-            QDataStream data_stream(&decoded_texture);
-            data_stream >> components;
-            data_stream >> width;
-            data_stream >> height;
-            data_stream >> level;
-            data_stream >> format;
-            data_stream >> data_length;
+    TextureResource *TextureCache::ParseLegacyTexture(const std::string &texture_id, const u8 *data, uint size)
+    {
+        QByteArray bytes = QByteArray::fromRawData((const char *)data, size);
+        QDataStream data_stream(bytes);
+
+        int data_length, format, level;
+        uint components, width, height;
+
+        // Read metadata
+        data_stream >> components;
+        data_stream >> width;
+        data_stream >> height;
+        data_stream >> level;
+        data_stream >> format;
+        data_stream >> data_length;
+        if (data_stream.status() != QDataStream::Ok || data_length < 0)
+            return 0;
+
+        // Init TextureResource with metadata
+        // Compressed data holds exactly the mip chain, and may be larger than the pixels
+        TextureResource *texture = new TextureResource(texture_id, width, height, components);
+        bool valid_length = (uint)data_length <= texture->GetDataSize();
+        if (Foundation::BlockCompression::IsCompressed(format))
+            valid_length = (uint)data_length == Foundation::BlockCompression::GetChainSize(width, height, (Foundation::BlockCompression::Format)format);
+        if (!valid_length)
+        {
+            delete texture;
+            return 0;
+        }
+        texture->SetLevel(level);
+        texture->SetFormat(format);
+        texture->SetDataSize(data_length);
 
-            // Init TextureResource with metadata
-            TextureResource *texture = new TextureResource(texture_id, width, height, components);
-            texture->SetLevel(level);
-            texture->SetFormat(format);
+        // Read data
+        if (data_length && data_stream.readRawData((char*)texture->GetData(), data_length) != data_length)
+        {
+            delete texture;
+            return 0;
+        }
 
-            // Read data
-            char *data_str_ptr = (char*)texture->GetData();
-            data_stream.readRawData(data_str_ptr, data_length);
+        return texture;
+    }
 
-            decoded_texture.close();
+    void TextureCache::StoreTexture(Foundation::TextureInterface *texture)
+    {
+        QString id = GetHash(texture->GetId());
+        if (cached_hashes_.contains(id))
+            return;
+        if (pack_cache_ && (pack_cache_->Find(id.toStdString()) || pack_cache_->IsStorePending(id.toStdString())))
+            return;
+
+        // Serialize on this thread, write in the background. The buffer is released once written
+        boost::shared_ptr<QByteArray> buffer(new QByteArray(TEXTURE_HEADER_SIZE + texture->GetDataSize(), 0));
+        u8 *header = (u8 *)buffer->data();
+        u32 fields[TEXTURE_HEADER_FIELDS - 1] = { TEXTURE_MAGIC, TEXTURE_VERSION, (u32)texture->GetFormat(), (u32)texture->GetLevel(),
+            texture->GetMipLevels(), texture->GetWidth(), texture->GetHeight(), texture->GetComponents(), texture->GetDataSize() };
+        for(uint i = 0; i < TEXTURE_HEADER_FIELDS - 1; ++i)
+            WriteU32(header + i * 4, fields[i]);
+        WriteU32(header + (TEXTURE_HEADER_FIELDS - 1) * 4, HeaderChecksum(header));
+        if (texture->GetDataSize())
+            memcpy(header + TEXTURE_HEADER_SIZE, texture->GetData(), texture->GetDataSize());
+
+        if (pack_cache_)
+        {
+            pack_cache_->Store(id.toStdString(), PACKED_TEXTURE_TYPE, (const u8 *)buffer->constData(), buffer->size(),
+                boost::shared_ptr<const void>(buffer));
+            pack_stores_[id.toStdString()] = texture->GetId();
+            return;
+        }
+
+        uint request_id = file_io_->Write(GetFullPath(id).toStdString(), (const u8 *)buffer->constData(), buffer->size(),
+            boost::shared_ptr<const void>(buffer), false);
+        pending_writes_[request_id] = texture->GetId();
+    }
+
+    TextureResource *TextureCache::GetTexture(const std::string &texture_id)
+    {
+        return LoadTexture(texture_id);
+    }
+
+    TextureResource *TextureCache::LoadTexture(const std::string &texture_id)
+    {
+        QString id = GetHash(texture_id);
+        std::string key = id.toStdString();
+        TextureResource *texture = 0;
+        Foundation::PackFileView view;
+        if (pack_cache_ && pack_cache_->Read(key, view))
+        {
+            texture = ParseTexture(texture_id, view.data_, view.size_, view.owner_);
+            if (!texture)
+                pack_cache_->Remove(key);
+        }
+        else if (cached_hashes_.contains(id))
+        {
+            boost::shared_ptr<Foundation::MappedFile> file(new Foundation::MappedFile(GetFullPath(id)));
+            return LoadMappedTexture(texture_id, file);
+        }
+
+        if (texture)
             TextureDecoderModule::LogDebug("Found decoded texture " + id.left(7).toStdString() + "... from cache");
-            return texture;
+        return texture;
+    }
+
+    TextureResource *TextureCache::LoadMappedTexture(const std::string &texture_id, boost::shared_ptr<Foundation::MappedFile> &file)
+    {
+        QString id = GetHash(texture_id);
+        TextureResource *texture = 0;
+        if (file && file->GetData())
+            texture = ParseTexture(texture_id, file->GetData(), (uint)file->GetSize(), file);
+
+        // Drop files that can not be mapped or are invalid, so that the texture is decoded and stored again
+        if (!texture)
+        {
+            file.reset();
+            RemoveFile(id);
+            return 0;
         }
-        return 0;
+
+        if (cached_hashes_.contains(id))
+            cached_hashes_[id].last_access_ = CurrentTime();
+        TextureDecoderModule::LogDebug("Found decoded texture " + id.left(7).toStdString() + "... from cache");
+        return texture;
+    }
+
+    bool TextureCache::RemoveFile(const QString &hash)
+    {
+        QHash<QString, CachedFile>::iterator i = cached_hashes_.find(hash);
+        if (i == cached_hashes_.end())
+            return true;
+
+        QString path = GetFullPath(hash);
+        if (!QFile::remove(path) && QFile::exists(path))
+            return false;
+
+        current_cache_size_ -= i->size_;
+        cached_hashes_.erase(i);
+        return true;
     }
 
     void TextureCache::DeleteFromCache(const std::string &texture_id)
     {
         QString id = GetHash(texture_id);
-        QFile decoded_texture(GetFullPath(id));
-        if (decoded_texture.exists())
+        if (pack_cache_ && (pack_cache_->Find(id.toStdString()) || pack_cache_->IsStorePending(id.toStdString())))
+        {
+            pack_cache_->Remove(id.toStdString());
+            pack_stores_.erase(id.toStdString());
+            TextureDecoderModule::LogDebug("Removed decoded texture " + id.left(7).toStdString() + "... from cache");
+            return;
+        }
+
+        if (cached_hashes_.contains(id))
         {
-            if (decoded_texture.remove())
+            if (RemoveFile(id))
                 TextureDecoderModule::LogDebug("Removed decoded texture " + id.left(7).toStdString() + "... from cache");
             else
                 TextureDecoderModule::LogDebug("Could not remove decoded texture " + id.left(7).toStdString() + "... from cache. I/O error.");
@@ -158,15 +503,20 @@ namespace TextureDecoder
             qint64 removed_bytes = 0;
             int removed_files = 0;
 
-            QFileInfoList file_info_list = cache_dir_.entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
-            foreach(QFileInfo info, file_info_list)
+            // Least recently accessed first, from the index
+            std::vector<std::pair<uint, QString> > files;
+            files.reserve(cached_hashes_.size());
+            for(QHash<QString, CachedFile>::const_iterator i = cached_hashes_.begin(); i != cached_hashes_.end(); ++i)
+                files.push_back(std::make_pair(i->last_access_, i.key()));
+            std::sort(files.begin(), files.end());
+
+            for(uint i = 0; i < files.size(); ++i)
             {
-                qint64 current_file_size = info.size();
-                if (!cache_dir_.remove(info.fileName()))
+                qint64 current_file_size = cached_hashes_[files[i].second].size_;
+                if (!RemoveFile(files[i].second))
                     continue;
                 removed_files++;
                 removed_bytes += current_file_size;
-                current_cache_size_ -= current_file_size;
                 if (current_cache_size_ < aimed_size)
                     break;
             }
@@ -190,12 +540,44 @@ namespace TextureDecoder
         if (cache_max_size != cache_max_size_)
         {
             cache_max_size_ = cache_max_size;
+            if (pack_cache_)
+                pack_cache_->SetMaxSize(cache_max_size_);
             CheckCacheSize(false);
         }
     }
 
+    qint64 TextureCache::GetCacheSize() const
+    {
+        qint64 size = current_cache_size_;
+        if (pack_cache_)
+            size += pack_cache_->GetFileSize();
+        return size;
+    }
+
+    uint TextureCache::GetCachedCount() const
+    {
+        uint count = cached_hashes_.size();
+        if (pack_cache_)
+            count += pack_cache_->GetRecords().size();
+        return count;
+    }
+
     void TextureCache::ClearCache()
     {
+        bool packed = pack_cache_ && pack_cache_->GetRecords().size();
+        if (packed)
+        {
+            qreal removed_bytes_f = pack_cache_->GetFileSize();
+            QString mb_string = QString::number(((removed_bytes_f/1024)/1024));
+            mb_string = mb_string.left(mb_string.indexOf(".")+3);
+            QMessageBox::information(0, "Texture Cache", QString("Texture cache cleared, removed %1 textures total of " + mb_string + " mb").arg(pack_cache_->GetRecords().size()));
+        }
+        if (pack_cache_)
+        {
+            pack_cache_->Clear();
+            pack_stores_.clear();
+        }
+
         QFileInfoList file_info_list = cache_dir_.entryInfoList(QDir::Files);
         if (file_info_list.count() > 0)
         {
@@ -219,8 +601,9 @@ namespace TextureDecoder
 
             // Reset tracking size
             current_cache_size_ = 0;
+            cached_hashes_.clear();
         }
-        else
+        else if (!packed)
             QMessageBox::information(0, "Texture Cache", "There are currently no files in texture cache");
     }
 
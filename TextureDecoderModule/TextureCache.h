@@ -5,9 +5,12 @@
 
 #include <QObject>
 #include <QDir>
+#include <QHash>
 
 #include "Foundation.h"
 #include "TextureResource.h"
+#include "AsyncFileIO.h"
+#include "PackFileCache.h"
 
 namespace TextureDecoder
 {
@@ -20,6 +23,12 @@ namespace TextureDecoder
         RequestTagVector tags;   
     };
 
+    //! Disk cache of decoded textures. Stores a file per texture, or with TextureDecoder/texture_cache_layout "pack"
+    //! packs them into a few large segment files, see Foundation::PackFileCache. Files of the file per texture layout
+    //! are moved into the pack a few at a time, and are used until then.
+    //! Each entry is a fixed little-endian header followed by the data. Cached textures are memory mapped, and refer
+    //! to the mapped data until it is uploaded. Files are opened and mapped on the background I/O threads. The size and last access of each file are kept in an index, so that
+    //! the directory is scanned only at startup.
     class TextureCache : public QObject
     {
         Q_OBJECT
@@ -28,12 +37,34 @@ namespace TextureDecoder
             TextureCache(Foundation::Framework* framework);
             virtual ~TextureCache();
 
+            //! Texture loaded from the cache in the background
+            struct CompletedRead
+            {
+                //! Texture id
+                std::string texture_id_;
+
+                //! Texture, or null if it could not be loaded
+                Foundation::ResourcePtr texture_;
+            };
+
+            //! Start loading a texture from the cache. The texture is mapped rather than read, in the background for
+            //! the file per texture layout. Pack segments stay mapped, so textures in the pack complete at once
+            //! @param texture id
+            //! @return true if the texture is in the cache and is being loaded, see TakeCompletedReads()
+            bool RequestTexture(const std::string &texture_id);
+
+            //! Collect background reads and writes. Called by TextureService
+            void Update();
+
+            //! Returns textures loaded in the background since last call
+            std::vector<CompletedRead> TakeCompletedReads();
+
         public slots:
-            //! Store a texture to disk cache
+            //! Store a texture to disk cache. The file is written in the background
             //! @param TextureInterface implementing pointer
             void StoreTexture(Foundation::TextureInterface *texture);
 
-            //! Get a texture resource from cache
+            //! Get a texture resource from cache synchronously
             //! @param texture id
             TextureResource *GetTexture(const std::string &texture_id);
 
@@ -53,6 +84,12 @@ namespace TextureDecoder
             //! Getter for TextureService to know what to cache
             bool CacheEverything() { return cache_everything_; }
 
+            //! Returns the disk space taken by cached textures in bytes
+            qint64 GetCacheSize() const;
+
+            //! Returns the number of cached textures
+            uint GetCachedCount() const;
+
         private slots:
             //! Check cache and remove files until we are under the cache_max_size_
             //! @param make_extra_space - When checking cache after new stores we want to make some extra space
@@ -65,6 +102,42 @@ namespace TextureDecoder
             //! Get full path of file to open it
             QString GetFullPath(QString hash_id);
 
+        private:
+            //! Size and last access of a file of the file per texture layout
+            struct CachedFile
+            {
+                //! File size
+                qint64 size_;
+
+                //! Last access time, seconds since epoch
+                uint last_access_;
+            };
+
+            //! Create texture resource from the contents of a cache file, returns null if the data is invalid
+            /*! \param texture_id Texture id
+                \param data Contents
+                \param size Size of the contents
+                \param owner Keeps the contents valid. If given, the texture refers to the contents instead of copying them
+             */
+            static TextureResource *ParseTexture(const std::string &texture_id, const u8 *data, uint size, boost::shared_ptr<const void> owner);
+
+            //! Create texture resource from the contents of a cache file written before the fixed header was used
+            static TextureResource *ParseLegacyTexture(const std::string &texture_id, const u8 *data, uint size);
+
+            //! Map a texture from the pack or its file, returns null if not cached or invalid
+            TextureResource *LoadTexture(const std::string &texture_id);
+
+            //! Create texture resource from a mapped file of the file per texture layout. Drops the file if it could
+            //! not be mapped or is invalid, so that the texture is decoded and stored again; the file is released first.
+            //! Returns null in that case
+            TextureResource *LoadMappedTexture(const std::string &texture_id, boost::shared_ptr<Foundation::MappedFile> &file);
+
+            //! Remove a file of the file per texture layout and its index entry. Returns false if the file could not be removed
+            bool RemoveFile(const QString &hash);
+
+            //! Handle stores completed by the pack, and move files of the file per texture layout into it
+            void UpdatePack();
+
         private:
             Foundation::Framework* framework_;
 
@@ -75,6 +148,30 @@ namespace TextureDecoder
             bool cache_everything_;
             int current_cache_size_;
             int cache_max_size_;
+
+            //! Files of the textures in the cache directory by hash
+            QHash<QString, CachedFile> cached_hashes_;
+
+            //! Pack of decoded textures, null if the file per texture layout is used
+            boost::scoped_ptr<Foundation::PackFileCache> pack_cache_;
+
+            //! Texture ids of stores to the pack by hash
+            std::map<std::string, std::string> pack_stores_;
+
+            //! Sizes of files being moved into the pack by hash
+            std::map<std::string, qint64> pack_imports_;
+
+            //! Background file I/O
+            boost::scoped_ptr<Foundation::AsyncFileIO> file_io_;
+
+            //! Texture ids of ongoing background writes by request id
+            std::map<uint, std::string> pending_writes_;
+
+            //! Texture ids of ongoing background maps by request id
+            std::map<uint, std::string> pending_maps_;
+
+            //! Completed reads not yet taken
+            std::vector<CompletedRead> completed_reads_;
     };
 }
 
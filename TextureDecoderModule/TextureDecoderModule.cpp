@@ -4,14 +4,45 @@
 #include "ConsoleCommandServiceInterface.h"
 #include "TextureService.h"
 #include "TextureDecoderModule.h"
+#include "OpenJpegDecoder.h"
+#include "TextureResource.h"
+#include "AsyncFileIO.h"
 #include "Framework.h"
 #include "EventManager.h"
 #include "ServiceManager.h"
+#include "ConfigurationManager.h"
+#include "HighPerfClock.h"
+#include "BlockCompression.h"
+
+#include <QDir>
+#include <cmath>
 
 namespace TextureDecoder
 {
     std::string TextureDecoderModule::type_name_static_ = "TextureDecoder";
 
+    namespace
+    {
+        //! JPEG2000 file read for the decode benchmark
+        class BenchmarkAsset : public Foundation::AssetInterface
+        {
+        public:
+            BenchmarkAsset(const std::string &id) : id_(id), type_("Texture") {}
+
+            virtual const std::string& GetId() const { return id_; }
+            virtual const std::string& GetType() const { return type_; }
+            virtual uint GetSize() const { return data_.size(); }
+            virtual const u8* GetData() const { return data_.empty() ? 0 : &data_[0]; }
+            virtual Foundation::AssetMetadataInterface* GetMetadata() const { return 0; }
+
+            std::vector<u8> data_;
+
+        private:
+            std::string id_;
+            std::string type_;
+        };
+    }
+
     TextureDecoderModule::TextureDecoderModule() : ModuleInterface(type_name_static_)
     {
     }
@@ -32,7 +63,22 @@ namespace TextureDecoder
     {   
         Foundation::EventManagerPtr event_manager = framework_->GetEventManager();
         asset_event_category_ = event_manager->QueryEventCategory("Asset");
-        task_event_category_ = event_manager->QueryEventCategory("Task");
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "BenchmarkTextureDecode", "Decodes the JPEG2000 files (.j2k, .j2c, .jp2) of a directory and prints the throughput. "
+            "Usage: BenchmarkTextureDecode(directory, number of threads, quality level). By default all levels are decoded "
+            "with one thread and with the configured number of threads.",
+            Console::Bind(this, &TextureDecoderModule::ConsoleBenchmarkDecode)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "TestTextureCompression", "Compresses a generated image to DXT1 and DXT5, decompresses it and prints the error, "
+            "sizes and encode time. Usage: TestTextureCompression(size). Size is a multiple of 4, by default 512.",
+            Console::Bind(this, &TextureDecoderModule::ConsoleTestCompression)));
+
+        RegisterConsoleCommand(Console::CreateCommand(
+            "TextureLoadStats", "Prints the textures decoded and loaded from cache so far, their texture memory, decode time "
+            "and the disk cache size.",
+            Console::Bind(this, &TextureDecoderModule::ConsoleLoadStats)));
     }
     
     // virtual
@@ -54,6 +100,186 @@ namespace TextureDecoder
         texture_service_.reset();
     }
     
+    Console::CommandResult TextureDecoderModule::ConsoleBenchmarkDecode(const StringVector &params)
+    {
+        if (params.empty())
+            return Console::ResultFailure("Usage: BenchmarkTextureDecode(directory, number of threads, quality level)");
+
+        // Same default as TextureService
+        int default_threads = framework_->GetDefaultConfig().DeclareSetting("TextureDecoder", "decode_threads", 0);
+        if (default_threads <= 0)
+            default_threads = std::max((int)boost::thread::hardware_concurrency() - 1, 1);
+        std::vector<uint> thread_counts;
+        if (params.size() > 1)
+            thread_counts.push_back(std::max(ParseString<int>(params[1], default_threads), 1));
+        else
+        {
+            thread_counts.push_back(1);
+            if (default_threads > 1)
+                thread_counts.push_back(default_threads);
+        }
+        int level = params.size() > 2 ? std::max(ParseString<int>(params[2], 0), 0) : 0;
+
+        // Only codestreams are decoded, as by TextureService, so files are skipped if they do not start with one
+        QDir dir(QString::fromStdString(params[0]));
+        QStringList filters;
+        filters << "*.j2k" << "*.j2c" << "*.jp2" << "*.jpc";
+        QStringList files = dir.entryList(filters, QDir::Files);
+        std::vector<Foundation::AssetPtr> assets;
+        double input_bytes = 0.0;
+        foreach(QString file, files)
+        {
+            boost::shared_ptr<BenchmarkAsset> asset(new BenchmarkAsset(file.toStdString()));
+            if (!Foundation::AsyncFileIO::ReadFile(dir.filePath(file).toStdString(), asset->data_) || asset->data_.empty() ||
+                asset->data_[0] != 0xff)
+                continue;
+            input_bytes += asset->data_.size();
+            assets.push_back(asset);
+        }
+        if (assets.empty())
+            return Console::ResultFailure("No JPEG2000 codestreams found in " + params[0]);
+
+        std::string result = ToString(assets.size()) + " textures, " + ToString(input_bytes / (1024.0 * 1024.0)) +
+            " MB, level " + ToString(level) + "\n";
+        for(uint t = 0; t < thread_counts.size(); ++t)
+        {
+            OpenJpegDecoder decoder(thread_counts[t], assets.size(), false);
+            Core::tick_t start = Core::GetCurrentClockTime();
+            for(uint i = 0; i < assets.size(); ++i)
+            {
+                DecodeRequestPtr request(new DecodeRequest());
+                request->id_ = assets[i]->GetId();
+                request->source_ = assets[i];
+                request->level_ = level;
+                decoder.AddRequest(request, 0.0f);
+            }
+            decoder.WaitForResults(assets.size());
+            double elapsed = (Core::GetCurrentClockTime() - start) / (double)Core::GetCurrentClockFreq();
+
+            std::vector<DecodeResultPtr> results = decoder.GetResults(assets.size());
+            uint failed = 0;
+            double pixels = 0.0;
+            double decode_time = 0.0;
+            for(uint i = 0; i < results.size(); ++i)
+            {
+                if (!results[i]->texture_)
+                {
+                    ++failed;
+                    continue;
+                }
+                TextureResource *texture = checked_static_cast<TextureResource *>(results[i]->texture_.get());
+                pixels += (double)texture->GetWidth() * texture->GetHeight();
+                decode_time += results[i]->decode_time_;
+            }
+
+            uint decoded = results.size() - failed;
+            result += ToString(thread_counts[t]) + " threads: " + ToString(elapsed) + " s, " + ToString(decoded / elapsed) +
+                " textures/s, " + ToString(pixels / elapsed / 1000000.0) + " Mpixels/s, " +
+                ToString(input_bytes / elapsed / (1024.0 * 1024.0)) + " MB/s of JPEG2000, " +
+                ToString(decoded ? decode_time * 1000.0 / decoded : 0.0) + " ms per texture, " + ToString(failed) + " failed\n";
+        }
+
+        return Console::ResultSuccess(result);
+    }
+
+    Console::CommandResult TextureDecoderModule::ConsoleTestCompression(const StringVector &params)
+    {
+        uint size = params.size() ? ParseString<int>(params[0], 512) : 512;
+        if (size < 4 || size > 8192 || size % 4)
+            return Console::ResultFailure("Size must be a multiple of 4 up to 8192");
+
+        // Smooth color ramps with a hard-edged checkerboard and a circle, which are the worst case for block compression.
+        // Alpha ramps diagonally
+        std::vector<u8> pixels(size * size * 4);
+        for(uint y = 0; y < size; ++y)
+        {
+            for(uint x = 0; x < size; ++x)
+            {
+                u8 *pixel = &pixels[(y * size + x) * 4];
+                int dx = (int)x - (int)size / 2;
+                int dy = (int)y - (int)size / 2;
+                bool inside = dx * dx + dy * dy < (int)(size * size / 9);
+                pixel[0] = x * 255 / (size - 1);
+                pixel[1] = inside ? 255 - y * 255 / (size - 1) : y * 255 / (size - 1);
+                pixel[2] = ((x / 8 + y / 8) % 2) ? 224 : 32;
+                pixel[3] = (x + y) * 255 / (2 * size - 2);
+            }
+        }
+
+        uint rgba_chain_size = 0;
+        uint levels = Foundation::BlockCompression::GetMipLevels(size, size);
+        for(uint i = 0; i < levels; ++i)
+            rgba_chain_size += std::max(size >> i, 1u) * std::max(size >> i, 1u) * 4;
+
+        std::string result = ToString(size) + "x" + ToString(size) + ", " + ToString(levels) + " levels, RGBA chain " +
+            ToString(rgba_chain_size / 1024.0) + " KB\n";
+
+        Foundation::BlockCompression::Format formats[] = { Foundation::BlockCompression::DXT1, Foundation::BlockCompression::DXT5 };
+        for(uint f = 0; f < 2; ++f)
+        {
+            Foundation::BlockCompression::Format format = formats[f];
+            // DXT1 leaves alpha out, so it is compared as opaque
+            uint components = format == Foundation::BlockCompression::DXT1 ? 3 : 4;
+            std::vector<u8> input(size * size * components);
+            for(uint i = 0; i < size * size; ++i)
+                for(uint c = 0; c < components; ++c)
+                    input[i * components + c] = pixels[i * 4 + c];
+
+            uint chain_size = Foundation::BlockCompression::GetChainSize(size, size, format);
+            std::vector<u8> compressed(chain_size);
+            Core::tick_t start = Core::GetCurrentClockTime();
+            if (!Foundation::BlockCompression::CompressChain(&input[0], size, size, components, format, &compressed[0]))
+                return Console::ResultFailure("Compression failed");
+            double elapsed = (Core::GetCurrentClockTime() - start) / (double)Core::GetCurrentClockFreq();
+
+            std::vector<u8> output(size * size * 4);
+            Foundation::BlockCompression::DecompressLevel(&compressed[0], size, size, format, &output[0]);
+
+            int max_error = 0;
+            double squared_error = 0.0;
+            for(uint i = 0; i < size * size; ++i)
+            {
+                for(uint c = 0; c < 4; ++c)
+                {
+                    int expected = c < components ? input[i * components + c] : 255;
+                    int error = abs((int)output[i * 4 + c] - expected);
+                    max_error = std::max(max_error, error);
+                    squared_error += error * error;
+                }
+            }
+            double rms_error = sqrt(squared_error / (size * size * 4.0));
+
+            result += std::string(format == Foundation::BlockCompression::DXT1 ? "DXT1" : "DXT5") + ": chain " +
+                ToString(chain_size / 1024.0) + " KB (" + ToString((double)rgba_chain_size / chain_size) + ":1), RMS error " +
+                ToString(rms_error) + ", PSNR " + ToString(rms_error > 0.0 ? 20.0 * log10(255.0 / rms_error) : 0.0) +
+                " dB, max error " + ToString(max_error) + ", encode " + ToString(elapsed * 1000.0) + " ms, " +
+                ToString(size * size / elapsed / 1000000.0) + " Mpixels/s\n";
+        }
+
+        return Console::ResultSuccess(result);
+    }
+
+    Console::CommandResult TextureDecoderModule::ConsoleLoadStats(const StringVector &params)
+    {
+        if (!texture_service_)
+            return Console::ResultFailure("Texture service not available");
+
+        const TextureLoadStats &stats = texture_service_->GetLoadStats();
+        const double mb = 1024.0 * 1024.0;
+        std::string result = "Decoded " + ToString(stats.decodes_) + " textures, " + ToString(stats.compressed_) +
+            " compressed, " + ToString(stats.decoded_bytes_ / mb) + " MB of texture memory, " +
+            ToString(stats.decode_time_) + " s decoding, " +
+            ToString(stats.decodes_ ? stats.decode_time_ * 1000.0 / stats.decodes_ : 0.0) + " ms per texture\n";
+        result += "Loaded " + ToString(stats.cache_loads_) + " textures from cache, " + ToString(stats.cache_bytes_ / mb) +
+            " MB of texture memory\n";
+        TextureCache *cache = texture_service_->GetCache();
+        if (cache)
+            result += "Disk cache " + ToString(cache->GetCachedCount()) + " textures, " +
+                ToString(cache->GetCacheSize() / mb) + " MB\n";
+
+        return Console::ResultSuccess(result);
+    }
+
     bool TextureDecoderModule::HandleEvent(event_category_id_t category_id, event_id_t event_id, Foundation::EventDataInterface* data)
     {
         PROFILE(TextureDecoderModule_HandleEvent);
@@ -63,12 +289,6 @@ namespace TextureDecoder
                 return texture_service_->HandleAssetEvent(event_id, data);
             else return false;
         }
-        if (category_id == task_event_category_)
-        {
-            if (texture_service_)
-                return texture_service_->HandleTaskEvent(event_id, data);
-            else return false;
-        }
         return false;
     }
 }
@@ -5,6 +5,7 @@
 
 #include "ModuleInterface.h"
 #include "ModuleLoggingFunctions.h"
+#include "ConsoleCommandServiceInterface.h"
 #include "TextureDecoderModuleApi.h"
 
 namespace Foundation
@@ -32,6 +33,15 @@ namespace TextureDecoder
 
         MODULE_LOGGING_FUNCTIONS
 
+        //! callback for console command. Measures JPEG2000 decode throughput over the files of a directory.
+        Console::CommandResult ConsoleBenchmarkDecode(const StringVector &params);
+
+        //! callback for console command. Compresses a generated image to DXT1 and DXT5, decompresses it and prints the error.
+        Console::CommandResult ConsoleTestCompression(const StringVector &params);
+
+        //! callback for console command. Prints decode and cache load totals, the texture memory they take and the cache size.
+        Console::CommandResult ConsoleLoadStats(const StringVector &params);
+
         //! returns name of this module. Needed for logging.
         static const std::string &NameStatic() { return type_name_static_; }
 
@@ -44,9 +54,6 @@ namespace TextureDecoder
 
         //! Asset event category
         event_category_id_t asset_event_category_;
-
-        //! Task event category
-        event_category_id_t task_event_category_;
     };
 }
 
@@ -4,6 +4,12 @@
 
 namespace TextureDecoder
 {
+    //! Lowest quality level
+    static const int MAX_LEVEL = 5;
+
+    //! Texture size assumed before the dimensions are known
+    static const uint DEFAULT_TEXTURE_SIZE = 512;
+
     TextureRequest::TextureRequest() :
         requested_(false),
         decode_requested_(false),
@@ -11,9 +17,18 @@ namespace TextureDecoder
         received_(0),
         width_(0),
         height_(0),
+        components_(0),
         levels_(-1),
         decoded_level_(-1),
-        next_level_(5)
+        next_level_(5),
+        asset_tag_(0),
+        target_level_(0),
+        priority_(0.0f),
+        receive_start_time_(-1.0),
+        receive_start_bytes_(0),
+        receive_rate_(0.0),
+        decodes_(0),
+        decode_time_(0.0)
     {
     }
     
@@ -25,9 +40,18 @@ namespace TextureDecoder
         received_(0),
         width_(0),
         height_(0),
+        components_(0),
         levels_(-1),
         decoded_level_(-1),
-        next_level_(5)
+        next_level_(5),
+        asset_tag_(0),
+        target_level_(0),
+        priority_(0.0f),
+        receive_start_time_(-1.0),
+        receive_start_bytes_(0),
+        receive_rate_(0.0),
+        decodes_(0),
+        decode_time_(0.0)
     {
     }
     
@@ -35,21 +59,83 @@ namespace TextureDecoder
     {
     }
    
-    void TextureRequest::UpdateSizeReceived(uint size, uint received)
+    void TextureRequest::UpdateSizeReceived(uint size, uint received, f64 time)
     {
         size_ = size;
         received_ = received;
 
-        // If has all data, can decode the max. quality level
+        // Average download rate since the first update
+        if (receive_start_time_ < 0.0)
+        {
+            receive_start_time_ = time;
+            receive_start_bytes_ = received;
+        }
+        else if ((time > receive_start_time_) && (received > receive_start_bytes_))
+            receive_rate_ = (received - receive_start_bytes_) / (time - receive_start_time_);
+
+        // If has all data, can decode the quality level needed. Otherwise, once the dimensions are known, skip the
+        // levels that the received data already goes past
         if ((size_) && (received >= size_))
-            next_level_ = 0;
+            next_level_ = std::min(next_level_, target_level_);
+        else if ((width_) && (height_) && (components_))
+        {
+            while ((next_level_ > target_level_) && (received_ >= EstimateDataSize(next_level_ - 1)))
+                --next_level_;
+        }
+    }
+
+    bool TextureRequest::SetScreenSize(uint screen_size)
+    {
+        // Drop the resolution levels that would be smaller than the on-screen size. Assume a typical size until known
+        uint texture_size = std::max(width_, height_);
+        if (!texture_size)
+            texture_size = DEFAULT_TEXTURE_SIZE;
+
+        int target_level = 0;
+        while ((target_level < MAX_LEVEL) && ((texture_size >> (target_level + 1)) >= screen_size))
+            ++target_level;
+
+        f32 priority = GetScreenPriority(screen_size);
+        if ((target_level == target_level_) && (priority == priority_))
+            return false;
+
+        target_level_ = target_level;
+        priority_ = priority;
+        if ((size_) && (received_ >= size_))
+            next_level_ = std::min(next_level_, target_level_);
+        return true;
     }
      
+    f32 TextureRequest::GetScreenPriority(uint screen_size)
+    {
+        // On-screen size rounded up to a power of two, so that small camera movements do not change it
+        if (!screen_size)
+            return 0.0f;
+
+        uint rounded = 1;
+        while (rounded < screen_size)
+            rounded <<= 1;
+        return (f32)rounded;
+    }
+
     bool TextureRequest::HasEnoughData() const
     {
         return received_ >= EstimateDataSize(next_level_);
     }
 
+    bool TextureRequest::IsWorthDecoding(f64 min_display_time) const
+    {
+        if ((decoded_level_ < 0) || (next_level_ <= target_level_))
+            return true;
+        if ((receive_rate_ <= 0.0) || (min_display_time <= 0.0))
+            return true;
+
+        uint needed = EstimateDataSize(target_level_);
+        if (received_ >= needed)
+            return true;
+        return (needed - received_) / receive_rate_ >= min_display_time;
+    }
+
     uint TextureRequest::EstimateDataSize(int level) const
     {
         if (level < 0) level = 0;
@@ -84,6 +170,8 @@ namespace TextureDecoder
 
             // Update amount of quality levels, should now be known
             levels_ = result->max_levels_;
+            ++decodes_;
+            decode_time_ += result->decode_time_;
             
             // See if successfully decoded data
             if (result->texture_)
@@ -93,7 +181,7 @@ namespace TextureDecoder
                 height_ =  result->original_height_;
                 components_ = result->components_;
                        
-                decoded_level_ = next_level_;  
+                decoded_level_ = result->level_;
             }
             
             // Set next quality level to decode
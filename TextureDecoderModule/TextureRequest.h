@@ -13,6 +13,8 @@ namespace TextureDecoder
     class DecodeRequest : public Foundation::ThreadTaskRequest
     {
     public:
+        DecodeRequest() : level_(0), image_(false) {}
+
         //! Texture asset ID
         std::string id_;
 
@@ -21,6 +23,9 @@ namespace TextureDecoder
 
         //! Quality level to decode, 0 = highest
         int level_;
+
+        //! Whether the source is an image file (PNG, JPEG etc.) rather than a JPEG2000 stream
+        bool image_;
     };
 
     typedef boost::shared_ptr<DecodeRequest> DecodeRequestPtr;
@@ -51,6 +56,9 @@ namespace TextureDecoder
         uint components_;
 
         bool is_jpeg2000_;
+
+        //! Seconds the decode took
+        f64 decode_time_;
     };
     
     typedef boost::shared_ptr<DecodeResult> DecodeResultPtr;
@@ -76,11 +84,21 @@ namespace TextureDecoder
         //! Sets decode request status
         void SetDecodeRequested(bool requested) { decode_requested_ = requested; }
 
-        //! Updates size & received count
+        //! Sets asset request tag
+        void SetAssetTag(request_tag_t tag) { asset_tag_ = tag; }
+
+        //! Sets on-screen size, and derives download priority and the quality level needed from it
+        /*! \param screen_size Largest on-screen size in pixels, 0 if not visible
+            \return true if priority or quality level needed changed
+         */
+        bool SetScreenSize(uint screen_size);
+
+        //! Updates size & received count, and picks the next level to decode from the data received
         /*! \param size Total size of asset (from asset service)
             \param received Received continuous bytes (from asset service)
+            \param time Current time in seconds, for the download rate
          */
-        void UpdateSizeReceived(uint size, uint received);
+        void UpdateSizeReceived(uint size, uint received, f64 time);
 
         //! Updates request from decode result
         /*! \param result Decode result
@@ -103,6 +121,16 @@ namespace TextureDecoder
         //! Checks if enough data to decode next level
         bool HasEnoughData() const;
 
+        //! Checks if the next level would be shown long enough to be worth decoding
+        /*! The first level and the quality level needed are always decoded. A level between them is not, if at the
+            current download rate the data for the quality level needed is expected sooner than the given time.
+            \param min_display_time Seconds
+         */
+        bool IsWorthDecoding(f64 min_display_time) const;
+
+        //! Checks if the quality level needed has been decoded, so that no decoding is needed for now
+        bool IsTargetLevelDecoded() const { return decoded_level_ >= 0 && decoded_level_ <= target_level_; }
+
         //! Returns asset id
         const std::string& GetId() const { return id_; }
 
@@ -135,6 +163,26 @@ namespace TextureDecoder
 
         //! Returns next level to decode
         int GetNextLevel() const { return next_level_; }
+
+        //! Returns asset request tag, 0 if not requested
+        request_tag_t GetAssetTag() const { return asset_tag_; }
+
+        //! Returns quality level needed for the on-screen size
+        int GetTargetLevel() const { return target_level_; }
+
+        //! Returns download priority
+        f32 GetPriority() const { return priority_; }
+
+        //! Returns download and decode priority for an on-screen size
+        /*! \param screen_size Largest on-screen size in pixels, 0 if not visible
+         */
+        static f32 GetScreenPriority(uint screen_size);
+
+        //! Returns number of decodes done
+        uint GetNumDecodes() const { return decodes_; }
+
+        //! Returns seconds spent decoding
+        f64 GetDecodeTime() const { return decode_time_; }
         
         //! List of request tags associated with this transfer
         RequestTagVector tags_;
@@ -177,6 +225,30 @@ namespace TextureDecoder
 
         //! Next quality level to decode
         int next_level_;     
+
+        //! Asset request tag, 0 if not requested
+        request_tag_t asset_tag_;
+
+        //! Quality level needed for the on-screen size, 0 = full quality
+        int target_level_;
+
+        //! Download priority, from the on-screen size
+        f32 priority_;
+
+        //! Time of the first size & received update, negative if none yet
+        f64 receive_start_time_;
+
+        //! Received bytes at the first size & received update
+        uint receive_start_bytes_;
+
+        //! Download rate in bytes per second, 0 if unknown
+        f64 receive_rate_;
+
+        //! Number of decodes done
+        uint decodes_;
+
+        //! Seconds spent decoding
+        f64 decode_time_;
     };
 }
 #endif
\ No newline at end of file
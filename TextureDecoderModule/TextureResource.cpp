@@ -3,6 +3,7 @@
 #include "StableHeaders.h"
 
 #include "TextureResource.h"
+#include "BlockCompression.h"
 
 namespace TextureDecoder
 {
@@ -11,8 +12,10 @@ namespace TextureDecoder
         width_(0),
         height_(0),
         components_(0),
+        data_size_(0),
         level_(-1),
-        format_(-1)
+        format_(-1),
+        view_data_(0)
     {
     }
 
@@ -22,7 +25,8 @@ namespace TextureDecoder
         height_(height),
         components_(components),
         level_(-1),
-        format_(-1)
+        format_(-1),
+        view_data_(0)
     {
         data_.resize(width * height * components);
         data_size_ = width * height * components;
@@ -38,10 +42,43 @@ namespace TextureDecoder
         height_ = height;
         components_ = components;
 
+        view_data_ = 0;
+        view_owner_.reset();
         data_.resize(width * height * components);
         data_size_ = width * height * components;
     }
 
+    void TextureResource::SetDataSize(uint data_size)
+    {
+        // Take a copy of external data before it can be modified
+        if (view_data_)
+        {
+            data_.assign(view_data_, view_data_ + std::min(data_size_, data_size));
+            view_data_ = 0;
+            view_owner_.reset();
+        }
+
+        if (data_size > data_.size())
+            data_.resize(data_size);
+        data_size_ = data_size;
+    }
+
+    void TextureResource::SetDataView(const u8* data, uint size, boost::shared_ptr<const void> owner)
+    {
+        std::vector<u8>().swap(data_);
+        view_data_ = data;
+        view_owner_ = owner;
+        data_size_ = size;
+    }
+
+    uint TextureResource::GetMipLevels()
+    {
+        // Compressed textures carry their full mip chain
+        if (Foundation::BlockCompression::IsCompressed(format_))
+            return Foundation::BlockCompression::GetMipLevels(width_, height_);
+        return 1;
+    }
+
     static const std::string texture_resource_name("Texture");
 
     const std::string& TextureResource::GetType() const
@@ -56,6 +93,6 @@ namespace TextureDecoder
     
     bool TextureResource::IsValid() const
     {
-        return data_.size() > 0;
+        return view_data_ || data_.size() > 0;
     }
 }
\ No newline at end of file
@@ -19,19 +19,29 @@ namespace TextureDecoder
         virtual uint GetHeight() const { return height_; }
         virtual uint GetComponents() const { return components_; }
         virtual int GetLevel() const { return level_; }
-        virtual u8* GetData() { return &data_[0]; }
+        virtual u8* GetData() { return view_data_ ? const_cast<u8*>(view_data_) : &data_[0]; }
         virtual uint GetDataSize() { return data_size_; }
         virtual int GetFormat() { return format_; }
+        virtual uint GetMipLevels();
         virtual const std::string& GetType() const;
         static const std::string& GetTypeStatic();
 
         void SetSize(uint width, uint height, uint components);
-        void SetDataSize(uint data_size) { data_size_ = data_size; }
+        //! Sets size of the data, growing the buffer if needed. Compressed data may be larger than the pixels.
+        void SetDataSize(uint data_size);
         void SetWidth(uint width) { width_ = width; }
         void SetHeight(uint height) { height_ = height; }
+        void SetComponents(uint components) { components_ = components; }
         void SetLevel(int level) { level_ = level; }
         void SetFormat(int format) { format_ = format; }
 
+        //! Sets the texture to refer to external read-only data instead of its own, without copying
+        /*! \param data Data, which must not be modified through GetData()
+            \param size Data size
+            \param owner Object keeping the data valid, such as a file mapping, held as long as the texture refers to the data
+         */
+        void SetDataView(const u8* data, uint size, boost::shared_ptr<const void> owner);
+
     private:
         uint width_;
         uint height_;
@@ -40,6 +50,12 @@ namespace TextureDecoder
         int format_;
         int level_;
         std::vector<u8> data_;
+
+        //! External data, null if the texture has its own data
+        const u8* view_data_;
+
+        //! Keeps the external data valid
+        boost::shared_ptr<const void> view_owner_;
     };
 }
 
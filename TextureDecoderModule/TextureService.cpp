@@ -13,19 +13,26 @@
 #include "Framework.h"
 #include "EventManager.h"
 #include "ServiceManager.h"
-#include "ThreadTaskManager.h"
 #include "ConfigurationManager.h"
 #include "TextureCache.h"
+#include "BlockCompression.h"
 
 #include <QStringList>
 
 namespace TextureDecoder
 {
     static const int DEFAULT_MAX_DECODES = 4;
+
+    //! Default number of decoder threads, 0 to use one less than the number of hardware threads
+    static const int DEFAULT_DECODE_THREADS = 0;
+
+    static const f32 DEFAULT_MIN_LEVEL_DISPLAY_TIME = 0.5f;
     
     TextureService::TextureService(Foundation::Framework* framework) : 
         framework_(framework),
-        cache_(new TextureCache(framework))
+        cache_(new TextureCache(framework)),
+        has_screen_sizes_(false),
+        time_(0.0)
     {
         Foundation::EventManagerPtr event_manager = framework_->GetEventManager();
 
@@ -35,11 +42,18 @@ namespace TextureDecoder
         if (max_decodes_per_frame_ <= 0) 
             max_decodes_per_frame_ = 1;
 
-        // Create decoder thread task and let the framework thread task manager handle it
-        OpenJpegDecoder* decoder = new OpenJpegDecoder();
-        decoder->SetDecodesPerFrame(max_decodes_per_frame_);
+        // Leave one hardware thread for the main thread
+        int decode_threads = framework_->GetDefaultConfig().DeclareSetting("TextureDecoder", "decode_threads", DEFAULT_DECODE_THREADS);
+        if (decode_threads <= 0)
+            decode_threads = std::max((int)boost::thread::hardware_concurrency() - 1, 1);
+
+        // Compressed textures take a quarter to an eighth of the GPU memory and cache space, at some cost in quality
+        bool compress_textures = framework_->GetDefaultConfig().DeclareSetting("TextureDecoder", "compress_textures", false);
+
+        decoder_.reset(new OpenJpegDecoder(decode_threads, max_decodes_per_frame_, compress_textures));
 
-        framework_->GetThreadTaskManager()->AddThreadTask(Foundation::ThreadTaskPtr(decoder));
+        // Each quality level is a decode of all the data received, so levels that would soon be replaced are skipped
+        min_level_display_time_ = framework_->GetDefaultConfig().DeclareSetting("TextureDecoder", "min_level_display_time", DEFAULT_MIN_LEVEL_DISPLAY_TIME);
     }
     
     TextureService::~TextureService()
@@ -64,14 +78,17 @@ namespace TextureDecoder
             return tag;
         }
 
-        // Check cache
-        TextureResource *texture = cache_->GetTexture(asset_id);
-        if (texture)
+        if (cache_reads_.find(asset_id) != cache_reads_.end())
+        {
+            // Already being loaded from cache, just add request tag
+            cache_reads_.find(asset_id)->second.push_back(tag);
+            return tag;
+        }
+
+        // Check cache. The texture is loaded in the background and replied to in a later update
+        if (cache_->RequestTexture(asset_id))
         {
-            CacheReply reply;
-            reply.tags.push_back(tag);
-            reply.resource = Foundation::ResourcePtr(texture);
-            cache_replys_[asset_id] = reply;
+            cache_reads_[asset_id].push_back(tag);
             return tag;
         }
 
@@ -83,14 +100,93 @@ namespace TextureDecoder
         return tag;
     }
 
+    request_tag_t TextureService::DecodeImage(Foundation::AssetPtr source)
+    {
+        if ((!source) || (!source->GetSize()))
+            return 0;
+
+        request_tag_t tag = framework_->GetEventManager()->GetNextRequestTag();
+        const std::string& id = source->GetId();
+
+        if (image_decodes_.find(id) != image_decodes_.end())
+        {
+            // Already being decoded, just add request tag
+            image_decodes_[id].push_back(tag);
+            return tag;
+        }
+
+        if (cache_replys_.find(id) != cache_replys_.end())
+        {
+            // Already found from cache, just add request tag
+            cache_replys_[id].tags.push_back(tag);
+            return tag;
+        }
+
+        if (cache_reads_.find(id) != cache_reads_.end())
+        {
+            // Already being loaded from cache, just add request tag
+            cache_reads_[id].push_back(tag);
+            return tag;
+        }
+
+        // Check cache. If the texture could not be loaded after all, the image is decoded then
+        if (cache_->RequestTexture(id))
+        {
+            cache_reads_[id].push_back(tag);
+            image_sources_[id] = source;
+            return tag;
+        }
+
+        QueueImageDecode(source, RequestTagVector(1, tag));
+        return tag;
+    }
+
+    void TextureService::QueueImageDecode(Foundation::AssetPtr source, const RequestTagVector& tags)
+    {
+        RequestTagVector& decode_tags = image_decodes_[source->GetId()];
+        decode_tags.insert(decode_tags.end(), tags.begin(), tags.end());
+
+        uint screen_size = 0;
+        std::map<std::string, uint>::const_iterator i = screen_sizes_.find(source->GetId());
+        if (i != screen_sizes_.end())
+            screen_size = i->second;
+
+        DecodeRequestPtr new_decode_request(new DecodeRequest());
+        new_decode_request->id_ = source->GetId();
+        new_decode_request->level_ = 0;
+        new_decode_request->source_ = source;
+        new_decode_request->image_ = true;
+        decoder_->AddRequest(new_decode_request, TextureRequest::GetScreenPriority(screen_size));
+    }
+
     void TextureService::DeleteFromCache(const std::string &texture_id)
     {
         if (cache_)
             cache_->DeleteFromCache(texture_id);
     }
     
+    void TextureService::SetTextureScreenSizes(const std::map<std::string, uint>& screen_sizes)
+    {
+        screen_sizes_ = screen_sizes;
+        has_screen_sizes_ = true;
+
+        Foundation::ServiceManagerPtr service_manager = framework_->GetServiceManager(); 
+        boost::shared_ptr<Foundation::AssetServiceInterface> asset_service = service_manager->GetService<Foundation::AssetServiceInterface>(Foundation::Service::ST_Asset).lock();
+        if (!asset_service)
+            return;
+
+        TextureRequestMap::iterator i = requests_.begin();
+        while (i != requests_.end())
+        {
+            UpdatePriority(i->second, asset_service.get());
+            ++i;
+        }
+    }
+
     void TextureService::Update(f64 frametime)
     {
+        time_ += frametime;
+
         Foundation::ServiceManagerPtr service_manager = framework_->GetServiceManager(); 
         if (!service_manager->IsRegistered(Foundation::Service::ST_Asset))
         {
@@ -109,6 +205,54 @@ namespace TextureDecoder
         if (!asset_service || !event_manager)
             return;
 
+        // Collect decoded textures, as many as the textures may be created per frame
+        std::vector<DecodeResultPtr> results = decoder_->GetResults(max_decodes_per_frame_);
+        for(uint j = 0; j < results.size(); ++j)
+        {
+            if (results[j]->texture_)
+            {
+                TextureResource* texture = checked_static_cast<TextureResource*>(results[j]->texture_.get());
+                ++load_stats_.decodes_;
+                if (Foundation::BlockCompression::IsCompressed(texture->GetFormat()))
+                    ++load_stats_.compressed_;
+                load_stats_.decode_time_ += results[j]->decode_time_;
+                load_stats_.decoded_bytes_ += texture->GetDataSize();
+            }
+            HandleDecodeResult(results[j].get());
+        }
+
+        // Collect textures loaded from cache. Decode the ones that could not be loaded after all
+        cache_->Update();
+        std::vector<TextureCache::CompletedRead> reads = cache_->TakeCompletedReads();
+        for(uint j = 0; j < reads.size(); ++j)
+        {
+            CacheReadMap::iterator r = cache_reads_.find(reads[j].texture_id_);
+            if (r == cache_reads_.end())
+                continue;
+
+            if (reads[j].texture_)
+            {
+                ++load_stats_.cache_loads_;
+                load_stats_.cache_bytes_ += checked_static_cast<TextureResource*>(reads[j].texture_.get())->GetDataSize();
+
+                CacheReply &reply = cache_replys_[r->first];
+                reply.resource = reads[j].texture_;
+                reply.tags.insert(reply.tags.end(), r->second.begin(), r->second.end());
+            }
+            else if (image_sources_.find(r->first) != image_sources_.end())
+                QueueImageDecode(image_sources_[r->first], r->second);
+            else
+            {
+                TextureRequest &request = requests_[r->first];
+                if (request.GetId().empty())
+                    request = TextureRequest(r->first);
+                request.InsertTags(r->second);
+            }
+
+            image_sources_.erase(r->first);
+            cache_reads_.erase(r);
+        }
+
         // Check if we want to send cached replies
         CacheReplys::iterator cache_iter = cache_replys_.begin();
         QStringList sent_replys;
@@ -143,17 +287,49 @@ namespace TextureDecoder
     
     void TextureService::UpdateRequest(TextureRequest& request, Foundation::AssetServiceInterface* asset_service)
     {
-        // If pending decode request, do nothing; wait for the result
+        // If pending decode request, wait for the result. If more data has arrived meanwhile and the decode has not
+        // started yet, decode the better level it allows right away instead of the level queued
         if (request.IsDecodeRequested())
+        {
+            if ((request.GetSize()) && (request.GetReceived() >= request.GetSize()))
+                return;
+
+            uint size = 0;
+            uint received = 0;
+            uint received_continuous = 0;
+            if (!asset_service->QueryAssetStatus(request.GetId(), size, received, received_continuous))
+                return;
+
+            TextureRequest updated = request;
+            updated.UpdateSizeReceived(size, received_continuous, time_);
+            if (updated.GetNextLevel() >= request.GetNextLevel())
+                return;
+
+            Foundation::AssetPtr asset = asset_service->GetIncompleteAsset(request.GetId(), RexTypes::ASSETTYPENAME_TEXTURE, updated.GetReceived());
+            if (!asset)
+                return;
+
+            DecodeRequestPtr new_decode_request(new DecodeRequest());
+            new_decode_request->id_ = request.GetId();
+            new_decode_request->level_ = updated.GetNextLevel();
+            new_decode_request->source_ = asset;
+            if (decoder_->ReplaceRequest(new_decode_request))
+                request = updated;
             return;
+        }
 
         // If asset not yet requested, request now
         if (!request.IsRequested())
         {
-            asset_service->RequestAsset(request.GetId(), "Texture");
+            request.SetAssetTag(asset_service->RequestAsset(request.GetId(), "Texture"));
             request.SetRequested(true);
+            UpdatePriority(request, asset_service);
         }
 
+        // If decoded to the quality the texture is shown at, wait until it is shown larger
+        if (request.IsTargetLevelDecoded())
+            return;
+
         uint size = 0;
         uint received = 0;
         uint received_continuous = 0;
@@ -161,9 +337,9 @@ namespace TextureDecoder
         if (!asset_service->QueryAssetStatus(request.GetId(), size, received, received_continuous))
             return;
         
-        request.UpdateSizeReceived(size, received_continuous);
+        request.UpdateSizeReceived(size, received_continuous, time_);
 
-        if (request.HasEnoughData())
+        if ((request.HasEnoughData()) && (request.IsWorthDecoding(min_level_display_time_)))
         {
             // Queue decode request to decode thread
             Foundation::AssetPtr asset = asset_service->GetIncompleteAsset(request.GetId(), RexTypes::ASSETTYPENAME_TEXTURE, request.GetReceived());
@@ -173,25 +349,56 @@ namespace TextureDecoder
                 new_decode_request->id_ = request.GetId();
                 new_decode_request->level_ = request.GetNextLevel();
                 new_decode_request->source_ = asset;
-                framework_->GetThreadTaskManager()->AddRequest<DecodeRequest>("TextureDecoder", new_decode_request);
+                decoder_->AddRequest(new_decode_request, request.GetPriority());
                 
                 request.SetDecodeRequested(true);
             }
         }
     }  
     
-    bool TextureService::HandleTaskEvent(event_id_t event_id, Foundation::EventDataInterface* data)
+    void TextureService::UpdatePriority(TextureRequest& request, Foundation::AssetServiceInterface* asset_service)
     {
-        if (event_id != Task::Events::REQUEST_COMPLETED)
-            return false;
-        DecodeResult* result = dynamic_cast<DecodeResult*>(data);
-        if (!result || result->task_description_ != "TextureDecoder")
-            return false;
-        
+        if (!has_screen_sizes_)
+            return;
+
+        uint screen_size = 0;
+        std::map<std::string, uint>::const_iterator i = screen_sizes_.find(request.GetId());
+        if (i != screen_sizes_.end())
+            screen_size = i->second;
+
+        if (!request.SetScreenSize(screen_size))
+            return;
+
+        if (request.GetAssetTag())
+            asset_service->SetRequestPriority(request.GetAssetTag(), request.GetPriority(), request.GetTargetLevel());
+        if (request.IsDecodeRequested())
+            decoder_->SetPriority(request.GetId(), request.GetPriority());
+    }
+
+    void TextureService::HandleDecodeResult(DecodeResult* result)
+    {
+        std::map<std::string, RequestTagVector>::iterator d = image_decodes_.find(result->id_);
+        if (d != image_decodes_.end())
+        {
+            RequestTagVector tags = d->second;
+            image_decodes_.erase(d);
+            HandleImageDecodeResult(result, tags);
+            return;
+        }
+
         TextureRequestMap::iterator i = requests_.find(result->id_);
         if (i != requests_.end())
         {
             bool done = i->second.UpdateWithDecodeResult(result);
+
+            // The texture dimensions are now known, which may change the quality level needed
+            if (!done && has_screen_sizes_)
+            {
+                boost::shared_ptr<Foundation::AssetServiceInterface> asset_service = framework_->GetServiceManager()->
+                    GetService<Foundation::AssetServiceInterface>(Foundation::Service::ST_Asset).lock();
+                if (asset_service)
+                    UpdatePriority(i->second, asset_service.get());
+            }
   
             if (result->texture_)
             {
@@ -220,12 +427,36 @@ namespace TextureDecoder
             
             // Remove request if final quality level was decoded
             if (done)
+            {
+                TextureDecoderModule::LogDebug("Texture " + i->second.GetId() + " decoded in " + ToString<uint>(i->second.GetNumDecodes()) +
+                    " passes, " + ToString<f64>(i->second.GetDecodeTime() * 1000.0) + " ms");
                 requests_.erase(i);
+            }
         }
-        
-        return true;
     }
     
+    void TextureService::HandleImageDecodeResult(DecodeResult* result, const RequestTagVector& tags)
+    {
+        Foundation::EventManagerPtr event_manager = framework_->GetEventManager();
+        if (!result->texture_)
+        {
+            for (uint j = 0; j < tags.size(); ++j)
+            {
+                Resource::Events::ResourceCanceled event_data(result->id_, tags[j]);
+                event_manager->SendEvent(resource_event_category_, Resource::Events::RESOURCE_CANCELED, &event_data);
+            }
+            return;
+        }
+
+        for (uint j = 0; j < tags.size(); ++j)
+        {
+            Resource::Events::ResourceReady event_data(result->id_, result->texture_, tags[j]);
+            event_manager->SendEvent(resource_event_category_, Resource::Events::RESOURCE_READY, &event_data);
+        }
+
+        cache_->StoreTexture(checked_static_cast<TextureResource*>(result->texture_.get()));
+    }
+
     bool TextureService::HandleAssetEvent(event_id_t event_id, Foundation::EventDataInterface* data)
     {
         if (event_id == Asset::Events::ASSET_CANCELED)
@@ -16,6 +16,27 @@ namespace Foundation
 namespace TextureDecoder
 {
     class TextureResource;
+    class OpenJpegDecoder;
+
+    //! Texture decode and cache load totals since startup
+    struct TextureLoadStats
+    {
+        TextureLoadStats() : decodes_(0), compressed_(0), decode_time_(0.0), decoded_bytes_(0.0), cache_loads_(0), cache_bytes_(0.0) {}
+
+        //! Decodes that produced a texture, and those of them that were block compressed
+        uint decodes_;
+        uint compressed_;
+
+        //! Decoder thread time spent on those decodes, including compression, in seconds
+        f64 decode_time_;
+
+        //! Texture data produced by the decodes, which is the GPU memory taken by the textures
+        f64 decoded_bytes_;
+
+        //! Textures loaded from the disk cache, and their texture data
+        uint cache_loads_;
+        f64 cache_bytes_;
+    };
 
     //! Texture decoder. Implements TextureServiceInterface.
     class TextureService : public Foundation::TextureServiceInterface
@@ -33,28 +54,59 @@ namespace TextureDecoder
          */
         virtual request_tag_t RequestTexture(const std::string& asset_id);
 
+        //! Queues an image asset to be decoded on the decoder threads
+        /*! \param source Image asset
+            \return request tag, will be used in eventual RESOURCE_READY or RESOURCE_CANCELED event
+         */
+        virtual request_tag_t DecodeImage(Foundation::AssetPtr source);
+
         //! Removes a texture from the disk cache with the texture id
         //! @param texture_is as std::string
         virtual void DeleteFromCache(const std::string &texture_id);
+
+        //! Sets on-screen sizes of textures. Reprioritizes the texture requests accordingly
+        /*! \param screen_sizes Largest on-screen size in pixels by texture ID. Textures not included are not visible.
+         */
+        virtual void SetTextureScreenSizes(const std::map<std::string, uint>& screen_sizes);
         
         //! Updates texture requests. Called by TextureDecoderModule
         void Update(f64 frametime);
 
         //! Handles an asset event. Called by TextureDecoderModule
         bool HandleAssetEvent(event_id_t event_id, Foundation::EventDataInterface* data);
-        
-        //! Handles a thread task event. Called by TextureDecoderModule
-        bool HandleTaskEvent(event_id_t event_id, Foundation::EventDataInterface* data);
+
+        //! Returns decode and cache load totals
+        const TextureLoadStats &GetLoadStats() const { return load_stats_; }
+
+        //! Returns the decoded texture cache
+        TextureCache *GetCache() const { return cache_; }
         
     private:
+        //! Handles a decode result
+        void HandleDecodeResult(DecodeResult* result);
+
         //! Updates a texture request
         /*! Polls the asset service & queues decode requests to the decode thread as necessary
          */
         void UpdateRequest(TextureRequest& request, Foundation::AssetServiceInterface* asset_service);
 
+        //! Updates on-screen size of a texture request, and passes a changed priority to the asset service
+        void UpdatePriority(TextureRequest& request, Foundation::AssetServiceInterface* asset_service);
+
+        //! Queues a decode of an image asset
+        /*! \param source Image asset
+            \param tags Request tags to reply to
+         */
+        void QueueImageDecode(Foundation::AssetPtr source, const RequestTagVector& tags);
+
+        //! Handles a decode result of an image asset
+        void HandleImageDecodeResult(DecodeResult* result, const RequestTagVector& tags);
+
         typedef std::map<std::string, TextureRequest> TextureRequestMap;
 
         typedef std::map<std::string, CacheReply> CacheReplys;
+
+        typedef std::map<std::string, RequestTagVector> CacheReadMap;
         
         //! Framework we belong to
         Foundation::Framework* framework_;
@@ -68,10 +120,37 @@ namespace TextureDecoder
         //! Decoded texture cache
         TextureCache *cache_;
 
+        //! Decoder threads
+        boost::scoped_ptr<OpenJpegDecoder> decoder_;
+
         CacheReplys cache_replys_;
 
+        //! Request tags of textures being loaded from cache
+        CacheReadMap cache_reads_;
+
+        //! Request tags of image assets being decoded
+        std::map<std::string, RequestTagVector> image_decodes_;
+
+        //! Image assets being loaded from cache, to be decoded if the cache read fails
+        std::map<std::string, Foundation::AssetPtr> image_sources_;
+
         //! Max decodes per frame
         int max_decodes_per_frame_;
+
+        //! Latest on-screen sizes of textures by texture ID
+        std::map<std::string, uint> screen_sizes_;
+
+        //! Whether on-screen sizes have been received. If not, textures are always decoded at full quality
+        bool has_screen_sizes_;
+
+        //! Seconds an intermediate quality level should be expected to be shown for, to be worth decoding
+        f64 min_level_display_time_;
+
+        //! Time in seconds
+        f64 time_;
+
+        //! Decode and cache load totals
+        TextureLoadStats load_stats_;
     };
 }
 
@@ -0,0 +1,109 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "HttpAssetServer.h"
+
+#include <QTcpSocket>
+#include <QTimer>
+#include <QStringList>
+
+#include <iostream>
+#include <algorithm>
+
+HttpAssetServer::HttpAssetServer(int asset_size) :
+    asset_(asset_size, 0),
+    sent_bytes_(0),
+    sent_replies_(0)
+{
+    for(int i = 0; i < asset_.size(); ++i)
+        asset_[i] = (char)(i * 31);
+
+    QTimer *timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()), SLOT(PrintStats()));
+    timer->start(1000);
+    stats_time_.start();
+}
+
+void HttpAssetServer::incomingConnection(int socket_descriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    socket->setSocketDescriptor(socket_descriptor);
+    connect(socket, SIGNAL(readyRead()), SLOT(ReadRequests()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+}
+
+void HttpAssetServer::ReadRequests()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    // Requests are GETs without a body, so each ends with an empty line. Unfinished requests are left in the socket
+    for(;;)
+    {
+        QByteArray pending = socket->peek(socket->bytesAvailable());
+        int end = pending.indexOf("\r\n\r\n");
+        if (end < 0)
+            return;
+        Respond(socket, socket->read(end + 4));
+    }
+}
+
+void HttpAssetServer::Respond(QTcpSocket *socket, const QByteArray &request)
+{
+    int start = 0;
+    int end = asset_.size();
+    bool ranged = false;
+
+    // Range: bytes=first-[last]
+    QStringList lines = QString(request).split("\r\n");
+    foreach(QString line, lines)
+    {
+        if (!line.startsWith("Range:", Qt::CaseInsensitive))
+            continue;
+        QString range = line.section('=', 1).trimmed();
+        int dash = range.indexOf('-');
+        if (dash < 0)
+            continue;
+        start = range.left(dash).toInt();
+        if (dash + 1 < range.length())
+            end = std::min(range.mid(dash + 1).toInt() + 1, end);
+        ranged = true;
+    }
+
+    QByteArray header;
+    if (ranged && start < end)
+    {
+        header = "HTTP/1.1 206 Partial Content\r\n";
+        header += "Content-Range: bytes " + QByteArray::number(start) + "-" + QByteArray::number(end - 1) + "/" +
+            QByteArray::number(asset_.size()) + "\r\n";
+    }
+    else
+    {
+        header = "HTTP/1.1 200 OK\r\n";
+        start = 0;
+        end = asset_.size();
+    }
+    header += "Content-Type: application/octet-stream\r\n";
+    header += "Content-Length: " + QByteArray::number(end - start) + "\r\n";
+    header += "Connection: Keep-Alive\r\n\r\n";
+
+    socket->write(header);
+    socket->write(asset_.constData() + start, end - start);
+    sent_bytes_ += end - start;
+    ++sent_replies_;
+}
+
+void HttpAssetServer::PrintStats()
+{
+    if (!sent_replies_)
+    {
+        stats_time_.restart();
+        return;
+    }
+
+    double seconds = stats_time_.restart() / 1000.0;
+    std::cout << sent_replies_ << " replies, " << sent_bytes_ << " bytes, " << sent_bytes_ / seconds / (1024.0 * 1024.0) <<
+        " MB/s" << std::endl;
+    sent_bytes_ = 0;
+    sent_replies_ = 0;
+}
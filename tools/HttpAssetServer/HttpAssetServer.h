@@ -0,0 +1,55 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#ifndef incl_HttpAssetServer_h
+#define incl_HttpAssetServer_h
+
+#include <QTcpServer>
+#include <QByteArray>
+#include <QTime>
+
+class QTcpSocket;
+
+//! Stand-in HTTP asset server, for measuring the throughput of QtHttpAssetProvider without a real asset server.
+/*! Answers every GET with the same generated asset, whatever the path, so that any number of distinct asset urls
+    can be requested. Range requests are answered with 206 Partial Content, and connections are kept alive, as the
+    asset servers do. The amount of data sent is printed every second.
+ */
+class HttpAssetServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    //! Constructor
+    /*! \param asset_size Size of the asset served, in bytes
+     */
+    explicit HttpAssetServer(int asset_size);
+
+private slots:
+    //! Reads and answers the requests received on a connection
+    void ReadRequests();
+
+    //! Prints the throughput of the last second
+    void PrintStats();
+
+protected:
+    //! Accepts a connection
+    void incomingConnection(int socket_descriptor);
+
+private:
+    //! Answers one request
+    void Respond(QTcpSocket *socket, const QByteArray &request);
+
+    //! Asset data
+    QByteArray asset_;
+
+    //! Bytes sent since the stats were last printed
+    qint64 sent_bytes_;
+
+    //! Requests answered since the stats were last printed
+    int sent_replies_;
+
+    //! Time since the stats were last printed
+    QTime stats_time_;
+};
+
+#endif
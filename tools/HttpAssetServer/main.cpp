@@ -0,0 +1,43 @@
+// For conditions of distribution and use, see copyright notice in license.txt
+
+#include "HttpAssetServer.h"
+
+#include <QCoreApplication>
+#include <QHostAddress>
+
+#include <iostream>
+
+//! Default port
+const int DEFAULT_PORT = 8002;
+
+//! Default asset size, about that of a 512x512 JPEG2000 texture
+const int DEFAULT_ASSET_SIZE = 160 * 1024;
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int port = DEFAULT_PORT;
+    int asset_size = DEFAULT_ASSET_SIZE;
+    if (argc > 1)
+        port = QString(argv[1]).toInt();
+    if (argc > 2)
+        asset_size = QString(argv[2]).toInt();
+    if (port <= 0 || asset_size <= 0)
+    {
+        std::cout << "Usage: HttpAssetServer [port, default " << DEFAULT_PORT << "] [asset size in bytes, default " <<
+            DEFAULT_ASSET_SIZE << "]" << std::endl;
+        return 1;
+    }
+
+    HttpAssetServer server(asset_size);
+    if (!server.listen(QHostAddress::Any, port))
+    {
+        std::cout << "Could not listen on port " << port << ": " << server.errorString().toStdString() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Serving " << asset_size << " byte assets at http://localhost:" << port << "/" << std::endl;
+    std::cout << "Measure with the viewer console command BenchmarkHttpAssets(http://localhost:" << port << "/)" << std::endl;
+    return app.exec();
+}